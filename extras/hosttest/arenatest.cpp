@@ -0,0 +1,357 @@
+/* Host test of the i/o arena of src/ioarena.cpp and allocation counter of
+the NB-IoT path.
+
+ioarena.cpp is compiled as is with VERBOSE set, so released blocks are
+poisoned. Checked are: a lease takes the smallest free block which fits,
+falls back to a larger class when a class is used up, is refused when
+nothing fits, and lease, refusal and peak counters.
+
+The allocation counter wraps malloc, calloc, realloc and operator new. The
+steady state of the NB path is replayed with the portable code it runs
+(coap.cpp, httpstream.cpp, linked as is) and the same leases BC95.cpp and
+nbiot.cpp take: CoAP uplink (pdu, AT+NSOST line, modem response, received
+datagram), MQTT downlink (message and AT response), a short AT command
+(small block) and an update check over HTTP (raw request with the version
+parameter, body, index parsed by updindex.cpp). After one warm up round no
+heap call may happen. The index parser is also checked on bad input.
+
+  g++ -O2 -Wall -Istub -I../../include -include stub/globals.h -DVERBOSE=1 \
+      -o arenatest arenatest.cpp ../../src/ioarena.cpp ../../src/coap.cpp \
+      ../../src/httpstream.cpp ../../src/updindex.cpp
+  ./arenatest
+*/
+
+#include <malloc.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <new>
+#include <string>
+
+#include "coap.h"
+#include "httpstream.h"
+#include "ioarena.h"
+#include "updindex.h"
+
+int host_verbose = 0;
+
+static int failed = 0;
+#define CHECK(c)                                                               \
+  do {                                                                         \
+    if (!(c)) {                                                                \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #c);                      \
+      failed++;                                                                \
+    }                                                                          \
+  } while (0)
+
+// ---- allocation counter ----
+
+extern "C" void *__libc_malloc(size_t);
+extern "C" void *__libc_calloc(size_t, size_t);
+extern "C" void *__libc_realloc(void *, size_t);
+
+static bool counting = false;
+static unsigned long allocs = 0;
+
+extern "C" void *malloc(size_t n) {
+  allocs += counting;
+  return __libc_malloc(n);
+}
+extern "C" void *calloc(size_t n, size_t size) {
+  allocs += counting;
+  return __libc_calloc(n, size);
+}
+extern "C" void *realloc(void *p, size_t n) {
+  allocs += counting;
+  return __libc_realloc(p, n);
+}
+void *operator new(size_t n) {
+  allocs += counting;
+  void *p = __libc_malloc(n);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+void *operator new[](size_t n) { return operator new(n); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+// ---- stand-ins ----
+
+static uint8_t arena[IO_ARENA_BYTES];
+static int task = 1;
+
+void *mem_buffer_get(mem_id_t id) { return id == MEM_BUF_IOARENA ? arena : NULL; }
+TaskHandle_t xTaskGetCurrentTaskHandle(void) { return &task; }
+const char *pcTaskGetTaskName(TaskHandle_t) { return "nbtask"; }
+
+// ---- arena ----
+
+static void test_arena(void) {
+  CHECK(io_arena_init() == ESP_OK);
+  const io_arena_stats_t *s = io_arena_stats();
+
+  // smallest block which fits
+  void *a = io_lease(100, "a");
+  void *b = io_lease(IO_ARENA_SMALL + 1, "b");
+  void *c = io_lease(IO_ARENA_MEDIUM + 1, "c");
+  CHECK(a && b && c);
+  CHECK(io_lease_size(a) == IO_ARENA_SMALL);
+  CHECK(io_lease_size(b) == IO_ARENA_MEDIUM);
+  CHECK(io_lease_size(c) == IO_ARENA_LARGE);
+  CHECK(io_lease(IO_ARENA_LARGE + 1, "too big") == NULL);
+  CHECK(s->failures == 1 && s->inuse == 3);
+
+  // released blocks are poisoned and leased again
+  memset(a, 0, 100);
+  io_release(a);
+  CHECK(((uint8_t *)a)[0] == 0xDD && ((uint8_t *)a)[IO_ARENA_SMALL - 1] == 0xDD);
+  CHECK(io_lease(1, "a again") == a);
+  io_release(a);
+  io_release(b);
+  io_release(c);
+  CHECK(s->inuse == 0 && s->peak == 3);
+
+  // a used up class falls back to the next larger one, then refuses
+  void *blk[IO_ARENA_BLOCKS];
+  for (int i = 0; i < IO_ARENA_BLOCKS; i++) {
+    blk[i] = io_lease(1, "fill");
+    CHECK(blk[i] != NULL);
+    size_t want = i < IO_ARENA_SMALL_BLOCKS ? IO_ARENA_SMALL
+                  : i < IO_ARENA_SMALL_BLOCKS + IO_ARENA_MEDIUM_BLOCKS
+                      ? IO_ARENA_MEDIUM
+                      : IO_ARENA_LARGE;
+    CHECK(io_lease_size(blk[i]) == want);
+  }
+  CHECK(io_lease(1, "none left") == NULL);
+  for (int i = 0; i < IO_ARENA_BLOCKS; i++)
+    io_release(blk[i]);
+  CHECK(s->inuse == 0 && s->peak == IO_ARENA_BLOCKS && s->failures == 2);
+  CHECK(io_lease_size(arena + 1) == 0);
+}
+
+// ---- NB path replay ----
+
+static const char hex[] = "0123456789ABCDEF";
+
+// AT+NSOST=<socket>,<ip>,<port>,<len>,<hex>, as udpSend() builds it
+static size_t nsost(char *line, size_t size, const uint8_t *data, size_t len) {
+  int n = snprintf(line, size, "AT+NSOST=1,10.0.0.1,5683,%u,", (unsigned)len);
+  for (size_t i = 0; i < len && (size_t)n + 2 < size; i++) {
+    line[n++] = hex[data[i] >> 4];
+    line[n++] = hex[data[i] & 15];
+  }
+  line[n] = 0;
+  return n;
+}
+
+static size_t unhex(const char *s, uint8_t *out, size_t size) {
+  size_t n = 0;
+  auto v = [](char c) { return c <= '9' ? c - '0' : c - 'A' + 10; };
+  for (; s[0] && s[1] && n < size; s += 2)
+    out[n++] = (v(s[0]) << 4) | v(s[1]);
+  return n;
+}
+
+static uint16_t mid = 1;
+
+static bool coap_uplink(const uint8_t *payload, size_t len) {
+  uint8_t *pdu = (uint8_t *)io_lease(COAP_MAX_PDU, "coap_pdu");
+  char *tx = (char *)io_lease(IO_ARENA_MEDIUM, "udp_tx");
+  char *resp = (char *)io_lease(IO_MODEM_RESP_SIZE, "modem");
+  char *rx = (char *)io_lease(IO_ARENA_MEDIUM, "udp_rx");
+  bool ok = pdu && tx && resp && rx;
+
+  if (ok) {
+    coap_msg_t m, r;
+    coap_init_msg(&m, COAP_CON, COAP_POST, mid++);
+    m.tkl = 2;
+    m.token[0] = 0xA5;
+    m.token[1] = (uint8_t)mid;
+    m.path = "pax/up";
+    m.query = "id=0011223344556677";
+    m.contentFormat = COAP_FORMAT_OCTETS;
+    m.payload = payload;
+    m.len = len;
+    size_t n = coap_build(pdu, COAP_MAX_PDU, &m);
+    nsost(tx, IO_ARENA_MEDIUM, pdu, n);
+    snprintf(resp, IO_MODEM_RESP_SIZE, "\r\n1,%u\r\n\r\nOK\r\n", (unsigned)n);
+
+    // the server acknowledges with 2.04 and the same token
+    coap_msg_t ack;
+    coap_init_msg(&ack, COAP_ACK, COAP_CHANGED, m.mid);
+    ack.tkl = m.tkl;
+    memcpy(ack.token, m.token, m.tkl);
+    n = coap_build(pdu, COAP_MAX_PDU, &ack);
+    size_t l = snprintf(rx, IO_ARENA_MEDIUM, "1,10.0.0.1,5683,%u,", (unsigned)n);
+    for (size_t i = 0; i < n; i++) {
+      rx[l++] = hex[pdu[i] >> 4];
+      rx[l++] = hex[pdu[i] & 15];
+    }
+    rx[l] = 0;
+    n = unhex(strrchr(rx, ',') + 1, pdu, COAP_MAX_PDU);
+    ok = (coap_parse(pdu, n, &r) == 0) && (r.code == COAP_CHANGED) &&
+         (r.mid == m.mid);
+  }
+  io_release(rx);
+  io_release(resp);
+  io_release(tx);
+  io_release(pdu);
+  return ok;
+}
+
+static bool mqtt_downlink(void) {
+  char *msg = (char *)io_lease(IO_ARENA_MEDIUM, "mqtt_msg");
+  char *data = (char *)io_lease(IO_MODEM_RESP_SIZE, "mqtt_rx");
+  bool ok = msg && data;
+  if (ok) {
+    snprintf(data, IO_MODEM_RESP_SIZE,
+             "\r\n+QMTRECV: 0,0,\"pax/down\",\"{\"data\":\"gAE=\"}\"\r\n");
+    const char *p = strstr(data, "{");
+    const char *e = strrchr(data, '}');
+    ok = p && e && (e > p);
+    if (ok) {
+      memcpy(msg, p, e - p + 1);
+      msg[e - p + 1] = 0;
+      ok = strstr(msg, "\"data\":\"gAE=\"") != NULL;
+    }
+  }
+  io_release(data);
+  io_release(msg);
+  return ok;
+}
+
+// AT+CEREG? as networkReady() sends it, answer fits the small class
+static bool at_short(void) {
+  char *resp = (char *)io_lease(IO_AT_RESP_SIZE, "modem");
+  bool ok = resp && (io_lease_size(resp) == IO_ARENA_SMALL);
+  if (ok) {
+    snprintf(resp, IO_AT_RESP_SIZE, "\r\n+CEREG:0,1\r\n\r\nOK\r\n");
+    ok = strstr(resp, "CEREG:0,1") != NULL;
+  }
+  io_release(resp);
+  return ok;
+}
+
+struct body_t {
+  char *buf;
+  size_t size, len;
+};
+
+static int body_sink(const uint8_t *data, size_t len, void *ctx) {
+  body_t *b = (body_t *)ctx;
+  if (b->len + len >= b->size)
+    return -1;
+  memcpy(b->buf + b->len, data, len);
+  b->len += len;
+  b->buf[b->len] = 0;
+  return len;
+}
+
+static bool http_update_check(void) {
+  char *raw = (char *)io_lease(IO_HTTP_RAW_SIZE, "http_raw");
+  char *body = (char *)io_lease(IO_HTTP_BODY_SIZE, "update_chk");
+  bool ok = raw && body;
+  if (ok) {
+    // as getData() builds it
+    char version[UPD_VERSION_LEN];
+    upd_version_param("1.10.45", version, sizeof(version));
+    snprintf(raw, IO_HTTP_RAW_SIZE,
+             "GET /index?deveui=0011223344556677&version=%s HTTP/1.1\r\n"
+             "Host: 10.0.0.2\r\n\r\n", version);
+    ok = strstr(raw, "version=1_10_45 ") != NULL;
+    static const char response[] =
+        "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n"
+        "Transfer-Encoding: chunked\r\n\r\n"
+        "9\r\n1.10.46\r\n\r\n4\r\n3 4\n\r\n0\r\n\r\n";
+    http_stream_t hs;
+    body_t b = {body, IO_HTTP_BODY_SIZE, 0};
+    http_stream_init(&hs, body_sink, &b);
+    int res = HTTP_STREAM_MORE;
+    // segments as the modem delivers them
+    for (size_t i = 0; i < sizeof(response) - 1 && res == HTTP_STREAM_MORE;
+         i += 7) {
+      size_t n = std::min<size_t>(7, sizeof(response) - 1 - i);
+      res = http_stream_feed(&hs, (const uint8_t *)response + i, n);
+    }
+    // as nb_checkLastSoftwareVersion() and downloadUpdates() read it
+    upd_index_t idx;
+    ok = ok && (res == HTTP_STREAM_DONE) && (hs.status == 200) &&
+         upd_index_version(body, version, sizeof(version)) &&
+         !strcmp(version, "1.10.46") && (upd_index_parse(body, &idx) == 0) &&
+         (idx.parts == 3) && (idx.perFile == 4);
+  }
+  io_release(body);
+  io_release(raw);
+  return ok;
+}
+
+static void test_index(void) {
+  upd_index_t idx;
+  char v[8];
+  CHECK(upd_index_parse("1.2.3\r\n40 8\r\n", &idx) == 0);
+  CHECK(!strcmp(idx.version, "1.2.3") && idx.parts == 40 && idx.perFile == 8);
+  CHECK(upd_index_parse("1.2.3", &idx) == UPD_INDEX_VERSION);
+  CHECK(upd_index_parse("\r\n40 8", &idx) == UPD_INDEX_VERSION);
+  CHECK(upd_index_parse("1.2.3\r\nx", &idx) == UPD_INDEX_PARTS);
+  CHECK(upd_index_parse("1.2.3\r\n0 8", &idx) == UPD_INDEX_PARTS);
+  CHECK(upd_index_parse("1.2.3\r\n40", &idx) == UPD_INDEX_PERFILE);
+  CHECK(idx.parts == 40);
+  CHECK(upd_index_parse("123456789012345678901234567890123\r\n1 1", &idx) ==
+        UPD_INDEX_VERSION);
+  CHECK(!upd_index_version("1.2.345678\r\n", v, sizeof(v)));
+  upd_version_param("1.2.345678", v, sizeof(v));
+  CHECK(!strcmp(v, "1_2_345"));
+}
+
+static void test_nb_path(void) {
+  uint8_t payload[51];
+  for (size_t i = 0; i < sizeof(payload); i++)
+    payload[i] = i * 7;
+
+  // the counter sees heap calls of the code under test
+  counting = true;
+  std::string(100, 'x');
+  free(malloc(1));
+  counting = false;
+  CHECK(allocs == 2);
+  allocs = 0;
+
+  const int rounds = 10000;
+  unsigned long warmup = 0;
+  int bad = 0;
+  for (int i = 0; i <= rounds; i++) {
+    counting = true;
+    bad += !coap_uplink(payload, 4 + i % (sizeof(payload) - 4));
+    if (i % 10 == 0)
+      bad += !mqtt_downlink() + !at_short();
+    if (i % 100 == 0)
+      bad += !http_update_check();
+    counting = false;
+    if (i == 0) { // first round may set up lazily
+      warmup = allocs;
+      allocs = 0;
+    }
+  }
+  const io_arena_stats_t *s = io_arena_stats();
+  printf("NB path: %d rounds, %lu heap calls in warm up, %lu after\n", rounds,
+         warmup, allocs);
+  CHECK(bad == 0);
+  CHECK(allocs == 0);
+  CHECK(s->inuse == 0);
+}
+
+int main(void) {
+  test_arena();
+  test_index();
+  test_nb_path();
+  if (failed) {
+    printf("%d checks failed\n", failed);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
@@ -0,0 +1,208 @@
+/* Host test of the BC95 uart rate negotiation of src/bc95link.cpp.
+
+bc95link.cpp is compiled as is against a modem emulator behind the link
+interface. The emulated modem listens on one rate and answers a command
+only if the host uart is at that rate, otherwise the command times out.
+AT+NATSPEED answers OK at the old rate and then moves the modem to the
+new one; if no AT arrives at the new rate within the timeout, the modem
+reverts. With store set the rate survives a modem reset. Rates the board
+cannot carry (level shifter, long wires) are accepted by the modem but
+garble every byte. Time advances with command timeouts and waits.
+
+Checked per scenario: the rate the negotiation reports, that host and
+modem end up at the same rate and talk, the result code, and commands
+and time spent.
+
+  g++ -O2 -Wall -I../../include -o baudtest baudtest.cpp ../../src/bc95link.cpp
+  ./baudtest [-v]
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <set>
+
+#include "bc95link.h"
+
+static int failed = 0;
+#define CHECK(c)                                                               \
+  do {                                                                         \
+    if (!(c)) {                                                                \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #c);                      \
+      failed++;                                                                \
+    }                                                                          \
+  } while (0)
+
+static bool verbose = false;
+
+// ---- modem emulator ----
+
+static struct {
+  uint32_t rate;      // rate the modem listens on
+  uint32_t persisted; // rate after reset
+  uint32_t revertTo;  // rate to go back to, 0 = no switch pending
+  uint32_t revertAt;  // [ms]
+  bool dead;          // never answers
+  std::set<uint32_t> supported, garbled;
+} modem;
+
+static uint32_t hostRate, now_ms, commands;
+
+static void modem_reset(uint32_t persisted) {
+  modem.rate = modem.persisted = persisted;
+  modem.revertTo = 0;
+  modem.dead = false;
+  modem.supported = {9600, 19200, 38400, 57600, 115200, 230400, 460800};
+  modem.garbled.clear();
+}
+
+static void modem_clock(void) {
+  if (modem.revertTo && (int32_t)(now_ms - modem.revertAt) >= 0) {
+    if (verbose)
+      printf("    %6u ms modem reverts %u -> %u\n", now_ms, modem.rate,
+             modem.revertTo);
+    modem.rate = modem.revertTo;
+    modem.revertTo = 0;
+  }
+}
+
+static bool link_command(const char *cmd, uint32_t timeout_ms) {
+  bool ok = false, answered = false;
+  uint32_t baud, timeout, store, mode;
+
+  commands++;
+  modem_clock();
+  if (!modem.dead && (hostRate == modem.rate) &&
+      !modem.garbled.count(hostRate)) {
+    answered = true;
+    if (!strcmp(cmd, "AT")) {
+      modem.revertTo = 0; // new rate confirmed
+      ok = true;
+    } else if (sscanf(cmd, "AT+NATSPEED=%u,%u,%u,%u", &baud, &timeout, &store,
+                      &mode) == 4) {
+      ok = modem.supported.count(baud) && (mode == 2);
+      if (ok) {
+        if (store)
+          modem.persisted = baud;
+        if (baud != modem.rate) {
+          modem.revertTo = modem.rate;
+          modem.revertAt = now_ms + 10 + timeout * 1000;
+          modem.rate = baud;
+        }
+      }
+    }
+  }
+  // an answer takes a few ms, silence the whole timeout
+  now_ms += answered ? 10 : timeout_ms;
+  if (verbose)
+    printf("    %6u ms %6u baud %-26s %s\n", now_ms, hostRate, cmd,
+           ok ? "OK" : answered ? "ERROR" : "-");
+  return ok;
+}
+
+static void link_setBaud(uint32_t baud) {
+  hostRate = baud;
+  now_ms += 20;
+}
+
+static void link_wait(uint32_t ms) { now_ms += ms; }
+
+static const bc95_link_t link = {link_command, link_setBaud, link_wait};
+
+// ---- scenarios ----
+
+struct outcome_t {
+  uint32_t rate;
+  bc95_baud_result_t result;
+  uint32_t commands;
+};
+
+static outcome_t run(const char *name, uint32_t stored, uint32_t target) {
+  outcome_t o;
+  hostRate = BC95_BAUD_DEFAULT;
+  now_ms = commands = 0;
+  if (verbose)
+    printf("  %s\n", name);
+  o.rate = bc95_negotiate(&link, stored, target, &o.result);
+  o.commands = commands;
+  printf("%-28s -> %6u baud, result %d, %2u commands, %5u ms\n", name, o.rate,
+         o.result, commands, now_ms);
+  CHECK(hostRate == o.rate);
+  if (!modem.dead) {
+    // both ends agree and keep agreeing after any pending revert
+    now_ms += BC95_NATSPEED_TIMEOUT * 1000 + 100;
+    CHECK(link_command("AT", 300));
+  }
+  return o;
+}
+
+static void test_scenarios(void) {
+  outcome_t o;
+
+  // first boot, stored is default: probe default, switch, verify, store
+  modem_reset(9600);
+  o = run("default rate probe", 9600, 115200);
+  CHECK(o.rate == 115200 && o.result == bc95_baud_ok);
+  CHECK(modem.persisted == 115200 && modem.rate == 115200);
+
+  // next boot: stored rate answers at once
+  o = run("stored rate answers", 115200, 115200);
+  CHECK(o.rate == 115200 && o.result == bc95_baud_ok && o.commands == 1);
+
+  // modem was replaced or factory reset, stored rate fails
+  modem_reset(9600);
+  o = run("stored rate fails", 115200, 115200);
+  CHECK(o.rate == 115200 && o.result == bc95_baud_ok);
+  CHECK(modem.persisted == 115200);
+
+  // target changed in paxcounter.conf, stored rate still answers
+  o = run("stored rate, new target", 115200, 460800);
+  CHECK(o.rate == 460800 && modem.persisted == 460800);
+
+  // board cannot carry the target: modem accepts, then reverts by itself
+  modem_reset(9600);
+  modem.garbled = {460800};
+  o = run("revert on no AT", 9600, 460800);
+  CHECK(o.rate == 9600 && o.result == bc95_baud_fallback);
+  CHECK(modem.persisted == 9600 && modem.rate == 9600);
+  CHECK(now_ms >= BC95_NATSPEED_TIMEOUT * 1000);
+
+  // same from a stored working rate: falls back to it, not to default
+  modem_reset(115200);
+  modem.garbled = {460800};
+  o = run("revert to stored rate", 115200, 460800);
+  CHECK(o.rate == 115200 && o.result == bc95_baud_fallback);
+  CHECK(modem.persisted == 115200);
+
+  // modem does not know the rate
+  modem_reset(9600);
+  o = run("modem refuses target", 9600, 250000);
+  CHECK(o.rate == 9600 && o.result == bc95_baud_refused);
+
+  // nvs lost, modem kept the target rate of an earlier run
+  modem_reset(115200);
+  o = run("nvs lost, modem at target", 9600, 115200);
+  CHECK(o.rate == 115200 && o.result == bc95_baud_ok);
+
+  // no negotiation wanted
+  modem_reset(9600);
+  o = run("target is default", 9600, 9600);
+  CHECK(o.rate == 9600 && o.result == bc95_baud_ok);
+
+  // modem dead: ends at default, says so
+  modem_reset(9600);
+  modem.dead = true;
+  o = run("modem silent", 115200, 115200);
+  CHECK(o.rate == 9600 && o.result == bc95_baud_silent);
+}
+
+int main(int argc, char **) {
+  verbose = (argc > 1);
+  test_scenarios();
+  if (failed) {
+    printf("%d checks failed\n", failed);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
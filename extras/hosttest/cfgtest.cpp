@@ -0,0 +1,387 @@
+/* Host test of the settings blob of src/configmanager.cpp.
+
+configmanager.cpp is compiled as is against stub/, NVS is an in-memory
+namespace that counts reads, writes and 32 byte entries, the scheduler job
+is run by the test when due. legacy_save() writes settings the way
+saveConfig() did before the blob: one key per field, each read, compared and
+written if changed. Checked are the migration from that key layout, an
+interrupted migration, a damaged and a shorter (older) blob, and that a
+burst of remote commands writes flash once. Flash writes per save are
+reported for both layouts.
+
+  g++ -O2 -Wall -Istub -I../../include -o cfgtest cfgtest.cpp \
+      ../../src/configmanager.cpp
+  ./cfgtest [-v]
+*/
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "globals.h"
+
+configData_t cfg;
+int host_verbose = 0;
+
+// ---- NVS ----
+
+nvs_host_stats_t nvs_host_stats;
+static std::map<std::string, std::vector<uint8_t>> flash;
+
+void nvs_host_clear(void) { flash.clear(); }
+size_t nvs_host_keys(void) { return flash.size(); }
+bool nvs_host_has(const char *key) { return flash.count(key) > 0; }
+uint8_t *nvs_host_blob(const char *key, size_t *len) {
+  auto it = flash.find(key);
+  if (it == flash.end())
+    return NULL;
+  *len = it->second.size();
+  return it->second.data();
+}
+
+esp_err_t nvs_flash_init(void) { return ESP_OK; }
+esp_err_t nvs_flash_erase(void) {
+  flash.clear();
+  return ESP_OK;
+}
+esp_err_t nvs_open(const char *, nvs_open_mode, nvs_handle *h) {
+  *h = 1;
+  return ESP_OK;
+}
+void nvs_close(nvs_handle) {}
+esp_err_t nvs_commit(nvs_handle) {
+  nvs_host_stats.commits++;
+  return ESP_OK;
+}
+esp_err_t nvs_erase_key(nvs_handle, const char *key) {
+  if (!flash.erase(key))
+    return ESP_ERR_NVS_NOT_FOUND;
+  nvs_host_stats.erases++;
+  return ESP_OK;
+}
+esp_err_t nvs_erase_all(nvs_handle) {
+  nvs_host_stats.erases += flash.size();
+  flash.clear();
+  return ESP_OK;
+}
+
+static esp_err_t get(const char *key, void *out, size_t *len, bool var) {
+  nvs_host_stats.gets++;
+  auto it = flash.find(key);
+  if (it == flash.end())
+    return ESP_ERR_NVS_NOT_FOUND;
+  if (var && !out) {
+    *len = it->second.size();
+    return ESP_OK;
+  }
+  if (*len < it->second.size())
+    return ESP_ERR_NVS_INVALID_LENGTH;
+  *len = it->second.size();
+  memcpy(out, it->second.data(), *len);
+  return ESP_OK;
+}
+
+static esp_err_t set(const char *key, const void *v, size_t len, bool var) {
+  nvs_host_stats.sets++;
+  nvs_host_stats.entries += var ? 1 + (len + 31) / 32 : 1;
+  flash[key].assign((const uint8_t *)v, (const uint8_t *)v + len);
+  return ESP_OK;
+}
+
+#define NVS_INT(T, name)                                                       \
+  esp_err_t nvs_get_##name(nvs_handle, const char *key, T *v) {                \
+    size_t len = sizeof(T);                                                    \
+    return get(key, v, &len, false);                                           \
+  }                                                                            \
+  esp_err_t nvs_set_##name(nvs_handle, const char *key, T v) {                 \
+    return set(key, &v, sizeof(T), false);                                     \
+  }
+NVS_INT(int8_t, i8)
+NVS_INT(int16_t, i16)
+NVS_INT(int32_t, i32)
+
+esp_err_t nvs_get_str(nvs_handle, const char *key, char *out, size_t *len) {
+  return get(key, out, len, true);
+}
+esp_err_t nvs_set_str(nvs_handle, const char *key, const char *v) {
+  return set(key, v, strlen(v) + 1, true);
+}
+esp_err_t nvs_get_blob(nvs_handle, const char *key, void *out, size_t *len) {
+  return get(key, out, len, true);
+}
+esp_err_t nvs_set_blob(nvs_handle, const char *key, const void *v,
+                       size_t len) {
+  return set(key, v, len, true);
+}
+
+uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+  crc = ~crc;
+  while (len--) {
+    crc ^= *buf++;
+    for (int i = 0; i < 8; i++)
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+// ---- time and scheduler ----
+
+static uint32_t now_ms = 1000;
+static sched_fn_t job = NULL;
+static bool jobArmed = false;
+static uint32_t jobDue = 0;
+
+uint32_t millis(void) { return now_ms; }
+int sched_add(const char *, sched_fn_t fn, uint32_t,
+              uint32_t, int) {
+  job = fn;
+  return 0;
+}
+void sched_trigger(int, uint32_t delay_ms) {
+  jobArmed = true;
+  jobDue = now_ms + delay_ms;
+}
+void sched_stop(int) { jobArmed = false; }
+
+static void advance(uint32_t ms) {
+  for (uint32_t end = now_ms + ms; now_ms < end; now_ms += 100)
+    if (jobArmed && (int32_t)(now_ms - jobDue) >= 0) {
+      jobArmed = false;
+      job();
+    }
+}
+
+// ---- settings as the firmware before the blob stored them ----
+
+void defaultConfig(void); // configmanager.cpp
+
+struct legacy_t {
+  const char *key;
+  size_t offset, size;
+  int width;
+};
+#define LEGACY(k, f, w)                                                        \
+  { k, offsetof(configData_t, f), sizeof(((configData_t *)0)->f), w }
+static const legacy_t legacy[] = {
+    LEGACY("loradr", loradr, 1),
+    LEGACY("txpower", txpower, 1),
+    LEGACY("adrmode", adrmode, 1),
+    LEGACY("screensaver", screensaver, 1),
+    LEGACY("screenon", screenon, 1),
+    LEGACY("countermode", countermode, 1),
+    LEGACY("sendcycle", sendcycle, 1),
+    LEGACY("wifichancycle", wifichancycle, 1),
+    LEGACY("blescantime", blescantime, 1),
+    LEGACY("blescanmode", blescan, 1),
+    LEGACY("btscanmode", btscan, 1),
+    LEGACY("wifiscanmode", wifiscan, 1),
+    LEGACY("wifiant", wifiant, 1),
+    LEGACY("vendorfilter", vendorfilter, 1),
+    LEGACY("rgblum", rgblum, 1),
+    LEGACY("payloadmask", payloadmask, 1),
+    LEGACY("monitormode", monitormode, 1),
+    LEGACY("rssilimit", rssilimit, 2),
+    LEGACY("salt", salt, 4),
+    LEGACY("saltversion", saltVersion, 4),
+    LEGACY("salttimestamp", saltTimestamp, 4),
+    LEGACY("resettimer", resettimer, 1),
+};
+
+static int32_t field(const configData_t &c, const legacy_t &l) {
+  const uint8_t *p = (const uint8_t *)&c + l.offset;
+  if (l.size == 1)
+    return *p;
+  if (l.size == 2)
+    return l.width == 2 ? *(const int16_t *)p : *(const uint16_t *)p;
+  return *(const int32_t *)p;
+}
+
+// get, compare, set per key, with the integer promotion of the old code: an
+// unsigned field above 127 never equals its stored i8 and is written again
+static void legacy_save(const configData_t &c) {
+  nvs_handle h = 1;
+  uint8_t bsec[BSEC_MAX_STATE_BLOB_SIZE + 1];
+  char version[10];
+  size_t len = sizeof(bsec);
+  if (nvs_get_blob(h, "bsecstate", bsec, &len) != ESP_OK ||
+      memcmp(bsec, c.bsecstate, sizeof(bsec)))
+    nvs_set_blob(h, "bsecstate", c.bsecstate, sizeof(bsec));
+  len = sizeof(version);
+  if (nvs_get_str(h, "version", version, &len) != ESP_OK ||
+      strcmp(version, c.version))
+    nvs_set_str(h, "version", c.version);
+  for (const legacy_t &l : legacy) {
+    int32_t v = field(c, l);
+    if (l.width == 1) {
+      int8_t f;
+      if (nvs_get_i8(h, l.key, &f) != ESP_OK || f != v)
+        nvs_set_i8(h, l.key, v);
+    } else if (l.width == 2) {
+      int16_t f;
+      if (nvs_get_i16(h, l.key, &f) != ESP_OK || f != v)
+        nvs_set_i16(h, l.key, v);
+    } else {
+      int32_t f;
+      if (nvs_get_i32(h, l.key, &f) != ESP_OK || f != v)
+        nvs_set_i32(h, l.key, v);
+    }
+  }
+  nvs_commit(h);
+}
+
+// ---- test ----
+
+static int failed = 0;
+#define CHECK(c)                                                               \
+  do {                                                                         \
+    if (!(c)) {                                                                \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #c);                      \
+      failed++;                                                                \
+    }                                                                          \
+  } while (0)
+
+static configData_t custom(void) {
+  defaultConfig();
+  configData_t c = cfg;
+  c.loradr = 3;
+  c.adrmode = 0;
+  c.sendcycle = 120;
+  c.rssilimit = -80;
+  c.payloadmask = 0x8F; // above 127
+  c.salt = 0xDEADBEEF;
+  c.saltVersion = 7;
+  c.saltTimestamp = 1760000000;
+  c.resettimer = 24;
+  for (int i = 0; i <= BSEC_MAX_STATE_BLOB_SIZE; i++)
+    c.bsecstate[i] = i;
+  snprintf(c.version, sizeof(c.version), "1.10.44");
+  return c;
+}
+
+static void reset_stats(void) { memset(&nvs_host_stats, 0, sizeof(nvs_host_stats)); }
+
+// stored fields, padding and runmode are not settings
+static bool same_settings(const configData_t &a, const configData_t &b) {
+  for (const legacy_t &l : legacy)
+    if (field(a, l) != field(b, l))
+      return false;
+  return !memcmp(a.bsecstate, b.bsecstate, sizeof(a.bsecstate));
+}
+
+int main(int argc, char **argv) {
+  host_verbose = (argc > 1) && !strcmp(argv[1], "-v");
+  configData_t old = custom();
+
+  // flash writes of one remote command per downlink, old layout
+  nvs_host_clear();
+  legacy_save(old);
+  configData_t c = old;
+  reset_stats();
+  const int burst = 5;
+  for (int i = 0; i < burst; i++) {
+    c.rgblum = 10 + i;
+    legacy_save(c);
+  }
+  nvs_host_stats_t legacyStats = nvs_host_stats;
+
+  // migration from the key layout
+  nvs_host_clear();
+  legacy_save(old);
+  CHECK(nvs_host_keys() == 24);
+  memset(&cfg, 0x55, sizeof(cfg));
+  reset_stats();
+  loadConfig();
+  CHECK(same_settings(cfg, old));
+  CHECK(cfg.sendcycle == 120); // was read back sign extended before
+  CHECK(!strcmp(cfg.version, PROGVERSION));
+  CHECK(nvs_host_keys() == 1 && nvs_host_has(CONFIG_BLOB_KEY));
+  CHECK(nvs_host_stats.sets == 1);
+  printf("migration: %u keys read, %u set, %u entries, %u keys erased\n",
+         nvs_host_stats.gets, nvs_host_stats.sets, nvs_host_stats.entries,
+         nvs_host_stats.erases);
+
+  // next boot reads the blob only and writes nothing
+  memset(&cfg, 0x55, sizeof(cfg));
+  reset_stats();
+  loadConfig();
+  CHECK(same_settings(cfg, old));
+  CHECK(nvs_host_stats.sets == 0 && nvs_host_stats.gets == 3);
+
+  // burst of remote commands, each with store flag
+  reset_stats();
+  for (int i = 0; i < burst; i++) {
+    cfg.rgblum = 10 + i;
+    saveConfig();
+    advance(500);
+  }
+  CHECK(nvs_host_stats.sets == 0);
+  advance(3000);
+  CHECK(nvs_host_stats.sets == 1);
+  nvs_host_stats_t blobStats = nvs_host_stats;
+  configData_t saved = cfg;
+
+  // same settings again, coalesced save finds nothing to write
+  saveConfig();
+  advance(3000);
+  CHECK(nvs_host_stats.sets == 1);
+
+  // endless stream of saves is written after CONFIG_SAVE_MAX_MS
+  reset_stats();
+  for (int i = 0; i < 40; i++) {
+    cfg.rgblum = i;
+    saveConfig();
+    advance(1000);
+  }
+  CHECK(nvs_host_stats.sets == 1);
+  cfg = saved;
+  saveConfig();
+  flushConfig(); // as do_reset() does
+  CHECK(nvs_host_stats.sets == 2);
+
+  // interrupted migration: blob written, keys still there
+  legacy_save(old);
+  memset(&cfg, 0x55, sizeof(cfg));
+  reset_stats();
+  loadConfig();
+  CHECK(same_settings(cfg, saved));
+  CHECK(nvs_host_keys() == 1 && nvs_host_stats.sets == 0);
+
+  // damaged blob, nothing else: factory settings
+  size_t len;
+  uint8_t *b = nvs_host_blob(CONFIG_BLOB_KEY, &len);
+  b[len - 3] ^= 0x01;
+  loadConfig();
+  configData_t def = cfg;
+  defaultConfig();
+  CHECK(same_settings(def, cfg));
+
+  // blob of an older firmware, one field shorter: the field keeps its default
+  cfg = old;
+  cfg.resettimer = 5;
+  saveConfig();
+  flushConfig();
+  b = nvs_host_blob(CONFIG_BLOB_KEY, &len);
+  std::vector<uint8_t> shorter(b, b + len - (sizeof(cfg) - offsetof(configData_t, resettimer)));
+  uint16_t hlen = shorter.size() - 12;
+  memcpy(&shorter[6], &hlen, 2);
+  uint32_t crc = crc32_le(0, &shorter[12], hlen);
+  memcpy(&shorter[8], &crc, 4);
+  nvs_set_blob(1, CONFIG_BLOB_KEY, shorter.data(), shorter.size());
+  loadConfig();
+  CHECK(cfg.resettimer == 0xFF && cfg.salt == old.salt);
+  b = nvs_host_blob(CONFIG_BLOB_KEY, &len);
+  CHECK(len == 12 + sizeof(cfg)); // rewritten with the new field
+
+  printf("%d remote commands, old layout: %u keys read, %u set, %u entries, "
+         "%u commits\n",
+         burst, legacyStats.gets, legacyStats.sets, legacyStats.entries,
+         legacyStats.commits);
+  printf("%d remote commands, blob:       %u keys read, %u set, %u entries, "
+         "%u commits\n",
+         burst, blobStats.gets, blobStats.sets, blobStats.entries,
+         blobStats.commits);
+  printf("blob %u bytes, configData_t %u bytes\n", (unsigned)(12 + sizeof(cfg)),
+         (unsigned)sizeof(cfg));
+  printf(failed ? "FAILED %d\n" : "ok\n", failed);
+  return failed != 0;
+}
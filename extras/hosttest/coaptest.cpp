@@ -0,0 +1,410 @@
+/* Host test of the CoAP codec of src/coap.cpp, and bytes on air of the NB
+uplink by CoAP against MQTT.
+
+coap.cpp is linked as is. Checked: build/parse round trips, the option
+list of built PDUs walked by an independent decoder of the test, option
+delta and length extensions (13 and 269), Block1 split, numbering and more
+flag, and that truncated or malformed PDUs are refused.
+
+Bytes on air are emulated per uplink the way BC95.cpp and nbiot.cpp count
+them for the housekeeping log. CoAP: the POST datagrams as coapPost()
+builds them plus the piggybacked 2.04 response, each with IP/UDP header.
+MQTT: the QoS 0 publish of sendNbMqtt() with its JSON envelope, fixed
+header and TCP/IP header, plus the bare TCP ack of the server. MQTT
+session setup and keepalive pings are not counted, they come on top.
+
+  g++ -O2 -Wall -I../../include -o coaptest coaptest.cpp ../../src/coap.cpp
+  ./coaptest
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "coap.h"
+
+static int failed = 0;
+#define CHECK(c)                                                               \
+  do {                                                                         \
+    if (!(c)) {                                                                \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #c);                      \
+      failed++;                                                                \
+    }                                                                          \
+  } while (0)
+
+// as BC95.hpp
+#define NB_TCPIP_HEADER 40
+#define NB_UDPIP_HEADER 28
+
+// ---- independent option decoder ----
+
+struct option_t {
+  unsigned number;
+  std::string value;
+};
+
+// options of a well formed pdu, straight from RFC 7252 section 3.1
+static std::vector<option_t> options(const uint8_t *pdu, size_t len) {
+  std::vector<option_t> opts;
+  size_t i = 4 + (pdu[0] & 0x0F);
+  unsigned number = 0;
+  while (i < len && pdu[i] != 0xFF) {
+    unsigned d = pdu[i] >> 4, l = pdu[i] & 0x0F;
+    i++;
+    if (d == 13)
+      d = 13 + pdu[i++];
+    else if (d == 14) {
+      d = 269 + (pdu[i] << 8 | pdu[i + 1]);
+      i += 2;
+    }
+    if (l == 13)
+      l = 13 + pdu[i++];
+    else if (l == 14) {
+      l = 269 + (pdu[i] << 8 | pdu[i + 1]);
+      i += 2;
+    }
+    number += d;
+    opts.push_back({number, std::string((const char *)pdu + i, l)});
+    i += l;
+  }
+  return opts;
+}
+
+static uint32_t uint_opt(const std::string &v) {
+  uint32_t x = 0;
+  for (unsigned char c : v)
+    x = x << 8 | c;
+  return x;
+}
+
+// ---- codec ----
+
+static void test_roundtrip(void) {
+  uint8_t pdu[COAP_MAX_PDU], data[COAP_BLOCK_SIZE];
+  coap_msg_t m, r;
+
+  for (size_t i = 0; i < sizeof(data); i++)
+    data[i] = i * 7;
+  coap_init_msg(&m, COAP_CON, COAP_POST, 0xBEEF);
+  m.tkl = 4;
+  memcpy(m.token, "\x01\x02\x03\x04", 4);
+  m.path = "up/x";
+  m.query = "d=0011223344556677&v=1";
+  m.contentFormat = COAP_FORMAT_OCTETS;
+  m.block1 = COAP_BLOCK1(1, true, COAP_BLOCK_SZX);
+  m.payload = data;
+  m.len = sizeof(data);
+  size_t n = coap_build(pdu, sizeof(pdu), &m);
+  CHECK(n > 0 && n <= COAP_MAX_PDU);
+
+  // header and option order as the RFC wants them
+  CHECK(pdu[0] == 0x44 && pdu[1] == COAP_POST && pdu[2] == 0xBE &&
+        pdu[3] == 0xEF);
+  std::vector<option_t> o = options(pdu, n);
+  CHECK(o.size() == 6);
+  if (o.size() == 6) {
+    CHECK(o[0].number == COAP_OPT_URI_PATH && o[0].value == "up");
+    CHECK(o[1].number == COAP_OPT_URI_PATH && o[1].value == "x");
+    CHECK(o[2].number == COAP_OPT_CONTENT_FORMAT &&
+          uint_opt(o[2].value) == COAP_FORMAT_OCTETS);
+    CHECK(o[3].number == COAP_OPT_URI_QUERY &&
+          o[3].value == "d=0011223344556677");
+    CHECK(o[4].number == COAP_OPT_URI_QUERY && o[4].value == "v=1");
+    CHECK(o[5].number == COAP_OPT_BLOCK1 &&
+          uint_opt(o[5].value) == (uint32_t)m.block1);
+  }
+
+  CHECK(coap_parse(pdu, n, &r) == 0);
+  CHECK(r.type == COAP_CON && r.code == COAP_POST && r.mid == 0xBEEF);
+  CHECK(r.tkl == 4 && !memcmp(r.token, m.token, 4));
+  CHECK(r.block1 == m.block1);
+  CHECK(r.len == sizeof(data) && !memcmp(r.payload, data, sizeof(data)));
+
+  // empty ACK, the smallest message
+  coap_init_msg(&m, COAP_ACK, COAP_EMPTY, 7);
+  CHECK(coap_build(pdu, 4, &m) == 4);
+  CHECK(coap_parse(pdu, 4, &r) == 0);
+  CHECK(r.type == COAP_ACK && r.code == COAP_EMPTY && r.mid == 7 &&
+        r.tkl == 0 && r.block1 == -1 && r.len == 0);
+
+  // response with content format 0: value is zero length
+  coap_init_msg(&m, COAP_ACK, COAP_CHANGED, 8);
+  m.contentFormat = 0;
+  n = coap_build(pdu, sizeof(pdu), &m);
+  o = options(pdu, n);
+  CHECK(n == 5 && o.size() == 1 && o[0].value.empty());
+
+  // does not fit
+  coap_init_msg(&m, COAP_CON, COAP_POST, 1);
+  m.path = "up";
+  m.payload = data;
+  m.len = sizeof(data);
+  CHECK(coap_build(pdu, 4 + 3 + sizeof(data), &m) == 0);
+  CHECK(coap_build(pdu, 4 + 3 + 1 + sizeof(data), &m) == 4 + 3 + 1 +
+                                                               sizeof(data));
+  m.tkl = COAP_MAX_TOKEN + 1;
+  CHECK(coap_build(pdu, sizeof(pdu), &m) == 0);
+}
+
+static void test_extensions(void) {
+  uint8_t pdu[1024];
+  coap_msg_t m, r;
+  char seg[400];
+
+  // option lengths 12, 13 (8 bit extension), 268, 269 (16 bit extension)
+  const size_t lens[] = {12, 13, 268, 269, 300};
+  for (size_t k = 0; k < sizeof(lens) / sizeof(lens[0]); k++) {
+    memset(seg, 'a' + k, lens[k]);
+    seg[lens[k]] = 0;
+    coap_init_msg(&m, COAP_NON, COAP_POST, k);
+    m.path = seg;
+    size_t n = coap_build(pdu, sizeof(pdu), &m);
+    size_t head = lens[k] < 13 ? 1 : lens[k] < 269 ? 2 : 3;
+    CHECK(n == 4 + head + lens[k]);
+    std::vector<option_t> o = options(pdu, n);
+    CHECK(o.size() == 1 && o[0].number == COAP_OPT_URI_PATH &&
+          o[0].value == seg);
+    CHECK(coap_parse(pdu, n, &r) == 0 && r.len == 0);
+  }
+
+  // deltas 15 and 27 from option 0 take the 8 bit extension
+  coap_init_msg(&m, COAP_NON, COAP_POST, 1);
+  m.query = "q";
+  CHECK(coap_build(pdu, sizeof(pdu), &m) == 7 && pdu[4] == 0xD1 &&
+        pdu[5] == 15 - 13);
+  coap_init_msg(&m, COAP_NON, COAP_POST, 1);
+  m.block1 = COAP_BLOCK1(2, false, 4);
+  CHECK(coap_build(pdu, sizeof(pdu), &m) == 7 && pdu[4] == 0xD1 &&
+        pdu[5] == 27 - 13 && pdu[6] == 0x24);
+
+  // hand made: Block1, then an unknown option 2000 with a 16 bit delta and
+  // 16 bit length, which the parser skips, then the payload
+  size_t n = 0;
+  uint8_t *p = pdu;
+  p[n++] = 0x50; // NON, tkl 0
+  p[n++] = COAP_CHANGED;
+  p[n++] = 0;
+  p[n++] = 9;
+  p[n++] = 0xD2; // delta 27 in 8 bit extension, length 2
+  p[n++] = 27 - 13;
+  p[n++] = 0x12; // block 0x123, more, szx 4
+  p[n++] = 0x3C;
+  p[n++] = 0xEE; // delta 1973 and length 300, both 16 bit
+  p[n++] = (1973 - 269) >> 8;
+  p[n++] = (1973 - 269) & 0xFF;
+  p[n++] = (300 - 269) >> 8;
+  p[n++] = (300 - 269) & 0xFF;
+  memset(p + n, 0x55, 300);
+  n += 300;
+  p[n++] = 0xFF;
+  p[n++] = 'o';
+  p[n++] = 'k';
+  std::vector<option_t> o = options(pdu, n);
+  CHECK(o.size() == 2 && o[1].number == 2000 && o[1].value.size() == 300);
+  CHECK(coap_parse(pdu, n, &r) == 0);
+  CHECK(r.block1 == COAP_BLOCK1(0x123, true, 4));
+  CHECK(r.len == 2 && !memcmp(r.payload, "ok", 2));
+}
+
+static void test_block1(void) {
+  static uint8_t data[5000];
+  uint8_t pdu[COAP_MAX_PDU];
+  coap_msg_t m, r;
+
+  for (size_t i = 0; i < sizeof(data); i++)
+    data[i] = i ^ (i >> 8);
+
+  // fits one block: no Block1 at all
+  coap_init_msg(&m, COAP_CON, COAP_POST, 1);
+  CHECK(!coap_block1(&m, data, COAP_BLOCK_SIZE, 0));
+  CHECK(m.block1 == -1 && m.payload == data && m.len == COAP_BLOCK_SIZE);
+
+  // block sizes around the edges, and block numbers past 15 which need a
+  // two byte option value
+  const size_t lens[] = {COAP_BLOCK_SIZE + 1, 2 * COAP_BLOCK_SIZE,
+                         2 * COAP_BLOCK_SIZE + 17, sizeof(data)};
+  for (size_t k = 0; k < sizeof(lens) / sizeof(lens[0]); k++) {
+    size_t len = lens[k], got = 0, blocks = 0;
+    bool more = true;
+    std::vector<uint8_t> joined;
+    for (size_t num = 0; more; num++) {
+      coap_init_msg(&m, COAP_CON, COAP_POST, num);
+      m.path = "up";
+      m.contentFormat = COAP_FORMAT_OCTETS;
+      more = coap_block1(&m, data, len, num);
+      size_t n = coap_build(pdu, sizeof(pdu), &m);
+      CHECK(n > 0);
+      CHECK(coap_parse(pdu, n, &r) == 0);
+      CHECK((size_t)(r.block1 >> 4) == num);
+      CHECK(((r.block1 & 8) != 0) == more);
+      CHECK((r.block1 & 7) == COAP_BLOCK_SZX);
+      CHECK(more ? r.len == COAP_BLOCK_SIZE : r.len > 0);
+      joined.insert(joined.end(), r.payload, r.payload + r.len);
+      got += r.len;
+      blocks++;
+    }
+    CHECK(got == len && !memcmp(joined.data(), data, len));
+    CHECK(blocks == (len + COAP_BLOCK_SIZE - 1) / COAP_BLOCK_SIZE);
+  }
+}
+
+static void test_malformed(void) {
+  uint8_t pdu[64], bad[64];
+  coap_msg_t m, r;
+
+  coap_init_msg(&m, COAP_CON, COAP_POST, 0x1234);
+  m.tkl = 2;
+  m.path = "up";
+  m.block1 = COAP_BLOCK1(20, true, 4);
+  m.payload = (const uint8_t *)"xyz";
+  m.len = 3;
+  size_t n = coap_build(pdu, sizeof(pdu), &m);
+  CHECK(coap_parse(pdu, n, &r) == 0);
+
+  // cut inside header, token or an option, or right after the payload
+  // marker, is refused. Cut at an option boundary or inside the payload
+  // still is a valid, shorter PDU, datagram truncation is the job of UDP.
+  size_t marker = n - 4;
+  CHECK(pdu[marker] == 0xFF);
+  for (size_t cut = 0; cut < n; cut++) {
+    bool valid = (cut == 4 + 2) || (cut == 4 + 2 + 3) || (cut == marker) ||
+                 (cut > marker + 1);
+    CHECK((coap_parse(pdu, cut, &r) == 0) == valid);
+  }
+  CHECK(coap_parse(pdu, marker + 1, &r) == -1);
+
+  // version 2
+  memcpy(bad, pdu, n);
+  bad[0] = (bad[0] & 0x3F) | 0x80;
+  CHECK(coap_parse(bad, n, &r) == -1);
+  // token length 9
+  memcpy(bad, pdu, n);
+  bad[0] = (bad[0] & 0xF0) | 9;
+  CHECK(coap_parse(bad, n, &r) == -1);
+  // reserved delta and length nibble 15
+  memcpy(bad, pdu, n);
+  bad[6] = 0xF2;
+  CHECK(coap_parse(bad, n, &r) == -1);
+  memcpy(bad, pdu, n);
+  bad[6] = 0xBF;
+  CHECK(coap_parse(bad, n, &r) == -1);
+  // option length past the end
+  memcpy(bad, pdu, n);
+  bad[6] = 0xBC;
+  CHECK(coap_parse(bad, n, &r) == -1);
+  // 16 bit extension cut after its first byte
+  const uint8_t ext[] = {0x50, 0x02, 0, 1, 0xE0, 0x01};
+  CHECK(coap_parse(ext, sizeof(ext), &r) == -1);
+  const uint8_t ext8[] = {0x50, 0x02, 0, 1, 0x0D};
+  CHECK(coap_parse(ext8, sizeof(ext8), &r) == -1);
+}
+
+// ---- bytes on air ----
+
+static const char b64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static std::string base64(const uint8_t *d, size_t n) {
+  std::string s;
+  for (size_t i = 0; i < n; i += 3) {
+    uint32_t v = d[i] << 16 | (i + 1 < n ? d[i + 1] << 8 : 0) |
+                 (i + 2 < n ? d[i + 2] : 0);
+    s += b64[v >> 18];
+    s += b64[(v >> 12) & 63];
+    s += i + 1 < n ? b64[(v >> 6) & 63] : '=';
+    s += i + 2 < n ? b64[v & 63] : '=';
+  }
+  return s;
+}
+
+static const char *devEui = "70b3d5499a1b2c3d";
+
+// sendNbMqtt(), nb.cnf defaults of sdcard.h
+static size_t mqtt_air(const uint8_t *msg, size_t size, int port) {
+  char topic[64], json[512];
+  snprintf(topic, sizeof(topic), "%s/application/%s/device/%s/rx",
+           "DIVALGATE", "1", devEui);
+  size_t len = snprintf(json, sizeof(json),
+                        "{\"applicationID\":\"%s\",\"applicationName\":\"%s\","
+                        "\"fPort\":%d,\"data\":\"%s\",\"deviceName\":\"%s\","
+                        "\"devEUI\":\"%s\"}",
+                        "1", "app", port, base64(msg, size).c_str(), devEui,
+                        devEui);
+  return NB_TCPIP_HEADER + 4 + strlen(topic) + len + NB_TCPIP_HEADER;
+}
+
+// coapPost() of sendNbCoap() plus a piggybacked 2.04 per datagram
+static size_t coap_air(const uint8_t *msg, size_t size, int port, int count,
+                       int *datagrams) {
+  std::vector<uint8_t> body;
+  uint8_t pdu[COAP_MAX_PDU];
+  char query[24];
+  coap_msg_t m;
+  size_t air = 0;
+  bool more = true;
+
+  for (int i = 0; i < count; i++) {
+    body.push_back(port);
+    body.push_back(size);
+    body.insert(body.end(), msg, msg + size);
+  }
+  snprintf(query, sizeof(query), "d=%s", devEui);
+  *datagrams = 0;
+  for (size_t num = 0; more; num++) {
+    coap_init_msg(&m, COAP_CON, COAP_POST, num);
+    m.tkl = 4;
+    m.path = "up";
+    m.query = query;
+    m.contentFormat = COAP_FORMAT_OCTETS;
+    more = coap_block1(&m, body.data(), body.size(), num);
+    air += NB_UDPIP_HEADER + coap_build(pdu, sizeof(pdu), &m);
+    coap_init_msg(&m, COAP_ACK, more ? COAP_CONTINUE : COAP_CHANGED, num);
+    m.tkl = 4;
+    if (m.block1 >= 0)
+      m.block1 = COAP_BLOCK1(num, more, COAP_BLOCK_SZX);
+    air += NB_UDPIP_HEADER + coap_build(pdu, sizeof(pdu), &m);
+    *datagrams += 2;
+  }
+  return air;
+}
+
+static void air_table(void) {
+  uint8_t msg[51];
+  for (size_t i = 0; i < sizeof(msg); i++)
+    msg[i] = i * 37;
+
+  printf("%-24s %5s %9s %9s %9s %7s\n", "uplink", "msgs", "payload",
+         "mqtt B", "coap B/dg", "coap/mqtt");
+  struct {
+    const char *name;
+    size_t size;
+    int port, count;
+  } cases[] = {{"pax count, 4 B", 4, 1, 1},
+               {"pax count, 4 B, batch 8", 4, 1, 8},
+               {"max payload, 51 B", 51, 1, 1},
+               {"max payload, batch 8", 51, 1, 8}};
+  for (auto &c : cases) {
+    int dg;
+    size_t mqtt = c.count * mqtt_air(msg, c.size, c.port);
+    size_t coap = coap_air(msg, c.size, c.port, c.count, &dg);
+    printf("%-24s %5d %9zu %9zu %6zu/%-2d %7.2f\n", c.name, c.count,
+           c.count * c.size, mqtt, coap, dg, (double)coap / mqtt);
+    CHECK(coap < mqtt);
+  }
+}
+
+int main(void) {
+  test_roundtrip();
+  test_extensions();
+  test_block1();
+  test_malformed();
+  air_table();
+  if (failed) {
+    printf("%d checks failed\n", failed);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
@@ -0,0 +1,286 @@
+/* Host test of the FUOTA FEC decoder of src/fragdec.cpp.
+
+fragdec.cpp is compiled as is, the fragment store is a RAM image that can be
+told to fail. An image of random bytes is split into fragments, coded
+fragments are the XOR of the uncoded fragments selected by the TS004 parity
+lines. Uncoded and coded fragments are lost at random, independently or in
+bursts (Gilbert-Elliott, mean burst 4), and fed to the decoder until it
+reports the image complete, which then has to equal the original. Checked
+are also duplicates, lost fragments arriving late, more lost fragments than
+the matrix allows and failing store reads and writes. Per configuration the
+coded fragments needed per lost fragment, the decode time of the coded
+fragments including the back substitution and the peak decoder heap are
+reported.
+
+  g++ -O2 -Wall -I../../include -o fragtest fragtest.cpp ../../src/fragdec.cpp
+  ./fragtest
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "fragdec.h"
+
+#define MAX_REDUNDANCY 256 // FUOTA_MAX_REDUNDANCY in src/paxcounter.conf
+
+static int failed = 0;
+#define CHECK(c)                                                               \
+  do {                                                                         \
+    if (!(c)) {                                                                \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #c);                      \
+      failed++;                                                                \
+    }                                                                          \
+  } while (0)
+
+static std::mt19937 rng(27);
+
+// ---- fragment store ----
+
+static std::vector<uint8_t> store;
+static long failAfter = -1; // store accesses until one fails, -1 = never
+
+static bool store_ok(void) {
+  if (failAfter < 0)
+    return true;
+  return failAfter-- > 0;
+}
+
+static bool store_read(uint32_t offset, uint8_t *buf, size_t len) {
+  if (!store_ok() || offset + len > store.size())
+    return false;
+  memcpy(buf, store.data() + offset, len);
+  return true;
+}
+
+static bool store_write(uint32_t offset, const uint8_t *buf, size_t len) {
+  if (!store_ok() || offset + len > store.size())
+    return false;
+  memcpy(store.data() + offset, buf, len);
+  return true;
+}
+
+// ---- sender ----
+
+struct image_t {
+  uint16_t nbFrag;
+  uint8_t fragSize;
+  std::vector<uint8_t> data;
+
+  image_t(uint16_t n, uint8_t size) : nbFrag(n), fragSize(size) {
+    data.resize((size_t)n * size);
+    for (auto &b : data)
+      b = rng();
+  }
+  const uint8_t *uncoded(uint16_t n) const {
+    return data.data() + (size_t)(n - 1) * fragSize;
+  }
+  // coded fragment n (1..), numbered nbFrag + n on air
+  std::vector<uint8_t> coded(uint32_t n) const {
+    std::vector<uint8_t> line((nbFrag + 7) / 8), out(fragSize);
+    frag_parity_line(n, nbFrag, line.data());
+    for (uint16_t j = 0; j < nbFrag; j++)
+      if ((line[j >> 3] >> (j & 7)) & 1)
+        for (int k = 0; k < fragSize; k++)
+          out[k] ^= data[(size_t)j * fragSize + k];
+    return out;
+  }
+};
+
+// loss pattern, independent (burst 1) or Gilbert-Elliott with mean burst
+struct channel_t {
+  double loss, burst;
+  bool bad = false;
+  bool lose(void) {
+    std::uniform_real_distribution<double> u(0, 1);
+    if (burst <= 1)
+      return u(rng) < loss;
+    // stay bad with 1 - 1/burst, enter bad so that loss is the mean
+    double leave = 1 / burst, enter = loss * leave / (1 - loss);
+    bad = bad ? (u(rng) >= leave) : (u(rng) < enter);
+    return bad;
+  }
+};
+
+static double now_us(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e6 + t.tv_nsec / 1e3;
+}
+
+struct run_t {
+  bool done;
+  uint16_t lost;
+  uint32_t coded, bytes;
+  double us;
+};
+
+// sends the uncoded fragments, then coded ones over the same channel
+static run_t session(const image_t &img, channel_t ch) {
+  frag_dec_t d;
+  run_t r = {false, 0, 0, 0, 0};
+  int ret = FRAG_DEC_MORE;
+
+  store.assign(img.data.size(), 0);
+  failAfter = -1;
+  CHECK(frag_dec_init(&d, img.nbFrag, img.fragSize, MAX_REDUNDANCY,
+                      store_read, store_write));
+  for (uint16_t n = 1; n <= img.nbFrag; n++)
+    if (!ch.lose()) {
+      ret = frag_dec_add(&d, n, img.uncoded(n));
+      CHECK(ret == FRAG_DEC_MORE || (ret == FRAG_DEC_DONE && n == img.nbFrag));
+    }
+  r.lost = img.nbFrag - d.received;
+  if (r.lost > MAX_REDUNDANCY) { // not decodable by design, caller retries
+    frag_dec_free(&d);
+    return r;
+  }
+
+  for (uint32_t c = 1; ret == FRAG_DEC_MORE && c <= 3u * r.lost + 64; c++) {
+    if (ch.lose())
+      continue;
+    std::vector<uint8_t> frag = img.coded(c);
+    double t = now_us();
+    ret = frag_dec_add(&d, img.nbFrag + c, frag.data());
+    r.us += now_us() - t;
+    r.bytes = std::max(r.bytes, d.bytes);
+    CHECK(ret == FRAG_DEC_MORE || ret == FRAG_DEC_DONE);
+  }
+  r.coded = d.codedRx;
+  r.done = (ret == FRAG_DEC_DONE);
+  CHECK(r.done);
+  CHECK(frag_dec_missing(&d) == 0);
+  CHECK(store == img.data);
+  frag_dec_free(&d);
+  return r;
+}
+
+static void test_random(void) {
+  struct {
+    uint16_t nbFrag;
+    uint8_t fragSize;
+    double loss, burst;
+  } cfg[] = {
+      {100, 50, 0.10, 1},   {100, 50, 0.10, 4},   {500, 242, 0.05, 1},
+      {1000, 100, 0.20, 1}, {1000, 100, 0.20, 4}, {2000, 50, 0.10, 1},
+      {4000, 242, 0.05, 4}, {16383, 51, 0.01, 1},
+  };
+  const int runs = 5;
+
+  printf("%6s %5s %5s %5s %7s %10s %9s %9s\n", "frags", "size", "loss",
+         "burst", "lost", "coded/lost", "decode ms", "heap B");
+  for (auto &c : cfg) {
+    image_t img(c.nbFrag, c.fragSize);
+    double lost = 0, coded = 0, us = 0;
+    uint32_t bytes = 0;
+    for (int i = 0; i < runs; i++) {
+      run_t r;
+      do // a run with more losses than the matrix allows says nothing
+        r = session(img, channel_t{c.loss, c.burst});
+      while (r.lost > MAX_REDUNDANCY);
+      lost += r.lost;
+      coded += r.coded;
+      us += r.us;
+      bytes = std::max(bytes, r.bytes);
+    }
+    printf("%6u %5u %4.0f%% %5.0f %7.1f %10.3f %9.2f %9u\n", c.nbFrag,
+           c.fragSize, c.loss * 100, c.burst, lost / runs,
+           lost ? coded / lost : 0.0, us / runs / 1e3, bytes);
+  }
+}
+
+static void test_edges(void) {
+  image_t img(200, 40);
+  frag_dec_t d;
+  std::vector<uint16_t> lost = {3, 50, 51, 52, 120, 199, 200};
+  auto is_lost = [&](uint16_t n) {
+    return std::find(lost.begin(), lost.end(), n) != lost.end();
+  };
+
+  // no loss, duplicates: done without coded fragments
+  store.assign(img.data.size(), 0);
+  CHECK(frag_dec_init(&d, img.nbFrag, img.fragSize, MAX_REDUNDANCY,
+                      store_read, store_write));
+  CHECK(frag_dec_add(&d, 1, img.uncoded(1)) == FRAG_DEC_MORE);
+  CHECK(frag_dec_add(&d, 1, img.uncoded(1)) == FRAG_DEC_MORE);
+  CHECK(d.received == 1);
+  for (uint16_t n = 2; n < img.nbFrag; n++)
+    CHECK(frag_dec_add(&d, n, img.uncoded(n)) == FRAG_DEC_MORE);
+  CHECK(frag_dec_add(&d, img.nbFrag, img.uncoded(img.nbFrag)) ==
+        FRAG_DEC_DONE);
+  CHECK(store == img.data && d.codedRx == 0);
+  frag_dec_free(&d);
+
+  // lost fragments arriving late after the freeze count as equations
+  store.assign(img.data.size(), 0);
+  CHECK(frag_dec_init(&d, img.nbFrag, img.fragSize, MAX_REDUNDANCY,
+                      store_read, store_write));
+  for (uint16_t n = 1; n <= img.nbFrag; n++)
+    if (!is_lost(n))
+      frag_dec_add(&d, n, img.uncoded(n));
+  CHECK(frag_dec_add(&d, img.nbFrag + 1, img.coded(1).data()) ==
+        FRAG_DEC_MORE);
+  CHECK(d.frozen && d.lost == lost.size());
+  uint16_t before = frag_dec_missing(&d);
+  for (size_t i = 0; i + 1 < lost.size(); i++)
+    frag_dec_add(&d, lost[i], img.uncoded(lost[i]));
+  CHECK(frag_dec_missing(&d) <= before - (lost.size() - 2));
+  int ret = FRAG_DEC_MORE;
+  for (uint32_t c = 2; ret == FRAG_DEC_MORE && c < 50; c++)
+    ret = frag_dec_add(&d, img.nbFrag + c, img.coded(c).data());
+  CHECK(ret == FRAG_DEC_DONE && store == img.data);
+  frag_dec_free(&d);
+
+  // more lost than the matrix holds: refused until late fragments arrive
+  store.assign(img.data.size(), 0);
+  CHECK(frag_dec_init(&d, img.nbFrag, img.fragSize, 4, store_read,
+                      store_write));
+  for (uint16_t n = 1; n <= img.nbFrag; n++)
+    if (!is_lost(n))
+      frag_dec_add(&d, n, img.uncoded(n));
+  CHECK(frag_dec_add(&d, img.nbFrag + 1, img.coded(1).data()) ==
+        FRAG_DEC_NOMEM);
+  CHECK(d.memError && !d.frozen && d.codedRx == 0);
+  for (size_t i = 0; i < 3; i++)
+    CHECK(frag_dec_add(&d, lost[i], img.uncoded(lost[i])) == FRAG_DEC_MORE);
+  ret = FRAG_DEC_MORE;
+  for (uint32_t c = 1; ret == FRAG_DEC_MORE && c < 50; c++)
+    ret = frag_dec_add(&d, img.nbFrag + c, img.coded(c).data());
+  CHECK(ret == FRAG_DEC_DONE && !d.memError && store == img.data);
+  frag_dec_free(&d);
+
+  // failing store: every access may fail, the decoder has to say so
+  for (long fail = 0; fail < 400; fail += 7) {
+    store.assign(img.data.size(), 0);
+    CHECK(frag_dec_init(&d, img.nbFrag, img.fragSize, MAX_REDUNDANCY,
+                        store_read, store_write));
+    failAfter = fail;
+    ret = FRAG_DEC_MORE;
+    for (uint16_t n = 1; ret == FRAG_DEC_MORE && n <= img.nbFrag; n++)
+      if (!is_lost(n))
+        ret = frag_dec_add(&d, n, img.uncoded(n));
+    for (uint32_t c = 1; ret == FRAG_DEC_MORE && c < 50; c++)
+      ret = frag_dec_add(&d, img.nbFrag + c, img.coded(c).data());
+    if (failAfter >= 0) // no failure happened
+      CHECK(ret == FRAG_DEC_DONE && store == img.data);
+    else
+      CHECK(ret == FRAG_DEC_STORE);
+    failAfter = -1;
+    frag_dec_free(&d);
+  }
+}
+
+int main(void) {
+  test_edges();
+  test_random();
+  if (failed) {
+    printf("%d checks failed\n", failed);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
@@ -0,0 +1,284 @@
+/* Host test of the bulk NMEA read of src/gpsread.cpp.
+
+gpsread.cpp is compiled as is with the GPS on a uart (GPS_SERIAL). The
+uart is backed by an emulated u-blox NEO-6M at 9600 baud. Once a second it
+sends its default sentences RMC, VTG, GGA, GSA, three GSV and GLL, byte by
+byte at the line rate, into a GPS_RX_BUFFER rx fifo. It switches off the
+sentences named in PUBX,40 commands that carry a valid checksum. The TinyGPS++
+stand-in records every sentence it is fed. gps_loop() runs on a virtual
+clock: ulTaskNotifyTake() advances the clock by its timeout and moves the
+bytes that arrived meanwhile into the fifo.
+
+Checked: from a mixed NMEA stream split over several reads and wakeups,
+exactly the complete RMC, GGA and ZDA sentences of any talker reach
+TinyGPS++. Everything else is held back: other sentences, proprietary
+ones, garbage, lines cut short by a new '$', and lines too long for NMEA.
+gps_init() switches the receiver down to RMC and GGA. Then a 10 minute run
+of the task prints gps_print_stats() and loses no byte.
+
+  g++ -O2 -Wall -Istub -I../../include -include stub/globals.h \
+      -include stub/gpshost.h -o gpstest gpstest.cpp ../../src/gpsread.cpp
+  ./gpstest
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <deque>
+#include <set>
+#include <string>
+#include <vector>
+
+int host_verbose = 0;
+
+static int failed = 0;
+#define CHECK(c)                                                               \
+  do {                                                                         \
+    if (!(c)) {                                                                \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #c);                      \
+      failed++;                                                                \
+    }                                                                          \
+  } while (0)
+
+std::vector<std::string> host_gps_sentences;
+configData_t cfg;
+
+// ---- virtual clock ----
+
+static uint32_t now_ms = 0, end_ms = 0;
+struct end_of_test {};
+
+uint32_t millis(void) { return now_ms; }
+void vTaskDelay(TickType_t ticks) { now_ms += ticks; }
+void timeSync(void) {}
+time_t timeIsValid(time_t const t) { return t; }
+time_t makeTime(const tmElements_t &) { return 0; }
+TickType_t tx_Ticks(uint32_t framesize, unsigned long baud, uint32_t,
+                    int8_t, int8_t) {
+  return framesize * 10 * 1000 / baud;
+}
+void xTaskNotifyGive(TaskHandle_t) {}
+
+// ---- emulated receiver ----
+
+static struct {
+  std::deque<std::pair<uint32_t, uint8_t>> line; // [arrival ms, byte]
+  std::deque<uint8_t> fifo;
+  size_t rxSize = 256; // uart driver default
+  uint32_t dropped = 0, nextEpoch = 0;
+  bool emulate = false;
+  std::set<std::string> enabled;
+  std::string tx;
+} uart;
+
+static std::string nmea(const char *body) {
+  uint8_t cs = 0;
+  for (const char *p = body; *p; p++)
+    cs ^= *p;
+  char buf[128];
+  snprintf(buf, sizeof(buf), "$%s*%02X\r\n", body, cs);
+  return buf;
+}
+
+static void receiver_reset(void) {
+  uart.line.clear();
+  uart.fifo.clear();
+  uart.tx.clear();
+  uart.dropped = 0;
+  uart.nextEpoch = now_ms;
+  uart.enabled = {"RMC", "VTG", "GGA", "GSA", "GSV", "GLL"};
+}
+
+// one second of output in u-blox order
+static void receiver_epoch(uint32_t t) {
+  unsigned s = t / 1000 % 60, m = t / 60000 % 60;
+  char b[3][100];
+  std::string out;
+  snprintf(b[0], sizeof(b[0]),
+           "GPRMC,1234%02u.00,A,4723.41234,N,00832.81234,E,0.012,,191026,,,A",
+           s);
+  if (uart.enabled.count("RMC"))
+    out += nmea(b[0]);
+  if (uart.enabled.count("VTG"))
+    out += nmea("GPVTG,,T,,M,0.012,N,0.022,K,A");
+  snprintf(b[0], sizeof(b[0]),
+           "GPGGA,12%02u%02u.00,4723.41234,N,00832.81234,E,1,08,1.01,"
+           "499.6,M,48.0,M,,",
+           m, s);
+  if (uart.enabled.count("GGA"))
+    out += nmea(b[0]);
+  if (uart.enabled.count("GSA"))
+    out += nmea("GPGSA,A,3,10,07,05,02,29,04,08,13,,,,,1.72,1.03,1.38");
+  if (uart.enabled.count("GSV")) {
+    out += nmea("GPGSV,3,1,11,10,63,137,17,07,61,098,15,05,59,290,20,08,"
+                "54,157,30");
+    out += nmea("GPGSV,3,2,11,02,39,223,19,13,28,070,17,26,23,252,,04,"
+                "14,186,14");
+    out += nmea("GPGSV,3,3,11,29,09,301,24,16,09,020,,36,,,");
+  }
+  if (uart.enabled.count("GLL"))
+    out += nmea("GPGLL,4723.41234,N,00832.81234,E,123456.00,A,A");
+  // 8N1 at 9600 baud, about 1.04 ms per byte
+  for (size_t i = 0; i < out.size(); i++)
+    uart.line.push_back({t + 50 + (uint32_t)(i * 10000 / 9600), out[i]});
+}
+
+static void receiver_run(void) {
+  while (uart.emulate && (int32_t)(now_ms - uart.nextEpoch) >= 0) {
+    receiver_epoch(uart.nextEpoch);
+    uart.nextEpoch += 1000;
+  }
+  while (!uart.line.empty() && (int32_t)(now_ms - uart.line.front().first) >= 0) {
+    if (uart.fifo.size() < uart.rxSize)
+      uart.fifo.push_back(uart.line.front().second);
+    else
+      uart.dropped++;
+    uart.line.pop_front();
+  }
+}
+
+// commands from the host, PUBX,40,<msg>,0,... switches msg off
+static void receiver_command(const std::string &s) {
+  char msg[4];
+  unsigned cs;
+  size_t star = s.find('*');
+  if (s[0] != '$' || star == std::string::npos ||
+      sscanf(s.c_str() + star + 1, "%2X", &cs) != 1 ||
+      nmea(s.substr(1, star - 1).c_str()) != s)
+    return;
+  if (sscanf(s.c_str(), "$PUBX,40,%3[A-Z],0,0,0,0,0,0", msg) == 1)
+    uart.enabled.erase(msg);
+}
+
+void HardwareSerial::setRxBufferSize(size_t size) { uart.rxSize = size; }
+void HardwareSerial::begin(unsigned long baud, uint32_t, int8_t,
+                           int8_t) {
+  CHECK(baud == 9600);
+}
+int HardwareSerial::available(void) { return uart.fifo.size(); }
+size_t HardwareSerial::readBytes(uint8_t *buf, size_t n) {
+  size_t k = 0;
+  for (; k < n && !uart.fifo.empty(); k++) {
+    buf[k] = uart.fifo.front();
+    uart.fifo.pop_front();
+  }
+  return k;
+}
+size_t HardwareSerial::write(const uint8_t *buf, size_t n) {
+  uart.tx.append((const char *)buf, n);
+  size_t eol;
+  while ((eol = uart.tx.find('\n')) != std::string::npos) {
+    receiver_command(uart.tx.substr(0, eol + 1));
+    uart.tx.erase(0, eol + 1);
+  }
+  return n;
+}
+
+// ---- task ----
+
+static std::vector<std::string> script; // filled into the fifo per wakeup
+static size_t scriptPos = 0;
+static uint32_t wakeups = 0;
+
+uint32_t ulTaskNotifyTake(BaseType_t, TickType_t wait) {
+  if (wakeups++ && scriptPos == script.size() && !uart.emulate)
+    throw end_of_test();
+  now_ms += wait;
+  if (scriptPos < script.size())
+    for (char c : script[scriptPos++])
+      uart.fifo.push_back(c);
+  receiver_run();
+  if (uart.emulate && (int32_t)(now_ms - end_ms) >= 0)
+    throw end_of_test();
+  return 0;
+}
+
+static void run_task(void) {
+  wakeups = 0;
+  try {
+    gps_loop((void *)1);
+  } catch (end_of_test &) {
+  }
+}
+
+// ---- tests ----
+
+static void test_filter(void) {
+  std::string rmc = nmea("GPRMC,123519.00,A,4807.038,N,01131.000,E,022.4,"
+                         "084.4,230394,003.1,W,A");
+  std::string gga = nmea("GNGGA,123519.00,4807.038,N,01131.000,E,1,08,0.9,"
+                         "545.4,M,46.9,M,,");
+  std::string zda = nmea("GPZDA,123519.00,23,03,1994,00,00");
+  std::string rmc2 = nmea("GLRMC,123520.00,A,4807.038,N,01131.000,E,022.4,"
+                          "084.4,230394,003.1,W,A");
+  std::string big = "$GPRMC," + std::string(100, '1') + "*00\r\n";
+
+  std::string wake1 =
+      "garbage\r\n" + rmc + nmea("GPGSV,3,1,11,10,63,137,17") + gga +
+      nmea("PUBX,00,123519.00,4807.038,N,01131.000,E,545.4,G3,2.1,2.0") +
+      "\r\n" + nmea("GPTXT,01,01,02,ANTENNA OK") + nmea("GPGLL,RMC,GGA") +
+      "$GPRMC,123519.00,A,48" + // cut short by the next '$'
+      zda + "$GPRM\r\n" + big + nmea("GPVTG,,T,,M,0.0,N,0.0,K,A") +
+      gga.substr(0, 30);
+  std::string wake2 = gga.substr(30) + nmea("GPGSA,A,3,10,07") + rmc2;
+
+  receiver_reset();
+  uart.emulate = false;
+  uart.rxSize = GPS_RX_BUFFER;
+  host_gps_sentences.clear();
+  script = {wake1, wake2};
+  scriptPos = 0;
+  run_task();
+
+  std::vector<std::string> want = {rmc, gga, zda, gga, rmc2};
+  CHECK(host_gps_sentences == want);
+  if (host_gps_sentences != want)
+    for (auto &s : host_gps_sentences)
+      printf("  got %s", s.c_str());
+  CHECK(uart.fifo.empty());
+}
+
+static void test_run(void) {
+  const uint32_t minutes = 10;
+
+  script.clear();
+  scriptPos = 0;
+  now_ms = 1000;
+  receiver_reset();
+  uart.emulate = true;
+  cfg.payloadmask = GPS_DATA | COUNT_DATA;
+  CHECK(gps_init() == 1);
+  CHECK(uart.enabled == std::set<std::string>({"RMC", "GGA"}));
+  CHECK(uart.rxSize == GPS_RX_BUFFER);
+
+  host_gps_sentences.clear();
+  end_ms = now_ms + minutes * 60000;
+  run_task();
+
+  size_t rmc = 0, gga = 0, other = 0;
+  for (auto &s : host_gps_sentences)
+    (s.compare(3, 3, "RMC") == 0)   ? rmc++
+    : (s.compare(3, 3, "GGA") == 0) ? gga++
+                                    : other++;
+  printf("%u min at 9600 baud: %zu RMC, %zu GGA, %zu other to TinyGPS++, "
+         "%u bytes lost in the uart\n",
+         minutes, rmc, gga, other, uart.dropped);
+  CHECK(rmc >= minutes * 60 - 1 && gga >= minutes * 60 - 1 && other == 0);
+  CHECK(uart.dropped == 0);
+
+  host_verbose = 1;
+  gps_print_stats();
+  host_verbose = 0;
+}
+
+int main(void) {
+  test_run(); // first, the stats count from gps_init() on
+  test_filter();
+  if (failed) {
+    printf("%d checks failed\n", failed);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
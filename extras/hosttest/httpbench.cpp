@@ -0,0 +1,348 @@
+/* Host bench of the http response path of the BC95 socket client, old
+string based parser against the streaming parser.
+
+The modem output of a response is built as the BC95 delivers it: +NSONMI
+lines of at most 512 bytes hex encoded data, then +NSOCLI. It is read
+through a fake uart, either trickling, 120 more bytes (the rx fifo
+threshold of the ESP32 uart driver) arrive each time a reader finds the
+uart empty, or buffered, all of it is waiting in the uart driver. New is
+nsonmi.cpp and httpstream.cpp linked as is with the body sink of
+getData(). Old is the
+code of BC95.cpp before the streaming parser (receiveSocketData,
+readResponseData, parseResponseCode, parseContentLength, parseData),
+copied below with only the uart replaced and its 2 and 4 KB buffers
+enlarged to hold the response. Both have to deliver the same body. Time
+per response is the median of the runs, heap calls and bytes are counted
+by operator new. The heap bytes, mostly string copies of the unscanned
+modem output, do not depend on the host.
+
+  g++ -O2 -Wall -I../../include -o httpbench httpbench.cpp \
+      ../../src/nsonmi.cpp ../../src/httpstream.cpp
+  ./httpbench
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "httpstream.h"
+#include "nsonmi.h"
+
+static int failed = 0;
+#define CHECK(c)                                                               \
+  do {                                                                         \
+    if (!(c)) {                                                                \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #c);                      \
+      failed++;                                                                \
+    }                                                                          \
+  } while (0)
+
+static unsigned long allocs = 0, allocBytes = 0;
+void *operator new(size_t n) {
+  allocs++;
+  allocBytes += n;
+  void *p = malloc(n);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+static double now_us(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e6 + t.tv_nsec / 1e3;
+}
+
+// ---- fake uart ----
+
+#define UART_BURST 120
+
+static struct {
+  const char *data;
+  size_t len, pos, arrived;
+} uart;
+
+static void uart_load(const std::string &s, bool buffered) {
+  uart.data = s.data();
+  uart.len = s.size();
+  uart.pos = 0;
+  uart.arrived = buffered ? s.size() : 0;
+}
+// next burst arrives while the reader waits
+static void uart_wait(void) {
+  uart.arrived = std::min(uart.len, uart.arrived + UART_BURST);
+}
+static int uart_available(void) { return uart.arrived - uart.pos; }
+static char uart_read(void) { return uart.data[uart.pos++]; }
+
+// ---- old parser, BC95.cpp before the streaming parser ----
+
+static int readResponseData(std::string response, char *buffer,
+                            int bufferSize) {
+  int socketIndex = response.find(",");
+  if (socketIndex == (int)std::string::npos)
+    return -1;
+  int lenIndex = response.find(",", socketIndex + 1);
+  if (lenIndex == (int)std::string::npos)
+    return -1;
+  int dataIndex = response.find("\r\n", lenIndex + 1);
+  if (dataIndex == (int)std::string::npos)
+    return -1;
+
+  std::string socketString = response.substr(0, socketIndex);
+  std::string lenString =
+      response.substr(socketIndex + 1, lenIndex - socketIndex - 1);
+  std::string dataString =
+      response.substr(lenIndex + 1, dataIndex - lenIndex - 1);
+
+  int dataLen = strtoul(lenString.c_str(), NULL, 10);
+  int strLen = strlen(dataString.c_str());
+
+  if (dataLen != strLen / 2)
+    return -1;
+  if (bufferSize < dataLen + 1)
+    return -2;
+
+  char *tempBuff = (char *)dataString.c_str();
+  for (int i = 0; i < strLen; i += 2) {
+    char tmp[3];
+    memcpy(tmp, tempBuff + i, 2);
+    tmp[2] = 0;
+    buffer[i / 2] = strtoul(tmp, NULL, 16);
+  }
+  buffer[strLen / 2] = 0;
+  return dataLen;
+}
+
+// uart read loop, HTTP_READ_TIMEOUT replaced by end of uart data
+static int receiveSocketData(int socket, char *buffer, int bufferSize,
+                             char *responseBuffer, char *dataBuffer,
+                             size_t responseSize) {
+  responseBuffer[0] = 0;
+  size_t responseBufferPos = 0;
+  int readBytes = strlen(buffer);
+  int buffPtr = readBytes;
+  char *scanPtr = buffer;
+
+  while (uart.pos < uart.len || *scanPtr) {
+    if (!uart_available())
+      uart_wait();
+    while (uart_available()) {
+      buffer[buffPtr++] = uart_read();
+      readBytes += 1;
+      if (buffPtr == bufferSize)
+        return -10;
+      buffer[buffPtr] = 0;
+    }
+    std::string current = std::string(scanPtr);
+    char expected[32];
+
+    sprintf(expected, "\r\n");
+
+    size_t pos = current.find(expected);
+    if (pos == std::string::npos)
+      continue;
+
+    std::string line = current.substr(0, pos + 2);
+    scanPtr += line.length();
+
+    sprintf(expected, "+NSONMI:%d", socket);
+    if (line.find(expected) != std::string::npos) {
+      int len = readResponseData(line, dataBuffer, responseSize);
+      if (len < 0)
+        return len;
+      if (responseBufferPos + len >= responseSize)
+        return -10;
+      memcpy(responseBuffer + responseBufferPos, dataBuffer, len);
+      responseBufferPos += len;
+      continue;
+    }
+
+    sprintf(expected, "+NSOCLI: %d", socket);
+    if (line.find(expected) != std::string::npos) {
+      memcpy(buffer, responseBuffer, responseBufferPos);
+      buffer[responseBufferPos] = 0;
+      return responseBufferPos;
+    }
+  };
+
+  memcpy(buffer, responseBuffer, responseBufferPos);
+  return -2;
+}
+
+static int parseResponseCode(char *buff, int) {
+  std::string inputString = std::string(buff);
+  size_t pos = inputString.find("\r\n");
+  if (pos == std::string::npos)
+    return -1;
+  std::string httpResponseLine = inputString.substr(0, pos + 2);
+  size_t responseCodePos = httpResponseLine.find(" ");
+  size_t responseCodePosEnd = httpResponseLine.find(" ", responseCodePos + 1);
+  std::string responseCodeStr = httpResponseLine.substr(
+      responseCodePos + 1, responseCodePosEnd - responseCodePos - 1);
+  return strtoul(responseCodeStr.c_str(), NULL, 10);
+}
+
+static int parseContentLength(char *buff, int) {
+  std::string inputString = std::string(buff);
+  size_t pos = inputString.find("\r\n\r\n");
+  if (pos == std::string::npos)
+    return -1;
+  std::string httpString = inputString.substr(0, pos + 4);
+  std::for_each(httpString.begin(), httpString.end(),
+                [](char &c) { c = ::tolower(c); });
+  size_t contentLengthPos = httpString.find("content-length:");
+  size_t contentLengthPosEnd = httpString.find("\r\n", contentLengthPos + 1);
+  std::string contentLengthStr =
+      httpString.substr(contentLengthPos + 15,
+                        contentLengthPosEnd - contentLengthPos - 15);
+  return strtoul(contentLengthStr.c_str(), NULL, 10);
+}
+
+static int parseData(char *buff, int dataSize, char *outBuff,
+                     int outBuffSize) {
+  std::string inputString = std::string(buff);
+  size_t pos = inputString.find("\r\n\r\n");
+  if (pos == std::string::npos)
+    return -1;
+  char *dataPos = buff + pos + 4;
+  if ((dataSize < 0) || (dataSize > outBuffSize))
+    return -2;
+  memmove(outBuff, dataPos, dataSize);
+  return dataSize;
+}
+
+// getData() from the response on, body to out
+static int old_get(std::vector<char> &raw, std::vector<char> &resp,
+                   std::vector<char> &chunk, char *out, int outSize) {
+  raw[0] = 0;
+  int n = receiveSocketData(1, raw.data(), raw.size(), resp.data(),
+                            chunk.data(), resp.size());
+  if (n <= 0 || parseResponseCode(raw.data(), n) != 200)
+    return -1;
+  int contentLength = parseContentLength(raw.data(), n);
+  int len = parseData(raw.data(), contentLength, raw.data(), raw.size());
+  if (len < 0 || len >= outSize)
+    return -1;
+  memcpy(out, raw.data(), len);
+  out[len] = 0;
+  return len;
+}
+
+// ---- new parser ----
+
+typedef struct {
+  char *buff;
+  int size;
+  int len;
+} body_sink_t;
+
+// getData() sink
+static int bodyToBuffer(const uint8_t *data, size_t len, void *ctx) {
+  body_sink_t *b = (body_sink_t *)ctx;
+  if (b->len + (int)len >= b->size)
+    return -1;
+  memcpy(b->buff + b->len, data, len);
+  b->len += len;
+  b->buff[b->len] = 0;
+  return len;
+}
+
+// receiveHttp() loop
+static int new_get(char *out, int outSize) {
+  nsonmi_scan_t scan;
+  http_stream_t hs;
+  body_sink_t b = {out, outSize, 0};
+  int res = HTTP_STREAM_MORE;
+  nsonmi_init(&scan, 1);
+  http_stream_init(&hs, bodyToBuffer, &b);
+  while (res == HTTP_STREAM_MORE && uart.pos < uart.len) {
+    if (!uart_available()) {
+      uart_wait();
+      continue;
+    }
+    res = nsonmi_feed(&scan, uart_read(), &hs);
+  }
+  return (res == HTTP_STREAM_DONE && hs.status == 200) ? b.len : -1;
+}
+
+// ---- bench ----
+
+static const char hex[] = "0123456789ABCDEF";
+
+static std::string modem_output(const std::string &body) {
+  std::string http = "HTTP/1.1 200 OK\r\nServer: nginx\r\n"
+                     "Content-Type: application/octet-stream\r\n"
+                     "Content-Length: " +
+                     std::to_string(body.size()) +
+                     "\r\nConnection: close\r\n\r\n" + body;
+  std::string out;
+  for (size_t i = 0; i < http.size(); i += 512) {
+    size_t n = std::min<size_t>(512, http.size() - i);
+    out += "\r\n+NSONMI:1," + std::to_string(n) + ",";
+    for (size_t k = 0; k < n; k++) {
+      out += hex[(uint8_t)http[i + k] >> 4];
+      out += hex[(uint8_t)http[i + k] & 15];
+    }
+    out += "\r\n";
+  }
+  out += "\r\n+NSOCLI: 1\r\n";
+  return out;
+}
+
+static void bench(size_t size, bool buffered, int runs) {
+  std::string body(size, 0);
+  for (auto &c : body) // printable, the old parser works on C strings
+    c = 'a' + rand() % 26;
+  std::string modem = modem_output(body);
+  std::vector<char> out(size + 1), raw(modem.size() + 1), resp(size + 1024),
+      chunk(size + 1024);
+  std::vector<double> t_old, t_new;
+  unsigned long a_old = 0, a_new = 0, b_old = 0;
+
+  for (int r = 0; r < runs; r++) {
+    uart_load(modem, buffered);
+    unsigned long a = allocs, b = allocBytes;
+    double t = now_us();
+    int n = old_get(raw, resp, chunk, out.data(), out.size());
+    t_old.push_back(now_us() - t);
+    a_old = allocs - a;
+    b_old = allocBytes - b;
+    CHECK(n == (int)size && !memcmp(out.data(), body.data(), size));
+
+    memset(out.data(), 0, out.size());
+    uart_load(modem, buffered);
+    a = allocs;
+    t = now_us();
+    n = new_get(out.data(), out.size());
+    t_new.push_back(now_us() - t);
+    a_new = allocs - a;
+    CHECK(n == (int)size && !memcmp(out.data(), body.data(), size));
+  }
+  std::sort(t_old.begin(), t_old.end());
+  std::sort(t_new.begin(), t_new.end());
+  printf("%6zu %6zu %-9s %8.1f %6lu %10lu %8.1f %6lu\n", size, modem.size(),
+         buffered ? "buffered" : "trickling", t_old[runs / 2], a_old, b_old,
+         t_new[runs / 2], a_new);
+}
+
+int main(void) {
+  printf("%6s %6s %-9s %8s %6s %10s %8s %6s\n", "body", "modem", "uart",
+         "old us", "heap", "heap B", "new us", "heap");
+  for (int buffered = 0; buffered < 2; buffered++) {
+    bench(2048, buffered, 101);
+    bench(65536, buffered, 11);
+  }
+  if (failed) {
+    printf("%d checks failed\n", failed);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
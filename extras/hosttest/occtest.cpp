@@ -0,0 +1,327 @@
+/* Host test of the occupancy time series of src/occseries.cpp.
+
+occseries.cpp is compiled as is. Minutes are closed the way occ_tick() in
+src/occupancy.cpp does it, with MACs hashed by occ_hash() and a key that
+changes every hour. Checked are the ring rollover of all three levels, gaps
+and clock jumps, that minutes hold the exact number of uniques, and that
+quarter hours and hours are downsampled from the minute sketches without
+counting a device twice: their estimate must equal that of one sketch fed
+all samples of the bucket. The estimation error against the exact number of
+uniques is reported.
+
+  g++ -O2 -Wall -I../../include -o occtest occtest.cpp ../../src/occseries.cpp
+  ./occtest
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "occseries.h"
+
+static int failed = 0;
+#define CHECK(c)                                                               \
+  do {                                                                         \
+    if (!(c)) {                                                                \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #c);                      \
+      failed++;                                                                \
+    }                                                                          \
+  } while (0)
+
+static std::mt19937 rng(1);
+static const uint32_t key = 0x5EC12E7;
+static const uint32_t t0 = 1760000000 / 3600 * 60; // minute at a full hour
+
+typedef std::vector<uint64_t> macs_t;
+
+static void mac_bytes(uint64_t id, uint8_t mac[6]) {
+  for (int i = 0; i < 6; i++)
+    mac[i] = id >> (8 * i);
+}
+
+static void add(occ_sketch_t *s, uint8_t type, uint32_t minute,
+                const macs_t &macs) {
+  uint8_t mac[6];
+  for (uint64_t id : macs) {
+    mac_bytes(id, mac);
+    occ_sketch_add(s, type, occ_hash(mac, key ^ (minute / 60)));
+  }
+}
+
+static void add(occ_minute_t *s, uint32_t *set, uint8_t type,
+                uint32_t minute, const macs_t &macs) {
+  uint8_t mac[6];
+  for (uint64_t id : macs) {
+    mac_bytes(id, mac);
+    occ_minute_add(s, set, type, occ_hash(mac, key ^ (minute / 60)));
+  }
+}
+
+static uint16_t at(const occ_series_t *ts, uint8_t level, uint32_t no,
+                   uint8_t type = 0) {
+  uint16_t v[1][OCC_TYPES];
+  occ_series_query(ts, level, no, 1, v);
+  return v[0][type];
+}
+
+static uint32_t set[OCC_MIN_HASHES];
+
+static void open_minute(occ_minute_t *s) {
+  memset(s, 0, sizeof(*s));
+  memset(set, 0, sizeof(set));
+}
+
+// closes a minute with n wifi devices, ids from base on, returns what the
+// minute has to read back
+static uint16_t close_n(occ_series_t *ts, uint32_t minute, int n,
+                        uint64_t base = 0) {
+  occ_minute_t s;
+  open_minute(&s);
+  macs_t m;
+  for (int i = 0; i < n; i++)
+    m.push_back(base + i);
+  add(&s, set, 0, minute, m);
+  CHECK(occ_series_close(ts, minute, &s));
+  return n;
+}
+
+static void test_rollover(void) {
+  static occ_series_t ts;
+  occ_series_reset(&ts);
+
+  // empty series reads as no data
+  CHECK(at(&ts, occ_minute, t0) == OCC_NODATA);
+
+  // 8 days of minutes, every minute its own count 1..20
+  uint32_t days = 8 * 24 * 60;
+  std::map<uint32_t, uint16_t> want;
+  for (uint32_t m = t0; m < t0 + days; m++)
+    want[m] = close_n(&ts, m, 1 + m % 20, (uint64_t)m << 8);
+  uint32_t last = t0 + days - 1;
+  CHECK(ts.last[occ_minute] == last);
+  CHECK(ts.last[occ_quarter] == last / 15);
+  CHECK(ts.last[occ_hour] == last / 60);
+
+  // minutes: exactly the last 180 are kept
+  CHECK(at(&ts, occ_minute, last) == want[last]);
+  CHECK(at(&ts, occ_minute, last - OCC_MIN_SLOTS + 1) ==
+        want[last - OCC_MIN_SLOTS + 1]);
+  CHECK(at(&ts, occ_minute, last - OCC_MIN_SLOTS) == OCC_NODATA);
+  CHECK(at(&ts, occ_minute, last + 1) == OCC_NODATA);
+
+  // quarters and hours: the last 96 and 168 are kept
+  CHECK(at(&ts, occ_quarter, last / 15) != OCC_NODATA);
+  CHECK(at(&ts, occ_quarter, last / 15 - OCC_QH_SLOTS + 1) != OCC_NODATA);
+  CHECK(at(&ts, occ_quarter, last / 15 - OCC_QH_SLOTS) == OCC_NODATA);
+  CHECK(at(&ts, occ_hour, last / 60 - OCC_HOUR_SLOTS + 1) != OCC_NODATA);
+  CHECK(at(&ts, occ_hour, last / 60 - OCC_HOUR_SLOTS) == OCC_NODATA);
+
+  // a query across the end of the ring
+  uint16_t v[OCC_MIN_SLOTS + 4][OCC_TYPES];
+  occ_series_query(&ts, occ_minute, last - OCC_MIN_SLOTS - 1, 184, v);
+  CHECK(v[0][0] == OCC_NODATA && v[1][0] == OCC_NODATA);
+  for (int i = 2; i < 182; i++)
+    CHECK(v[i][0] == want[last - OCC_MIN_SLOTS - 1 + i]);
+  CHECK(v[182][0] == OCC_NODATA && v[183][0] == OCC_NODATA);
+
+  // same or older minute is refused
+  occ_minute_t s;
+  open_minute(&s);
+  CHECK(!occ_series_close(&ts, last, &s));
+  CHECK(!occ_series_close(&ts, last - 10, &s));
+  CHECK(ts.last[occ_minute] == last);
+
+  // device off for 50 minutes: they read as no data, the minutes before and
+  // after hold counts. The quarter with the restart holds its few minutes
+  uint32_t back = last + 51;
+  uint16_t n = close_n(&ts, back, 7, 1ULL << 40);
+  for (uint32_t m = last + 1; m < back; m++)
+    CHECK(at(&ts, occ_minute, m) == OCC_NODATA);
+  CHECK(at(&ts, occ_minute, back) == n);
+  CHECK(at(&ts, occ_minute, last) == want[last]);
+  for (uint32_t q = last / 15 + 1; q < back / 15; q++)
+    CHECK(at(&ts, occ_quarter, q) == OCC_NODATA);
+  CHECK(ts.openNo[occ_quarter] == back / 15);
+
+  // forward jump of more than the ring: everything else is no data
+  uint32_t jump = back + 10 * 24 * 60;
+  n = close_n(&ts, jump, 3, 1ULL << 41);
+  CHECK(at(&ts, occ_minute, jump) == n);
+  CHECK(at(&ts, occ_minute, jump - 1) == OCC_NODATA);
+  CHECK(at(&ts, occ_minute, jump - OCC_MIN_SLOTS + 1) == OCC_NODATA);
+  // the interrupted hour was closed with what it had, the hour of the jump
+  // is still open
+  CHECK(at(&ts, occ_hour, back / 60) != OCC_NODATA);
+  CHECK(ts.last[occ_hour] == back / 60 && ts.openNo[occ_hour] == jump / 60);
+  CHECK(at(&ts, occ_hour, jump / 60) == OCC_NODATA);
+  close_n(&ts, jump + 60, 3, 1ULL << 41);
+  CHECK(at(&ts, occ_hour, jump / 60) != OCC_NODATA);
+  CHECK(at(&ts, occ_hour, jump / 60 - 1) == OCC_NODATA);
+  CHECK(at(&ts, occ_hour, back / 60) == OCC_NODATA); // out of the ring
+
+  // clock set back by more than the minute ring: series starts over
+  uint32_t past = jump - 2 * OCC_MIN_SLOTS;
+  n = close_n(&ts, past, 4, 1ULL << 42);
+  CHECK(ts.last[occ_minute] == past);
+  CHECK(at(&ts, occ_minute, past) == n);
+  CHECK(at(&ts, occ_minute, jump) == OCC_NODATA);
+}
+
+// a population where a share of the devices stays the whole hour, the rest
+// passes by within a few minutes
+static void test_downsampling(void) {
+  static occ_series_t ts;
+  occ_series_reset(&ts);
+
+  const int hours = 24;
+  const int levels[] = {occ_quarter, occ_hour};
+  double err[OCC_LEVELS] = {0}, worst[OCC_LEVELS] = {0};
+  int buckets[OCC_LEVELS] = {0};
+  uint64_t next = 1;
+
+  for (int h = 0; h < hours; h++) {
+    int residents = 5 + rng() % 200, passing = 1 + rng() % 40;
+    macs_t res;
+    for (int i = 0; i < residents; i++)
+      res.push_back(next++);
+
+    occ_sketch_t direct[OCC_LEVELS];
+    std::set<uint64_t> exact[OCC_LEVELS][OCC_TYPES];
+    memset(direct, 0, sizeof(direct));
+
+    for (int mi = 0; mi < 60; mi++) {
+      uint32_t m = t0 + h * 60 + mi;
+      occ_minute_t s;
+      open_minute(&s);
+      size_t uniq[OCC_TYPES];
+      for (uint8_t t = 0; t < OCC_TYPES; t++) {
+        macs_t seen;
+        for (uint64_t id : res)
+          if (rng() % 3) // residents are not seen every minute
+            seen.push_back(id ^ ((uint64_t)t << 56));
+        for (int i = 0; i < passing; i++)
+          seen.push_back((next + rng() % (passing * 3)) ^
+                         ((uint64_t)t << 56));
+        add(&s, set, t, m, seen);
+        uniq[t] = std::set<uint64_t>(seen.begin(), seen.end()).size();
+        for (int l : levels) {
+          add(&direct[l], t, m, seen);
+          exact[l][t].insert(seen.begin(), seen.end());
+        }
+      }
+      next += passing / 2;
+      CHECK(occ_series_close(&ts, m, &s));
+      for (uint8_t t = 0; t < OCC_TYPES; t++)
+        CHECK(at(&ts, occ_minute, m, t) == uniq[t]);
+
+      for (int l : levels) {
+        if ((m + 1) % occ_level_min[l])
+          continue;
+        uint32_t no = m / occ_level_min[l];
+        CHECK(ts.last[l] == no);
+        for (uint8_t t = 0; t < OCC_TYPES; t++) {
+          // merged minute sketches equal one sketch of all samples
+          uint16_t got = at(&ts, l, no, t);
+          CHECK(got == occ_sketch_estimate(&direct[l], t));
+          double e = fabs((double)got - exact[l][t].size()) /
+                     exact[l][t].size();
+          err[l] += e;
+          if (e > worst[l])
+            worst[l] = e;
+          buckets[l]++;
+          // a sum of minutes would count residents up to 60 times
+          CHECK(e < 0.35);
+          exact[l][t].clear();
+        }
+        memset(&direct[l], 0, sizeof(direct[l]));
+      }
+    }
+  }
+
+  for (int l : levels)
+    printf("%-8s %3d buckets, mean error %.1f%%, worst %.1f%%\n",
+           l == occ_quarter ? "quarter" : "hour", buckets[l],
+           100 * err[l] / buckets[l], 100 * worst[l]);
+}
+
+// minutes count exactly what was seen, repeats once, the same MAC once per
+// type. A minute over the hash set stores at least what it could count
+static void test_minute_exact(void) {
+  static occ_series_t ts;
+  occ_series_reset(&ts);
+  occ_minute_t s;
+  uint32_t m = t0 + 7;
+
+  open_minute(&s);
+  macs_t a, b;
+  for (int i = 0; i < 300; i++)
+    a.push_back(rng());
+  for (int i = 0; i < 40; i++)
+    b.push_back(a[i]);
+  for (int rep = 0; rep < 5; rep++)
+    add(&s, set, 0, m, a);
+  add(&s, set, 1, m, b);
+  add(&s, set, 2, m, b);
+  add(&s, set, 1, m, b);
+  CHECK(!s.full && s.used == 380);
+  CHECK(occ_series_close(&ts, m, &s));
+  CHECK(at(&ts, occ_minute, m, 0) == 300);
+  CHECK(at(&ts, occ_minute, m, 1) == 40);
+  CHECK(at(&ts, occ_minute, m, 2) == 40);
+
+  // up to 3/4 of the set exact, then a lower bound
+  const int cap = OCC_MIN_HASHES / 4 * 3;
+  for (int n : {cap, cap + 1, 2000}) {
+    open_minute(&s);
+    macs_t c;
+    for (int i = 0; i < n; i++)
+      c.push_back(((uint64_t)n << 32) + i);
+    add(&s, set, 0, ++m, c);
+    add(&s, set, 0, m, c);
+    CHECK(s.full == (n > cap));
+    CHECK(occ_series_close(&ts, m, &s));
+    uint16_t v = at(&ts, occ_minute, m);
+    if (n <= cap)
+      CHECK(v == n);
+    else
+      CHECK(v >= cap && v == std::max<uint16_t>(
+                                  cap, occ_sketch_estimate(&s.sketch, 0)));
+    printf("minute of %4d uniques reads %u%s\n", n, v,
+           s.full ? ", hash set full" : "");
+  }
+}
+
+// linear counting range, where most buckets of a paxcounter are
+static void test_small_counts(void) {
+  int off = 0, worst = 0;
+  for (int n = 0; n <= 60; n++) {
+    occ_sketch_t s;
+    memset(&s, 0, sizeof(s));
+    macs_t m;
+    for (int i = 0; i < n; i++)
+      m.push_back(rng());
+    add(&s, 1, t0, m);
+    int e = occ_sketch_estimate(&s, 1);
+    CHECK(abs(e - n) <= 2 + n / 4);
+    off += e != n;
+    worst = std::max(worst, abs(e - n));
+  }
+  printf("counts 0..60: %d of 61 not exact, worst off by %d\n", off, worst);
+}
+
+int main(void) {
+  printf("series %u bytes, HLL %d registers per type\n",
+         (unsigned)sizeof(occ_series_t), OCC_REGS);
+  test_rollover();
+  test_downsampling();
+  test_minute_exact();
+  test_small_counts();
+  printf(failed ? "FAILED %d\n" : "ok\n", failed);
+  return failed != 0;
+}
@@ -0,0 +1,360 @@
+/* Host model of the I2C bus time the OLED refresh of src/display.cpp takes,
+before and after frames are compared against a shadow of the panel.
+
+display.cpp needs OneBitDisplay, LMIC and the sensors, so it is not linked.
+The model replays both refresh paths instead, each called every
+DISPLAYREFRESH_MS like the display timer does:
+- old: under the mutex the page is drawn and the whole back buffer dumped.
+  A page flip clears with render on, and the pax graph page dumps plotbuf
+  in addition.
+- new: dp_refresh() as it is now, with the idle rate, the compare against
+  the shadow, and dumps of the changed blocks only.
+Pages are drawn like dp_drawPage() for a board with LoRa and a battery,
+without GPS and BME, with text in the font sizes of OneBitDisplay. Glyphs
+are made up but distinct per character. The data changes like on a
+device: seconds tick, a new device is counted every few seconds, and every
+SENDCYCLE * 2 s the counters reset and a LoRa uplink goes out.
+
+Wire cost follows obdDumpBuffer(): per 8 pixel row, blocks of 16 bytes
+are sent if they differ from the back buffer, or all of them if the back
+buffer is dumped itself. A block is written as 0x40 plus 16 data bytes.
+Each run of blocks starts with obdSetPosition(), three commands of 0x00
+plus the command byte. Every byte takes 9 clocks on the bus, start and
+stop of a transfer take 2 more. Clock is OLED_FREQUENCY. A refresh taking
+longer than DISPLAYREFRESH_MS delays the next one.
+
+  g++ -O2 -Wall -o oledmodel oledmodel.cpp
+  ./oledmodel [minutes]
+*/
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+static int failed = 0;
+#define CHECK(c)                                                               \
+  do {                                                                         \
+    if (!(c)) {                                                                \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #c);                      \
+      failed++;                                                                \
+    }                                                                          \
+  } while (0)
+
+// src/paxcounter.conf, include/display.h
+#define DISPLAYREFRESH_MS 40
+#define DISPLAYIDLE_FRAMES 5
+#define DISPLAYIDLE_MS 250
+#define DISPLAYCYCLE 3
+#define DISPLAY_PAGES 7
+#define SENDCYCLE 30
+#define WIFI_CHANNEL_SWITCH_INTERVAL 50 // [s/100]
+#define OLED_FREQUENCY 400000L
+#define W 128
+#define H 64
+#define FB (W * H / 8)
+
+enum { FONT_SMALL, FONT_NORMAL, FONT_LARGE, FONT_STRETCHED };
+
+// ---- bus ----
+
+static struct {
+  uint64_t clocks, takes, refreshes;
+} bus;
+
+static void i2c_write(int bytes) { bus.clocks += bytes * 9 + 2; }
+
+// obdDumpBuffer(), back is the back buffer of the library
+static void obd_dump(const uint8_t *buf, const uint8_t *back) {
+  for (int y = 0; y < H / 8; y++) {
+    bool needPos = true;
+    for (int x = 0; x < W / 16; x++) {
+      int i = y * W + x * 16;
+      if (buf == back || memcmp(buf + i, back + i, 16)) {
+        if (needPos) {
+          for (int c = 0; c < 3; c++)
+            i2c_write(1 + 2); // address, 0x00, command
+          needPos = false;
+        }
+        i2c_write(1 + 1 + 16); // address, 0x40, data
+      } else
+        needPos = true;
+    }
+  }
+}
+
+// ---- frame composer ----
+
+static uint8_t displaybuf[FB], plotbuf[FB], shadow[FB];
+static int curX, curRow, page;
+
+// statics of dp_refresh() and dp_plotCurve()
+static struct {
+  uint32_t framecounter, pageSince, frameSince;
+  uint8_t unchanged;
+  bool shadowValid;
+  int lastCount, col;
+} st;
+
+static void text(int font, bool inv, const char *s) {
+  static const int width[] = {6, 8, 16, 16}, rows[] = {1, 1, 4, 2};
+  for (; *s; s++) {
+    for (int col = 0; col < width[font]; col++, curX++) {
+      if (curX >= W)
+        return;
+      for (int r = 0; r < rows[font] && curRow + r < H / 8; r++) {
+        uint8_t g = (*s == ' ') ? 0
+                                : (uint8_t)((*s * 37 + col * 11 + r * 5) | 1);
+        if (col == width[font] - 1)
+          g = 0; // spacing
+        displaybuf[(curRow + r) * W + curX] = inv ? ~g : g;
+      }
+    }
+  }
+}
+
+static void at(int x, int row) {
+  curX = x;
+  curRow = row;
+}
+
+static void printf_at(int font, bool inv, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+static void printf_at(int font, bool inv, const char *fmt, ...) {
+  char s[64];
+  va_list a;
+  va_start(a, fmt);
+  vsnprintf(s, sizeof(s), fmt, a);
+  va_end(a);
+  text(font, inv, s);
+}
+
+// ---- device state ----
+
+static struct {
+  uint32_t ms;
+  int wifi, ble, mem, fup;
+  bool tick; // TimePulseTick
+  const char *event;
+} dev;
+
+static void dev_init(void) {
+  memset(&dev, 0, sizeof(dev));
+  dev.mem = 142;
+  dev.event = "EV_JOINED";
+  srand(1);
+}
+
+// advances the device by one refresh period
+static void dev_step(void) {
+  uint32_t before = dev.ms;
+  dev.ms += DISPLAYREFRESH_MS;
+  bool second = dev.ms / 1000 != before / 1000;
+  if (second) {
+    dev.tick = true;
+    // a new device every 4 s on average, wifi twice as likely
+    if (rand() % 4 == 0)
+      (rand() % 3) ? dev.wifi++ : dev.ble++;
+    uint32_t s = dev.ms / 1000;
+    if (s % (SENDCYCLE * 2) == 0) {
+      dev.wifi = dev.ble = 0;
+      dev.fup++;
+      dev.event = "EV_TXSTART";
+    } else if (s % (SENDCYCLE * 2) == 2)
+      dev.event = "EV_TXCOMPLETE";
+    if (s % 20 == 0)
+      dev.mem = 140 + rand() % 4;
+  }
+}
+
+// dp_plotCurve(), one column per count cycle
+static void plot(void) {
+  int count = dev.wifi + dev.ble, row;
+  if (count == st.lastCount)
+    return;
+  if (count < st.lastCount) {
+    st.col = (st.col + 1) % W;
+  } else if (st.lastCount >= 0) {
+    row = H - 1 - st.lastCount;
+    plotbuf[(row / 8) * W + st.col] &= ~(1 << (row & 7));
+  }
+  st.lastCount = count;
+  row = std::max(0, H - 1 - count);
+  plotbuf[(row / 8) * W + st.col] |= 1 << (row & 7);
+}
+
+// dp_drawPage(), returns true if the old path dumps plotbuf too
+static bool draw_page(bool nextPage, bool oldClear) {
+  uint32_t s = dev.ms / 1000 + 12 * 3600 + 34 * 60;
+
+  if (nextPage) {
+    page = (page >= DISPLAY_PAGES - 1) ? 0 : page + 1;
+    memset(displaybuf, 0, FB);
+    if (oldClear) // obdFill() with render on
+      obd_dump(displaybuf, displaybuf);
+  }
+  at(0, 0);
+  if (page < 5)
+    printf_at(FONT_STRETCHED, false, "PAX:%-4d", dev.wifi + dev.ble);
+
+  switch (page) {
+  case 0:
+    at(0, 3);
+    printf_at(FONT_SMALL, false, "WIFI:%-5d BLTH:%-5d", dev.wifi, dev.ble);
+    at(0, 4);
+    printf_at(FONT_SMALL, false, "B:%3d%%  ", 87);
+    printf_at(FONT_SMALL, false, "        ch:%02d",
+              1 + (dev.ms / (WIFI_CHANNEL_SWITCH_INTERVAL * 10)) % 13);
+    at(0, 5);
+    printf_at(FONT_SMALL, false, "RLIM:off   Mem:%4dKB", dev.mem);
+    at(0, 6);
+    printf_at(FONT_SMALL, false, "19.Oct 2026 %02u:%02u:%02u%c",
+              s / 3600 % 24, s / 60 % 60, s % 60, dev.tick ? ' ' : '*');
+    dev.tick = false;
+    at(0, 7);
+    printf_at(FONT_SMALL, false, "%-16s", dev.event);
+    printf_at(FONT_SMALL, true, " %-4s", "SF7");
+    break;
+  case 1:
+    at(0, 3);
+    printf_at(FONT_SMALL, false, "NetwID:000013 TXpw:14");
+    at(0, 4);
+    printf_at(FONT_SMALL, false, "DevAdd:260B1234 DR:5");
+    at(0, 5);
+    printf_at(FONT_SMALL, false, "ChMsk:00FF Nonce:0003");
+    at(0, 6);
+    printf_at(FONT_SMALL, false, "fUp:%-6d fDn:%-6d", dev.fup, 0);
+    at(0, 7);
+    printf_at(FONT_SMALL, false, "SNR:%-5d  RSSI:%-5d", 9, -87);
+    break;
+  case 2: // no GPS
+    page++;
+    // fall through
+  case 3: // no BME
+    page++;
+    // fall through
+  case 4:
+    at(0, 4);
+    printf_at(FONT_LARGE, false, "%02u:%02u:%02u", s / 3600 % 24, s / 60 % 60,
+              s % 60);
+    break;
+  case 5:
+    if (!oldClear)
+      memcpy(displaybuf, plotbuf, FB);
+    at(0, 0);
+    printf_at(FONT_NORMAL, false, "Pax graph");
+    return oldClear;
+  case 6: // no button
+    page++;
+  }
+  return false;
+}
+
+// ---- refresh paths ----
+
+static bool button; // board with a button stays on its page
+
+// dp_refresh() before, mutex held for the whole refresh
+static void refresh_old(void) {
+  bool nextPage = false;
+
+  plot();
+  bus.takes++;
+  if (!button && (++st.framecounter) > (DISPLAYCYCLE * 1000 / DISPLAYREFRESH_MS)) {
+    st.framecounter = 0;
+    nextPage = true;
+  }
+  bus.refreshes++;
+  if (draw_page(nextPage, true))
+    obd_dump(plotbuf, displaybuf);
+  obd_dump(displaybuf, displaybuf);
+}
+
+// dp_refresh() now
+static void refresh_new(void) {
+  bool nextPage = false;
+
+  plot();
+  if (!button && (dev.ms - st.pageSince >= DISPLAYCYCLE * 1000UL)) {
+    st.pageSince = dev.ms;
+    nextPage = true;
+  }
+  if (!nextPage && (st.unchanged >= DISPLAYIDLE_FRAMES) &&
+      (dev.ms - st.frameSince < DISPLAYIDLE_MS))
+    return;
+  st.frameSince = dev.ms;
+
+  draw_page(nextPage, false);
+  bus.refreshes++;
+  bool changed = !st.shadowValid || memcmp(displaybuf, shadow, FB);
+  if (changed)
+    st.unchanged = 0;
+  else if (st.unchanged < 255)
+    st.unchanged++;
+  if (!changed)
+    return;
+
+  bus.takes++;
+  obd_dump(displaybuf, st.shadowValid ? shadow : displaybuf);
+  memcpy(shadow, displaybuf, FB);
+  st.shadowValid = true;
+}
+
+struct result_t {
+  double busy, fps, takes;
+};
+
+static result_t run(void (*refresh)(void), uint32_t minutes) {
+  memset(&bus, 0, sizeof(bus));
+  memset(displaybuf, 0, FB);
+  memset(plotbuf, 0, FB);
+  dev_init();
+  page = 0;
+  memset(&st, 0, sizeof(st));
+  st.lastCount = -1;
+  uint32_t end = minutes * 60000, ticks = 0;
+  double busyUntil = 0; // [ms]
+  while (dev.ms < end) {
+    dev_step();
+    ticks++;
+    // the display task is still on the previous refresh, tick is lost
+    if (dev.ms < busyUntil)
+      continue;
+    uint64_t before = bus.clocks;
+    refresh();
+    busyUntil = dev.ms + (bus.clocks - before) * 1000.0 / OLED_FREQUENCY;
+  }
+  result_t r;
+  r.busy = bus.clocks * 1000.0 / OLED_FREQUENCY / end;
+  r.fps = bus.refreshes * 1000.0 / end;
+  r.takes = bus.takes * 1000.0 / end;
+  return r;
+}
+
+int main(int argc, char **argv) {
+  uint32_t minutes = (argc > 1) ? strtoul(argv[1], NULL, 10) : 10;
+
+  printf("%-22s %-4s %11s %8s %11s\n", "board", "path", "i2c busy", "frames/s",
+         "mutex/s");
+  for (int b = 0; b < 2; b++) {
+    button = b;
+    const char *name = b ? "button, page 0" : "no button, page flips";
+    result_t o = run(refresh_old, minutes);
+    result_t n = run(refresh_new, minutes);
+    printf("%-22s %-4s %10.2f%% %8.1f %11.1f\n", name, "old", o.busy * 100,
+           o.fps, o.takes);
+    printf("%-22s %-4s %10.2f%% %8.1f %11.1f\n", name, "new", n.busy * 100,
+           n.fps, n.takes);
+    CHECK(n.busy < o.busy / 10);
+    CHECK(n.takes < o.takes);
+  }
+  if (failed) {
+    printf("%d checks failed\n", failed);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
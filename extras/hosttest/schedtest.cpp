@@ -0,0 +1,361 @@
+/* Host test of the timer wheel scheduler of src/scheduler.cpp.
+
+scheduler.cpp is compiled as is against stub/, the worker task of one core
+runs on a virtual clock: ulTaskNotifyTake() advances the clock to the end of
+the sleep, or to the next event of the test script, and ends the run by
+throwing once the test time is over. A job callback may take virtual run
+time. Checked are: runs start in the order of their nominal due times, due
+times stay phase locked to the job start over days (no drift from run time
+or lateness), lateness stays below one tick, jitter tolerant jobs are
+coalesced into occupied slots within their tolerance, overruns skip periods
+instead of piling up, trigger, period change and stop, long periods on the
+upper wheels, and a wrap of the 32 bit tick counter. Worker wakeups per
+hour are reported with and without jitter tolerance.
+
+  g++ -O2 -Wall -Istub -I../../include -include stub/globals.h \
+      -o schedtest schedtest.cpp ../../src/scheduler.cpp
+  ./schedtest [-v]
+*/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "scheduler.h"
+
+int host_verbose = 0;
+
+static int failed = 0;
+#define CHECK(c)                                                               \
+  do {                                                                         \
+    if (!(c)) {                                                                \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #c);                      \
+      failed++;                                                                \
+    }                                                                          \
+  } while (0)
+
+// ---- virtual clock and worker ----
+
+static int64_t now_us;
+static int64_t end_us;
+static bool notified;
+static uint32_t wakeups;
+static TaskFunction_t worker[portNUM_PROCESSORS];
+static void *workerParam[portNUM_PROCESSORS];
+
+static std::multimap<int64_t, std::function<void(void)>> script;
+
+struct end_of_test {};
+
+int64_t esp_timer_get_time(void) { return now_us; }
+
+BaseType_t mem_task_create(mem_id_t, TaskFunction_t fn, void *param,
+                           uint32_t, TaskHandle_t *handle,
+                           BaseType_t core) {
+  worker[core] = fn;
+  workerParam[core] = param;
+  *handle = (TaskHandle_t)&worker[core];
+  return pdPASS;
+}
+
+void xTaskNotifyGive(TaskHandle_t) { notified = true; }
+
+uint32_t ulTaskNotifyTake(BaseType_t, TickType_t wait) {
+  int64_t until = now_us + (int64_t)wait * 1000;
+  wakeups++;
+  if (notified) {
+    notified = false;
+    return 1;
+  }
+  // script events in the sleep wake the worker if they notify it
+  while (!script.empty() && script.begin()->first <= until &&
+         script.begin()->first <= end_us) {
+    auto ev = script.begin();
+    if (ev->first > now_us)
+      now_us = ev->first;
+    auto fn = ev->second;
+    script.erase(ev);
+    fn();
+    if (notified) {
+      notified = false;
+      return 1;
+    }
+  }
+  if (until >= end_us)
+    throw end_of_test();
+  now_us = until;
+  return 0;
+}
+
+static void at(double s, std::function<void(void)> fn) {
+  script.emplace(now_us + (int64_t)(s * 1e6), fn);
+}
+
+// runs the worker for s seconds and half a tick, so runs due at s are in
+static double run_len;
+static void run_for(double s, BaseType_t core = 1) {
+  run_len = s + SCHED_TICK_MS / 2000.0;
+  end_us = now_us + (int64_t)(run_len * 1e6);
+  wakeups = 0;
+  try {
+    worker[core](workerParam[core]);
+  } catch (end_of_test &) {
+  }
+  script.clear();
+}
+
+static void start(int64_t t_us = 1000000) {
+  now_us = t_us;
+  notified = false;
+  script.clear();
+  for (int i = 0; i < portNUM_PROCESSORS; i++)
+    worker[i] = NULL;
+  sched_init();
+}
+
+// ---- jobs ----
+
+#define JOBS 8
+
+struct log_t {
+  int job;
+  int64_t t_us;
+};
+static std::vector<log_t> runlog;
+static int64_t runtime_us[JOBS]; // virtual run time per call
+static int selfTrigger = -1;     // job id which retriggers itself once
+
+template <int N> static void job(void) {
+  runlog.push_back({N, now_us});
+  now_us += runtime_us[N];
+  if (now_us >= end_us) // worker is busy and does not sleep any more
+    throw end_of_test();
+  if (selfTrigger == N) {
+    selfTrigger = -1;
+    sched_trigger(N, 250);
+  }
+}
+static const sched_fn_t fns[JOBS] = {job<0>, job<1>, job<2>, job<3>,
+                                     job<4>, job<5>, job<6>, job<7>};
+
+static int add(int n, uint32_t period_ms, uint32_t jitter_ms,
+               int64_t runtime = 0) {
+  static const char *names[JOBS] = {"j0", "j1", "j2", "j3",
+                                    "j4", "j5", "j6", "j7"};
+  runtime_us[n] = runtime;
+  int id = sched_add(names[n], fns[n], period_ms, jitter_ms, 1);
+  CHECK(id == n);
+  return id;
+}
+
+static std::vector<int64_t> runs_of(int n) {
+  std::vector<int64_t> t;
+  for (auto &r : runlog)
+    if (r.job == n)
+      t.push_back(r.t_us);
+  return t;
+}
+
+// runs of a job with period p in the last run_for(), a run due within slack
+// of the end may be cut off
+static bool runs_ok(size_t runs, uint32_t period_ms, int64_t slack_us) {
+  size_t hi = (size_t)(run_len * 1000 / period_ms);
+  size_t lo = (size_t)((run_len * 1e6 - SCHED_TICK_MS * 1000 - slack_us) /
+                       (period_ms * 1000.0));
+  return runs >= lo && runs <= hi;
+}
+
+// every run k of a job started at t0 with period p, no jitter, starts in
+// [t0 + k p, t0 + k p + one tick + slack)
+static void check_phase(int n, int64_t t0, uint32_t period_ms,
+                        int64_t slack_us) {
+  std::vector<int64_t> t = runs_of(n);
+  CHECK(runs_ok(t.size(), period_ms, slack_us));
+  int64_t worst = 0;
+  for (size_t k = 0; k < t.size(); k++) {
+    int64_t late = t[k] - (t0 + (int64_t)(k + 1) * period_ms * 1000);
+    CHECK(late >= 0);
+    worst = std::max(worst, late);
+  }
+  CHECK(worst < SCHED_TICK_MS * 1000 + slack_us);
+  if (host_verbose)
+    printf("  job %d: %zu runs, worst lateness %.1f ms\n", n, t.size(),
+           worst / 1e3);
+}
+
+// ---- tests ----
+
+static void test_order_and_drift(void) {
+  start();
+  runlog.clear();
+  int64_t t0 = now_us;
+  // periods not multiples of each other, callbacks take run time
+  add(0, 1000, 0, 30000);
+  add(1, 300, 0, 5000);
+  add(2, 700, 0, 0);
+  add(3, 60000, 0, 80000);
+  run_for(24 * 3600);
+
+  // phase locked: run k of each job still starts within a tick of its
+  // nominal due time after a day, although every run takes time
+  check_phase(0, t0, 1000, 120000);
+  check_phase(1, t0, 300, 120000);
+  check_phase(2, t0, 700, 120000);
+  check_phase(3, t0, 60000, 120000);
+
+  // runs of one wheel step are run in the order of their due ticks, and
+  // across steps never before an earlier due run
+  std::map<int, int> count;
+  int64_t prevDue = 0;
+  const uint32_t period[] = {1000, 300, 700, 60000};
+  for (auto &r : runlog) {
+    int k = ++count[r.job];
+    int64_t due = t0 + (int64_t)k * period[r.job] * 1000;
+    int64_t dueTick = due / (SCHED_TICK_MS * 1000);
+    CHECK(dueTick >= prevDue);
+    prevDue = dueTick;
+  }
+  for (int n = 0; n < 4; n++) {
+    const sched_stats_t *s = sched_get_stats(n, NULL);
+    CHECK(s->skipped == 0);
+    CHECK(s->lateMax_ms < SCHED_TICK_MS + 120);
+  }
+}
+
+static void test_coalescing(void) {
+  uint32_t plain, tolerant;
+
+  // two jobs whose periods rarely meet
+  for (int tol = 0; tol < 2; tol++) {
+    start();
+    runlog.clear();
+    int64_t t0 = now_us;
+    add(0, 1000, 0);
+    add(1, 1300, tol ? 600 : 0);
+    add(2, 4100, tol ? 2000 : 0);
+    run_for(3600);
+    (tol ? tolerant : plain) = wakeups;
+
+    const uint32_t period[] = {1000, 1300, 4100};
+    const uint32_t jitter[] = {0, 600, 2000};
+    std::map<int, int> count;
+    for (auto &r : runlog) {
+      int k = ++count[r.job];
+      int64_t due = t0 + (int64_t)k * period[r.job] * 1000;
+      // never early, late at most by the tolerance and one tick
+      CHECK(r.t_us >= due);
+      CHECK(r.t_us - due <
+            (int64_t)(tol ? jitter[r.job] : 0) * 1000 + SCHED_TICK_MS * 1000);
+    }
+    for (int n = 0; n < 3; n++)
+      CHECK(runs_ok(count[n], period[n], tol ? jitter[n] * 1000 : 0));
+  }
+  printf("worker wakeups per hour: %u without, %u with jitter tolerance\n",
+         plain, tolerant);
+  CHECK(tolerant < plain * 3 / 4);
+}
+
+static void test_overrun(void) {
+  start();
+  runlog.clear();
+  // 100 ms period, each run takes 350 ms: periods are skipped, the job is
+  // not run back to back to catch up
+  add(0, 100, 0, 350000);
+  run_for(60);
+  std::vector<int64_t> t = runs_of(0);
+  const sched_stats_t *s = sched_get_stats(0, NULL);
+  CHECK(t.size() >= 140 && t.size() <= 160);
+  for (size_t k = 1; k < t.size(); k++)
+    CHECK(t[k] - t[k - 1] >= 350000 && t[k] - t[k - 1] <= 500000);
+  CHECK(s->skipped >= 3 * (t.size() - 1) && s->skipped <= 4 * t.size());
+}
+
+static void test_control(void) {
+  start();
+  runlog.clear();
+  int64_t t0 = now_us;
+  add(0, 10000, 0);
+  add(1, 10000, 0);
+  add(2, 0, 0); // trigger only
+
+  // trigger j0 after 2.5 s: runs then and continues its period from there
+  at(2.5 - 1e-3, [] { sched_trigger(0, 0); });
+  // j1 gets a period of 4 s at 15 s, first run one period later
+  at(15, [] { sched_set_period(1, 4000); });
+  // j2 one shot at 7 s and 33 s, and j1 stopped at 30 s
+  at(7 - 0.3, [] { sched_trigger(2, 300); });
+  at(30, [] { sched_stop(1); });
+  at(33, [] { sched_trigger(2, 0); });
+  run_for(60);
+
+  std::vector<int64_t> a = runs_of(0), b = runs_of(1), c = runs_of(2);
+  auto sec = [&](int64_t t) { return (t - t0) / 1e6; };
+  CHECK(a.size() == 6 && fabs(sec(a[0]) - 2.5) < 0.11 &&
+        fabs(sec(a[1]) - 12.5) < 0.11 && fabs(sec(a[5]) - 52.5) < 0.11);
+  CHECK(b.size() == 4 && fabs(sec(b[0]) - 10) < 0.11 &&
+        fabs(sec(b[1]) - 19) < 0.11 && fabs(sec(b[3]) - 27) < 0.11);
+  CHECK(c.size() == 2 && fabs(sec(c[0]) - 7) < 0.11 &&
+        fabs(sec(c[1]) - 33) < 0.11);
+
+  // a job retriggering itself from its callback runs again after the delay
+  // and keeps its period from there
+  start();
+  runlog.clear();
+  t0 = now_us;
+  add(0, 1000, 0);
+  selfTrigger = 0;
+  run_for(4);
+  a = runs_of(0);
+  CHECK(a.size() == 4 && fabs(sec(a[0]) - 1) < 0.11 &&
+        fabs(sec(a[1]) - 1.3) < 0.11 && fabs(sec(a[2]) - 2.3) < 0.11);
+}
+
+static void test_long_periods(void) {
+  start();
+  runlog.clear();
+  int64_t t0 = now_us;
+  add(0, 30 * 60000, 0);   // second wheel
+  add(1, 2 * 3600000, 0);  // third wheel
+  add(2, 25 * 3600000, 0); // beyond the third wheel, refiled
+  add(3, 25000, 0);
+  run_for(72 * 3600);
+  check_phase(0, t0, 30 * 60000, 0);
+  check_phase(1, t0, 2 * 3600000, 0);
+  check_phase(2, t0, 25 * 3600000, 0);
+  check_phase(3, t0, 25000, 0);
+}
+
+static void test_wrap(void) {
+  // tick counter wraps 10 minutes into the run
+  int64_t wrap = ((int64_t)1 << 32) * SCHED_TICK_MS * 1000;
+  start(wrap - 600 * 1000000LL);
+  runlog.clear();
+  int64_t t0 = now_us;
+  add(0, 1000, 0);
+  add(1, 60000, 500);
+  add(2, 3600000, 0);
+  run_for(2 * 3600);
+  check_phase(0, t0, 1000, 0);
+  check_phase(2, t0, 3600000, 0);
+  CHECK(runs_ok(runs_of(1).size(), 60000, 500000));
+}
+
+int main(int argc, char **) {
+  host_verbose = (argc > 1);
+  test_order_and_drift();
+  test_coalescing();
+  test_overrun();
+  test_control();
+  test_long_periods();
+  test_wrap();
+  if (failed) {
+    printf("%d checks failed\n", failed);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
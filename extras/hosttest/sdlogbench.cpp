@@ -0,0 +1,252 @@
+/* Host bench of the binary TX log of src/sdlog.cpp against the csv lines
+it replaced, and of the src/SdLog/sdlog2csv.py converter.
+
+sdlog.cpp is linked as is against in-memory files, the sd service is the
+bench loop: it commits when sdlog_write() posts its request. Old is
+_sd_log_tx() of lorawan.cpp before the binary log, copied below with
+sdcardWriteLine() down to what it costs the producer, sd_post_line()
+copying the line into a request and the request into the service queue.
+Producer cost is the time in sdlog_write() or _sd_log_tx() per event,
+taken over batches so the clock is not in it, commits and the service
+side of the queue are not. Bytes on card per event are the csv line with
+its newline, and the frames written by sdlog_commit(). The converter is
+run on the written paxbin.00, its output has to equal the old csv lines.
+
+  g++ -O2 -Wall -Istub -I../../include -include stub/globals.h -DHAS_SDCARD \
+      -o sdlogbench sdlogbench.cpp ../../src/sdlog.cpp
+  ./sdlogbench [events] [path of sdlog2csv.py]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "sdcard.h"
+
+static int failed = 0;
+#define CHECK(c)                                                               \
+  do {                                                                         \
+    if (!(c)) {                                                                \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #c);                      \
+      failed++;                                                                \
+    }                                                                          \
+  } while (0)
+
+// ---- platform ----
+
+int host_verbose = 0;
+std::map<std::string, std::string> host_files;
+SDClass mySD;
+
+static uint32_t epoch = 1760000000, ms = 0;
+uint32_t now(void) { return epoch; }
+uint32_t millis(void) { return ms; }
+uint32_t micros(void) { return ms * 1000; }
+bool isSDCardAvailable() { return true; }
+
+static bool logPosted = false;
+static sd_req_t reqQueue[SD_REQ_QUEUE_SIZE];
+static unsigned reqHead = 0;
+
+// xQueueSend() copies the request
+bool sd_post(sd_req_t *req, TickType_t) {
+  if (req->type == sd_req_log)
+    logPosted = true;
+  else
+    memcpy(&reqQueue[reqHead++ % SD_REQ_QUEUE_SIZE], req, sizeof(*req));
+  return true;
+}
+
+// sdcard.cpp
+uint16_t crc16_ccitt(const uint8_t *data, size_t len, uint16_t crc) {
+  while (len--) {
+    crc ^= (uint16_t)(*data++) << 8;
+    for (int i = 0; i < 8; i++) {
+      if (crc & 0x8000) crc = (crc << 1) ^ 0x1021;
+      else crc <<= 1;
+    }
+  }
+  return crc;
+}
+
+// ---- old csv path, lorawan.cpp and sdservice.cpp before the binary log ----
+
+bool sd_post_line(const char *line, sd_done_t done, void *ctx) {
+  sd_req_t req;
+  req.type = sd_req_line;
+  req.done = done;
+  req.ctx = ctx;
+  strncpy(req.u.line, line, sizeof(req.u.line) - 1);
+  req.u.line[sizeof(req.u.line) - 1] = 0;
+  return sd_post(&req, pdMS_TO_TICKS(SD_POST_WAIT_MS));
+}
+
+void sdcardWriteLine(const char *line) { sd_post_line(line, NULL, NULL); }
+
+static void _hex_of_payload(const uint8_t *b, size_t n, char *out, size_t outcap) {
+    size_t p = 0;
+    for (size_t i = 0; i < n && (p + 2) < outcap; i++) {
+        p += snprintf(out + p, outcap - p, "%02X", b[i]);
+    }
+    out[(p < outcap) ? p : (outcap - 1)] = 0;
+}
+
+static void _sd_log_tx(const char *tag, const MessageBuffer_t *m, const char *note) {
+    if (!isSDCardAvailable() || !m) return;
+    // line: TAG,epoch,port,size,HEX[,note]
+    char hex[2 * 256 + 1] = {0}; // ajusta si tu Message[] > 256
+    _hex_of_payload(m->Message, m->MessageSize, hex, sizeof(hex));
+
+    char line[512];
+    snprintf(line, sizeof(line), "%s,%lu,%u,%u,%s%s%s",
+             tag,
+             (unsigned long)now(),
+             (unsigned)m->MessagePort,
+             (unsigned)m->MessageSize,
+             hex,
+             (note && note[0]) ? "," : "",
+             (note && note[0]) ? note : "");
+    sdcardWriteLine(line);
+}
+
+// ---- bench ----
+
+// names of sdlog.h, as the old path wrote them
+static const char *channels[] = {"TX_LORA_OK", "TX_SD_ENQ", "TX_NB_ENQ",
+                                 "TX_SD_ENQ_PURGE"};
+static const char *reasons[] = {"", "NO_JOIN_PENDING", "NO_JOIN_QUEUE",
+                                "PENDING_AGE", "PENDING_AGE_NO_NB",
+                                "BUSY_TIMEOUT", "TOO_LARGE", "TOO_LARGE_NO_NB",
+                                "LMIC_ERROR", "LMIC_ERROR_NO_NB",
+                                "LORA_QUEUE_FULL"};
+
+struct event_t {
+  uint8_t channel, reason;
+  MessageBuffer_t m;
+};
+
+static double now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static std::vector<event_t> make_events(size_t n, size_t size) {
+  std::vector<event_t> ev(n);
+  srand(1);
+  for (auto &e : ev) {
+    // mostly successful sends, the rest spread over the fallbacks
+    e.channel = (rand() % 4) ? SDLOG_TX_LORA_OK : 1 + rand() % 3;
+    e.reason = (e.channel == SDLOG_TX_LORA_OK) ? SDLOG_NONE : 1 + rand() % 10;
+    e.m.MessagePort = 1 + rand() % 9;
+    e.m.MessageSize = size;
+    for (size_t i = 0; i < size; i++)
+      e.m.Message[i] = rand();
+  }
+  return ev;
+}
+
+// time per event of write() over batches of 32, median of the batches
+template <typename F>
+static double producer_ns(const std::vector<event_t> &ev, F write,
+                          void (*service)(void)) {
+  std::vector<double> batches;
+  for (size_t i = 0; i < ev.size(); i += 32) {
+    size_t end = std::min(ev.size(), i + 32);
+    double t = now_ns();
+    for (size_t k = i; k < end; k++)
+      write(ev[k]);
+    batches.push_back((now_ns() - t) / (end - i));
+    service();
+  }
+  std::sort(batches.begin(), batches.end());
+  return batches[batches.size() / 2];
+}
+
+static std::string csv;
+
+static void csv_service(void) {
+  for (unsigned i = 0; i < reqHead; i++)
+    csv += std::string(reqQueue[i].u.line) + "\n";
+  reqHead = 0;
+}
+
+static void log_service(void) {
+  ms += 100;
+  if (logPosted) {
+    logPosted = false;
+    sdlog_commit(SDLOG_FLUSH_MS);
+  }
+}
+
+static void bench(size_t n, size_t size, const char *conv) {
+  std::vector<event_t> ev = make_events(n, size);
+
+  csv.clear();
+  double t_old = producer_ns(
+      ev,
+      [](const event_t &e) {
+        _sd_log_tx(channels[e.channel], &e.m, reasons[e.reason]);
+      },
+      csv_service);
+
+  host_files.clear();
+  sdlog_card_open();
+  double t_new = producer_ns(
+      ev,
+      [](const event_t &e) { sdlog_write(e.channel, e.reason, &e.m); },
+      log_service);
+  sdlog_card_close();
+  const std::string &bin = host_files["paxbin.00"];
+
+  printf("%4zu B payload: producer csv %6.0f ns  binary %4.0f ns, "
+         "card csv %5.1f B  binary %5.1f B per event\n",
+         size, t_old, t_new, (double)csv.size() / n, (double)bin.size() / n);
+  CHECK(t_new < t_old);
+  CHECK(bin.size() < csv.size());
+
+  if (!conv)
+    return;
+  const char *path = "/tmp/sdlogbench.paxbin";
+  FILE *f = fopen(path, "wb");
+  fwrite(bin.data(), 1, bin.size(), f);
+  fclose(f);
+  std::string cmd = std::string("python3 ") + conv + " " + path + " 2>/dev/null";
+  std::string out;
+  char buf[4096];
+  double t = now_ns();
+  FILE *p = popen(cmd.c_str(), "r");
+  CHECK(p != NULL);
+  if (!p)
+    return;
+  size_t k;
+  while ((k = fread(buf, 1, sizeof(buf), p)) > 0)
+    out.append(buf, k);
+  CHECK(pclose(p) == 0);
+  t = (now_ns() - t) / 1e9;
+  printf("%4zu B payload: converter %zu records in %.2f s, %.0f records/s "
+         "incl. python start, output %s the csv lines\n",
+         size, n, t, n / t, out == csv ? "equals" : "DIFFERS from");
+  CHECK(out == csv);
+  remove(path);
+}
+
+int main(int argc, char **argv) {
+  size_t n = (argc > 1) ? strtoul(argv[1], NULL, 10) : 100000;
+  const char *conv = (argc > 2) ? argv[2] : "../../src/SdLog/sdlog2csv.py";
+
+  bench(n, 4, conv);
+  bench(n, 20, conv);
+  bench(n, PAYLOAD_BUFFER_SIZE, conv);
+  if (failed) {
+    printf("%d checks failed\n", failed);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
@@ -0,0 +1,177 @@
+/* Host benchmark of the sliding window of src/slidewin.cpp.
+
+A street where devices arrive, stay a few minutes and are sighted every
+SIGHT_S seconds while present, sized so that about 10k hashes are inside the
+window at any time. Per simulated second the sightings are added, then one
+tick sweeps capacity / 16 slots as slide_job() in src/slidecount.cpp does.
+Window counts are checked every second against a reference map of last
+sightings the table took. A second map of all sightings gives the devices
+really in the window: with a table too small for them, counts must stay
+below, the refusals must show, and the peak must read the table limit.
+Reported: live entries, share of devices counted, ns per add, us per tick
+(mean and worst) and for a full pass over the table.
+
+  g++ -O2 -Wall -I../../include -o slidebench slidebench.cpp \
+      ../../src/slidewin.cpp
+  ./slidebench [capacity] [window minutes]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <map>
+#include <random>
+#include <vector>
+
+#include "slidewin.h"
+
+#define SIM_S (4 * 3600)
+#define SIGHT_S 30
+#define STAY_MEAN_S 600
+#define ARRIVALS_S 6.7 // devices per second, ~10k in a 15 min window
+
+struct device_t {
+  uint32_t hash;
+  uint8_t type;
+  uint32_t leave, next;
+};
+
+static double now_us() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e6 + t.tv_nsec / 1e3;
+}
+
+int main(int argc, char **argv) {
+  uint32_t cap = argc > 1 ? atoi(argv[1]) : 16384;
+  uint8_t window = argc > 2 ? atoi(argv[2]) : 15;
+  if (cap & (cap - 1)) {
+    fprintf(stderr, "capacity must be a power of 2\n");
+    return 1;
+  }
+
+  std::mt19937 rng(1);
+  std::poisson_distribution<int> arrivals(ARRIVALS_S);
+  std::exponential_distribution<double> stay(1.0 / STAY_MEAN_S);
+  std::vector<device_t> present;
+  // reference: last sighting [s] of every hash and type, taken and all
+  std::map<uint64_t, uint32_t> seen, all;
+
+  static slide_t w;
+  std::vector<uint8_t> mem(SLIDE_BYTES(cap));
+  slide_create(&w, mem.data(), cap, 0);
+
+  double addUs = 0, tickUs = 0, worstTick = 0;
+  uint64_t adds = 0, ticks = 0, freed = 0;
+  uint32_t maxLive = 0, minCount = 0xFFFFFFFF, maxCount = 0;
+  double minShare = 1;
+  int bad = 0;
+
+  for (uint32_t s = 0; s < SIM_S; s++) {
+    uint32_t minute = s / 60;
+
+    for (int i = arrivals(rng); i > 0; i--) {
+      device_t d;
+      d.hash = rng();
+      d.type = rng() % 4 ? 0 : 1; // wifi mostly
+      d.leave = s + 1 + (uint32_t)stay(rng);
+      d.next = s + rng() % SIGHT_S;
+      present.push_back(d);
+    }
+
+    double t0 = now_us();
+    for (size_t i = 0; i < present.size(); i++) {
+      device_t &d = present[i];
+      if (d.next != s)
+        continue;
+      uint64_t k = (uint64_t)d.type << 32 | (d.hash ? d.hash : 1);
+      if (slide_add(&w, d.type, d.hash, minute, window) >= 0)
+        seen[k] = s;
+      all[k] = s;
+      adds++;
+      d.next += SIGHT_S;
+    }
+    addUs += now_us() - t0;
+    for (size_t i = 0; i < present.size();)
+      if (present[i].leave <= s) {
+        present[i] = present.back();
+        present.pop_back();
+      } else
+        i++;
+
+    t0 = now_us();
+    freed += slide_sweep(&w, minute, window, cap / 16);
+    double t = now_us() - t0;
+    tickUs += t;
+    if (t > worstTick)
+      worstTick = t;
+    ticks++;
+
+    // window count: sightings in the current minute and window - 1 before
+    uint32_t ref[SLIDE_TYPES] = {0};
+    for (auto it = seen.begin(); it != seen.end();) {
+      if (minute - it->second / 60 >= window) {
+        it = seen.erase(it);
+        continue;
+      }
+      ref[it->first >> 32]++;
+      ++it;
+    }
+    uint32_t real[SLIDE_TYPES] = {0};
+    for (auto it = all.begin(); it != all.end();) {
+      if (minute - it->second / 60 >= window) {
+        it = all.erase(it);
+        continue;
+      }
+      real[it->first >> 32]++;
+      ++it;
+    }
+    for (uint8_t type = 0; type < SLIDE_TYPES; type++) {
+      uint32_t c = slide_count(&w, type, window);
+      if ((c != ref[type]) || (c > real[type]) ||
+          (!w.full && (c != real[type]))) {
+        if (bad++ < 5)
+          printf("%u s type %u: count %u, expected %u, %u in window\n", s,
+                 type, c, ref[type], real[type]);
+      }
+    }
+
+    if (s > 3600) {
+      uint32_t n = real[0] + real[1];
+      double share = (double)(ref[0] + ref[1]) / n;
+      if (share < minShare)
+        minShare = share;
+      if (n < minCount)
+        minCount = n;
+      if (n > maxCount)
+        maxCount = n;
+    }
+    if (w.live > maxLive)
+      maxLive = w.live;
+  }
+
+  // a full pass over the table
+  double t0 = now_us();
+  slide_sweep(&w, SIM_S / 60, window, cap);
+  double pass = now_us() - t0;
+
+  printf("capacity %u (%u bytes), window %u min, %u h simulated\n", cap,
+         (unsigned)SLIDE_BYTES(cap), window, SIM_S / 3600);
+  printf("in window %u .. %u, counted %.0f%% at worst, table live max %u "
+         "of %u, %u refused\n",
+         minCount, maxCount, 100 * minShare, maxLive, w.limit, w.full);
+  // what slide_job() reports to the memory budget
+  if ((w.peak < maxLive) || (w.full && (w.peak != w.limit)))
+    bad++;
+  printf("add %.0f ns, tick of %u slots %.1f us (worst %.1f us), full pass "
+         "%.1f us, %llu expired\n",
+         addUs * 1e3 / adds, cap / 16, tickUs / ticks, worstTick, pass,
+         (unsigned long long)freed);
+  if (bad)
+    printf("FAILED, %d counts off\n", bad);
+  else
+    printf(w.full ? "counts exact for the hashes taken, the rest refused\n"
+                  : "counts exact\n");
+  return bad != 0;
+}
@@ -0,0 +1,359 @@
+/* Host benchmark of the SPI slave frames of src/spiframe.cpp.
+
+An emulated master polls the slave every poll interval and clocks out what
+the slave has queued. Messages arrive in bursts of one to four, as
+sendData() emits them, at the given mean rate with paxcounter sizes, into a
+send queue of SEND_QUEUE_SIZE messages. Two protocols are compared:
+
+  single   one message per transaction in a fixed 56 byte buffer, as
+           spi_slave_task() did before the frames, the master has no
+           indication of messages left and keeps its poll interval
+  frames   as many messages as fit into a SPI_FRAME_SIZE frame, two frames
+           queued at the slave, the master reads the 8 byte header, clocks
+           the rest of the frame and polls again at once while the header
+           reports messages still queued
+
+The slave loop of src/spislave.cpp is modelled with its SPI_POLL_MS wakeups
+while one frame is queued. Every frame is decoded with spi_frame_check() and
+spi_frame_next() and its messages checked for order and content, a copy
+with up to three flipped bits must be rejected. Reported per protocol:
+delivered messages per second, queue drops, wire bytes per payload byte,
+bus busy time and latency from enqueue to the end of the transaction.
+
+  g++ -O2 -Wall -Istub -I../../include -o spibench spibench.cpp \
+      ../../src/spiframe.cpp
+  ./spibench [msgs/s] [poll ms] [spi kHz]
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include <rom/crc.h>
+
+#include "spiframe.h"
+
+#define SIM_S 3600
+#define SEND_QUEUE_SIZE 500     // src/paxcounter.conf
+#define PAYLOAD_BUFFER_SIZE 51  // src/paxcounter.conf
+#define RCMDPORT 2              // src/paxcounter.conf
+#define SINGLE_BUFFER 56        // former spislave.cpp BUFFER_SIZE
+#define SPI_FRAME_SIZE 512      // include/spislave.h
+#define SPI_POLL_MS 50          // include/spislave.h
+#define SLAVE_GAP_US 50         // slave task wakeup after a transaction
+#define MASTER_GAP_US 100       // master turnaround for an immediate re-poll
+
+#define CHECK(x)                                                               \
+  do {                                                                         \
+    if (!(x)) {                                                                \
+      printf("FAIL %s:%d %s\n", __FILE__, __LINE__, #x);                      \
+      exit(1);                                                                 \
+    }                                                                          \
+  } while (0)
+
+// same result as the ESP32 rom function (zlib crc32)
+uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+  crc = ~crc;
+  while (len--) {
+    crc ^= *buf++;
+    for (int i = 0; i < 8; i++)
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+struct msg_t {
+  double t; // enqueue time, us
+  uint32_t id;
+  uint8_t port, size;
+};
+
+struct frame_t {
+  std::vector<uint8_t> buf;
+  uint16_t len;
+  uint32_t n;
+};
+
+struct result_t {
+  uint64_t delivered = 0, dropped = 0, payload = 0, wire = 0, polls = 0;
+  size_t qmax = 0;
+  double busy = 0;
+  std::vector<double> latency;
+};
+
+static std::vector<msg_t> arrivals;
+static size_t next_arrival;
+static std::deque<msg_t> q;
+static std::vector<bool> lost; // by message id, dropped at the queue
+static double us_per_byte;
+static std::mt19937 rng(7);
+
+static uint8_t msg_byte(uint32_t id, int k) {
+  return k < 4 ? (id >> (8 * k)) & 0xFF : (id * 31 + k) & 0xFF;
+}
+
+static void generate(double rate) {
+  static const uint8_t sizes[] = {4, 4, 4, 6, 10, 16, 51};
+  static const uint8_t ports[] = {1, 7, 9, 10, 15};
+  std::exponential_distribution<double> gap(rate / 2.5 / 1e6);
+  std::uniform_int_distribution<int> burst(1, 4), pick(0, 6), port(0, 4);
+  double t = 0;
+  uint32_t id = 0;
+  arrivals.clear();
+  while ((t += gap(rng)) < SIM_S * 1e6)
+    for (int b = burst(rng); b; b--)
+      arrivals.push_back({t, id++, ports[port(rng)], sizes[pick(rng)]});
+}
+
+static void admit(double t, result_t &r) {
+  while (next_arrival < arrivals.size() && arrivals[next_arrival].t <= t) {
+    if (q.size() < SEND_QUEUE_SIZE)
+      q.push_back(arrivals[next_arrival]);
+    else {
+      lost[arrivals[next_arrival].id] = true;
+      r.dropped++;
+    }
+    next_arrival++;
+  }
+  r.qmax = std::max(r.qmax, q.size());
+}
+
+static double next_time(double now) {
+  if (!q.empty())
+    return now;
+  return next_arrival < arrivals.size() ? arrivals[next_arrival].t : INFINITY;
+}
+
+static void deliver(const msg_t &m, double tc, result_t &r) {
+  r.delivered++;
+  r.payload += m.size;
+  r.latency.push_back(tc - m.t);
+}
+
+// ---- single: one message per fixed size transaction ----
+
+static result_t run_single(double poll_us) {
+  result_t r;
+  next_arrival = 0;
+  q.clear();
+  lost.assign(arrivals.size(), false);
+  for (double t = 0; t < SIM_S * 1e6; t += poll_us) {
+    admit(t, r);
+    double tc = t + SINGLE_BUFFER * us_per_byte;
+    r.polls++;
+    r.wire += SINGLE_BUFFER;
+    r.busy += tc - t;
+    if (!q.empty()) {
+      deliver(q.front(), tc, r);
+      q.pop_front();
+    }
+  }
+  return r;
+}
+
+// ---- frames: slave of src/spislave.cpp, master reading frames ----
+
+static std::deque<frame_t> slots;
+static double slave_now, slave_wake;
+static uint16_t seq;
+
+static void fill(double) {
+  frame_t fr;
+  spi_frame_t f;
+  uint8_t data[PAYLOAD_BUFFER_SIZE];
+
+  fr.buf.resize(SPI_FRAME_SIZE);
+  spi_frame_begin(&f, fr.buf.data(), SPI_FRAME_SIZE);
+  while (!q.empty()) {
+    const msg_t &m = q.front();
+    for (int k = 0; k < m.size; k++)
+      data[k] = msg_byte(m.id, k);
+    if (!spi_frame_add(&f, m.port, data, m.size))
+      break;
+    q.pop_front();
+  }
+  fr.n = f.n;
+  fr.len = spi_frame_end(&f, seq++, std::min<size_t>(q.size(), 255));
+  slots.push_back(fr);
+}
+
+// slave actions up to time t: blocked on the queue with no frame queued,
+// woken every SPI_POLL_MS with one frame queued, idle with both queued
+static void slave_run(double t, result_t &r) {
+  while (slots.size() < 2) {
+    double a = next_time(slave_now);
+    if (slots.size() == 1) // next wakeup at or after a
+      a = slave_wake +
+          ceil((a - slave_wake) / (SPI_POLL_MS * 1e3)) * SPI_POLL_MS * 1e3;
+    if (a > t)
+      break;
+    slave_now = a;
+    admit(a, r);
+    fill(a);
+    if (slots.size() == 1)
+      slave_wake = a;
+  }
+  admit(t, r);
+}
+
+static void decode(const frame_t &fr, double tc, result_t &r,
+                   std::deque<msg_t> &sent) {
+  uint16_t pos = SPI_FRAME_HEAD;
+  uint8_t port, size;
+  const uint8_t *data;
+  uint32_t n = 0;
+
+  CHECK(fr.len % 4 == 0 && fr.len >= 8);
+  CHECK(spi_frame_check(fr.buf.data(), fr.len) == (int)fr.n);
+  while (spi_frame_next(fr.buf.data(), &pos, &port, &data, &size)) {
+    while (!sent.empty() && lost[sent.front().id])
+      sent.pop_front();
+    CHECK(!sent.empty());
+    const msg_t &m = sent.front();
+    CHECK(m.port == port && m.size == size);
+    for (int k = 0; k < size; k++)
+      CHECK(data[k] == msg_byte(m.id, k));
+    deliver(m, tc, r);
+    sent.pop_front();
+    n++;
+  }
+  CHECK(n == fr.n);
+
+  // a copy with one to three flipped bits must be rejected
+  std::vector<uint8_t> bad(fr.buf);
+  uint16_t end = SPI_FRAME_HEAD + (fr.buf[6] | fr.buf[7] << 8) + SPI_FRAME_CRC;
+  std::uniform_int_distribution<int> bit(0, end * 8 - 1), flips(1, 3);
+  for (int f = flips(rng); f; f--) {
+    int b = bit(rng);
+    bad[b / 8] ^= 1 << (b % 8);
+  }
+  if (bad != fr.buf)
+    CHECK(spi_frame_check(bad.data(), fr.len) < 0);
+}
+
+static result_t run_frames(double poll_us) {
+  result_t r;
+  std::deque<msg_t> sent(arrivals.begin(), arrivals.end());
+  next_arrival = 0;
+  q.clear();
+  lost.assign(arrivals.size(), false);
+  slots.clear();
+  slave_now = slave_wake = 0;
+
+  double t = 0, next_poll = 0;
+  while (t < SIM_S * 1e6) {
+    slave_run(t, r);
+    r.polls++;
+    if (slots.empty()) { // header only, no magic
+      r.wire += SPI_FRAME_HEAD;
+      r.busy += SPI_FRAME_HEAD * us_per_byte;
+      t = next_poll += poll_us;
+      continue;
+    }
+    double tc = t + slots.front().len * us_per_byte;
+    r.wire += slots.front().len;
+    r.busy += tc - t;
+    slave_run(tc, r); // may pack the second frame meanwhile
+    frame_t fr = slots.front();
+    slots.pop_front();
+    decode(fr, tc, r, sent);
+    slave_now = slave_wake = std::max(slave_now, tc + SLAVE_GAP_US);
+
+    if (fr.buf[5]) { // messages still queued, poll again at once
+      t = tc + MASTER_GAP_US;
+    } else {
+      while (next_poll <= tc)
+        next_poll += poll_us;
+      t = next_poll;
+    }
+  }
+  return r;
+}
+
+static void print(const char *name, result_t &r) {
+  std::sort(r.latency.begin(), r.latency.end());
+  size_t n = r.latency.size();
+  double sum = 0;
+  for (double l : r.latency)
+    sum += l;
+  printf("%-7s %8.2f %8llu %6zu %8.2f %7.3f%% %9.1f %9.1f %9.1f\n", name,
+         r.delivered / (double)SIM_S, (unsigned long long)r.dropped, r.qmax,
+         r.payload ? r.wire / (double)r.payload : 0.0,
+         100.0 * r.busy / (SIM_S * 1e6), n ? sum / n / 1e3 : 0.0,
+         n ? r.latency[n * 99 / 100] / 1e3 : 0.0,
+         n ? r.latency[n - 1] / 1e3 : 0.0);
+}
+
+static void unit_tests(void) {
+  uint8_t buf[1024], data[PAYLOAD_BUFFER_SIZE] = {1, 2, 3};
+  spi_frame_t f;
+
+  // empty frame, minimum transaction
+  spi_frame_begin(&f, buf, sizeof(buf));
+  CHECK(spi_frame_end(&f, 1, 0) == 12 && spi_frame_check(buf, 12) == 0);
+  CHECK(spi_frame_check(buf, 11) < 0);
+
+  // a record that does not fit leaves the frame unchanged
+  spi_frame_begin(&f, buf, 20);
+  CHECK(spi_frame_add(&f, 9, data, 5));
+  CHECK(!spi_frame_add(&f, 9, data, 0) && f.n == 1 && f.len == 7);
+  CHECK(spi_frame_end(&f, 2, 0) == 20);
+  CHECK(spi_frame_check(buf, 20) == 1);
+
+  // record count is limited to 255
+  spi_frame_begin(&f, buf, sizeof(buf));
+  while (spi_frame_add(&f, 1, data, 0))
+    ;
+  CHECK(f.n == 255);
+  uint16_t len = spi_frame_end(&f, 3, 0);
+  CHECK(spi_frame_check(buf, len) == 255);
+
+  // command frame from the master
+  spi_frame_begin(&f, buf, SPI_FRAME_SIZE);
+  CHECK(spi_frame_add(&f, RCMDPORT, data, 2));
+  len = spi_frame_end(&f, 0, 0);
+  uint16_t pos = SPI_FRAME_HEAD;
+  uint8_t port, size;
+  const uint8_t *p;
+  CHECK(spi_frame_check(buf, len) == 1);
+  CHECK(spi_frame_next(buf, &pos, &port, &p, &size));
+  CHECK(port == RCMDPORT && size == 2 && p[0] == 1 && p[1] == 2);
+  CHECK(!spi_frame_next(buf, &pos, &port, &p, &size));
+
+  // record sizes not adding up to len
+  buf[SPI_FRAME_HEAD + 1] = 3;
+  uint32_t crc = crc32_le(0, buf, SPI_FRAME_HEAD + 4);
+  memcpy(buf + SPI_FRAME_HEAD + 4, &crc, 4);
+  CHECK(spi_frame_check(buf, len) < 0);
+}
+
+int main(int argc, char **argv) {
+  double rate = argc > 1 ? atof(argv[1]) : 20;
+  double poll_ms = argc > 2 ? atof(argv[2]) : 100;
+  double khz = argc > 3 ? atof(argv[3]) : 1000;
+  us_per_byte = 8 * 1e3 / khz;
+
+  unit_tests();
+  generate(rate);
+  printf("%zu messages in %d s, %.1f/s, poll %.0f ms, SPI %.0f kHz\n",
+         arrivals.size(), SIM_S, arrivals.size() / (double)SIM_S, poll_ms,
+         khz);
+  printf("%-7s %8s %8s %6s %8s %8s %9s %9s %9s\n", "", "msgs/s", "dropped",
+         "qmax", "wire/B", "busy", "lat ms", "p99 ms", "max ms");
+  result_t single = run_single(poll_ms * 1e3);
+  print("single", single);
+  result_t frames = run_frames(poll_ms * 1e3);
+  print("frames", frames);
+  size_t queued = q.size();
+  for (const frame_t &fr : slots)
+    queued += fr.n;
+  CHECK(frames.delivered + frames.dropped + queued == next_arrival);
+  printf("frames decoded, order, content and crc checks ok\n");
+  return 0;
+}
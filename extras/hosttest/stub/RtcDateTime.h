@@ -0,0 +1 @@
+// host stand-in for the Rtc by Makuna header, nothing of it is used
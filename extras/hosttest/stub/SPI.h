@@ -0,0 +1,4 @@
+// host stand-in for the Arduino SPI header, nothing of it is used
+#ifndef _SPI_H_INCLUDED
+#define _SPI_H_INCLUDED
+#endif
@@ -0,0 +1,65 @@
+// host stand-in for TinyGPS++, encode() records the sentences it is fed in
+// host_gps_sentences, every value reads as not valid
+#ifndef __TinyGPSPlus_h
+#define __TinyGPSPlus_h
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+extern std::vector<std::string> host_gps_sentences;
+
+struct TinyGPSValue {
+  bool isValid() const { return false; }
+  bool isUpdated() const { return false; }
+  uint32_t age() const { return 0xFFFFFFFF; }
+  uint32_t value() const { return 0; }
+};
+
+struct TinyGPSRawDegrees {
+  bool negative = false;
+};
+
+struct TinyGPSLocation : TinyGPSValue {
+  double lat() const { return 0; }
+  double lng() const { return 0; }
+  TinyGPSRawDegrees rawLat() const { return TinyGPSRawDegrees(); }
+};
+
+struct TinyGPSAltitude : TinyGPSValue {
+  double meters() const { return 0; }
+};
+
+struct TinyGPSDate : TinyGPSValue {
+  uint16_t year() const { return 2000; }
+  uint8_t month() const { return 1; }
+  uint8_t day() const { return 1; }
+};
+
+class TinyGPSPlus {
+  std::string current;
+
+public:
+  TinyGPSLocation location;
+  TinyGPSValue satellites, hdop, time;
+  TinyGPSAltitude altitude;
+  TinyGPSDate date;
+
+  bool encode(char c) {
+    if (c == '$')
+      current.clear();
+    current += c;
+    if (c == '\n')
+      host_gps_sentences.push_back(current);
+    return c == '\n';
+  }
+};
+
+class TinyGPSCustom : public TinyGPSValue {
+public:
+  TinyGPSCustom(TinyGPSPlus &, const char *, int) {}
+  const char *value() const { return ""; }
+};
+
+#endif
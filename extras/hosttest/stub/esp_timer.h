@@ -0,0 +1,6 @@
+#ifndef _ESP_TIMER_H
+#define _ESP_TIMER_H
+#include <stdint.h>
+// microseconds since boot, set by the test
+int64_t esp_timer_get_time(void);
+#endif
@@ -0,0 +1,117 @@
+// host stand-in for include/globals.h, just what configmanager.cpp,
+// scheduler.cpp, ioarena.cpp and sdlog.cpp use
+#ifndef _GLOBALS_H
+#define _GLOBALS_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BSEC_MAX_STATE_BLOB_SIZE 139 // bsec_datatypes.h
+#define PROGVERSION "1.10.45"
+
+// src/paxcounter.conf
+#define SENDCYCLE 30
+#define COUNTERMODE 0
+#define SLIDING_WINDOW 15
+#define VENDORFILTER 1
+#define BLECOUNTER 1
+#define WIFICOUNTER 1
+#define BLESCANINTERVAL 80
+#define WIFI_CHANNEL_SWITCH_INTERVAL 50
+#define LORADRDEFAULT 5
+#define LORATXPOWDEFAULT 14
+#define RGBLUMINOSITY 30
+
+#define PAYLOAD_BUFFER_SIZE 51
+
+#define GPS_DATA (0x01)
+#define ALARM_DATA (0x02)
+#define MEMS_DATA (0x04)
+#define COUNT_DATA (0x08)
+#define SENSOR1_DATA (0x10)
+#define SENSOR2_DATA (0x20)
+#define SENSOR3_DATA (0x40)
+#define BATT_DATA (0x80)
+
+enum sendprio_t { prio_low, prio_normal, prio_high };
+enum nbtransport_t { nb_mqtt, nb_coap };
+enum nbpower_t { nb_power_on, nb_power_psm, nb_power_edrx };
+
+typedef struct {
+  uint8_t MessageSize;
+  uint8_t MessagePort;
+  sendprio_t MessagePrio;
+  uint32_t MsgId;
+  uint8_t Message[PAYLOAD_BUFFER_SIZE];
+} MessageBuffer_t;
+
+typedef struct {
+  char ServerAddress[46];
+  uint16_t port;
+  nbtransport_t transport;
+  uint16_t coapPort;
+  nbpower_t power;
+  char ServerUsername[46];
+  char ServerPassword[46];
+  char ApplicationId[6];
+  char ApplicationName[32];
+  char GatewayId[46];
+} ConfigBuffer_t;
+
+extern int host_verbose;
+#define ESP_LOGI(tag, fmt, ...)                                                \
+  do {                                                                         \
+    if (host_verbose)                                                          \
+      printf("  [%s] " fmt "\n", tag, ##__VA_ARGS__);                          \
+  } while (0)
+#define ESP_LOGW ESP_LOGI
+#define ESP_LOGD ESP_LOGI
+#define ESP_LOGE ESP_LOGI
+#define ESP_ERROR_CHECK(x) (void)(x)
+
+// FreeRTOS, single threaded on the host
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) (void)(mux)
+#define portEXIT_CRITICAL(mux) (void)(mux)
+#define portNUM_PROCESSORS 2
+#define pdTRUE 1
+#define pdPASS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms)) // 1 ms tick
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait);
+void xTaskNotifyGive(TaskHandle_t task);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+const char *pcTaskGetTaskName(TaskHandle_t task);
+
+// membudget.h
+typedef enum { MEM_TASK_SCHED0, MEM_TASK_SCHED1, MEM_BUF_IOARENA } mem_id_t;
+BaseType_t mem_task_create(mem_id_t id, TaskFunction_t fn, void *param,
+                           uint32_t prio, TaskHandle_t *handle,
+                           BaseType_t core);
+void *mem_buffer_get(mem_id_t id);
+
+#include "configdata.h"
+#include "configmanager.h"
+
+extern configData_t cfg;
+
+uint32_t millis(void);
+uint32_t micros(void);
+uint32_t now(void); // TimeLib
+
+// scheduler.h, the test runs the job itself
+typedef void (*sched_fn_t)(void);
+int sched_add(const char *name, sched_fn_t fn, uint32_t period_ms,
+              uint32_t jitter_ms, int core);
+void sched_trigger(int id, uint32_t delay_ms);
+void sched_stop(int id);
+
+#endif
@@ -0,0 +1,64 @@
+// host stand-ins gpsread.cpp needs beyond stub/globals.h: board settings,
+// uart, String, TimeLib and timekeeper.h, force included after globals.h
+#ifndef _GPSHOST_H
+#define _GPSHOST_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define HAS_GPS 1
+#define GPS_SERIAL 9600, SERIAL_8N1, 12, 15 // src/hal/generic.h
+#define SERIAL_8N1 0x800001c
+#define TIME_SYNC_INTERVAL 60
+
+// globals.h
+typedef struct {
+  int32_t latitude;
+  int32_t longitude;
+  uint8_t satellites;
+  uint16_t hdop;
+  int16_t altitude;
+} gpsStatus_t;
+
+// FreeRTOS
+#define portTICK_PERIOD_MS 1
+#define configASSERT(x) ((void)(x))
+void vTaskDelay(TickType_t ticks);
+
+// uart, the test emulates the receiver behind it
+class HardwareSerial {
+public:
+  HardwareSerial(int) {}
+  void setRxBufferSize(size_t size);
+  void begin(unsigned long baud, uint32_t config, int8_t rx, int8_t tx);
+  int available(void);
+  size_t readBytes(uint8_t *buf, size_t n);
+  size_t write(const uint8_t *buf, size_t n);
+};
+
+class String {
+  const char *s;
+
+public:
+  String(const char *s) : s(s) {}
+  float toFloat() const { return atof(s); }
+};
+
+// TimeLib
+typedef struct {
+  uint8_t Second, Minute, Hour, Wday, Day, Month, Year;
+} tmElements_t;
+#define CalendarYrToTm(Y) ((Y) - 1970)
+time_t makeTime(const tmElements_t &tm);
+
+// timekeeper.h
+#define _timekeeper_H
+void timeSync(void);
+time_t timeIsValid(time_t const t);
+TickType_t tx_Ticks(uint32_t framesize, unsigned long baud, uint32_t config,
+                    int8_t rxPin, int8_t txPins);
+
+#include "gpsread.h"
+
+#endif
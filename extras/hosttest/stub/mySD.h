@@ -0,0 +1,52 @@
+// host stand-in for lib/esp32-micro-sdcard, files live in host_files of the
+// test, a file opened for write appends
+#ifndef __MYSD_H__
+#define __MYSD_H__
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+#define FILE_READ 0x01
+#define FILE_WRITE 0x13
+
+extern std::map<std::string, std::string> host_files;
+
+class FileMySD {
+  std::string *_data = nullptr;
+  uint32_t _pos = 0;
+
+public:
+  FileMySD() {}
+  FileMySD(std::string *data, uint32_t pos) : _data(data), _pos(pos) {}
+  size_t write(const uint8_t *buf, size_t size) {
+    _data->replace(_pos, size, (const char *)buf, size);
+    _pos += size;
+    return size;
+  }
+  void flush() {}
+  uint32_t position() { return _pos; }
+  bool preAllocate(uint32_t) { return true; }
+  void close() { _data = nullptr; }
+  operator bool() { return _data != nullptr; }
+};
+
+class SDClass {
+public:
+  FileMySD open(const char *name, uint8_t mode = FILE_READ) {
+    auto f = host_files.find(name);
+    if (f == host_files.end()) {
+      if (mode != FILE_WRITE)
+        return FileMySD();
+      f = host_files.emplace(name, std::string()).first;
+    }
+    return FileMySD(&f->second, mode == FILE_WRITE ? f->second.size() : 0);
+  }
+  bool exists(const char *name) { return host_files.count(name); }
+  bool remove(const char *name) { return host_files.erase(name); }
+};
+
+extern SDClass mySD;
+
+#endif
@@ -0,0 +1,47 @@
+// host stand-in for the IDF NVS api, one in-memory namespace. Counts the
+// 32 byte entries written: one per integer, one plus the data span per string
+// or blob, as nvs_storage.cpp lays them out.
+#ifndef _NVS_H
+#define _NVS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int esp_err_t;
+typedef uint32_t nvs_handle;
+typedef enum { NVS_READONLY, NVS_READWRITE } nvs_open_mode;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NVS_NOT_FOUND 0x1102
+#define ESP_ERR_NVS_NO_FREE_PAGES 0x110d
+#define ESP_ERR_NVS_INVALID_LENGTH 0x110c
+
+typedef struct {
+  uint32_t gets, sets, entries, commits, erases;
+} nvs_host_stats_t;
+extern nvs_host_stats_t nvs_host_stats;
+void nvs_host_clear(void); // empty flash
+size_t nvs_host_keys(void);
+bool nvs_host_has(const char *key);
+// raw access to a stored blob, for damaging it in tests
+uint8_t *nvs_host_blob(const char *key, size_t *len);
+
+esp_err_t nvs_open(const char *name, nvs_open_mode mode, nvs_handle *h);
+void nvs_close(nvs_handle h);
+esp_err_t nvs_commit(nvs_handle h);
+esp_err_t nvs_erase_key(nvs_handle h, const char *key);
+esp_err_t nvs_erase_all(nvs_handle h);
+esp_err_t nvs_get_i8(nvs_handle h, const char *key, int8_t *v);
+esp_err_t nvs_get_i16(nvs_handle h, const char *key, int16_t *v);
+esp_err_t nvs_get_i32(nvs_handle h, const char *key, int32_t *v);
+esp_err_t nvs_set_i8(nvs_handle h, const char *key, int8_t v);
+esp_err_t nvs_set_i16(nvs_handle h, const char *key, int16_t v);
+esp_err_t nvs_set_i32(nvs_handle h, const char *key, int32_t v);
+esp_err_t nvs_get_str(nvs_handle h, const char *key, char *out, size_t *len);
+esp_err_t nvs_set_str(nvs_handle h, const char *key, const char *v);
+esp_err_t nvs_get_blob(nvs_handle h, const char *key, void *out, size_t *len);
+esp_err_t nvs_set_blob(nvs_handle h, const char *key, const void *v,
+                       size_t len);
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef _ROM_CRC_H
+#define _ROM_CRC_H
+#include <stdint.h>
+// same result as the ESP32 rom function (zlib crc32)
+uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
+#endif
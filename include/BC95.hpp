@@ -3,6 +3,12 @@
 #include <Arduino.h>
 #include "globals.h"
 #include "lorawan.h"
+#include "bc95link.h"
+#include "httpstream.h"
+#include "nsonmi.h"
+#include "coap.h"
+#include "updindex.h"
+#include <nvs.h>
 
 //#define bc95serial Serial1
 //#define RESET_PIN 25
@@ -13,6 +19,18 @@
 #define HTTP_READ_TIMEOUT 10000
 #define HTTP_SOCKET_TIMEOUT 2000
 
+#define BC95_NVS "bc95"            // nvs namespace of negotiated rate
+
+// bytes on air per NB transport, IP and TCP/UDP headers included
+#define NB_TCPIP_HEADER 40
+#define NB_UDPIP_HEADER 28
+
+typedef struct {
+  uint32_t messages; // uplink messages delivered
+  uint32_t payload;  // their payload bytes
+  uint32_t air;      // bytes sent and received over the radio
+} nb_air_t;
+
 #define APN "lpwa.vodafone.iot"
 
 #define DEBUG_MODEM
@@ -21,6 +39,9 @@ int readResponseBC(HardwareSerial *port, char *buff, int b_size, uint32_t timeou
 bool assertResponseBC(const char *expected, char *received, int bytesRead);
 bool sendAndReadOkResponseBC(HardwareSerial *port, const char *command, char* buffer, int bufferSize, uint32_t timeout);
 void initModem();
+void bc95_printWireStats(void);
+void nbAirCount(nbtransport_t t, uint32_t messages, uint32_t payload,
+                uint32_t air);
 void resetModem();
 bool configModem();
 bool preConfigModem();
@@ -28,6 +49,9 @@ bool networkReady();
 void getCsq();
 bool attachNetwork();
 bool networkAttached();
+bool modemWarm();
+bool setPowerSaving(nbpower_t mode);
+bool wakeModem();
 bool connectModem(char *ip, int port);
 void disconnectModem();
 int connectMqtt(char *url, int port, char *username, char *password, char *clientId);
@@ -40,6 +64,10 @@ int checkSubscriptionMqtt(char *message);
 int publishMqtt(char *topic, char *message, int qos);
 int disconnectMqtt();
 int postPage(char *domainBuffer, int thisPort, char *page, char *thisData, char* identityKey);
+int coapOpen(char *host, int port);
+void coapClose();
+int coapPost(const char *path, const char *query, const uint8_t *data,
+             size_t len, uint8_t *resp, size_t respSize);
 int getData(char *ip, int port, char *page, char *responseBuffer, int responseBufferSize, int *responseSizePtr);
 String bc95_getImei();
 String bc95_getMsisdn();
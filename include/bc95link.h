@@ -0,0 +1,33 @@
+#ifndef _BC95LINK_H
+#define _BC95LINK_H
+
+#include <stdint.h>
+
+// AT+NATSPEED baud negotiation of the BC95 uart. The modem is reached
+// through a small interface of AT command, host rate and wait, so the
+// state machine runs against a modem emulator as well. No Arduino
+// dependencies, extras/hosttest/baudtest.cpp links this file as is
+#define BC95_BAUD_DEFAULT 9600  // modem factory rate, always tried last
+#define BC95_NATSPEED_TIMEOUT 3 // modem reverts rate if no AT within [s]
+
+typedef struct {
+  // sends an AT command at the host rate, true if the modem answered OK
+  bool (*command)(const char *cmd, uint32_t timeout_ms);
+  // switches the host uart, discards pending input
+  void (*setBaud)(uint32_t baud);
+  void (*wait)(uint32_t ms);
+} bc95_link_t;
+
+typedef enum {
+  bc95_baud_ok,       // link is at the target rate, or target is default
+  bc95_baud_silent,   // modem did not answer at any rate
+  bc95_baud_refused,  // modem refused the target rate
+  bc95_baud_fallback, // target rate did not work, modem reverted
+} bc95_baud_result_t;
+
+// finds the rate the modem listens on, starting with stored, and moves it
+// to target. Returns the rate the link ends up at
+uint32_t bc95_negotiate(const bc95_link_t *link, uint32_t stored,
+                        uint32_t target, bc95_baud_result_t *result);
+
+#endif // _BC95LINK_H
@@ -13,7 +13,7 @@
 #include <Adafruit_BMP085.h>
 #endif
 
-extern Ticker bmecycler;
+extern int bmecycleJob;
 
 extern bmeStatus_t
     bme_status; // Make struct for storing gps data globally available
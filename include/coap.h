@@ -0,0 +1,57 @@
+#ifndef _COAP_H
+#define _COAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// CoAP (RFC 7252) message codec with block-wise transfer (RFC 7959) for
+// the NB-IoT UDP uplink, no allocation, no platform dependencies
+#define COAP_DEFAULT_PORT 5683
+#define COAP_ACK_TIMEOUT_MS 4000 // first retransmission, doubled each try
+#define COAP_MAX_RETRANSMIT 3
+#define COAP_BLOCK_SZX 4 // block1 size exponent, 16 << 4 = 256 bytes
+#define COAP_BLOCK_SIZE (16 << COAP_BLOCK_SZX)
+#define COAP_MAX_PDU (COAP_BLOCK_SIZE + 64) // header, token and options
+#define COAP_MAX_TOKEN 8
+
+enum { COAP_CON, COAP_NON, COAP_ACK, COAP_RST };
+
+// codes are class << 5 | detail
+#define COAP_CODE(c, d) (((c) << 5) | (d))
+#define COAP_EMPTY 0
+#define COAP_POST COAP_CODE(0, 2)
+#define COAP_CREATED COAP_CODE(2, 1)
+#define COAP_CHANGED COAP_CODE(2, 4)
+#define COAP_CONTINUE COAP_CODE(2, 31)
+
+#define COAP_OPT_URI_PATH 11
+#define COAP_OPT_CONTENT_FORMAT 12
+#define COAP_OPT_URI_QUERY 15
+#define COAP_OPT_BLOCK1 27
+
+#define COAP_FORMAT_OCTETS 42 // application/octet-stream
+#define COAP_FORMAT_NONE -1
+
+// block1 option value: block number, more flag, size exponent
+#define COAP_BLOCK1(num, more, szx) (((num) << 4) | ((more) ? 8 : 0) | (szx))
+
+typedef struct {
+  uint8_t type;
+  uint8_t code;
+  uint16_t mid;
+  uint8_t tkl;
+  uint8_t token[COAP_MAX_TOKEN];
+  const char *path;    // uri path, segments separated by '/', build only
+  const char *query;   // uri query, build only
+  int contentFormat;   // COAP_FORMAT_NONE if absent
+  int32_t block1;      // block1 option value, -1 if absent
+  const uint8_t *payload;
+  size_t len;
+} coap_msg_t;
+
+void coap_init_msg(coap_msg_t *m, uint8_t type, uint8_t code, uint16_t mid);
+size_t coap_build(uint8_t *pdu, size_t size, const coap_msg_t *m);
+int coap_parse(const uint8_t *pdu, size_t len, coap_msg_t *m);
+bool coap_block1(coap_msg_t *m, const uint8_t *data, size_t len, size_t num);
+
+#endif // _COAP_H
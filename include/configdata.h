@@ -0,0 +1,44 @@
+#ifndef _CONFIGDATA_H
+#define _CONFIGDATA_H
+
+#include <stdint.h>
+
+// configData_t is stored in NVS as one blob (see configmanager.cpp). Append
+// new fields at the end only, they keep their defaults when an older, shorter
+// blob is loaded. Moving or retyping a field needs a new CONFIG_BLOB_VERSION
+// and a step in migrateVersion().
+#define CONFIG_BLOB_VERSION 1
+
+// Struct holding devices's runtime configuration
+typedef struct {
+  uint8_t loradr;      // 0-15, lora datarate
+  uint8_t txpower;     // 2-15, lora tx power
+  uint8_t adrmode;     // 0=disabled, 1=enabled
+  uint8_t screensaver; // 0=disabled, 1=enabled
+  uint8_t screenon;    // 0=disabled, 1=enabled
+  uint8_t countermode; // 0=cyclic unconfirmed, 1=cumulative, 2=cyclic confirmed,
+                       // 4=sliding window
+  int16_t rssilimit;   // threshold for rssilimiter, negative value!
+  uint16_t sendcycle;  // payload send cycle [seconds/2]
+  uint8_t wifichancycle; // wifi channel switch cycle [seconds/100]
+  uint8_t blescantime;   // BLE scan cycle duration [seconds]
+  uint8_t blescan;       // 0=disabled, 1=enabled
+  uint8_t btscan;        // 0=disabled, 1=enabled
+  uint8_t wifiscan;      // 0=disabled, 1=enabled
+  uint8_t wifiant;       // 0=internal, 1=external (for LoPy/LoPy4)
+  uint8_t vendorfilter;  // 0=disabled, 1=enabled
+  uint8_t rgblum;        // RGB Led luminosity (0..100%)
+  uint8_t monitormode;   // 0=disabled, 1=enabled
+  uint8_t runmode;       // 0=normal, 1=update
+  uint8_t payloadmask;   // bitswitches for payload data
+  uint32_t salt;
+  uint32_t saltVersion;
+  uint32_t saltTimestamp;
+  char version[10]; // Firmware version
+  uint8_t
+      bsecstate[BSEC_MAX_STATE_BLOB_SIZE + 1]; // BSEC state for BME680 sensor
+  uint8_t resettimer; // reset cycle counter
+  uint8_t slidewindow; // countermode 4 window [minutes]
+} configData_t;
+
+#endif // _CONFIGDATA_H
@@ -4,8 +4,14 @@
 #include <nvs.h>
 #include <nvs_flash.h>
 
+#define CONFIG_BLOB_KEY "cfgblob"
+#define CONFIG_BLOB_MAGIC 0x31474643 // "CFG1"
+#define CONFIG_SAVE_DELAY_MS 2000    // saves within this window are coalesced
+#define CONFIG_SAVE_MAX_MS 30000     // pending save is written at the latest
+
 void eraseConfig(void);
 void saveConfig(void);
+void flushConfig(void);
 void loadConfig(void);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,57 @@
+#ifndef _CRASHTRACE_H
+#define _CRASHTRACE_H
+
+// crash trace: a ring of small binary events in RTC memory that survives
+// watchdog, panic and software resets. After such a reset the ring of the
+// previous run is deflated at boot and uplinked on CRASHPORT, a few frames per
+// send cycle. Frame: boot count (low byte), frame index, frames total, then
+// up to CRASH_FRAME_DATA bytes of the deflated trace.
+// src/CrashTrace/ctdecode.py reassembles and decodes it
+#define CRASH_TRACE_EVENTS 128 // event ring, 8 bytes each
+#define CRASH_TRACE_TASKS 32   // task switch ring, 8 bytes each
+#define CRASH_TRACE_AT 16      // last AT command kept as text
+#define CRASH_SAMPLE_MS 1000   // queue depth and heap low water sampling
+#define CRASH_FRAME_HEAD 3
+#define CRASH_FRAME_DATA (PAYLOAD_BUFFER_SIZE - CRASH_FRAME_HEAD)
+#define CRASH_MAX_FRAMES 16    // longer traces drop their oldest events
+#define CRASH_BURST 2          // frames sent per send cycle
+
+typedef enum {
+  ct_boot = 1, // arg: esp_reset_reason() of this boot, val: boot count
+  ct_reset,    // arg: crash_cause_t, val: free heap / 16
+  ct_task,     // arg: core, val: memory budget id of the task switched in
+  ct_queue,    // arg: memory budget id, val: items waiting
+  ct_heap,     // val: heap low water mark / 16
+  ct_at,       // arg, val: first three letters of the command after "AT+"
+  ct_sd_begin, // arg: sd_req_type_t
+  ct_sd_end,   // arg: sd_req_type_t, val: result
+} crash_event_t;
+
+typedef enum {
+  ct_rst_timer = 1, // cfg.resettimer
+  ct_rst_uptime,    // MAX_UPTIME
+  ct_rst_memlow,    // MEM_LOW, heap
+  ct_rst_psramlow,  // MEM_LOW, psram
+  ct_rst_update,    // runmode update
+  ct_rst_remote,    // remote command
+  ct_rst_ota,       // end of wifi ota
+  ct_rst_sdcard,    // sd card did not come back
+} crash_cause_t;
+
+#if (CRASH_TRACE)
+
+esp_err_t crash_init(void);
+void crash_note(crash_event_t type, uint8_t arg, uint16_t val);
+void crash_reset(crash_cause_t cause);
+void crash_at(const char *command);
+void crash_send(void);
+
+#else
+
+static inline void crash_note(crash_event_t type, uint8_t arg, uint16_t val) {}
+static inline void crash_reset(crash_cause_t cause) {}
+static inline void crash_at(const char *command) {}
+
+#endif // CRASH_TRACE
+
+#endif // _CRASHTRACE_H
@@ -19,7 +19,7 @@
 #include "display.h"
 #endif
 
-extern Ticker housekeeper;
+extern int housekeepingJob;
 
 void housekeeping(void);
 void doHousekeeping(void);
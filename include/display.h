@@ -83,6 +83,7 @@ void dp_println(int lines = 1);
 void dp_printf(const char *format, ...);
 void dp_setFont(int font, int inv = 0);
 void dp_dump(uint8_t *pBuffer);
+void dp_print_stats(void);
 void dp_setTextCursor(int col, int row);
 void dp_contrast(uint8_t contrast);
 void dp_clear(void);
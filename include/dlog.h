@@ -0,0 +1,55 @@
+#ifndef _DLOG_H
+#define _DLOG_H
+
+// deferred log: DLOG(id, args...) stores a format id and up to DLOG_ARGS
+// integer arguments in a lock-free ring, a low priority task formats them
+// later, to serial if VERBOSE, as "DLG,ms,id,args..." csv lines to their own
+// file on the SD card if DLOG_SD. Formats are in the table of src/dlog.cpp,
+// integer conversions only, src/DLog/dlogdecode.py renders the csv lines with
+// that table. Compiled out with DEFERRED_LOG 0
+#define DLOG_RING 128      // records, power of 2, 36 bytes each
+#define DLOG_ARGS 6
+#define DLOG_DRAIN_MS 500  // formatting task cycle
+#define DLOG_TASK_STACK 3072
+#define DLOG_FILE_NAME "paxdlog.csv"       // DLG lines, not the counter csv
+#define DLOG_FILE_MAX (8UL * 1024 * 1024)  // started over when reached
+#define DLOG_SD_BATCH 2048 // DLG line bytes handed to the sd service at once
+
+// keep in sync with the format table in dlog.cpp
+typedef enum {
+  dlog_dropped, // emitted by the drain task itself
+  dlog_mac_wifi,
+  dlog_mac_ble,
+  dlog_mac_bt,
+  dlog_mac_raw, // VERBOSE builds only, never written to the card
+  dlog_nb_enqueue,
+  dlog_nb_high,
+  dlog_nb_normal,
+  dlog_nb_sd_fallback,
+  dlog_nb_stats,
+  dlog_sdq_enqueue,
+  dlog_sdq_dequeue,
+  dlog_sdq_flush_cycle,
+  dlog_sdq_peek,
+  dlog_sdq_delivered,
+  DLOG_IDS
+} dlog_id_t;
+
+#if (DEFERRED_LOG)
+
+// arguments are read as 32 bit integers, no strings, no 64 bit values
+void dlog_put(dlog_id_t id, int n, ...);
+esp_err_t dlog_init(void);
+void dlog_print_stats(void);
+
+#define DLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, N, ...) N
+#define DLOG_NARGS(...) DLOG_NARGS_(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define DLOG(id, ...) dlog_put(id, DLOG_NARGS(__VA_ARGS__), ##__VA_ARGS__)
+
+#else
+
+#define DLOG(id, ...)
+
+#endif // DEFERRED_LOG
+
+#endif // _DLOG_H
@@ -0,0 +1,58 @@
+#ifndef _FRAGDEC_H
+#define _FRAGDEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// FEC decoder of the LoRaWAN Fragmented Data Block Transport (TS004).
+// Uncoded fragments go to a fragment store, the first coded fragment fixes
+// the set of lost fragments, every later fragment is an equation over GF(2)
+// reduced against the pivot rows found so far (incremental gaussian
+// elimination). The store is accessed through callbacks, a slot of a lost
+// fragment holds the data of its pivot row until the back substitution. No
+// Arduino dependencies, extras/hosttest/fragtest.cpp links this file as is
+
+#define FRAG_DEC_MORE 0   // fragment taken, more needed
+#define FRAG_DEC_DONE 1   // all fragments are in the store
+#define FRAG_DEC_NOMEM -1 // too many lost fragments, fragment ignored
+#define FRAG_DEC_STORE -2 // store access failed, session is unusable
+
+typedef bool (*frag_read_t)(uint32_t offset, uint8_t *buf, size_t len);
+typedef bool (*frag_write_t)(uint32_t offset, const uint8_t *buf, size_t len);
+
+typedef struct {
+  uint16_t nbFrag;
+  uint8_t fragSize;
+  uint16_t maxLost; // bound of the FEC matrix
+  bool frozen;      // set of lost fragments fixed by first coded fragment
+  bool memError;    // too many lost fragments for maxLost
+  uint16_t received; // uncoded fragments received
+  uint16_t lost;     // number of lost fragments at freeze
+  uint16_t rank;     // pivot rows found so far
+  uint16_t rowBytes;
+  uint32_t codedRx;
+  uint32_t bytes;    // heap in use
+  frag_read_t read;
+  frag_write_t write;
+  uint8_t *rcvd;     // bitmap of received uncoded fragments
+  uint8_t *line;     // scratch bitmap for parity line
+  uint16_t *missing; // lost index -> fragment number, ascending
+  uint8_t *matrix;   // lost x rowBytes, pivot rows (upper triangular)
+  uint8_t *pivot;    // bitmap of present pivot rows
+  uint8_t *row;      // equation being reduced
+  uint8_t *data, *tmp; // fragSize each
+} frag_dec_t;
+
+// false if out of memory, frag_dec_free() cleans up in any case
+bool frag_dec_init(frag_dec_t *d, uint16_t nbFrag, uint8_t fragSize,
+                   uint16_t maxLost, frag_read_t read, frag_write_t write);
+void frag_dec_free(frag_dec_t *d);
+// fragment n as numbered by FragDataFragment: 1 .. nbFrag uncoded, above
+// coded. Returns one of FRAG_DEC_*
+int frag_dec_add(frag_dec_t *d, uint16_t n, const uint8_t *data);
+// fragments still needed
+uint16_t frag_dec_missing(const frag_dec_t *d);
+// parity line of coded fragment n (1..) for m uncoded fragments, TS004 annex
+void frag_parity_line(uint32_t n, uint32_t m, uint8_t *line);
+
+#endif // _FRAGDEC_H
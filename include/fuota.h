@@ -0,0 +1,29 @@
+#ifndef _FUOTA_H
+#define _FUOTA_H
+
+#include "globals.h"
+
+// LoRaWAN Fragmented Data Block Transport, package identifier and version
+#define FRAG_PACKAGE_ID 3
+#define FRAG_PACKAGE_VERSION 1
+
+// package commands, received and answered on FRAGPORT
+#define FRAG_PACKAGE_VERSION_REQ 0x00
+#define FRAG_SESSION_STATUS_REQ 0x01
+#define FRAG_SESSION_SETUP_REQ 0x02
+#define FRAG_SESSION_DELETE_REQ 0x03
+#define FRAG_DATA_FRAGMENT 0x08
+
+// FragSessionSetupAns status bits
+#define FRAG_SETUP_ENCODING_UNSUPPORTED 0x01
+#define FRAG_SETUP_NOT_ENOUGH_MEMORY 0x02
+#define FRAG_SETUP_INDEX_UNSUPPORTED 0x04
+#define FRAG_SETUP_WRONG_DESCRIPTOR 0x08
+
+extern TaskHandle_t fuotaTask;
+
+esp_err_t fuota_init(void);
+void fuota_rx(const uint8_t *buf, size_t len);
+void fuota_task(void *pvParameters);
+
+#endif // _FUOTA_H
@@ -50,6 +50,8 @@
 #define I2C_MUTEX_UNLOCK() (xSemaphoreGive(I2Caccess))
 
 enum sendprio_t { prio_low, prio_normal, prio_high };
+enum nbtransport_t { nb_mqtt, nb_coap };
+enum nbpower_t { nb_power_on, nb_power_psm, nb_power_edrx };
 enum timesource_t { _gps, _rtc, _lora, _unsynced };
 
 enum runmode_t {
@@ -59,35 +61,7 @@ enum runmode_t {
   RUNMODE_UPDATE
 };
 
-// Struct holding devices's runtime configuration
-typedef struct {
-  uint8_t loradr;      // 0-15, lora datarate
-  uint8_t txpower;     // 2-15, lora tx power
-  uint8_t adrmode;     // 0=disabled, 1=enabled
-  uint8_t screensaver; // 0=disabled, 1=enabled
-  uint8_t screenon;    // 0=disabled, 1=enabled
-  uint8_t countermode; // 0=cyclic unconfirmed, 1=cumulative, 2=cyclic confirmed
-  int16_t rssilimit;   // threshold for rssilimiter, negative value!
-  uint16_t sendcycle;  // payload send cycle [seconds/2]
-  uint8_t wifichancycle; // wifi channel switch cycle [seconds/100]
-  uint8_t blescantime;   // BLE scan cycle duration [seconds]
-  uint8_t blescan;       // 0=disabled, 1=enabled
-  uint8_t btscan;        // 0=disabled, 1=enabled
-  uint8_t wifiscan;      // 0=disabled, 1=enabled
-  uint8_t wifiant;       // 0=internal, 1=external (for LoPy/LoPy4)
-  uint8_t vendorfilter;  // 0=disabled, 1=enabled
-  uint8_t rgblum;        // RGB Led luminosity (0..100%)
-  uint8_t monitormode;   // 0=disabled, 1=enabled
-  uint8_t runmode;       // 0=normal, 1=update
-  uint8_t payloadmask;   // bitswitches for payload data
-  uint32_t salt;
-  uint32_t saltVersion;
-  uint32_t saltTimestamp;
-  char version[10]; // Firmware version
-  uint8_t
-      bsecstate[BSEC_MAX_STATE_BLOB_SIZE + 1]; // BSEC state for BME680 sensor
-  uint8_t resettimer; // reset cycle counter
-} configData_t;
+#include "configdata.h" // devices's runtime configuration
 
 // Struct holding payload for data send queue
 typedef struct {
@@ -101,6 +75,9 @@ typedef struct {
 typedef struct {
   char ServerAddress[46];
   uint16_t port;
+  nbtransport_t transport; // uplink over MQTT/TCP or CoAP/UDP
+  uint16_t coapPort;
+  nbpower_t power; // modem always on, or resting in PSM/eDRX between windows
   char ServerUsername[46];
   char ServerPassword[46];
   char ApplicationId[6];
@@ -160,6 +137,15 @@ extern uint8_t DEVEUI[8];
 #include "payload.h"
 #include "blescan.h"
 #include "power.h"
+#include "scheduler.h"
+#include "occupancy.h"
+#include "slidecount.h"
+#include "membudget.h"
+#include "ioarena.h"
+#include "taskstats.h"
+#include "latprobe.h"
+#include "crashtrace.h"
+#include "dlog.h"
 
 #if (HAS_GPS)
 #include "gpsread.h"
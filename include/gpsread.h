@@ -12,6 +12,13 @@
 #define NMEA_FRAME_SIZE 82 // NEMA has a maxium of 82 bytes per record
 #define NMEA_COMPENSATION_FACTOR 480 // empiric for Ublox Neo 6M
 
+// NMEA is read in bulk, whole sentences are parsed at once
+#define GPS_POLL_MS 250       // bulk read cycle [ms]
+#define GPS_RX_BUFFER 1024    // uart rx buffer, holds > 1s of NMEA at 9600 baud
+#define GPS_FIX_TIMEOUT_S 180 // receiver on time without fix, then it rests
+#define GPS_SYNC_GRACE_S 10   // receiver stays on after a fix for time sync
+#define GPS_REST_S 3600 // receiver off between fixes without GPS_DATA [s]
+
 extern TinyGPSPlus gps; // Make TinyGPS++ instance globally availabe
 extern TaskHandle_t GpsTask;
 
@@ -22,5 +29,6 @@ void gps_storelocation(gpsStatus_t *gps_store);
 void gps_loop(void *pvParameters);
 time_t fetch_gpsTime(uint16_t *msec);
 time_t fetch_gpsTime(void);
+void gps_print_stats(void);
 
 #endif
\ No newline at end of file
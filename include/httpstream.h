@@ -0,0 +1,51 @@
+#ifndef _HTTPSTREAM_H
+#define _HTTPSTREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// incremental HTTP/1.1 response parser, fed with received segments of any
+// size, passes the body to a caller sink, does not allocate
+#define HTTP_LINE_MAX 96 // longer status and header lines are truncated
+
+enum {
+  HTTP_STREAM_MORE = 0,   // response incomplete, feed more data
+  HTTP_STREAM_DONE = 1,   // response complete
+  HTTP_STREAM_SYNTAX = -1, // malformed status line or chunk header
+  HTTP_STREAM_SINK = -2,  // sink refused body data
+  HTTP_STREAM_SHORT = -3  // connection closed before body was complete
+};
+
+typedef enum {
+  http_status,
+  http_header,
+  http_body,
+  http_chunk_size,
+  http_chunk_data,
+  http_chunk_end,
+  http_trailer,
+  http_done,
+  http_error
+} http_state_t;
+
+// returns bytes taken or < 0 to abort the response
+typedef int (*http_sink_t)(const uint8_t *data, size_t len, void *ctx);
+
+typedef struct {
+  http_state_t state;
+  int status;             // http status code, 0 until status line is parsed
+  int32_t contentLength;  // -1 if not given
+  bool chunked;
+  uint32_t remaining;     // body or chunk bytes still to come
+  uint32_t bodyBytes;     // body bytes passed to sink
+  http_sink_t sink;
+  void *ctx;
+  uint8_t linelen;
+  char line[HTTP_LINE_MAX];
+} http_stream_t;
+
+void http_stream_init(http_stream_t *hs, http_sink_t sink, void *ctx);
+int http_stream_feed(http_stream_t *hs, const uint8_t *data, size_t len);
+int http_stream_close(http_stream_t *hs);
+
+#endif // _HTTPSTREAM_H
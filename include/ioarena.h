@@ -0,0 +1,42 @@
+#ifndef _IOARENA_H
+#define _IOARENA_H
+
+#include "globals.h"
+
+// i/o arena: fixed blocks in three size classes, leased by modem, http and
+// update code instead of global, stack or per call heap buffers
+#define IO_ARENA_SMALL 512
+#define IO_ARENA_SMALL_BLOCKS 4
+#define IO_ARENA_MEDIUM 2048
+#define IO_ARENA_MEDIUM_BLOCKS 6
+#define IO_ARENA_LARGE 4096
+#define IO_ARENA_LARGE_BLOCKS 2
+
+#define IO_ARENA_BYTES                                                         \
+  (IO_ARENA_SMALL * IO_ARENA_SMALL_BLOCKS +                                    \
+   IO_ARENA_MEDIUM * IO_ARENA_MEDIUM_BLOCKS +                                  \
+   IO_ARENA_LARGE * IO_ARENA_LARGE_BLOCKS)
+#define IO_ARENA_BLOCKS                                                        \
+  (IO_ARENA_SMALL_BLOCKS + IO_ARENA_MEDIUM_BLOCKS + IO_ARENA_LARGE_BLOCKS)
+
+// lease sizes of the modem paths
+#define IO_AT_RESP_SIZE IO_ARENA_SMALL     // short AT response, OK, CEREG, id
+#define IO_MODEM_RESP_SIZE IO_ARENA_MEDIUM // AT response with data, mqtt rx
+#define IO_HTTP_BODY_SIZE IO_ARENA_MEDIUM  // http body, update index and parts
+#define IO_HTTP_RAW_SIZE IO_ARENA_LARGE    // http request and raw response
+
+typedef struct {
+  uint32_t leases;   // successful leases
+  uint32_t failures; // leases refused, arena exhausted or size too big
+  uint8_t inuse;     // blocks currently leased
+  uint8_t peak;      // most blocks leased at the same time
+} io_arena_stats_t;
+
+esp_err_t io_arena_init(void);
+void *io_lease(size_t size, const char *owner);
+void io_release(void *buf);
+size_t io_lease_size(const void *buf);
+const io_arena_stats_t *io_arena_stats(void);
+void io_arena_print(void);
+
+#endif // _IOARENA_H
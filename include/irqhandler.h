@@ -11,6 +11,8 @@
 #define BME_IRQ 0x080
 #define MATRIX_DISPLAY_IRQ 0x100
 #define PMU_IRQ 0x200
+#define HEALTHCHECK_IRQ 0x400
+#define NB_HEALTHCHECK_IRQ 0x800
 
 #include "globals.h"
 #include "cyclic.h"
@@ -0,0 +1,76 @@
+#ifndef _LATPROBE_H
+#define _LATPROBE_H
+
+// latency probes: LAT_SCOPE(id) at the top of a function counts its run time
+// in cpu cycles into a log2 histogram of the probe, from construction to the
+// end of the scope. Compiled out with LATENCY_PROBES 0
+#define LAT_BUCKETS 24 // bucket 0: < 2^9 cycles, bucket i: 2^(i+8) ..
+#define LAT_SHIFT 8
+#define LAT_DUMP_MS (15 * 60 * 1000) // histograms to SD card and serial
+#define LAT_LINE_LEN 160 // dump line, fits SD_LINE_MAX of sdservice.h
+
+typedef enum {
+  lat_mac_add,
+  lat_send_payload,
+  lat_sdq_enqueue,
+  lat_sdq_dequeue,
+  lat_mqtt_publish,
+  lat_at_read,
+  LAT_PROBES
+} lat_id_t;
+
+typedef struct {
+  uint32_t count;
+  uint32_t max; // cycles
+  uint32_t bucket[LAT_BUCKETS];
+} lat_hist_t;
+
+#if (LATENCY_PROBES)
+
+#include <xtensa/hal.h>
+
+extern lat_hist_t latHist[LAT_PROBES];
+
+// not locked: two tasks hitting the same probe at once may lose a count
+static inline void lat_record(lat_id_t id, uint32_t cycles) {
+  lat_hist_t *h = &latHist[id];
+  int b = 31 - __builtin_clz(cycles | 1) - LAT_SHIFT;
+  h->bucket[b < 0 ? 0 : b]++;
+  h->count++;
+  if (cycles > h->max)
+    h->max = cycles;
+}
+
+// the cycle counter is per core, a task moved between cores is not counted
+class LatProbe {
+public:
+  explicit LatProbe(lat_id_t id)
+      : id(id), core(xPortGetCoreID()), t0(xthal_get_ccount()) {}
+  ~LatProbe() {
+    uint32_t t = xthal_get_ccount();
+    if (xPortGetCoreID() == core)
+      lat_record(id, t - t0);
+  }
+
+private:
+  lat_id_t id;
+  uint32_t core;
+  uint32_t t0;
+};
+
+#define LAT_SCOPE(id) LatProbe latProbe_(id)
+
+esp_err_t lat_init(void);
+const char *lat_name(lat_id_t id);
+void lat_get(lat_id_t id, lat_hist_t *out);
+void lat_reset(void);
+int lat_line(lat_id_t id, char *buf, size_t len);
+void lat_print(void);
+
+#else
+
+#define LAT_SCOPE(id)
+
+#endif // LATENCY_PROBES
+
+#endif // _LATPROBE_H
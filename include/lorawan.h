@@ -16,6 +16,7 @@
 #include <arduino_lmic_hal_boards.h>
 #include "loraconf.h"
 #include "nbiot.h"
+#include "fuota.h"
 
 // Needed for 24AA02E64, does not hurt anything if included and not used
 #ifdef MCP_24AA02E64_I2C_ADDRESS
@@ -37,6 +38,9 @@ extern bool nb_data_mode;
 
 esp_err_t lora_stack_init(bool do_join);
 void lora_setupForNetwork(bool preJoin);
+void lora_session_save(bool force);
+bool lora_session_restore(void);
+void lora_session_erase(void);
 void lmictask(void *pvParameters);
 void gen_lora_deveui(uint8_t *pdeveui);
 void RevBytes(unsigned char *b, size_t c);
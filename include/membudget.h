@@ -0,0 +1,92 @@
+#ifndef _MEMBUDGET_H
+#define _MEMBUDGET_H
+
+#include "globals.h"
+
+// memory budget: every long lived task stack, send queue and large i/o
+// buffer is listed in one table in membudget.cpp and carved exactly once
+#define MEM_SAMPLE_MS 1000 // queue fill level sampling cycle [ms]
+
+typedef enum { mem_task, mem_queue, mem_buffer } mem_kind_t;
+
+// keep in sync with budget table in membudget.cpp
+typedef enum {
+  // task stacks
+  MEM_TASK_IRQHANDLER,
+#if (HAS_LED != NOT_A_PIN) || defined(HAS_RGB_LED)
+  MEM_TASK_LEDLOOP,
+#endif
+#if (BLECOUNTER)
+  MEM_TASK_BTHANDLER,
+#endif
+#if (HAS_GPS)
+  MEM_TASK_GPSLOOP,
+#endif
+#ifdef HAS_SPI
+  MEM_TASK_SPILOOP,
+#endif
+#if (HAS_LORA)
+  MEM_TASK_LMIC,
+  MEM_TASK_LORASEND,
+#if (USE_FUOTA)
+  MEM_TASK_FUOTA,
+#endif
+#endif
+#if (HAS_NBIOT)
+  MEM_TASK_NB,
+#endif
+#ifdef HAS_SDCARD
+  MEM_TASK_SDSERVICE,
+  MEM_TASK_SDQFLUSHER,
+  MEM_TASK_SDREINSERT,
+#endif
+#if (defined HAS_IF482 || defined HAS_DCF77)
+  MEM_TASK_CLOCK,
+#endif
+#if (TIME_SYNC_LORASERVER)
+  MEM_TASK_TIMESYNC,
+#endif
+#if (DEFERRED_LOG)
+  MEM_TASK_DLOG,
+#endif
+  MEM_TASK_SCHED0,
+  MEM_TASK_SCHED1,
+  // send queues
+#if (HAS_LORA)
+  MEM_QUEUE_LORASEND,
+#endif
+#if (HAS_NBIOT)
+  MEM_QUEUE_NBSEND,
+#endif
+#ifdef HAS_SPI
+  MEM_QUEUE_SPISEND,
+#endif
+#ifdef HAS_SDCARD
+  MEM_QUEUE_SDREQ,
+#endif
+  // i/o buffers
+  MEM_BUF_IOARENA, // leased modem, http and update buffers, see ioarena.h
+  MEM_BUF_SLIDEWIN, // countermode 4 hash table, see slidewin.h
+#ifdef HAS_SDCARD
+  MEM_BUF_SDLINES, // csv lines parked on a full sd request queue
+#endif
+  MEM_BUDGET_COUNT
+} mem_id_t;
+
+BaseType_t mem_task_create(mem_id_t id, TaskFunction_t fn, void *param,
+                           UBaseType_t prio, TaskHandle_t *handle,
+                           BaseType_t core);
+QueueHandle_t mem_queue_create(mem_id_t id);
+void *mem_buffer_get(mem_id_t id);
+size_t mem_buffer_size(mem_id_t id);
+void mem_buffer_used(mem_id_t id, uint32_t used);
+esp_err_t mem_budget_init(void);
+int32_t mem_budget_peak(mem_id_t id);
+uint32_t mem_budget_size(mem_id_t id);
+mem_kind_t mem_budget_kind(mem_id_t id);
+const char *mem_budget_name(mem_id_t id);
+void *mem_budget_handle(mem_id_t id);
+int mem_task_find(TaskHandle_t handle);
+void mem_budget_print(void);
+
+#endif // _MEMBUDGET_H
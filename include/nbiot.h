@@ -39,6 +39,12 @@
 
 #define MAX_MQTT_PUBLISH_FAILURES 3  // errores consecutivos AT+QMTPUB antes de reconectar
 
+#define MAX_COAP_OPEN_FAILURES 5 // MAX NB CoAP socket failures before restarting
+#define NB_COAP_PATH "up"        // CoAP uplink resource
+#define NB_COAP_BATCH 8          // messages per CoAP post, block-wise above COAP_BLOCK_SIZE
+
+#define NB_IDLE_POLL_MS 1000 // nb task wakeup between psm/edrx windows
+
 
 class NbIotManager {
     bool enabled;
@@ -58,12 +64,12 @@ class NbIotManager {
     int subscribeFailures;
     int mqttSendFailures;
 
-    long nbLastStatusCheck;
-
     int mqttPublishFailures;
 
+    bool coapReady;
+    int coapFailures;
+
     char updatesServerResponse[1600];
-    long lastUpdateCheck;
     bool updateReadyToInstall;
 
     public:
@@ -73,6 +79,8 @@ class NbIotManager {
 
         void loop();
         void set_enabled(int control);
+        bool powerSaving();
+        bool resting();
     private:
         void nb_init();
         void nb_loop();
@@ -81,6 +89,8 @@ class NbIotManager {
         void nb_connectNetwork();
         void nb_connectMqtt();
         void nb_subscribeMqtt();
+        void nb_openCoap();
+        bool nb_requeue(MessageBuffer_t *SendBuffer, int count);
         void nb_readMessages();
         void nb_sendMessages();
         void nb_resetStatus();
@@ -106,6 +116,7 @@ void nb_queuereset(void);
 void nb_enable(bool temporary);
 void nb_disable(void);
 bool nb_isEnabled(void);
+void nb_sendcycle(void);
 esp_err_t nb_iot_init();
 
 // === ADEMUX: envío directo por NB-IoT sin pasar por cola ===
@@ -118,5 +129,7 @@ extern uint8_t nb_status_connected;
 extern uint8_t nb_status_failures;
 // nb_status_rssi eliminado — sustituido por nb_status_rsrp en BC95.hpp
 extern bool nb_module_ok;
+extern bool nb_warm_start;
+extern uint16_t nb_ttfp;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,34 @@
+#ifndef _NSONMI_H
+#define _NSONMI_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "httpstream.h"
+
+// scanner of the BC95 socket receive output, +NSONMI:<socket>,<length>,<hex>
+// segments are hex decoded while they arrive and fed to an http parser, a
+// +NSOCLI of the socket closes the response. Only the head of a line is
+// kept. No Arduino dependencies, extras/hosttest/httpbench.cpp links this
+// file as is
+#define NSONMI_SIZE -4 // segment length does not match its hex data
+
+typedef struct {
+  int socket;
+  char head[32];   // line up to start of hex data
+  uint8_t headlen;
+  bool data;       // inside hex data of a segment
+  bool mine;       // segment belongs to our socket
+  int8_t nibble;   // pending high nibble, -1 if none
+  uint16_t expected, got;
+  uint8_t out[64]; // decoded bytes not yet fed
+  uint8_t outlen;
+} nsonmi_scan_t;
+
+void nsonmi_init(nsonmi_scan_t *s, int socket);
+// returns HTTP_STREAM_MORE, _DONE when response or socket ended, or < 0
+int nsonmi_feed(nsonmi_scan_t *s, char c, http_stream_t *hs);
+// value of a hex digit, -1 if c is none
+int nsonmi_hex(char c);
+
+#endif // _NSONMI_H
@@ -0,0 +1,68 @@
+#ifndef _OCCSERIES_H
+#define _OCCSERIES_H
+
+#include <stdint.h>
+
+// occupancy time series: unique devices per sniff type at 1 min, 15 min and
+// hourly resolution in fixed ring buffers. Uniques of a minute are counted
+// exactly in a hash set. Each minute also fills a HyperLogLog sketch, coarser
+// buckets merge the sketches of their minutes, so a device seen in several
+// minutes of an hour counts once for that hour. No Arduino dependencies,
+// extras/hosttest/occtest.cpp links this file as is
+#define OCC_TYPES 3     // MAC_SNIFF_WIFI, MAC_SNIFF_BLE, MAC_SNIFF_BT
+#define OCC_HLL_BITS 7  // 128 registers per type, ~9% standard error
+#define OCC_MIN_SLOTS 180 // 3 h of minutes
+#define OCC_QH_SLOTS 96   // 24 h of quarter hours
+#define OCC_HOUR_SLOTS 168 // 7 days of hours
+#define OCC_NODATA 0xFFFF  // device was not running, or out of range
+#define OCC_MIN_HASHES 1024 // hash set slots of an open minute, 3/4 are used
+
+#define OCC_REGS (1 << OCC_HLL_BITS)
+
+typedef enum { occ_minute, occ_quarter, occ_hour, OCC_LEVELS } occ_level_t;
+
+typedef struct {
+  uint8_t reg[OCC_TYPES][OCC_REGS];
+} occ_sketch_t;
+
+// an open minute, its hash set is a separate array of OCC_MIN_HASHES
+typedef struct {
+  uint16_t n[OCC_TYPES]; // exact uniques
+  uint16_t used;         // hash set slots taken
+  bool full;             // hashes did not fit, n is a lower bound
+  occ_sketch_t sketch;   // merged into quarter and hour
+} occ_minute_t;
+
+// plain data, checkpointed to SD as is
+typedef struct {
+  uint32_t last[OCC_LEVELS];   // newest closed bucket number, 0 = none
+  uint32_t openNo[OCC_LEVELS]; // bucket merging minutes, 0 = none
+  occ_sketch_t open[OCC_LEVELS - 1]; // quarter, hour
+  uint16_t minute[OCC_MIN_SLOTS][OCC_TYPES];
+  uint16_t quarter[OCC_QH_SLOTS][OCC_TYPES];
+  uint16_t hour[OCC_HOUR_SLOTS][OCC_TYPES];
+} occ_series_t;
+
+// bucket length [minutes] of a level
+extern const uint8_t occ_level_min[OCC_LEVELS];
+
+uint32_t occ_hash(const uint8_t *mac, uint32_t key);
+void occ_sketch_add(occ_sketch_t *s, uint8_t type, uint32_t hash);
+void occ_sketch_merge(occ_sketch_t *dst, const occ_sketch_t *src);
+uint16_t occ_sketch_estimate(const occ_sketch_t *s, uint8_t type);
+// counts hash once for the minute m, set is its hash set, 0 = free slot
+void occ_minute_add(occ_minute_t *m, uint32_t *set, uint8_t type,
+                    uint32_t hash);
+
+void occ_series_reset(occ_series_t *ts);
+// closes minute (epoch / 60) with its exact uniques, rolls its sketch up
+// into quarter and hour. A full minute stores the sketch estimate where that
+// is larger. Minutes skipped since the last one are stored as OCC_NODATA.
+// Returns false if minute is not newer than the last one
+bool occ_series_close(occ_series_t *ts, uint32_t minute,
+                      const occ_minute_t *m);
+// copies n buckets starting at bucket number first, OCC_NODATA where none
+void occ_series_query(const occ_series_t *ts, uint8_t level, uint32_t first,
+                      uint8_t n, uint16_t (*out)[OCC_TYPES]);
+
+#endif // _OCCSERIES_H
@@ -0,0 +1,22 @@
+#ifndef _OCCUPANCY_H
+#define _OCCUPANCY_H
+
+#include "occseries.h"
+
+// unique device counts at 1 min, 15 min and hourly resolution for backfill
+// by remote command 0x8D, checkpointed to SD after every quarter hour
+#define OCC_TICK_MS 10000          // elapsed minutes are closed this late
+#define OCC_FILE_NAME "paxocc.bin" // checkpoint
+#define OCC_MAGIC 0x3143434F       // "OCC1"
+#define OCC_QUERY_MAX 42           // buckets per remote command, 6 frames
+
+esp_err_t occ_init(void);
+void occ_add(uint8_t type, const uint8_t *mac);
+uint8_t occ_query(uint8_t level, uint32_t from, uint8_t n, uint32_t *first,
+                  uint16_t (*out)[OCC_TYPES]);
+void occ_print_stats(void);
+
+// card level, runs on the sd service task only
+void occ_card_load(void);
+
+#endif // _OCCUPANCY_H
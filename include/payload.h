@@ -51,14 +51,15 @@ public:
   void addSaltVersion(uint32_t value);
   void addSaltTimestamp(uint32_t value);
   void addConfig(configData_t value);
-  // === ADEMUX: addStatus extendido a 19 bytes (offset 14=nb_rsrp, 17=nb_snr, 18=nb_ecl) ===
+  // === ADEMUX: addStatus extendido a 21 bytes (offset 14=nb_rsrp, 17=nb_snr, 18=nb_ecl, 19-20=nb_ttfp) ===
   void addStatus(uint32_t uptime, uint8_t cputemp,
                   uint16_t free_heap_div16, uint16_t min_heap_div16,
                   uint8_t reset_reason, uint8_t flags1, uint8_t flags2,
                   uint8_t lora_rssi, int8_t lora_snr,
                   uint8_t nb_rsrp, uint8_t nb_failures,
                   uint8_t flags3,
-                  uint8_t nb_snr_encoded, uint8_t nb_ecl);
+                  uint8_t nb_snr_encoded, uint8_t nb_ecl,
+                  uint16_t nb_ttfp);
   void addAlarm(int8_t rssi, uint8_t message);
   void addVoltage(uint16_t value);
   void addGPS(gpsStatus_t value);
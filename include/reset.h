@@ -4,6 +4,7 @@
 #include <driver/rtc_io.h>
 #include <rom/rtc.h>
 #include "i2c.h"
+#include "configmanager.h"
 
 void do_reset(bool warmstart);
 void do_after_reset(int reason);
@@ -0,0 +1,35 @@
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+
+#include "globals.h"
+
+// hierarchical timer wheel: 256 slots of one tick, then 2 levels of 64 slots
+#define SCHED_TICK_MS 100     // wheel resolution [ms]
+#define SCHED_WHEEL0_BITS 8   // 256 x 100ms = 25.6 sec
+#define SCHED_WHEELN_BITS 6   // 64 x 25.6 sec = 27 min, 64 x 27 min = 29 h
+#define SCHED_MAX_JOBS 20
+#define SCHED_TASK_PRIO 3
+#define SCHED_TASK_STACK 4096
+
+typedef void (*sched_fn_t)(void);
+
+typedef struct {
+  uint32_t runs;
+  uint32_t skipped;    // periods dropped because job was too late
+  uint32_t runMax_us;  // longest run time of job callback
+  uint64_t runSum_us;
+  uint32_t lateMax_ms; // worst lateness against nominal due time
+  uint64_t lateSum_ms;
+} sched_stats_t;
+
+esp_err_t sched_init(void);
+int sched_add(const char *name, sched_fn_t fn, uint32_t period_ms,
+              uint32_t jitter_ms, BaseType_t core);
+void sched_set_period(int id, uint32_t period_ms);
+void sched_trigger(int id, uint32_t delay_ms);
+void sched_stop(int id);
+const sched_stats_t *sched_get_stats(int id, const char **name);
+uint8_t sched_jobcount(void);
+void sched_print_stats(void);
+
+#endif // _SCHEDULER_H
@@ -7,6 +7,9 @@
 #include <SPI.h>
 #include <mySD.h>
 
+#include "sdservice.h"
+#include "sdlog.h"
+
 #define DEFAULT_GESINEN 1
 //#define DEFAULT_DIPUTACION 1
 
@@ -30,9 +33,20 @@
 #define DEFAULT_GATEWAY_ID "REMOTE"
 #endif
 
+#define DEFAULT_TRANSPORT nb_mqtt   // nb.cnf "transport": "mqtt" or "coap"
+#define DEFAULT_COAP_PORT 5683
+#define DEFAULT_NB_POWER nb_power_on // nb.cnf "power": "on", "psm" or "edrx"
+
 #define SDCARD_FILE_NAME       "paxcount.%02d"
 #define SDCARD_FILE_HEADER     "date, time, wifi, bluet"
 
+// queue and log files are preallocated as one contiguous extent each
+#define SDCARD_LOG_SIZE        (64UL * 1024 * 1024) // per log, rotated when full
+#define SDCARD_QUEUE_SIZE      (1024UL * 1024)      // paxqueue.q, grows if full
+#define SDCARD_QUEUE_COMPACT   128000 // move records to front when head is past
+#define SDCARD_QUEUE_COMPRESS  1    // new queues seal records into deflated blocks
+#define SDCARD_QUEUE_BLOCK     4096 // raw records per sealed block [bytes]
+
 bool sdcardInit( void );
 void sdcardWriteData( uint16_t, uint16_t);
 int sdcardReadFrame(MessageBuffer_t *message, int N);
@@ -48,11 +62,12 @@ bool openFile(std::string filename, FileMySD &file);
 bool createFolder(std::string path);
 bool folderExists(std::string path);
 bool isSDCardAvailable(); //nueva funcion para saber si hay SD
+uint16_t crc16_ccitt(const uint8_t *data, size_t len, uint16_t crc = 0xFFFF);
 void sdcardWriteLine(const char *line); //
 
 
 // ===== Persistent SD FIFO queue (paxqueue.q) =====
-bool sdqueueInit();
+bool sdqueueInit();         // all queue calls are served by the sd service task
 bool sdqueueEnqueue(MessageBuffer_t *msg);
 bool sdqueuePeek(MessageBuffer_t *msg);
 bool sdqueueDequeue(MessageBuffer_t *msg);
@@ -0,0 +1,64 @@
+#ifndef _SDLOG_H
+#define _SDLOG_H
+
+#include "globals.h"
+
+// binary TX event log, records are collected in RAM and written by the sd
+// service as one CRC'd frame per group commit, see src/SdLog/sdlog2csv.py
+#define SDLOG_FILE_NAME "paxbin.%02d"
+#define SDLOG_FILE_SIZE (16UL * 1024 * 1024) // preallocated, rotated when full
+#define SDLOG_BUF_SIZE 2048  // per buffer, two buffers alternate
+#define SDLOG_WATERMARK 1536 // commit at this fill [bytes], three SD blocks
+#define SDLOG_FLUSH_MS 10000 // commit records older than this [ms]
+#define SDLOG_MAGIC 0x31425850 // "PXB1"
+
+// event a message went through, keep in sync with sdlog2csv.py
+typedef enum {
+  SDLOG_TX_LORA_OK,
+  SDLOG_TX_SD_ENQ,
+  SDLOG_TX_NB_ENQ,
+  SDLOG_TX_SD_ENQ_PURGE,
+} sdlog_channel_t;
+
+typedef enum {
+  SDLOG_NONE,
+  SDLOG_NO_JOIN_PENDING,
+  SDLOG_NO_JOIN_QUEUE,
+  SDLOG_PENDING_AGE,
+  SDLOG_PENDING_AGE_NO_NB,
+  SDLOG_BUSY_TIMEOUT,
+  SDLOG_TOO_LARGE,
+  SDLOG_TOO_LARGE_NO_NB,
+  SDLOG_LMIC_ERROR,
+  SDLOG_LMIC_ERROR_NO_NB,
+  SDLOG_LORA_QUEUE_FULL,
+} sdlog_reason_t;
+
+#pragma pack(push, 1)
+// starts every group commit, crc covers seq, len and the records
+typedef struct {
+  uint32_t magic;
+  uint32_t seq; // frame counter since boot
+  uint16_t len; // record bytes following
+  uint16_t crc; // crc16 ccitt
+} sdlog_frame_t;
+
+// followed by size payload bytes
+typedef struct {
+  uint32_t ts; // epoch [s]
+  uint8_t channel;
+  uint8_t reason;
+  uint8_t port;
+  uint8_t size;
+} sdlog_rec_t;
+#pragma pack(pop)
+
+bool sdlog_write(uint8_t channel, uint8_t reason, const MessageBuffer_t *m);
+void sdlog_print_stats(void);
+
+// card level, runs on the sd service task only
+bool sdlog_card_open(void);
+void sdlog_card_close(void);
+void sdlog_commit(uint32_t maxAge);
+
+#endif // _SDLOG_H
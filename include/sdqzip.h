@@ -0,0 +1,19 @@
+#ifndef _SDQZIP_H
+#define _SDQZIP_H
+
+#include <stdint.h>
+
+// deflate of the sealed blocks of the SD queue, static huffman blocks of the
+// bundled uzlib (lib/ESP32-targz). No Arduino dependencies, the host bench in
+// lib/esp32-micro-sdcard/extras/hostbench links this file as is
+#define SDQZIP_HASH_BITS 10 // match finder table, 4 bytes per entry
+
+// compresses len bytes, returns a malloc'd buffer the caller frees, NULL if
+// out of memory. *zLen may be larger than len for random data
+uint8_t *sdqzip_deflate(const uint8_t *raw, uint16_t len, uint16_t *zLen);
+
+// inflates exactly rawLen bytes, never reads past z + zLen
+bool sdqzip_inflate(const uint8_t *z, uint16_t zLen, uint8_t *raw,
+                    uint16_t rawLen);
+
+#endif // _SDQZIP_H
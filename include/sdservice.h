@@ -0,0 +1,65 @@
+#ifndef _SDSERVICE_H
+#define _SDSERVICE_H
+
+#include "globals.h"
+
+// one task owns the SD card and all its open handles, other tasks post typed
+// requests, each request completes through an optional callback
+#define SD_REQ_QUEUE_SIZE 32 // pending requests
+#define SD_LINE_MAX 160      // csv line incl. terminator, longer lines are cut
+#define SD_FLUSH_MS 2000     // csv lines are batched, flushed at most this late
+#define SD_POST_WAIT_MS 1000 // csv writer blocks at most this long on full queue
+#define SD_LINE_OVERFLOW 4096 // csv lines parked while the queue is full [bytes]
+#define SD_HIST_BUCKETS 12   // latency histogram, <1 ms .. >=1 s, log2 ms
+
+typedef enum {
+  sd_req_line,    // append csv line, async
+  sd_req_enqueue, // persistent queue, sync
+  sd_req_dequeue,
+  sd_req_peek,
+  sd_req_count,
+  sd_req_call, // run a function on the service task, sync
+  sd_req_lend, // hand the card to the caller until sd_return(), sync
+  sd_req_log,  // commit the binary TX log buffer, async
+  SD_REQ_TYPES
+} sd_req_type_t;
+
+// result is the request result, < 0 if request could not be served
+typedef void (*sd_done_t)(int result, void *ctx);
+typedef int (*sd_fn_t)(void *arg);
+
+typedef struct {
+  uint8_t type;
+  uint32_t posted; // [us]
+  sd_done_t done;
+  void *ctx;
+  union {
+    char line[SD_LINE_MAX];
+    MessageBuffer_t msg;  // enqueue: message to store
+    MessageBuffer_t *out; // dequeue, peek: message read
+    struct {
+      sd_fn_t fn;
+      void *arg;
+    } call;
+  } u;
+} sd_req_t;
+
+esp_err_t sd_service_init(void);
+bool sd_post(sd_req_t *req, TickType_t wait);
+bool sd_post_line(const char *line, sd_done_t done, void *ctx);
+int sd_request(sd_req_type_t type, MessageBuffer_t *msg);
+int sd_call(sd_fn_t fn, void *arg);
+bool sd_borrow(void);
+void sd_return(void);
+void sd_print_stats(void);
+
+// card level work in sdcard.cpp, runs on the service task only
+bool sd_card_mount(void);
+void sd_csv_append(const char *line);
+void sd_csv_flush(void);
+bool sdq_card_enqueue(MessageBuffer_t *msg);
+bool sdq_card_dequeue(MessageBuffer_t *msg);
+bool sdq_card_peek(MessageBuffer_t *msg);
+uint32_t sdq_card_count(void);
+
+#endif // _SDSERVICE_H
@@ -21,7 +21,7 @@
 #include "sdcard.h"
 #endif
 
-extern Ticker sendcycler;
+extern int sendcycleJob;
 
 void SendPayload(uint8_t port, sendprio_t prio);
 void sendData(void);
@@ -29,5 +29,11 @@ void checkQueue();
 void checkSendQueues(void);
 void flushQueues();
 void sendcycle(void);
+void healthcheck(void);
+void sendHealthCheck(void);
+#if (HAS_NBIOT)
+void nbhealthcheck(void);
+void sendNbHealthCheck(void);
+#endif
 
 #endif // _SENDDATA_H_
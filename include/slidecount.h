@@ -0,0 +1,17 @@
+#ifndef _SLIDECOUNT_H
+#define _SLIDECOUNT_H
+
+#include "slidewin.h"
+
+// countermode 4: macs_wifi, macs_ble and macs_bt are the devices seen in the
+// last cfg.slidewindow minutes, see slidewin.h
+#define COUNTER_SLIDING 4
+#define SLIDE_TICK_MS 1000    // sweep and counter update cycle
+#define SLIDE_SWEEP_CHUNK 32  // slots swept per critical section
+
+esp_err_t slide_init(void);
+void slide_mac(uint8_t type, uint32_t hash);
+void slide_reset(void);
+void slide_print_stats(void);
+
+#endif // _SLIDECOUNT_H
@@ -0,0 +1,45 @@
+#ifndef _SLIDEWIN_H
+#define _SLIDEWIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// sliding window of hashed MACs: last seen minute per hash in a fixed open
+// addressing table, expired incrementally by a sweep hand, and a histogram
+// of live entries per minute, so "seen in the last N minutes" is a sum of N
+// counters at any time. No Arduino dependencies,
+// extras/hosttest/slidebench.cpp links this file as is
+#define SLIDE_TYPES 3  // MAC_SNIFF_WIFI, MAC_SNIFF_BLE, MAC_SNIFF_BT
+#define SLIDE_HIST 64  // minutes of histogram, window is 1 .. SLIDE_HIST - 1
+#define SLIDE_STAMP_BITS 14 // last seen minute mod 2^14, 11 days
+#define SLIDE_EMPTY 0       // key of a free slot
+
+// table memory for capacity entries
+#define SLIDE_BYTES(capacity) ((capacity) * (sizeof(uint32_t) + sizeof(uint16_t)))
+
+typedef struct {
+  uint32_t *key;  // hash, SLIDE_EMPTY = free
+  uint16_t *tag;  // type << SLIDE_STAMP_BITS | last seen minute
+  uint32_t mask;  // capacity - 1, capacity is a power of 2
+  uint32_t limit; // max. live entries, 7/8 of capacity
+  uint32_t live;  // entries in the table, expired or not
+  uint32_t peak;  // most live entries seen, limit once full
+  uint32_t hand;  // next slot the sweep looks at
+  uint32_t now;   // newest minute seen
+  uint16_t hist[SLIDE_TYPES][SLIDE_HIST]; // entries per last seen minute
+  uint32_t full;  // hashes refused, table at limit
+} slide_t;
+
+// capacity must be a power of 2, mem holds SLIDE_BYTES(capacity)
+void slide_create(slide_t *w, void *mem, uint32_t capacity, uint32_t minute);
+void slide_clear(slide_t *w, uint32_t minute);
+// notes hash seen at minute, returns 1 if it was not in the window, 0 if it
+// was, -1 if the table is full
+int slide_add(slide_t *w, uint8_t type, uint32_t hash, uint32_t minute,
+              uint8_t window);
+// looks at up to n slots, frees entries older than window, returns freed
+uint32_t slide_sweep(slide_t *w, uint32_t minute, uint8_t window, uint32_t n);
+// entries of type seen in the last window minutes, the current one included
+uint32_t slide_count(const slide_t *w, uint8_t type, uint8_t window);
+
+#endif // _SLIDEWIN_H
@@ -0,0 +1,44 @@
+#ifndef _SPIFRAME_H
+#define _SPIFRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// SPI slave frame: as many queued messages as fit into one transaction.
+// Little endian:
+//   magic, version, frame counter (2 bytes), records n, messages still
+//   queued (255 = 255 or more), record bytes len (2 bytes),
+//   n * (port, size, size bytes of payload), crc32 over all bytes before it
+// The master sends commands in the same format, records on RCMDPORT are run
+// by the command interpreter. No Arduino dependencies, the master emulator
+// extras/hosttest/spibench.cpp links this file as is
+#define SPI_FRAME_MAGIC 0xB5
+#define SPI_FRAME_VERSION 1
+#define SPI_FRAME_HEAD 8
+#define SPI_FRAME_CRC 4
+#define SPI_RECORD_HEAD 2
+
+typedef struct {
+  uint8_t *buf;
+  uint16_t size; // buffer bytes
+  uint16_t len;  // record bytes so far
+  uint8_t n;
+} spi_frame_t;
+
+void spi_frame_begin(spi_frame_t *f, uint8_t *buf, uint16_t size);
+// false if the record does not fit, the frame is unchanged then
+bool spi_frame_add(spi_frame_t *f, uint8_t port, const uint8_t *data,
+                   uint8_t size);
+// writes header and crc, returns bytes to clock out, padded to the 4 byte
+// multiple of at least 8 the SPI slave driver needs
+uint16_t spi_frame_end(spi_frame_t *f, uint16_t seq, uint8_t pending);
+
+// checks magic, version, length and crc of a received frame, returns its
+// record count or -1
+int spi_frame_check(const uint8_t *buf, uint16_t size);
+// record at *pos, start with pos = SPI_FRAME_HEAD, returns false past the
+// last record
+bool spi_frame_next(const uint8_t *buf, uint16_t *pos, uint8_t *port,
+                    const uint8_t **data, uint8_t *size);
+
+#endif // _SPIFRAME_H
@@ -25,8 +25,18 @@ licenses. Refer to LICENSE.txt file in repository for more details.
 #define _SPISLAVE_H
 
 #include "globals.h"
+#include "spiframe.h"
+
+// Each transaction carries one frame of include/spiframe.h packed with as
+// many queued messages as fit. Two frames are queued to the driver, so the
+// next one is ready while the master clocks out the current one. The master
+// may end a transaction after 8 + len + 4 bytes (padded to 4), or re-poll at
+// once while the frame header reports messages still queued
+#define SPI_FRAME_SIZE 512 // bytes per frame and DMA buffer, multiple of 4
+#define SPI_POLL_MS 50     // checks the queue while one frame is waiting
 
 esp_err_t spi_init();
+void spi_print_stats(void);
 
 extern TaskHandle_t spiTask;
 
@@ -0,0 +1,25 @@
+#ifndef _TASKSTATS_H
+#define _TASKSTATS_H
+
+// per task cpu share, sampled on every FreeRTOS tick of both cores, and
+// stack headroom of budgeted tasks, for remote command 0x8E and the health
+// check on TELEMETRYPORT. Report block, MSB first:
+//   period [s] (2 bytes), core 0 load [%], core 1 load [%], entries n,
+//   n * (task name (6 bytes, zero padded), cpu [per mille of one core]
+//   (2 bytes), free stack [bytes] (2 bytes, 0xFFFF = not budgeted))
+// src/TTN/taskstats_decoder.js decodes it
+#define TASKSTAT_MAX 24           // tasks tracked, the rest counts as "other"
+#define TASKSTAT_PERIOD_MS 60000  // report period
+#define TASKSTAT_NAME 6           // name bytes per entry
+#define TASKSTAT_ENTRY (TASKSTAT_NAME + 4)
+#define TASKSTAT_HEAD 5
+#define TASKSTAT_HEALTH_TOP 2     // busiest tasks appended to the health check
+
+esp_err_t taskstat_init(void);
+uint8_t taskstat_count(void);
+// appends the report block with entries first .. first + n - 1 (busiest
+// first) to payload, returns the number of entries added
+uint8_t taskstat_add(uint8_t first, uint8_t n);
+void taskstat_print(void);
+
+#endif // _TASKSTATS_H
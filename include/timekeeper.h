@@ -17,7 +17,7 @@
 #endif
 
 extern const char timeSetSymbols[];
-extern Ticker timesyncer;
+extern int timesyncJob;
 
 void IRAM_ATTR CLOCKIRQ(void);
 void clock_init(void);
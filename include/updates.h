@@ -9,13 +9,14 @@
 //#include <Update.h>
 #include <SPIFFS.h>
 #include <ESP32-targz.h>
+#include "updindex.h"
 
 #define UPDATE_FOLDER "update"
 #define MAX_DOWNLOAD_RETRIES 3
 #define MAX_DOWNLOAD_TIME 900*1000
 
 bool checkUpdateFile(char * filename, uint32_t crc);
-bool downloadUpdates(std::string index);
+bool downloadUpdates(const char *index);
 bool updateFromFS(void);
-bool removeUpdateFiles(std::string index);
+bool removeUpdateFiles(const char *index);
 #endif
\ No newline at end of file
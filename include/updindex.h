@@ -0,0 +1,29 @@
+#ifndef _UPDINDEX_H
+#define _UPDINDEX_H
+
+#include <stddef.h>
+
+// parser of the update server index, "<version>\r\n<parts> <checksums per
+// .chk file>", and the version query parameter of update requests. Fixed
+// buffers only, no heap. No Arduino dependencies,
+// extras/hosttest/arenatest.cpp links this file as is
+#define UPD_VERSION_LEN 32 // version incl. terminator
+
+#define UPD_INDEX_VERSION -1 // no version line, or too long
+#define UPD_INDEX_PARTS -2   // number of parts missing or out of range
+#define UPD_INDEX_PERFILE -3 // checksums per file missing or out of range
+
+typedef struct {
+  char version[UPD_VERSION_LEN];
+  long parts;
+  long perFile; // checksums per .chk file
+} upd_index_t;
+
+// version line of index, false if there is none or it does not fit
+bool upd_index_version(const char *index, char *version, size_t size);
+// returns 0 or UPD_INDEX_..., fields before the failing one are set
+int upd_index_parse(const char *index, upd_index_t *idx);
+// version as query parameter, dots become underscores
+void upd_version_param(const char *version, char *out, size_t size);
+
+#endif // _UPDINDEX_H
@@ -128,6 +128,20 @@ uint32_t FileMySD::size() {
   return _file->fileSize();
 }
 
+// reserves contiguous space for an empty file, the size stays 0
+boolean FileMySD::preAllocate(uint32_t length) {
+  if (! _file) return false;
+  return _file->preAllocate(length);
+}
+
+// true if the clusters are one run, checked once after open
+boolean FileMySD::isContiguous(void) {
+  if (! _file) return false;
+  if (_file->isContiguous()) return true;
+  uint32_t bgn, end;
+  return _file->contiguousRange(&bgn, &end);
+}
+
 void FileMySD::close() {
   if (_file) {
     _file->close();
@@ -0,0 +1,217 @@
+/* Host benchmark of the sealed blocks of the paxcounter SD queue.
+
+Generates the records sdcard.cpp enqueues during an outage: per send cycle a
+count message on COUNTERPORT and the hashed MAC lists on WIFIMACSPORT and
+BLEMACSPORT (4 byte time, up to 11 hashes, sorted set popped from the back as
+in senddata.cpp). Devices come from a population with a share that stays for
+many cycles, the salt is fixed, so a device keeps its hash. Records get the
+10 byte PaxQRecHdr and are cut into blocks of SDCARD_QUEUE_BLOCK raw bytes
+like sdq_seal_locked(), each block is deflated with src/sdqzip.cpp, inflated
+again and compared. Reported per scenario: compression ratio incl. the block
+header, 512 byte card blocks written for the backlog, and the deflate and
+inflate time per block on this host.
+
+  gcc -O2 -c ../../../ESP32-targz/src/uzlib/genlz77.c \
+      ../../../ESP32-targz/src/uzlib/defl_static.c \
+      ../../../ESP32-targz/src/uzlib/tinflate.c \
+      ../../../ESP32-targz/src/uzlib/crc32.c \
+      ../../../ESP32-targz/src/uzlib/adler32.c
+  g++ -O2 -I../../../../include -I../../../ESP32-targz/src -o qzbench \
+      qzbench.cpp ../../../../src/sdqzip.cpp *.o
+  ./qzbench [hours]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <random>
+#include <set>
+#include <vector>
+
+#include "sdqzip.h"
+
+#define SDCARD_QUEUE_BLOCK 4096 // include/sdcard.h
+#define SEND_CYCLE_S 60         // SENDCYCLE * 2
+
+#pragma pack(push, 1)
+struct PaxQRecHdr {
+  uint16_t len;
+  uint8_t port;
+  uint8_t prio;
+  uint32_t ts;
+  uint16_t crc;
+};
+struct PaxQBlkHdr {
+  uint16_t rawLen;
+  uint16_t zLen;
+  uint16_t records;
+  uint16_t crc;
+};
+#pragma pack(pop)
+
+static uint16_t crc16_ccitt(const uint8_t *data, size_t len,
+                            uint16_t crc = 0xFFFF) {
+  while (len--) {
+    crc ^= (uint16_t)(*data++) << 8;
+    for (int i = 0; i < 8; i++)
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+struct scenario_t {
+  const char *name;
+  int wifi, ble;  // devices seen per cycle
+  double resident; // share of them staying for many cycles
+};
+
+static const scenario_t scenarios[] = {
+    {"quiet street", 6, 4, 0.8},
+    {"office", 40, 25, 0.7},
+    {"busy square", 120, 60, 0.3},
+    {"all new hashes", 80, 40, 0.0},
+};
+
+static std::mt19937 rng(1);
+
+static void put_be32(std::vector<uint8_t> &p, uint32_t v) {
+  for (int s = 24; s >= 0; s -= 8)
+    p.push_back((v >> s) & 0xFF);
+}
+
+static void add_record(std::vector<uint8_t> &q, uint8_t port, uint32_t ts,
+                       const std::vector<uint8_t> &payload) {
+  PaxQRecHdr rh;
+  rh.len = payload.size();
+  rh.port = port;
+  rh.prio = port == 1 ? 3 : 1;
+  rh.ts = ts;
+  rh.crc = crc16_ccitt((const uint8_t *)&rh, sizeof(rh) - sizeof(rh.crc));
+  rh.crc = crc16_ccitt(payload.data(), payload.size(), rh.crc);
+  const uint8_t *h = (const uint8_t *)&rh;
+  q.insert(q.end(), h, h + sizeof(rh));
+  q.insert(q.end(), payload.begin(), payload.end());
+}
+
+// hashes of one cycle: residents drift slowly, the rest is new every cycle
+static void cycle_macs(std::vector<uint32_t> &residents, int n, double share,
+                       std::set<uint32_t> &out) {
+  int keep = (int)(n * share + 0.5);
+  while ((int)residents.size() < keep)
+    residents.push_back(rng());
+  if (!residents.empty() && (rng() % 10 == 0))
+    residents[rng() % residents.size()] = rng();
+  for (int i = 0; i < keep; i++)
+    out.insert(residents[i]);
+  while ((int)out.size() < n)
+    out.insert(rng());
+}
+
+static void add_macs(std::vector<uint8_t> &q, uint8_t port, uint32_t ts,
+                     const std::set<uint32_t> &macs) {
+  std::vector<uint32_t> v(macs.begin(), macs.end());
+  while (!v.empty()) {
+    std::vector<uint8_t> p;
+    put_be32(p, ts);
+    for (int i = 0; i < 11 && !v.empty(); i++) {
+      put_be32(p, v.back());
+      v.pop_back();
+    }
+    add_record(q, port, ts, p);
+  }
+}
+
+static double now_us() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e6 + t.tv_nsec / 1e3;
+}
+
+static void run(const scenario_t &s, int hours) {
+  std::vector<uint8_t> q;
+  std::vector<uint32_t> resWifi, resBle;
+  uint32_t ts = 1760000000;
+  uint32_t records = 0;
+  for (int c = 0; c < hours * 3600 / SEND_CYCLE_S; c++, ts += SEND_CYCLE_S) {
+    int jitter = (int)(rng() % 5) - 2;
+    std::set<uint32_t> wifi, ble;
+    cycle_macs(resWifi, s.wifi + jitter, s.resident, wifi);
+    cycle_macs(resBle, s.ble + jitter, s.resident, ble);
+
+    std::vector<uint8_t> p;
+    put_be32(p, ts);
+    p.push_back(wifi.size() >> 8);
+    p.push_back(wifi.size() & 0xFF);
+    p.push_back(ble.size() >> 8);
+    p.push_back(ble.size() & 0xFF);
+    add_record(q, 1, ts, p);
+    add_macs(q, 10, ts, wifi);
+    add_macs(q, 7, ts, ble);
+  }
+
+  // cut into blocks at record boundaries, as the staging area fills
+  uint32_t blocks = 0, stored = 0, sealed = 0;
+  double defl = 0, infl = 0, worst = 0;
+  static uint8_t back[SDCARD_QUEUE_BLOCK];
+  size_t pos = 0;
+  while (pos < q.size()) {
+    size_t len = 0;
+    uint16_t n = 0;
+    while (pos + len + sizeof(PaxQRecHdr) <= q.size()) {
+      PaxQRecHdr rh;
+      memcpy(&rh, &q[pos + len], sizeof(rh));
+      size_t r = sizeof(rh) + rh.len;
+      if (len + r > SDCARD_QUEUE_BLOCK)
+        break;
+      len += r;
+      n++;
+    }
+    records += n;
+
+    double t0 = now_us();
+    uint16_t zLen = 0;
+    uint8_t *z = sdqzip_deflate(&q[pos], len, &zLen);
+    double t1 = now_us();
+    if (!z) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+    }
+    if (zLen >= len) {
+      stored++;
+      zLen = len;
+    } else {
+      if (!sdqzip_inflate(z, zLen, back, len) || memcmp(back, &q[pos], len)) {
+        fprintf(stderr, "%s: block %u does not inflate\n", s.name, blocks);
+        exit(1);
+      }
+      infl += now_us() - t1;
+    }
+    free(z);
+    defl += t1 - t0;
+    if (t1 - t0 > worst)
+      worst = t1 - t0;
+    sealed += sizeof(PaxQBlkHdr) + zLen;
+    blocks++;
+    pos += len;
+  }
+
+  uint32_t inflated = blocks - stored;
+  printf("%-15s %7u rec %8u B raw -> %8u B sealed  ratio %.2f  "
+         "card blocks %5u -> %5u  deflate %5.0f us (max %5.0f)  "
+         "inflate %4.0f us  stored %u/%u\n",
+         s.name, records, (unsigned)q.size(), sealed,
+         (double)q.size() / sealed, (unsigned)(q.size() + 511) / 512,
+         (sealed + 511) / 512, defl / blocks, worst,
+         inflated ? infl / inflated : 0.0, stored, blocks);
+}
+
+int main(int argc, char **argv) {
+  int hours = argc > 1 ? atoi(argv[1]) : 72;
+  printf("%d h outage, %d s send cycle, %d B blocks, hash bits %d\n", hours,
+         SEND_CYCLE_S, SDCARD_QUEUE_BLOCK, SDQZIP_HASH_BITS);
+  for (const scenario_t &s : scenarios)
+    run(s, hours);
+  return 0;
+}
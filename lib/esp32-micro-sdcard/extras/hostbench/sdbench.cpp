@@ -0,0 +1,305 @@
+/* Host benchmark of the SdFat block layer with the paxcounter SD workload.
+
+Sd2Card is replaced by a RAM block device that counts card commands, the
+volume is a freshly formatted FAT32 image. The workload replays what
+sdcard.cpp does: each record is enqueued to /paxqueue.q (read header, append
+record, rewrite header, sync, close) and one csv line is appended and synced
+to the open log. With "prealloc" as second argument the queue stays open with
+a cached header and both files are preallocated contiguous extents, as done
+by sdcard.cpp now. Per record the mean and worst number of card commands and
+of FAT block accesses are reported. A second phase writes and reads back an
+update part file in 2 KB chunks like updates.cpp. Build it once with the
+original single block cache and once with the default cache to compare:
+
+  g++ -O2 -DESP32 -Istub -I../../utility -DSD_CACHE_FAT_BLOCKS=0 \
+      -DSD_CACHE_DATA_BLOCKS=1 -DSD_MULTI_BLOCK=0 -o bench_single \
+      sdbench.cpp ../../utility/SdFile.cpp ../../utility/SdVolume.cpp
+  g++ -O2 -DESP32 -Istub -I../../utility -o bench_lru \
+      sdbench.cpp ../../utility/SdFile.cpp ../../utility/SdVolume.cpp
+  ./bench_single 1000; ./bench_lru 1000; ./bench_lru 1000 prealloc
+*/
+
+#include <stdlib.h>
+
+#include <map>
+#include <vector>
+
+#include "SdFat.h"
+
+HostSerial Serial;
+
+// ---------------- RAM block device ----------------
+
+static const uint32_t CARD_BLOCKS = 1UL << 20;  // 512 MB
+static std::map<uint32_t, std::vector<uint8_t> > disk;
+
+struct card_stats_t {
+  uint32_t fat;     // blocks read or written in the FAT area
+  uint32_t cmd17;   // single block reads
+  uint32_t cmd18;   // multiple block reads
+  uint32_t rdMulti; // blocks read by cmd18
+  uint32_t cmd24;   // single block writes
+  uint32_t cmd25;   // multiple block writes
+  uint32_t wrMulti; // blocks written by cmd25
+};
+static card_stats_t stats;
+static uint32_t multiBlock;  // next block of a cmd25 sequence
+static uint32_t fatStart, fatEnd;  // FAT area, both copies
+
+static void countFat(uint32_t block, uint32_t count) {
+  for (uint32_t b = block; b < block + count; b++) {
+    if (b >= fatStart && b < fatEnd) stats.fat++;
+  }
+}
+
+static uint8_t* blockData(uint32_t block) {
+  std::vector<uint8_t>& b = disk[block];
+  if (b.empty()) b.resize(512, 0);
+  return b.data();
+}
+
+uint8_t Sd2Card::readData(uint32_t block, uint16_t offset, uint16_t count,
+                          uint8_t* dst) {
+  if (block >= CARD_BLOCKS || offset + count > 512) return false;
+  stats.cmd17++;
+  countFat(block, 1);
+  memcpy(dst, blockData(block) + offset, count);
+  return true;
+}
+
+uint8_t Sd2Card::readBlock(uint32_t block, uint8_t* dst) {
+  return readData(block, 0, 512, dst);
+}
+
+uint8_t Sd2Card::readBlocks(uint32_t block, uint16_t count, uint8_t* dst) {
+  if (count == 1) return readBlock(block, dst);
+  if (block + count > CARD_BLOCKS) return false;
+  stats.cmd18++;
+  stats.rdMulti += count;
+  countFat(block, count);
+  for (uint16_t i = 0; i < count; i++) memcpy(dst + 512 * i, blockData(block + i), 512);
+  return true;
+}
+
+uint8_t Sd2Card::writeBlock(uint32_t block, const uint8_t* src) {
+  if (block == 0 || block >= CARD_BLOCKS) return false;
+  stats.cmd24++;
+  countFat(block, 1);
+  memcpy(blockData(block), src, 512);
+  return true;
+}
+
+uint8_t Sd2Card::writeStart(uint32_t block, uint32_t eraseCount) {
+  if (block == 0 || block + eraseCount > CARD_BLOCKS) return false;
+  stats.cmd25++;
+  multiBlock = block;
+  return true;
+}
+
+uint8_t Sd2Card::writeData(const uint8_t* src) {
+  stats.wrMulti++;
+  countFat(multiBlock, 1);
+  memcpy(blockData(multiBlock++), src, 512);
+  return true;
+}
+
+uint8_t Sd2Card::writeStop(void) { return true; }
+
+uint8_t Sd2Card::writeBlocks(uint32_t block, uint16_t count,
+                             const uint8_t* const* src) {
+  if (count == 1) return writeBlock(block, src[0]);
+  if (!writeStart(block, count)) return false;
+  for (uint16_t i = 0; i < count; i++) writeData(src[i]);
+  return writeStop();
+}
+
+// FAT32 super floppy, 4 KB clusters, two FATs, empty root in cluster 2
+static void formatFat32(void) {
+  const uint32_t reserved = 32, perCluster = 8;
+  uint32_t fatBlocks = 1;
+  for (;;) {
+    uint32_t clusters = (CARD_BLOCKS - reserved - 2 * fatBlocks) / perCluster;
+    uint32_t need = ((clusters + 2) * 4 + 511) / 512;
+    if (need <= fatBlocks) break;
+    fatBlocks = need;
+  }
+  fatStart = reserved;
+  fatEnd = reserved + 2 * fatBlocks;
+  fbs_t* fbs = reinterpret_cast<fbs_t*>(blockData(0));
+  fbs->bpb.bytesPerSector = 512;
+  fbs->bpb.sectorsPerCluster = perCluster;
+  fbs->bpb.reservedSectorCount = reserved;
+  fbs->bpb.fatCount = 2;
+  fbs->bpb.mediaType = 0XF8;
+  fbs->bpb.totalSectors32 = CARD_BLOCKS;
+  fbs->bpb.sectorsPerFat32 = fatBlocks;
+  fbs->bpb.fat32RootCluster = 2;
+  fbs->bootSectorSig0 = 0X55;
+  fbs->bootSectorSig1 = 0XAA;
+  for (uint8_t f = 0; f < 2; f++) {
+    uint32_t* fat = reinterpret_cast<uint32_t*>(blockData(reserved + f * fatBlocks));
+    fat[0] = 0X0FFFFFF8;
+    fat[1] = 0X0FFFFFFF;
+    fat[2] = 0X0FFFFFFF;
+  }
+}
+
+// ---------------- workload ----------------
+
+#pragma pack(push, 1)
+struct QHeader {  // PaxQHeader of sdcard.cpp
+  uint32_t magic;
+  uint8_t version;
+  uint8_t reserved[3];
+  uint32_t head, tail, count;
+  uint16_t hdrCrc, pad;
+};
+#pragma pack(pop)
+
+static SdVolume volume;
+static SdFile root;
+static SdFile csv;
+static SdFile queue;  // prealloc: open queue file
+static QHeader qh;    // prealloc: its cached header
+static bool prealloc;
+
+static void check(bool ok, const char* what) {
+  if (ok) return;
+  fprintf(stderr, "%s failed\n", what);
+  exit(1);
+}
+
+static void enqueue(uint32_t n) {
+  uint8_t rec[10 + 23];  // record header and a typical counter payload
+  memset(rec, n & 0XFF, sizeof(rec));
+
+  if (prealloc) {
+    // record first, then the header that points to it
+    check(queue.seekSet(qh.tail), "seek tail");
+    check(queue.write(rec, sizeof(rec)) == sizeof(rec), "write record");
+    check(queue.sync(), "sync record");
+    qh.tail += sizeof(rec);
+    qh.count++;
+    check(queue.seekSet(0), "seek header");
+    check(queue.write(&qh, sizeof(qh)) == sizeof(qh), "write header");
+    check(queue.sync(), "sync header");
+    return;
+  }
+
+  SdFile f;
+  QHeader h;
+  check(f.open(&root, "PAXQUEUE.Q", F_READ), "open queue");
+  check(f.read(&h, sizeof(h)) == sizeof(h), "read header");
+  f.close();
+
+  check(f.open(&root, "PAXQUEUE.Q", F_READ | F_WRITE), "open queue rw");
+  check(f.seekSet(h.tail), "seek tail");
+  check(f.write(rec, sizeof(rec)) == sizeof(rec), "write record");
+  h.tail += sizeof(rec);
+  h.count++;
+  check(f.seekSet(0), "seek header");
+  check(f.write(&h, sizeof(h)) == sizeof(h), "write header");
+  check(f.sync(), "sync queue");
+  f.close();
+}
+
+static void logLine(uint32_t n) {
+  char line[48];
+  snprintf(line, sizeof(line), "2026-10-19,12:%02u:%02u,%u,%u,3.92", n / 60 % 60,
+           n % 60, n % 97, n % 31);
+  csv.println(line);
+  check(csv.sync(), "sync csv");
+}
+
+static uint32_t commands(const card_stats_t& s) {
+  return s.cmd17 + s.cmd18 + s.cmd24 + s.cmd25;
+}
+
+static void report(const char* phase, uint32_t per, const card_stats_t& s) {
+  uint32_t cmds = commands(s);
+  uint32_t blocks = s.cmd17 + s.rdMulti + s.cmd24 + s.wrMulti;
+  printf("%-8s cmds %7.2f  blocks %7.2f  (rd %u+%u/%u wr %u+%u/%u) per %s\n",
+         phase, (double)cmds / per, (double)blocks / per, s.cmd17, s.cmd18,
+         s.rdMulti, s.cmd24, s.cmd25, s.wrMulti,
+         per > 1 ? "record" : "file");
+}
+
+int main(int argc, char** argv) {
+  uint32_t records = argc > 1 ? atoi(argv[1]) : 1000;
+  prealloc = argc > 2 && !strcmp(argv[2], "prealloc");
+  Sd2Card card;
+
+  formatFat32();
+  check(volume.init(&card), "volume init");
+  check(root.openRoot(&volume), "open root");
+
+  // empty queue and log, as after sdcardInit()
+  SdFile f;
+  QHeader h = {0x31515850, 1, {0}, sizeof(QHeader), sizeof(QHeader), 0, 0, 0};
+  check(f.open(&root, "PAXQUEUE.Q", F_READ | F_WRITE | F_CREAT), "create queue");
+  if (prealloc) check(f.preAllocate(1024UL * 1024), "preallocate queue");
+  check(f.write(&h, sizeof(h)) == sizeof(h), "init queue");
+  f.close();
+  if (prealloc) {
+    check(queue.open(&root, "PAXQUEUE.Q", F_READ | F_WRITE), "open queue");
+    check(queue.contiguousRange(&qh.head, &qh.tail), "queue contiguous");
+    qh = h;
+  }
+  check(csv.open(&root, "PAXCOUNT.00", F_READ | F_WRITE | F_CREAT), "create csv");
+  if (prealloc) check(csv.preAllocate(64UL * 1024 * 1024), "preallocate csv");
+  csv.println("date, time, wifi, bluet");
+  check(csv.sync(), "sync csv");
+
+  printf("cache %u fat + %u data blocks, multi block %s, files %s\n",
+         SD_CACHE_FAT_BLOCKS, SD_CACHE_DATA_BLOCKS,
+         SD_MULTI_BLOCK ? "on" : "off", prealloc ? "preallocated" : "grown");
+
+  memset(&stats, 0, sizeof(stats));
+  uint32_t worstCmds = 0, worstFat = 0;
+  for (uint32_t n = 0; n < records; n++) {
+    uint32_t cmds = commands(stats), fat = stats.fat;
+    enqueue(n);
+    logLine(n);
+    if (commands(stats) - cmds > worstCmds) worstCmds = commands(stats) - cmds;
+    if (stats.fat - fat > worstFat) worstFat = stats.fat - fat;
+  }
+  report("queue", records, stats);
+  printf("         fat %7.2f, worst record %u cmds %u fat blocks\n",
+         (double)stats.fat / records, worstCmds, worstFat);
+  if (prealloc) {
+    check(queue.isContiguous() && csv.isContiguous(), "still contiguous");
+    queue.close();
+  }
+
+  // update part, written and read back in 2 KB chunks
+  static uint8_t chunk[2048];
+  const uint32_t partSize = 64 * 1024;
+  memset(&stats, 0, sizeof(stats));
+  check(f.open(&root, "1.BIN", F_READ | F_WRITE | F_CREAT), "create part");
+  for (uint32_t pos = 0; pos < partSize; pos += sizeof(chunk)) {
+    memset(chunk, pos >> 11, sizeof(chunk));
+    check(f.write(chunk, sizeof(chunk)) == sizeof(chunk), "write part");
+  }
+  f.close();
+  report("write", 1, stats);
+
+  memset(&stats, 0, sizeof(stats));
+  check(f.open(&root, "1.BIN", F_READ), "open part");
+  for (uint32_t pos = 0; pos < partSize; pos += sizeof(chunk)) {
+    check(f.read(chunk, sizeof(chunk)) == sizeof(chunk), "read part");
+    check(chunk[0] == (uint8_t)(pos >> 11) &&
+              chunk[sizeof(chunk) - 1] == (uint8_t)(pos >> 11),
+          "verify part");
+  }
+  f.close();
+  report("read", 1, stats);
+
+  // queue and log survived the cache
+  check(f.open(&root, "PAXQUEUE.Q", F_READ), "reopen queue");
+  check(f.read(&h, sizeof(h)) == sizeof(h) && h.count == records &&
+            f.fileSize() == h.tail,
+        "verify queue");
+  f.close();
+  check(csv.fileSize() > records * 30, "verify csv");
+  return 0;
+}
@@ -0,0 +1,26 @@
+// host stand-in for the parts of Arduino.h the SdFat sources use
+#ifndef HOSTBENCH_ARDUINO_H
+#define HOSTBENCH_ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "Print.h"
+
+#define SS 5
+#define MOSI 23
+#define MISO 19
+#define SCK 18
+#define HIGH 1
+#define LOW 0
+#define OUTPUT 1
+#define INPUT 0
+
+class HostSerial : public Print {
+ public:
+  size_t write(uint8_t c) { return fputc(c, stdout) == EOF ? 0 : 1; }
+};
+extern HostSerial Serial;
+
+#endif
@@ -0,0 +1,38 @@
+// host stand-in for the Arduino Print class
+#ifndef HOSTBENCH_PRINT_H
+#define HOSTBENCH_PRINT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buf, size_t n) {
+    size_t done = 0;
+    while (n--) done += write(*buf++);
+    return done;
+  }
+  size_t print(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(long v) { return printf_("%ld", v); }
+  size_t print(unsigned long v) { return printf_("%lu", v); }
+  size_t print(int v) { return print((long)v); }
+  size_t print(unsigned int v) { return print((unsigned long)v); }
+  size_t println(void) { return print("\r\n"); }
+  size_t println(const char *s) { return print(s) + println(); }
+  void setWriteError(int err = 1) { writeError_ = err; }
+  int getWriteError() { return writeError_; }
+
+ private:
+  size_t printf_(const char *fmt, unsigned long v) {
+    char b[24];
+    int n = snprintf(b, sizeof(b), fmt, v);
+    return write((const uint8_t *)b, n);
+  }
+  int writeError_ = 0;
+};
+
+#endif
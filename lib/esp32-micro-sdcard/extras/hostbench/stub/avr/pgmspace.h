@@ -0,0 +1,7 @@
+// host stand-in, flash strings are plain strings
+#ifndef HOSTBENCH_PGMSPACE_H
+#define HOSTBENCH_PGMSPACE_H
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#endif
@@ -53,6 +53,8 @@ public:
   boolean seek(uint32_t pos);
   uint32_t position();
   uint32_t size();
+  boolean preAllocate(uint32_t length);
+  boolean isContiguous(void);
   void close();
   operator bool();
   char * name();
@@ -166,8 +166,9 @@ uint8_t Sd2Card::cardCommand(uint8_t cmd, uint32_t arg) {
   // select card
   chipSelectLow();
 
-  // wait up to 300 ms if busy
-  waitNotBusy(300);
+  // wait up to 300 ms if busy, a multiple block read is stopped while the
+  // card still sends data
+  if (cmd != CMD12) waitNotBusy(300);
 
   // send command
   spiSend(cmd | 0x40);
@@ -423,6 +424,44 @@ uint8_t Sd2Card::readBlock(uint32_t block, uint8_t* dst) {
   return readData(block, 0, 512, dst);
 }
 //------------------------------------------------------------------------------
+/**
+ * Read consecutive 512 byte blocks with one READ_MULTIPLE_BLOCK command.
+ *
+ * \param[in] block First logical block to be read.
+ * \param[in] count Number of blocks to read.
+ * \param[out] dst Pointer to the location that will receive count * 512 bytes.
+ *
+ * \return The value one, true, is returned for success and
+ * the value zero, false, is returned for failure.
+ */
+uint8_t Sd2Card::readBlocks(uint32_t block, uint16_t count, uint8_t* dst) {
+  if (count == 1) return readBlock(block, dst);
+  // use address if not SDHC card
+  if (type() != SD_CARD_TYPE_SDHC) block <<= 9;
+  if (cardCommand(CMD18, block)) {
+    error(SD_CARD_ERROR_CMD18);
+    goto fail;
+  }
+  for (uint16_t b = 0; b < count; b++, dst += 512) {
+    if (!waitStartBlock()) goto fail;
+    for (uint16_t i = 0; i < 512; i++) dst[i] = spiRec();
+    // skip crc
+    spiRec();
+    spiRec();
+  }
+  // r1b response, card is busy until it has stopped
+  if (cardCommand(CMD12, 0) || !waitNotBusy(SD_READ_TIMEOUT)) {
+    error(SD_CARD_ERROR_CMD12);
+    goto fail;
+  }
+  chipSelectHigh();
+  return true;
+
+ fail:
+  chipSelectHigh();
+  return false;
+}
+//------------------------------------------------------------------------------
 /**
  * Read part of a 512 byte block from an SD card.
  *
@@ -660,6 +699,27 @@ uint8_t Sd2Card::writeBlock(uint32_t blockNumber, const uint8_t* src) {
   return false;
 }
 //------------------------------------------------------------------------------
+/**
+ * Write consecutive 512 byte blocks with one WRITE_MULTIPLE_BLOCK command.
+ *
+ * \param[in] blockNumber First logical block to be written.
+ * \param[in] count Number of blocks to write.
+ * \param[in] src Pointers to the data of each block, blocks need not be
+ * adjacent in memory.
+ *
+ * \return The value one, true, is returned for success and
+ * the value zero, false, is returned for failure.
+ */
+uint8_t Sd2Card::writeBlocks(uint32_t blockNumber, uint16_t count,
+                             const uint8_t* const* src) {
+  if (count == 1) return writeBlock(blockNumber, src[0]);
+  if (!writeStart(blockNumber, count)) return false;
+  for (uint16_t b = 0; b < count; b++) {
+    if (!writeData(src[b])) return false;
+  }
+  return writeStop();
+}
+//------------------------------------------------------------------------------
 /** Write one data block in a multiple block write sequence */
 uint8_t Sd2Card::writeData(const uint8_t* src) {
   // wait for previous write to finish
@@ -212,6 +212,12 @@ class SdFile : public Print {
   uint8_t isDir(void) const {return type_ >= FAT_FILE_TYPE_MIN_DIR;}
   /** \return True if this is a SdFile for a file else false. */
   uint8_t isFile(void) const {return type_ == FAT_FILE_TYPE_NORMAL;}
+  /**
+   * \return True if the file is known to be one run of clusters, cluster
+   * numbers are then computed without reading the FAT.
+   * See preAllocate() and contiguousRange().
+   */
+  uint8_t isContiguous(void) const {return flags_ & F_FILE_CONTIGUOUS;}
   /** \return True if this is a SdFile for an open file/directory else false. */
   uint8_t isOpen(void) const {return type_ != FAT_FILE_TYPE_CLOSED;}
   /** \return True if this is a SdFile for a subdirectory else false. */
@@ -226,6 +232,7 @@ class SdFile : public Print {
   uint8_t open(SdFile* dirFile, const char* fileName, uint8_t oflag);
 
   uint8_t openRoot(SdVolume* vol);
+  uint8_t preAllocate(uint32_t length);
   static void printDirName(const dir_t& dir, uint8_t width);
   static void printFatDate(uint16_t fatDate);
   static void printFatTime(uint16_t fatTime);
@@ -373,14 +380,17 @@ class SdFile : public Print {
   // should be 0XF
   static uint8_t const F_OFLAG = (F_ACCMODE | F_APPEND | F_SYNC);
   // available bits
-  static uint8_t const F_UNUSED = 0X30;
+  static uint8_t const F_UNUSED = 0X10;
+  // clusters of file are contiguous up to contiguousEnd_
+  static uint8_t const F_FILE_CONTIGUOUS = 0X20;
   // use unbuffered SD read
   static uint8_t const F_FILE_UNBUFFERED_READ = 0X40;
   // sync of directory entry required
   static uint8_t const F_FILE_DIR_DIRTY = 0X80;
 
 // make sure F_OFLAG is ok
-#if ((F_UNUSED | F_FILE_UNBUFFERED_READ | F_FILE_DIR_DIRTY) & F_OFLAG)
+#if ((F_UNUSED | F_FILE_CONTIGUOUS | F_FILE_UNBUFFERED_READ | \
+  F_FILE_DIR_DIRTY) & F_OFLAG)
 #error flags_ bits conflict
 #endif  // flags_ bits
 
@@ -393,6 +403,7 @@ class SdFile : public Print {
   uint8_t   dirIndex_;      // index of entry in dirBlock 0 <= dirIndex_ <= 0XF
   uint32_t  fileSize_;      // file size in bytes
   uint32_t  firstCluster_;  // first cluster of file
+  uint32_t  contiguousEnd_; // last cluster of contiguous file
   SdVolume* vol_;           // volume where file is located
 
   // private functions
@@ -424,6 +435,44 @@ union cache_t {
   fbs_t    fbs;
 };
 //------------------------------------------------------------------------------
+/**
+ * Block cache size. FAT blocks and directory/data blocks are kept in separate
+ * LRU sets, so that file data does not evict the FAT and vice versa. With
+ * SD_CACHE_FAT_BLOCKS 0 all blocks share one set, SD_CACHE_FAT_BLOCKS 0 and
+ * SD_CACHE_DATA_BLOCKS 1 is the single block cache of the original library.
+ */
+#ifndef SD_CACHE_FAT_BLOCKS
+#define SD_CACHE_FAT_BLOCKS 2
+#endif
+#ifndef SD_CACHE_DATA_BLOCKS
+#define SD_CACHE_DATA_BLOCKS 4
+#endif
+#define SD_CACHE_BLOCKS (SD_CACHE_FAT_BLOCKS + SD_CACHE_DATA_BLOCKS)
+/** Take the cache buffers from PSRAM instead of internal RAM. */
+#ifndef SD_CACHE_PSRAM
+#ifdef BOARD_HAS_PSRAM
+#define SD_CACHE_PSRAM 1
+#else
+#define SD_CACHE_PSRAM 0
+#endif
+#endif
+/**
+ * Write runs of adjacent dirty cache blocks and full block file transfers
+ * with one WRITE/READ_MULTIPLE_BLOCK command instead of one per block.
+ */
+#ifndef SD_MULTI_BLOCK
+#define SD_MULTI_BLOCK 1
+#endif
+/**
+ * \brief State of one block cache entry
+ */
+struct cache_entry_t {
+  uint32_t block;   // cached block number, 0XFFFFFFFF if unused
+  uint32_t mirror;  // block number for mirror FAT, 0 if none
+  uint32_t used;    // lru stamp
+  uint8_t dirty;    // block must be written before eviction
+};
+//------------------------------------------------------------------------------
 /**
  * \class SdVolume
  * \brief Access FAT16 and FAT32 volumes on SD and SDHC cards.
@@ -437,8 +486,9 @@ class SdVolume {
    */
   static uint8_t* cacheClear(void) {
     cacheFlush();
+    cacheEntry_[cacheCurrent_].block = 0XFFFFFFFF;
     cacheBlockNumber_ = 0XFFFFFFFF;
-    return cacheBuffer_.data;
+    return cacheBuffer_->data;
   }
   /**
    * Initialize a FAT volume.  Try partition one first then try super
@@ -499,11 +549,15 @@ class SdVolume {
   // value for action argument in cacheRawBlock to indicate cache dirty
   static uint8_t const CACHE_FOR_WRITE = 1;
 
-  static cache_t cacheBuffer_;        // 512 byte cache for device blocks
-  static uint32_t cacheBlockNumber_;  // Logical number of block in the cache
+  static cache_t* cacheBuffer_;       // current block, last one cached
+  static uint32_t cacheBlockNumber_;  // Logical number of the current block
   static Sd2Card* sdCard_;            // Sd2Card object for cache
-  static uint8_t cacheDirty_;         // cacheFlush() will write block if true
-  static uint32_t cacheMirrorBlock_;  // block number for mirror FAT
+  static cache_t* cacheStore_;        // SD_CACHE_BLOCKS buffers
+  static cache_entry_t cacheEntry_[SD_CACHE_BLOCKS];
+  static uint8_t cacheCurrent_;       // entry of the current block
+  static uint32_t cacheClock_;        // lru stamp source
+  static uint32_t cacheFatStart_;     // blocks [start, end) go to the FAT set
+  static uint32_t cacheFatEnd_;
 //
   uint32_t allocSearchStart_;   // start cluster for alloc search
   uint8_t blocksPerCluster_;    // cluster size in blocks
@@ -526,8 +580,21 @@ class SdVolume {
            return clusterStartBlock(cluster) + blockOfCluster(position);}
   static uint8_t cacheFlush(void);
   static uint8_t cacheRawBlock(uint32_t blockNumber, uint8_t action);
-  static void cacheSetDirty(void) {cacheDirty_ |= CACHE_FOR_WRITE;}
+  static void cacheSetDirty(void) {
+    cacheEntry_[cacheCurrent_].dirty |= CACHE_FOR_WRITE;
+  }
+  static void cacheSetMirror(uint32_t block) {
+    cacheEntry_[cacheCurrent_].mirror = block;
+  }
   static uint8_t cacheZeroBlock(uint32_t blockNumber);
+  static uint8_t cacheNewBlock(uint32_t blockNumber);
+  static uint8_t cacheHas(uint32_t first, uint32_t count);
+  static void cacheInvalidate(uint32_t first, uint32_t count);
+  static int8_t cacheLookup(uint32_t blockNumber, uint8_t dirtyData);
+  static uint8_t cacheEvict(uint8_t i);
+  static void cacheSelect(uint8_t i);
+  static uint8_t cacheVictim(uint32_t blockNumber);
+  static uint8_t cacheWrite(uint8_t i);
   uint8_t chainSize(uint32_t beginCluster, uint32_t* size) const;
   uint8_t fatGet(uint32_t cluster, uint32_t* value) const;
   uint8_t fatPut(uint32_t cluster, uint32_t value);
@@ -544,8 +611,12 @@ class SdVolume {
     uint16_t count, uint8_t* dst) {
       return sdCard_->readData(block, offset, count, dst);
   }
+  uint8_t readBlocks(uint32_t block, uint16_t count, uint8_t* dst) {
+    return sdCard_->readBlocks(block, count, dst);
+  }
   uint8_t writeBlock(uint32_t block, const uint8_t* dst) {
     return sdCard_->writeBlock(block, dst);
   }
+  uint8_t writeBlocks(uint32_t block, uint16_t count, const uint8_t* src);
 };
 #endif  // SdFat_h
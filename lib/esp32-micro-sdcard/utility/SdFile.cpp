@@ -62,7 +62,7 @@ uint8_t SdFile::addDirCluster(void) {
 // return pointer to cached entry or null for failure
 dir_t* SdFile::cacheDirEntry(uint8_t action) {
   if (!SdVolume::cacheRawBlock(dirBlock_, action)) return NULL;
-  return SdVolume::cacheBuffer_.dir + dirIndex_;
+  return SdVolume::cacheBuffer_->dir + dirIndex_;
 }
 //------------------------------------------------------------------------------
 /**
@@ -89,6 +89,8 @@ uint8_t SdFile::close(void) {
  * the value zero, false, is returned for failure.
  * Reasons for failure include file is not contiguous, file has zero length
  * or an I/O error occurred.
+ *
+ * A contiguous file is marked, see isContiguous().
  */
 uint8_t SdFile::contiguousRange(uint32_t* bgnBlock, uint32_t* endBlock) {
   // error if no blocks
@@ -105,6 +107,8 @@ uint8_t SdFile::contiguousRange(uint32_t* bgnBlock, uint32_t* endBlock) {
       *bgnBlock = vol_->clusterStartBlock(firstCluster_);
       *endBlock = vol_->clusterStartBlock(c)
                   + vol_->blocksPerCluster_ - 1;
+      contiguousEnd_ = c;
+      flags_ |= F_FILE_CONTIGUOUS;
       return true;
     }
   }
@@ -143,9 +147,10 @@ uint8_t SdFile::createContiguous(SdFile* dirFile,
     return false;
   }
   fileSize_ = size;
+  contiguousEnd_ = firstCluster_ + count - 1;
 
   // insure sync() will update dir entry
-  flags_ |= F_FILE_DIR_DIRTY;
+  flags_ |= F_FILE_DIR_DIRTY | F_FILE_CONTIGUOUS;
   return sync();
 }
 //------------------------------------------------------------------------------
@@ -322,7 +327,7 @@ uint8_t SdFile::makeDir(SdFile* dir, const char* dirName) {
   if (!SdVolume::cacheRawBlock(block, SdVolume::CACHE_FOR_WRITE)) return false;
 
   // copy '.' to block
-  memcpy(&SdVolume::cacheBuffer_.dir[0], &d, sizeof(d));
+  memcpy(&SdVolume::cacheBuffer_->dir[0], &d, sizeof(d));
 
   // make entry for '..'
   d.name[1] = '.';
@@ -334,7 +339,7 @@ uint8_t SdFile::makeDir(SdFile* dir, const char* dirName) {
     d.firstClusterHigh = dir->firstCluster_ >> 16;
   }
   // copy '..' to block
-  memcpy(&SdVolume::cacheBuffer_.dir[1], &d, sizeof(d));
+  memcpy(&SdVolume::cacheBuffer_->dir[1], &d, sizeof(d));
 
   // set position after '..'
   curPosition_ = 2 * sizeof(d);
@@ -441,7 +446,7 @@ uint8_t SdFile::open(SdFile* dirFile, const char* fileName, uint8_t oflag) {
 
     // use first entry in cluster
     dirIndex_ = 0;
-    p = SdVolume::cacheBuffer_.dir;
+    p = SdVolume::cacheBuffer_->dir;
   }
   // initialize as empty file
   memset(p, 0, sizeof(dir_t));
@@ -509,7 +514,7 @@ uint8_t SdFile::open(SdFile* dirFile, uint16_t index, uint8_t oflag) {
 // open a cached directory entry. Assumes vol_ is initializes
 uint8_t SdFile::openCachedEntry(uint8_t dirIndex, uint8_t oflag) {
   // location of entry in cache
-  dir_t* p = SdVolume::cacheBuffer_.dir + dirIndex;
+  dir_t* p = SdVolume::cacheBuffer_->dir + dirIndex;
 
   // write or truncate is an error for a directory or read-only file
   if (p->attributes & (DIR_ATT_READ_ONLY | DIR_ATT_DIRECTORY)) {
@@ -585,6 +590,35 @@ uint8_t SdFile::openRoot(SdVolume* vol) {
   return true;
 }
 //------------------------------------------------------------------------------
+/**
+ * Allocate contiguous clusters to an empty file.
+ *
+ * The file size is not changed, data written later goes to the allocated
+ * clusters without FAT lookups or updates. Clusters past the end of file
+ * stay allocated when the file is closed. A file that grows past the
+ * allocated space gets clusters added one by one as usual.
+ *
+ * \param[in] length Number of bytes to allocate.
+ *
+ * \return The value one, true, is returned for success and
+ * the value zero, false, is returned for failure.
+ * Reasons for failure include the file is not open for write, already has
+ * clusters, no contiguous free space of \a length on the volume
+ * or an I/O error.
+ */
+uint8_t SdFile::preAllocate(uint32_t length) {
+  if (!isFile() || !(flags_ & F_WRITE) || firstCluster_ || length == 0) {
+    return false;
+  }
+  uint32_t count = ((length - 1) >> (vol_->clusterSizeShift_ + 9)) + 1;
+  if (!vol_->allocContiguous(count, &firstCluster_)) return false;
+  contiguousEnd_ = firstCluster_ + count - 1;
+
+  // link clusters to directory entry
+  flags_ |= F_FILE_DIR_DIRTY | F_FILE_CONTIGUOUS;
+  return sync();
+}
+//------------------------------------------------------------------------------
 /** %Print the name field of a directory entry in 8.3 format to Serial.
  *
  * \param[in] dir The directory structure containing the name.
@@ -688,6 +722,8 @@ int16_t SdFile::read(void* buf, uint16_t nbyte) {
         if (curPosition_ == 0) {
           // use first cluster in file
           curCluster_ = firstCluster_;
+        } else if (isContiguous()) {
+          curCluster_++;
         } else {
           // get next cluster from FAT
           if (!vol_->fatGet(curCluster_, &curCluster_)) return -1;
@@ -700,15 +736,31 @@ int16_t SdFile::read(void* buf, uint16_t nbyte) {
     // amount to be read from current block
     if (n > (512 - offset)) n = 512 - offset;
 
-    // no buffering needed if n == 512 or user requests no buffering
-    if ((unbufferedRead() || n == 512) &&
-      block != SdVolume::cacheBlockNumber_) {
-      if (!vol_->readData(block, offset, n, dst)) return -1;
+    // no buffering needed if n == 512 or user requests no buffering,
+    // a cached copy of the block may be dirty
+    if ((unbufferedRead() || n == 512) && !SdVolume::cacheHas(block, 1)) {
+      uint16_t count = 1;
+#if SD_MULTI_BLOCK
+      // whole blocks up to the end of the cluster with one command
+      if (n == 512 && type_ != FAT_FILE_TYPE_ROOT16) {
+        uint16_t max = vol_->blocksPerCluster_ - vol_->blockOfCluster(curPosition_);
+        while (count < max && (toRead >> 9) > count &&
+               !SdVolume::cacheHas(block + count, 1)) {
+          count++;
+        }
+      }
+#endif  // SD_MULTI_BLOCK
+      if (count > 1) {
+        if (!vol_->readBlocks(block, count, dst)) return -1;
+        n = count << 9;
+      } else if (!vol_->readData(block, offset, n, dst)) {
+        return -1;
+      }
       dst += n;
     } else {
       // read block to cache and copy data to caller
       if (!SdVolume::cacheRawBlock(block, SdVolume::CACHE_FOR_READ)) return -1;
-      uint8_t* src = SdVolume::cacheBuffer_.data + offset;
+      uint8_t* src = SdVolume::cacheBuffer_->data + offset;
       uint8_t* end = src + n;
       while (src != end) *dst++ = *src++;
     }
@@ -762,7 +814,7 @@ dir_t* SdFile::readDirCache(void) {
   curPosition_ += 31;
 
   // return pointer to entry
-  return (SdVolume::cacheBuffer_.dir + i);
+  return (SdVolume::cacheBuffer_->dir + i);
 }
 //------------------------------------------------------------------------------
 /**
@@ -939,6 +991,12 @@ uint8_t SdFile::seekSet(uint32_t pos) {
   uint32_t nCur = (curPosition_ - 1) >> (vol_->clusterSizeShift_ + 9);
   uint32_t nNew = (pos - 1) >> (vol_->clusterSizeShift_ + 9);
 
+  if (isContiguous()) {
+    // no need to follow the chain
+    curCluster_ = firstCluster_ + nNew;
+    curPosition_ = pos;
+    return true;
+  }
   if (nNew < nCur || curPosition_ == 0) {
     // must follow chain from first cluster
     curCluster_ = firstCluster_;
@@ -1104,8 +1162,9 @@ uint8_t SdFile::truncate(uint32_t length) {
   }
   fileSize_ = length;
 
-  // need to update directory entry
+  // need to update directory entry, clusters may have been freed
   flags_ |= F_FILE_DIR_DIRTY;
+  flags_ &= ~F_FILE_CONTIGUOUS;
 
   if (!sync()) return false;
 
@@ -1156,7 +1215,12 @@ size_t SdFile::write(const void* buf, uint16_t nbyte) {
         } else {
           curCluster_ = firstCluster_;
         }
+      } else if (isContiguous() && curCluster_ < contiguousEnd_) {
+        // next cluster of preallocated space
+        curCluster_++;
       } else {
+        // file grows past its contiguous space
+        flags_ &= ~F_FILE_CONTIGUOUS;
         uint32_t next;
         if (!vol_->fatGet(curCluster_, &next)) return false;
         if (vol_->isEOC(next)) {
@@ -1176,26 +1240,27 @@ size_t SdFile::write(const void* buf, uint16_t nbyte) {
     // block for data write
     uint32_t block = vol_->clusterStartBlock(curCluster_) + blockOfCluster;
     if (n == 512) {
-      // full block - don't need to use cache
-      // invalidate cache if block is in cache
-      if (SdVolume::cacheBlockNumber_ == block) {
-        SdVolume::cacheBlockNumber_ = 0XFFFFFFFF;
-      }
-      if (!vol_->writeBlock(block, src)) goto writeErrorReturn;
-      src += 512;
+      // full blocks - don't need to use cache, cached copies are dropped
+      uint16_t count = 1;
+#if SD_MULTI_BLOCK
+      // up to the end of the cluster with one command
+      uint16_t max = vol_->blocksPerCluster_ - blockOfCluster;
+      while (count < max && (nToWrite >> 9) > count) count++;
+#endif  // SD_MULTI_BLOCK
+      if (!vol_->writeBlocks(block, count, src)) goto writeErrorReturn;
+      n = count << 9;
+      src += n;
     } else {
       if (blockOffset == 0 && curPosition_ >= fileSize_) {
         // start of new block don't need to read into cache
-        if (!SdVolume::cacheFlush()) goto writeErrorReturn;
-        SdVolume::cacheBlockNumber_ = block;
-        SdVolume::cacheSetDirty();
+        if (!SdVolume::cacheNewBlock(block)) goto writeErrorReturn;
       } else {
         // rewrite part of block
         if (!SdVolume::cacheRawBlock(block, SdVolume::CACHE_FOR_WRITE)) {
           goto writeErrorReturn;
         }
       }
-      uint8_t* dst = SdVolume::cacheBuffer_.data + blockOffset;
+      uint8_t* dst = SdVolume::cacheBuffer_->data + blockOffset;
       uint8_t* end = dst + n;
       while (dst != end) *dst++ = *src++;
     }
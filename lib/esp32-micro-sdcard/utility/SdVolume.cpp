@@ -18,14 +18,30 @@
  * <http://www.gnu.org/licenses/>.
  */
 #include "SdFat.h"
+#if SD_CACHE_PSRAM
+#include <esp_heap_caps.h>
+#endif
+#if SD_CACHE_DATA_BLOCKS < 1
+#error SD_CACHE_DATA_BLOCKS must be at least 1
+#endif
 //------------------------------------------------------------------------------
-// raw block cache
+// raw block cache, SD_CACHE_BLOCKS entries with lru replacement
 // init cacheBlockNumber_to invalid SD block number
 uint32_t SdVolume::cacheBlockNumber_ = 0XFFFFFFFF;
-cache_t  SdVolume::cacheBuffer_;     // 512 byte cache for Sd2Card
 Sd2Card* SdVolume::sdCard_;          // pointer to SD card object
-uint8_t  SdVolume::cacheDirty_ = 0;  // cacheFlush() will write block if true
-uint32_t SdVolume::cacheMirrorBlock_ = 0;  // mirror  block for second FAT
+#if SD_CACHE_PSRAM
+cache_t* SdVolume::cacheStore_ = NULL;   // allocated by init()
+cache_t* SdVolume::cacheBuffer_ = NULL;
+#else
+static cache_t cacheBlocks[SD_CACHE_BLOCKS];
+cache_t* SdVolume::cacheStore_ = cacheBlocks;
+cache_t* SdVolume::cacheBuffer_ = cacheBlocks;
+#endif
+cache_entry_t SdVolume::cacheEntry_[SD_CACHE_BLOCKS];
+uint8_t  SdVolume::cacheCurrent_ = 0;
+uint32_t SdVolume::cacheClock_ = 0;
+uint32_t SdVolume::cacheFatStart_ = 0;
+uint32_t SdVolume::cacheFatEnd_ = 0;
 //------------------------------------------------------------------------------
 // find a contiguous group of clusters
 uint8_t SdVolume::allocContiguous(uint32_t count, uint32_t* curCluster) {
@@ -46,9 +62,12 @@ uint8_t SdVolume::allocContiguous(uint32_t count, uint32_t* curCluster) {
     // start at likely place for free cluster
     bgnCluster = allocSearchStart_;
 
-    // save next search start if one cluster
-    setStart = 1 == count;
+    // save next search start
+    setStart = true;
   }
+  // first free cluster seen, next search start if not used now
+  uint32_t firstFree = 0;
+
   // end of group
   uint32_t endCluster = bgnCluster;
 
@@ -70,9 +89,10 @@ uint8_t SdVolume::allocContiguous(uint32_t count, uint32_t* curCluster) {
     if (f != 0) {
       // cluster in use try next cluster as bgnCluster
       bgnCluster = endCluster + 1;
-    } else if ((endCluster - bgnCluster + 1) == count) {
+    } else {
+      if (firstFree == 0) firstFree = endCluster;
       // done - found space
-      break;
+      if ((endCluster - bgnCluster + 1) == count) break;
     }
   }
   // mark end of chain
@@ -90,52 +110,172 @@ uint8_t SdVolume::allocContiguous(uint32_t count, uint32_t* curCluster) {
   // return first cluster number to caller
   *curCluster = bgnCluster;
 
-  // remember possible next free cluster
-  if (setStart) allocSearchStart_ = bgnCluster + 1;
+  // remember possible next free cluster, skip a preallocated group
+  if (setStart) {
+    allocSearchStart_ = firstFree == bgnCluster ? bgnCluster + count : firstFree;
+  }
 
   return true;
 }
 //------------------------------------------------------------------------------
+// write all dirty blocks
 uint8_t SdVolume::cacheFlush(void) {
-  if (cacheDirty_) {
-    if (!sdCard_->writeBlock(cacheBlockNumber_, cacheBuffer_.data)) {
-      return false;
+  for (uint8_t i = 0; i < SD_CACHE_BLOCKS; i++) {
+    if (!cacheWrite(i)) return false;
+  }
+  return true;
+}
+//------------------------------------------------------------------------------
+// write entry i if dirty, with its mirror FAT block or together with the
+// adjacent dirty data blocks in one multiple block write
+uint8_t SdVolume::cacheWrite(uint8_t i) {
+  cache_entry_t* e = &cacheEntry_[i];
+  if (!e->dirty) return true;
+#if SD_MULTI_BLOCK
+  if (!e->mirror) {
+    uint32_t first = e->block;
+    while (first > 1 && cacheLookup(first - 1, true) >= 0) first--;
+    const uint8_t* src[SD_CACHE_BLOCKS];
+    int8_t run[SD_CACHE_BLOCKS];
+    uint8_t n = 0;
+    while (n < SD_CACHE_BLOCKS &&
+           (run[n] = cacheLookup(first + n, true)) >= 0) {
+      src[n] = cacheStore_[run[n]].data;
+      n++;
     }
-    // mirror FAT tables
-    if (cacheMirrorBlock_) {
-      if (!sdCard_->writeBlock(cacheMirrorBlock_, cacheBuffer_.data)) {
-        return false;
-      }
-      cacheMirrorBlock_ = 0;
+    if (!sdCard_->writeBlocks(first, n, src)) return false;
+    while (n) cacheEntry_[run[--n]].dirty = 0;
+    return true;
+  }
+#endif  // SD_MULTI_BLOCK
+  if (!sdCard_->writeBlock(e->block, cacheStore_[i].data)) return false;
+  // mirror FAT tables
+  if (e->mirror) {
+    if (!sdCard_->writeBlock(e->mirror, cacheStore_[i].data)) return false;
+    e->mirror = 0;
+  }
+  e->dirty = 0;
+  return true;
+}
+//------------------------------------------------------------------------------
+// entry holding blockNumber or -1, dirtyData: only dirty non FAT entries
+int8_t SdVolume::cacheLookup(uint32_t blockNumber, uint8_t dirtyData) {
+  for (uint8_t i = 0; i < SD_CACHE_BLOCKS; i++) {
+    cache_entry_t* e = &cacheEntry_[i];
+    if (e->block != blockNumber) continue;
+    if (dirtyData && (!e->dirty || e->mirror)) return -1;
+    return i;
+  }
+  return -1;
+}
+//------------------------------------------------------------------------------
+// true if any block of [first, first + count) is cached
+uint8_t SdVolume::cacheHas(uint32_t first, uint32_t count) {
+  for (uint8_t i = 0; i < SD_CACHE_BLOCKS; i++) {
+    if (cacheEntry_[i].block - first < count) return true;
+  }
+  return false;
+}
+//------------------------------------------------------------------------------
+// drop cached blocks of [first, first + count) without writing them
+void SdVolume::cacheInvalidate(uint32_t first, uint32_t count) {
+  for (uint8_t i = 0; i < SD_CACHE_BLOCKS; i++) {
+    cache_entry_t* e = &cacheEntry_[i];
+    if (e->block - first < count) {
+      e->block = 0XFFFFFFFF;
+      e->mirror = 0;
+      e->dirty = 0;
+      if (i == cacheCurrent_) cacheBlockNumber_ = 0XFFFFFFFF;
     }
-    cacheDirty_ = 0;
   }
+}
+//------------------------------------------------------------------------------
+// least recently used or free entry of the set blockNumber belongs to
+uint8_t SdVolume::cacheVictim(uint32_t blockNumber) {
+  uint8_t first = 0;
+  uint8_t end = SD_CACHE_BLOCKS;
+#if SD_CACHE_FAT_BLOCKS
+  if (blockNumber - cacheFatStart_ < cacheFatEnd_ - cacheFatStart_) {
+    end = SD_CACHE_FAT_BLOCKS;
+  } else {
+    first = SD_CACHE_FAT_BLOCKS;
+  }
+#endif  // SD_CACHE_FAT_BLOCKS
+  uint8_t v = first;
+  for (uint8_t i = first; i < end; i++) {
+    if (cacheEntry_[i].block == 0XFFFFFFFF) return i;
+    if (cacheEntry_[i].used < cacheEntry_[v].used) v = i;
+  }
+  return v;
+}
+//------------------------------------------------------------------------------
+// write entry i if dirty and free it
+uint8_t SdVolume::cacheEvict(uint8_t i) {
+  if (!cacheWrite(i)) return false;
+  cacheEntry_[i].block = 0XFFFFFFFF;
+  if (i == cacheCurrent_) cacheBlockNumber_ = 0XFFFFFFFF;
   return true;
 }
 //------------------------------------------------------------------------------
+// make entry i the current block
+void SdVolume::cacheSelect(uint8_t i) {
+  cacheCurrent_ = i;
+  cacheBuffer_ = &cacheStore_[i];
+  cacheBlockNumber_ = cacheEntry_[i].block;
+  cacheEntry_[i].used = ++cacheClock_;
+}
+//------------------------------------------------------------------------------
 uint8_t SdVolume::cacheRawBlock(uint32_t blockNumber, uint8_t action) {
   if (cacheBlockNumber_ != blockNumber) {
-    if (!cacheFlush()) return false;
-    if (!sdCard_->readBlock(blockNumber, cacheBuffer_.data)) return false;
-    cacheBlockNumber_ = blockNumber;
+    int8_t i = cacheLookup(blockNumber, false);
+    if (i < 0) {
+      i = cacheVictim(blockNumber);
+      if (!cacheEvict(i)) return false;
+      if (!sdCard_->readBlock(blockNumber, cacheStore_[i].data)) return false;
+      cacheEntry_[i].block = blockNumber;
+    }
+    cacheSelect(i);
   }
-  cacheDirty_ |= action;
+  cacheEntry_[cacheCurrent_].dirty |= action;
+  return true;
+}
+//------------------------------------------------------------------------------
+// cache blockNumber without reading it, caller overwrites the data
+uint8_t SdVolume::cacheNewBlock(uint32_t blockNumber) {
+  int8_t i = cacheLookup(blockNumber, false);
+  if (i < 0) {
+    i = cacheVictim(blockNumber);
+    if (!cacheEvict(i)) return false;
+    cacheEntry_[i].block = blockNumber;
+  }
+  cacheSelect(i);
+  cacheSetDirty();
   return true;
 }
 //------------------------------------------------------------------------------
 // cache a zero block for blockNumber
 uint8_t SdVolume::cacheZeroBlock(uint32_t blockNumber) {
-  if (!cacheFlush()) return false;
+  if (!cacheNewBlock(blockNumber)) return false;
 
-  // loop take less flash than memset(cacheBuffer_.data, 0, 512);
+  // loop take less flash than memset(cacheBuffer_->data, 0, 512);
   for (uint16_t i = 0; i < 512; i++) {
-    cacheBuffer_.data[i] = 0;
+    cacheBuffer_->data[i] = 0;
   }
-  cacheBlockNumber_ = blockNumber;
-  cacheSetDirty();
   return true;
 }
 //------------------------------------------------------------------------------
+// write whole blocks past the cache, cached copies are dropped
+uint8_t SdVolume::writeBlocks(uint32_t block, uint16_t count,
+                              const uint8_t* src) {
+  cacheInvalidate(block, count);
+  if (count == 1) return sdCard_->writeBlock(block, src);
+  if (!sdCard_->writeStart(block, count)) return false;
+  for (uint16_t i = 0; i < count; i++, src += 512) {
+    if (!sdCard_->writeData(src)) return false;
+  }
+  return sdCard_->writeStop();
+}
+//------------------------------------------------------------------------------
 // return the size in bytes of a cluster chain
 uint8_t SdVolume::chainSize(uint32_t cluster, uint32_t* size) const {
   uint32_t s = 0;
@@ -156,9 +296,9 @@ uint8_t SdVolume::fatGet(uint32_t cluster, uint32_t* value) const {
     if (!cacheRawBlock(lba, CACHE_FOR_READ)) return false;
   }
   if (fatType_ == 16) {
-    *value = cacheBuffer_.fat16[cluster & 0XFF];
+    *value = cacheBuffer_->fat16[cluster & 0XFF];
   } else {
-    *value = cacheBuffer_.fat32[cluster & 0X7F] & FAT32MASK;
+    *value = cacheBuffer_->fat32[cluster & 0X7F] & FAT32MASK;
   }
   return true;
 }
@@ -180,14 +320,14 @@ uint8_t SdVolume::fatPut(uint32_t cluster, uint32_t value) {
   }
   // store entry
   if (fatType_ == 16) {
-    cacheBuffer_.fat16[cluster & 0XFF] = value;
+    cacheBuffer_->fat16[cluster & 0XFF] = value;
   } else {
-    cacheBuffer_.fat32[cluster & 0X7F] = value;
+    cacheBuffer_->fat32[cluster & 0X7F] = value;
   }
   cacheSetDirty();
 
   // mirror second FAT
-  if (fatCount_ > 1) cacheMirrorBlock_ = lba + blocksPerFat_;
+  if (fatCount_ > 1) cacheSetMirror(lba + blocksPerFat_);
   return true;
 }
 //------------------------------------------------------------------------------
@@ -227,12 +367,23 @@ uint8_t SdVolume::freeChain(uint32_t cluster) {
 uint8_t SdVolume::init(Sd2Card* dev, uint8_t part) {
   uint32_t volumeStartBlock = 0;
   sdCard_ = dev;
+#if SD_CACHE_PSRAM
+  if (!cacheStore_) {
+    cacheStore_ = (cache_t*)heap_caps_malloc(SD_CACHE_BLOCKS * sizeof(cache_t),
+                                  MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!cacheStore_) return false;
+    cacheBuffer_ = cacheStore_;
+  }
+#endif  // SD_CACHE_PSRAM
+  // blocks cached from a previous card are stale
+  cacheInvalidate(0, 0XFFFFFFFF);
+  cacheFatStart_ = cacheFatEnd_ = 0;
   // if part == 0 assume super floppy with FAT boot sector in block zero
   // if part > 0 assume mbr volume with partition table
   if (part) {
     if (part > 4)return false;
     if (!cacheRawBlock(volumeStartBlock, CACHE_FOR_READ)) return false;
-    part_t* p = &cacheBuffer_.mbr.part[part-1];
+    part_t* p = &cacheBuffer_->mbr.part[part-1];
     if ((p->boot & 0X7F) !=0  ||
       p->totalSectors < 100 ||
       p->firstSector == 0) {
@@ -242,7 +393,7 @@ uint8_t SdVolume::init(Sd2Card* dev, uint8_t part) {
     volumeStartBlock = p->firstSector;
   }
   if (!cacheRawBlock(volumeStartBlock, CACHE_FOR_READ)) return false;
-  bpb_t* bpb = &cacheBuffer_.fbs.bpb;
+  bpb_t* bpb = &cacheBuffer_->fbs.bpb;
   if (bpb->bytesPerSector != 512 ||
     bpb->fatCount == 0 ||
     bpb->reservedSectorCount == 0 ||
@@ -263,6 +414,8 @@ uint8_t SdVolume::init(Sd2Card* dev, uint8_t part) {
                     bpb->sectorsPerFat16 : bpb->sectorsPerFat32;
 
   fatStartBlock_ = volumeStartBlock + bpb->reservedSectorCount;
+  cacheFatStart_ = fatStartBlock_;
+  cacheFatEnd_ = fatStartBlock_ + bpb->fatCount * blocksPerFat_;
 
   // count for FAT16 zero for FAT32
   rootDirEntryCount_ = bpb->rootDirEntryCount;
@@ -2,7 +2,6 @@
 
 // SoftwareSerial bc95serial(8, 9);
 HardwareSerial bc95serial(1);
-char globalBuff[4096];
 char TAG[] = "BC95";
 
 // === ADEMUX: variables globales NUESTATS ===
@@ -17,6 +16,7 @@ void cleanbuffer() {
 
 int readResponseBC(HardwareSerial *port, char *buff, int b_size,
                    uint32_t timeout = 500) {
+  LAT_SCOPE(lat_at_read);
   port->setTimeout(timeout);
   buff[0] = 0;
   int bytesRead = port->readBytes(buff, b_size - 1);
@@ -62,36 +62,168 @@ bool assertResponseBC(const char *expected, char *received, int bytesRead) {
   return strstr(received, expected) != nullptr;
 }
 
+// --- uart link: wire time statistics ---
+
+#define WIRE_STATS_MAX 16 // AT commands tracked, further ones count as "other"
+
+typedef struct {
+  char name[12];
+  uint32_t count, txBytes, rxBytes;
+} wire_stat_t;
+
+static wire_stat_t wireStats[WIRE_STATS_MAX];
+static uint32_t bc95Baud = BC95_BAUD_DEFAULT;
+
+// account bytes of an AT command and its response to the command name
+static void wireCount(const char *command, uint32_t tx, uint32_t rx) {
+  char name[sizeof(wireStats[0].name)];
+  int i, n = 0;
+
+  if (strncmp(command, "AT+", 3) == 0)
+    command += 3;
+  while (command[n] && !strchr("=?\r\n", command[n]) && (n < (int)sizeof(name) - 1))
+    name[n] = command[n], n++;
+  name[n] = 0;
+
+  for (i = 0; i < WIRE_STATS_MAX - 1; i++)
+    if (!wireStats[i].name[0] || !strcmp(wireStats[i].name, name))
+      break;
+  if (!wireStats[i].name[0])
+    strcpy(wireStats[i].name, (i < WIRE_STATS_MAX - 1) ? name : "other");
+  wireStats[i].count++;
+  wireStats[i].txBytes += tx;
+  wireStats[i].rxBytes += rx;
+}
+
+static nb_air_t nbAir[2];
+
+void nbAirCount(nbtransport_t t, uint32_t messages, uint32_t payload,
+                uint32_t air) {
+  nbAir[t].messages += messages;
+  nbAir[t].payload += payload;
+  nbAir[t].air += air;
+}
+
+// 8N1 frame, 10 bit times per byte
+static uint32_t wireMs(uint32_t bytes, uint32_t baud) {
+  return (uint64_t)bytes * 10 * 1000 / baud;
+}
+
+void bc95_printWireStats(void) {
+  ESP_LOGD(TAG, "Modem uart %u baud", bc95Baud);
+  for (int i = 0; i < WIRE_STATS_MAX && wireStats[i].name[0]; i++) {
+    uint32_t bytes = wireStats[i].txBytes + wireStats[i].rxBytes;
+    ESP_LOGD(TAG, "%-11s %5u cmds %7u/%7u bytes tx/rx, wire %u ms (%u ms at %u)",
+             wireStats[i].name, wireStats[i].count, wireStats[i].txBytes,
+             wireStats[i].rxBytes, wireMs(bytes, bc95Baud),
+             wireMs(bytes, BC95_BAUD_DEFAULT), BC95_BAUD_DEFAULT);
+  }
+  for (int t = nb_mqtt; t <= nb_coap; t++)
+    if (nbAir[t].messages)
+      ESP_LOGD(TAG, "%s: %u msgs, %u payload bytes, %u bytes on air (%u per msg)",
+               t == nb_coap ? "CoAP" : "MQTT", nbAir[t].messages,
+               nbAir[t].payload, nbAir[t].air,
+               nbAir[t].air / nbAir[t].messages);
+}
+
 bool sendAndReadOkResponseBC(HardwareSerial *port, const char *command,
                              char *buffer, int bufferSize, uint32_t timeout = 500) {
   ESP_LOGV(TAG, "Command: %s", command);
+  crash_at(command);
   port->println(command);
   int bytesRead = readResponseBC(port, buffer, bufferSize, timeout);
+  wireCount(command, strlen(command) + 2, bytesRead > 0 ? bytesRead : 0);
   return assertResponseBC("OK\r", buffer, bytesRead);
 }
 
+// send command and check for OK, response goes to a leased buffer, a small
+// one unless the response can be longer
+static bool sendAndReadOk(const char *command, uint32_t timeout = 500,
+                          size_t size = IO_AT_RESP_SIZE) {
+  char *resp = (char *)io_lease(size, "modem");
+  if (!resp)
+    return false;
+  bool ok = sendAndReadOkResponseBC(&bc95serial, command, resp, size, timeout);
+  io_release(resp);
+  return ok;
+}
+
+// --- uart link: AT+NATSPEED baud negotiation ---
+
+static void setBaud(uint32_t baud) {
+  bc95serial.flush();
+  bc95serial.updateBaudRate(baud);
+  bc95Baud = baud;
+  delay(20);
+  cleanbuffer();
+}
+
+static uint32_t loadBaud(void) {
+  nvs_handle h;
+  uint32_t baud = BC95_BAUD_DEFAULT;
+  if (nvs_open(BC95_NVS, NVS_READONLY, &h) == ESP_OK) {
+    nvs_get_u32(h, "baud", &baud);
+    nvs_close(h);
+  }
+  return baud;
+}
+
+static void storeBaud(uint32_t baud) {
+  nvs_handle h;
+  if (nvs_open(BC95_NVS, NVS_READWRITE, &h) == ESP_OK) {
+    if (nvs_set_u32(h, "baud", baud) == ESP_OK)
+      nvs_commit(h);
+    nvs_close(h);
+  }
+}
+
+static bool linkCommand(const char *cmd, uint32_t timeout_ms) {
+  return sendAndReadOk(cmd, timeout_ms);
+}
+
+static void linkWait(uint32_t ms) { delay(ms); }
+
+static const bc95_link_t bc95link = {linkCommand, setBaud, linkWait};
+
 void initModem() {
   bc95serial.setRxBufferSize(4096);
-  bc95serial.begin(9600, SERIAL_8N1, RX_PIN, TX_PIN);
+  bc95serial.begin(BC95_BAUD_DEFAULT, SERIAL_8N1, RX_PIN, TX_PIN);
 #ifdef DEBUG_MODEM
   // ESP_LOGD(TAG, bc95serial.readString().c_str());
 #endif
+  uint32_t stored = loadBaud();
+  bc95_baud_result_t result;
+  uint32_t baud = bc95_negotiate(&bc95link, stored, NB_UART_BAUD, &result);
+  if (baud != stored)
+    storeBaud(baud);
+  if (result == bc95_baud_silent)
+    ESP_LOGW(TAG, "Modem does not answer at any rate");
+  else if (result == bc95_baud_refused)
+    ESP_LOGW(TAG, "Modem refused %u baud", NB_UART_BAUD);
+  else if (result == bc95_baud_fallback)
+    ESP_LOGW(TAG, "No answer at %u baud, fell back", NB_UART_BAUD);
+  ESP_LOGI(TAG, "Modem uart at %u baud", baud);
 }
 
 bool networkReady() {
-  bc95serial.println("AT+CEREG?");
-  int bytesRead = readResponseBC(&bc95serial, globalBuff, sizeof(globalBuff));
-  if (assertResponseBC("CEREG:0,1", globalBuff, bytesRead))
-    return true;
-  else if (assertResponseBC("CEREG:0,5", globalBuff, bytesRead))
-    return true;
-  else
+  char *resp = (char *)io_lease(IO_AT_RESP_SIZE, "modem");
+  if (!resp)
     return false;
+  bc95serial.println("AT+CEREG?");
+  int bytesRead = readResponseBC(&bc95serial, resp, IO_AT_RESP_SIZE);
+  bool ready = assertResponseBC("CEREG:0,1", resp, bytesRead) ||
+               assertResponseBC("CEREG:0,5", resp, bytesRead);
+  io_release(resp);
+  return ready;
 }
 
 void getCsq() {
+  char *resp = (char *)io_lease(IO_AT_RESP_SIZE, "modem");
+  if (!resp)
+    return;
   bc95serial.println("AT+CSQ");
-  int bytesRead = readResponseBC(&bc95serial, globalBuff, sizeof(globalBuff));
+  readResponseBC(&bc95serial, resp, IO_AT_RESP_SIZE);
+  io_release(resp);
 }
 
 void resetModem() {
@@ -100,72 +232,145 @@ void resetModem() {
   ESP_LOGI(TAG, "Reset NBIOT modem");
   bc95serial.println("AT+NRB");
   delay(2000);
-  int bytesRead = readResponseBC(&bc95serial, globalBuff, sizeof(globalBuff));
-  assertResponseBC("REBOOTING", globalBuff, bytesRead);
+  char *resp = (char *)io_lease(IO_AT_RESP_SIZE, "modem");
+  if (resp) {
+    readResponseBC(&bc95serial, resp, IO_AT_RESP_SIZE);
+    io_release(resp);
+  }
   delay(7000);
   while (bc95serial.available() > 0)
     bc95serial.read();
-  sendAndReadOkResponseBC(&bc95serial, "AT", globalBuff, sizeof(globalBuff));
+  sendAndReadOk("AT");
 }
 
 bool preConfigModem() {
   ESP_LOGI(TAG, "Preconfiguring NBIOT modem");
-  return sendAndReadOkResponseBC(&bc95serial, "AT", globalBuff,
-                                 sizeof(globalBuff)) &&
-         sendAndReadOkResponseBC(&bc95serial, "AT+NCONFIG=AUTOCONNECT,FALSE",
-                                 globalBuff, sizeof(globalBuff));
+  return sendAndReadOk("AT") && sendAndReadOk("AT+NCONFIG=AUTOCONNECT,FALSE");
 }
 
 bool configModem() {
   ESP_LOGI(TAG, "Config NBIOT modem");
-  return sendAndReadOkResponseBC(&bc95serial, "AT+CEREG=0", globalBuff,
-                                 sizeof(globalBuff)) &&
-         sendAndReadOkResponseBC(&bc95serial, "AT+NBAND=8,20", globalBuff,
-                                 sizeof(globalBuff)) &&
-         sendAndReadOkResponseBC(&bc95serial, "AT+NCONFIG=CELL_RESELECTION,TRUE", globalBuff,
-                                 sizeof(globalBuff)) &&
-         sendAndReadOkResponseBC(&bc95serial, "AT+CSCON=0", globalBuff,
-                                 sizeof(globalBuff)) &&
-         sendAndReadOkResponseBC(&bc95serial, "AT+CFUN=1", globalBuff,
-                                 sizeof(globalBuff), 10000) &&
-         sendAndReadOkResponseBC(&bc95serial, "AT+QREGSWT=1", globalBuff,
-                                 sizeof(globalBuff)) &&
-         sendAndReadOkResponseBC(&bc95serial, "AT+NSONMI=3", globalBuff,
-                                 sizeof(globalBuff));
+  return sendAndReadOk("AT+CEREG=0") &&
+         sendAndReadOk("AT+NBAND=8,20") &&
+         sendAndReadOk("AT+NCONFIG=CELL_RESELECTION,TRUE") &&
+         sendAndReadOk("AT+CSCON=0") &&
+         sendAndReadOk("AT+CFUN=1", 10000) &&
+         sendAndReadOk("AT+QREGSWT=1") &&
+         sendAndReadOk("AT+NSONMI=3");
 }
 
 bool attachNetwork() {
-  return sendAndReadOkResponseBC(&bc95serial,
-                              "AT+CGDCONT=1,\"IP\",\"" APN "\"",
-                              globalBuff, sizeof(globalBuff)) &&
-      sendAndReadOkResponseBC(&bc95serial, "AT+CGATT=1", globalBuff,
-                          sizeof(globalBuff)) &&
-      sendAndReadOkResponseBC(&bc95serial, "AT+CGATT?", globalBuff,
-                              sizeof(globalBuff));
+  return sendAndReadOk("AT+CGDCONT=1,\"IP\",\"" APN "\"") &&
+         sendAndReadOk("AT+CGATT=1") &&
+         sendAndReadOk("AT+CGATT?");
+}
+
+// --- power saving: PSM and eDRX timers ---
+
+typedef struct {
+  uint8_t code;    // 3 bit unit field
+  uint32_t unit_s; // seconds per step
+} timer_unit_t;
+
+// GPRS timer 3 (T3412 extended) and GPRS timer 2 (T3324), 3GPP TS 24.008
+static const timer_unit_t t3412Units[] = {{3, 2},    {4, 30},     {5, 60},
+                                          {0, 600},  {1, 3600},   {2, 36000},
+                                          {6, 1152000}};
+static const timer_unit_t t3324Units[] = {{0, 2}, {1, 60}, {2, 360}};
+
+// "uuuvvvvv" bit string of a timer, smallest unit still holding seconds
+static void timerBits(char *out, const timer_unit_t *units, int n,
+                      uint32_t seconds) {
+  int i = 0;
+  while ((i < n - 1) && (seconds > 31 * units[i].unit_s))
+    i++;
+  uint32_t v = (seconds + units[i].unit_s - 1) / units[i].unit_s;
+  uint8_t b = units[i].code << 5 | (v > 31 ? 31 : v);
+  for (int k = 0; k < 8; k++)
+    out[k] = (b & (0x80 >> k)) ? '1' : '0';
+  out[8] = 0;
+}
+
+// modes are exclusive, the one not selected is switched off
+bool setPowerSaving(nbpower_t mode) {
+  char command[48], tau[9], active[9];
+  bool ok;
+
+  switch (mode) {
+  case nb_power_psm:
+    timerBits(tau, t3412Units, sizeof(t3412Units) / sizeof(t3412Units[0]),
+              NB_PSM_TAU_S);
+    timerBits(active, t3324Units, sizeof(t3324Units) / sizeof(t3324Units[0]),
+              NB_PSM_ACTIVE_S);
+    snprintf(command, sizeof(command), "AT+CPSMS=1,,,\"%s\",\"%s\"", tau,
+             active);
+    ok = sendAndReadOk("AT+CEDRXS=0,5") && sendAndReadOk(command);
+    break;
+  case nb_power_edrx:
+    ok = sendAndReadOk("AT+CPSMS=0") &&
+         sendAndReadOk("AT+CEDRXS=1,5,\"" NB_EDRX_VALUE "\"");
+    break;
+  default:
+    ok = sendAndReadOk("AT+CPSMS=0") && sendAndReadOk("AT+CEDRXS=0,5");
+    break;
+  }
+  if (!ok)
+    ESP_LOGW(TAG, "Modem refused power saving mode %d", mode);
+  return ok;
+}
+
+// uart wakes the modem from PSM, the first characters may get lost
+bool wakeModem() { return probeAt(3); }
+
+// after a reset of the ESP32 alone the modem keeps function level,
+// registration and PDP address, then the whole config sequence is skipped
+bool modemWarm() {
+  char *resp = (char *)io_lease(IO_AT_RESP_SIZE, "modem");
+  if (!resp)
+    return false;
+  bool warm = false;
+  do {
+    if (!wakeModem() ||
+        !sendAndReadOkResponseBC(&bc95serial, "AT+CFUN?", resp,
+                                 IO_AT_RESP_SIZE, 500) ||
+        !strstr(resp, "+CFUN:1"))
+      break;
+    if (!sendAndReadOkResponseBC(&bc95serial, "AT+CEREG?", resp,
+                                 IO_AT_RESP_SIZE, 500) ||
+        !(strstr(resp, "CEREG:0,1") || strstr(resp, "CEREG:0,5")))
+      break;
+    // +CGPADDR:0,<address>, no address if PDP context is down
+    char *addr;
+    if (!sendAndReadOkResponseBC(&bc95serial, "AT+CGPADDR", resp,
+                                 IO_AT_RESP_SIZE, 500) ||
+        !(addr = strstr(resp, "+CGPADDR:0,")) || !isdigit(addr[11]))
+      break;
+    // volatile urc settings, cheap to set again
+    warm = sendAndReadOk("AT+NSONMI=3");
+  } while (0);
+  io_release(resp);
+  ESP_LOGI(TAG, "Modem %s", warm ? "already attached" : "needs configuration");
+  return warm;
 }
 
 bool networkAttached() {
-  return sendAndReadOkResponseBC(&bc95serial, "AT+CGPADDR", globalBuff,
-                                 sizeof(globalBuff));
+  return sendAndReadOk("AT+CGPADDR");
 }
 
 bool connectModem(char *ip, int port) {
-  bool r1 = sendAndReadOkResponseBC(&bc95serial, "AT+CGPADDR", globalBuff,
-                                    sizeof(globalBuff));
+  char command[64];
+  bool r1 = sendAndReadOk("AT+CGPADDR");
   delay(100);
-  bool r2 = sendAndReadOkResponseBC(&bc95serial, "AT+NSOCR=STREAM,6,0,1",
-                                    globalBuff, sizeof(globalBuff));
+  bool r2 = sendAndReadOk("AT+NSOCR=STREAM,6,0,1");
   delay(100);
-  sprintf(globalBuff, "AT+NSOCO=1,%s,%d", ip, port);
-  bool r3 = sendAndReadOkResponseBC(&bc95serial, globalBuff, globalBuff,
-                                    sizeof(globalBuff));
+  snprintf(command, sizeof(command), "AT+NSOCO=1,%s,%d", ip, port);
+  bool r3 = sendAndReadOk(command);
   delay(100);
   return r1 && r2 && r3;
 }
 
 void disconnectModem() {
-  sendAndReadOkResponseBC(&bc95serial, "AT+NSOCL=1", globalBuff,
-                          sizeof(globalBuff));
+  sendAndReadOk("AT+NSOCL=1");
 }
 
 bool receiveData(char *data, int bytesRead, int bufferLen) {
@@ -190,41 +395,44 @@ bool receiveData(char *data, int bytesRead, int bufferLen) {
     return false;
   }
 
-  char *tempBuff = new char[strLen + 1];
-  memcpy(tempBuff, dataPtr, strLen + 1);
-
+  // hex digits are decoded in place, output index trails input index
   for (int i = 0; i < strLen; i += 2) {
     char tmp[3];
-    memcpy(tmp, tempBuff + i, 2);
+    memcpy(tmp, dataPtr + i, 2);
     tmp[2] = 0;
     data[i / 2] = strtoul(tmp, NULL, 16);
   }
   data[bytesRead] = 0;
-  delete tempBuff;
   return true;
 }
 
 enum sendStatus { INIT, DATAOK, SENTOK, RECOK };
 
-int openSocket() {
+static int openSocketWith(const char *command) {
   ESP_LOGV(TAG, "Openning socket");
-  if (!sendAndReadOkResponseBC(&bc95serial, "AT+NSOCR=STREAM,6,0,1", globalBuff,
-                               sizeof(globalBuff))) {
+  char *resp = (char *)io_lease(IO_AT_RESP_SIZE, "modem");
+  if (!resp)
+    return -1;
+  if (!sendAndReadOkResponseBC(&bc95serial, command, resp,
+                               IO_AT_RESP_SIZE)) {
+    io_release(resp);
     return -1;
   }
 
-  char *socketPtr = strtok(globalBuff, "\r\n");
+  char *socketPtr = strtok(resp, "\r\n");
   ESP_LOGV(TAG, "Open Socket: %s", socketPtr);
   int socket = atoi(socketPtr);
+  io_release(resp);
   return socket;
 }
 
+int openSocket() { return openSocketWith("AT+NSOCR=STREAM,6,0,1"); }
+
 bool connectSocket(int socket, char *ip, int port) {
   ESP_LOGV(TAG, "Connecting socket");
   char outBuffer[64];
   sprintf(outBuffer, "AT+NSOCO=%d,%s,%d", socket, ip, port);
-  return sendAndReadOkResponseBC(&bc95serial, outBuffer, globalBuff,
-                                 sizeof(globalBuff));
+  return sendAndReadOk(outBuffer);
 }
 
 int sendData(int socket, char *data, int datalen, char *responseBuff,
@@ -301,106 +509,37 @@ int sendData(int socket, char *data, int datalen, char *responseBuff,
   return 0;
 }
 
-int readResponseData(std::string response, char *buffer, int bufferSize) {
-  int socketIndex = response.find(",");
-  if (socketIndex == std::string::npos) {
-    ESP_LOGD(TAG, "Cannot find socket index in response");
-    return -1;
-  }
-  int lenIndex = response.find(",", socketIndex + 1);
-  if (lenIndex == std::string::npos) {
-    ESP_LOGD(TAG, "Cannot find length index in response");
-    return -1;
-  }
-  int dataIndex = response.find("\r\n", lenIndex + 1);
-  if (dataIndex == std::string::npos) {
-    ESP_LOGD(TAG, "Cannot find data index in response");
-    return -1;
-  }
-
-  std::string socketString = response.substr(0, socketIndex);
-  std::string lenString = response.substr(socketIndex + 1, lenIndex - socketIndex - 1);
-  std::string dataString = response.substr(lenIndex + 1, dataIndex - lenIndex - 1);
-
-  int dataLen = strtoul(lenString.c_str(), NULL, 10);
-  int strLen = strlen(dataString.c_str());
-
-  if (dataLen != strLen / 2) {
-    ESP_LOGE(TAG, "Size mismatch");
-    return -1;
-  }
-
-  if (bufferSize < dataLen + 1) {
-    ESP_LOGE(TAG, "Buffer too small");
-    return -2;
-  }
-
-  char* tempBuff = (char*)dataString.c_str();
-  for (int i = 0; i < strLen; i += 2) {
-    char tmp[3];
-    memcpy(tmp, tempBuff + i, 2);
-    tmp[2] = 0;
-    buffer[i / 2] = strtoul(tmp, NULL, 16);
-  }
-  buffer[strLen/2] = 0;
-  return dataLen;
-}
+// streams the response of socket into the http parser, pending holds
+// modem output which was read together with the send confirmation
+static int receiveHttp(int socket, const char *pending, http_stream_t *hs) {
+  nsonmi_scan_t scan;
+  int res = HTTP_STREAM_MORE;
+  nsonmi_init(&scan, socket);
 
-int getReceivedBytes(int socket, char *buffer, int bufferSize) {
-  char responseBuffer[2048];
-  responseBuffer[0] = 0;
-  size_t responseBufferPos = 0;
   ESP_LOGV(TAG, "Getting received bytes");
-  int readBytes = strlen(buffer);
-  int buffPtr = readBytes;
-  char* scanPtr = buffer;
+  while (*pending && (res == HTTP_STREAM_MORE))
+    res = nsonmi_feed(&scan, *pending++, hs);
 
+  uint32_t rx = 0;
   unsigned long startT = millis();
-  while (millis() < startT + HTTP_READ_TIMEOUT) {
-    while (bc95serial.available()) {
-      buffer[buffPtr++] = bc95serial.read();
-      readBytes += 1;
-      if (buffPtr == bufferSize) {
-        return -10;
-      }
-      buffer[buffPtr] = 0;
-    }
-    std::string current = std::string(scanPtr);
-    char expected[32];
-
-    sprintf(expected, "\r\n");
-
-    size_t pos = current.find(expected);
-    if (pos == std::string::npos) {
+  while ((res == HTTP_STREAM_MORE) && (millis() - startT < HTTP_READ_TIMEOUT)) {
+    if (!bc95serial.available()) {
+      delay(1);
       continue;
     }
+    res = nsonmi_feed(&scan, bc95serial.read(), hs);
+    rx++;
+  }
+  wireCount("NSONMI", 0, rx);
+  if (res == NSONMI_SIZE)
+    ESP_LOGE(TAG, "Size mismatch");
+  return (res == HTTP_STREAM_MORE) ? -2 : res;
+}
 
-    std::string line = current.substr(0, pos + 2);
-    scanPtr += line.length();
-
-    sprintf(expected, "+NSONMI:%d", socket);
-    if (line.find(expected) != std::string::npos) {
-      char dataBuffer[2048];
-      int len = readResponseData(line, dataBuffer, sizeof(dataBuffer));
-      if (len < 0) {
-        return len;
-      }
-      memcpy(responseBuffer + responseBufferPos, dataBuffer, len);
-      responseBufferPos += len;
-      continue;
-    }
-
-    sprintf(expected, "+NSOCLI: %d", socket);
-    if (line.find(expected) != std::string::npos) {
-      ESP_LOGV(TAG, "Socket closed");
-      memcpy(buffer, responseBuffer, responseBufferPos);
-      buffer[responseBufferPos] = 0;
-      return responseBufferPos;
-    }
-  };
-
-  memcpy(buffer, responseBuffer, responseBufferPos);
-  return -2;
+static void closeSocket(int socket) {
+  char command[16];
+  snprintf(command, sizeof(command), "AT+NSOCL=%d", socket);
+  sendAndReadOk(command);
 }
 
 int parseResponse(char *buff, int bytesReceived, int *responseCode) {
@@ -437,57 +576,23 @@ int parseResponse(char *buff, int bytesReceived, int *responseCode) {
   return bodyLen;
 }
 
-int parseResponseCode(char* buff, int buffSize) {
-  std::string inputString = std::string(buff);
-  size_t pos = inputString.find("\r\n");
-  if (pos == std::string::npos) {
-    return -1;
-  }
-
-  std::string httpResponseLine = inputString.substr(0, pos + 2);
-  ESP_LOGV(TAG, "Response line: %s", httpResponseLine.c_str());
-
-  size_t responseCodePos = httpResponseLine.find(" ");
-  size_t responseCodePosEnd = httpResponseLine.find(" ", responseCodePos + 1);
-
-  std::string responseCodeStr = httpResponseLine.substr(responseCodePos + 1, responseCodePosEnd - responseCodePos - 1);
-  ESP_LOGV(TAG, "Response code: %s", responseCodeStr.c_str());
-  return strtoul(responseCodeStr.c_str(), NULL, 10);
-}
-
-int parseContentLength(char* buff, int buffSize) {
-  std::string inputString = std::string(buff);
-  size_t pos = inputString.find("\r\n\r\n");
-  if (pos == std::string::npos) {
-    return -1;
-  }
-
-  std::string httpString = inputString.substr(0, pos + 4);
-
-  std::for_each(httpString.begin(), httpString.end(), [](char & c) {
-    c = ::tolower(c);
-  });
-
-  size_t contentLengthPos = httpString.find("content-length:");
-  size_t contentLengthPosEnd = httpString.find("\r\n", contentLengthPos + 1);
-  std::string contentLengthStr = httpString.substr(contentLengthPos + 15, contentLengthPosEnd - contentLengthPos - 15);
-
-  ESP_LOGV(TAG, "Content Length str: %s", contentLengthStr.c_str());
-
-  unsigned long contentLength = strtoul(contentLengthStr.c_str(), NULL, 10);
-  return contentLength;
-}
-
-int parseData(char* buff, int dataSize, char* outBuff, int outBuffSize) {
-  std::string inputString = std::string(buff);
-  size_t pos = inputString.find("\r\n\r\n");
-  if (pos == std::string::npos) {
+typedef struct {
+  char *buff;
+  int size;
+  int len;
+} body_sink_t;
+
+// http sink, body is copied to the caller buffer, kept null terminated
+static int bodyToBuffer(const uint8_t *data, size_t len, void *ctx) {
+  body_sink_t *b = (body_sink_t *)ctx;
+  if (b->len + (int)len >= b->size) {
+    ESP_LOGE(TAG, "Response does not fit in %d bytes", b->size);
     return -1;
   }
-
-  char* dataPos = buff + pos + 4;
-  memcpy(outBuff, dataPos, dataSize);
-  return dataSize;
+  memcpy(b->buff + b->len, data, len);
+  b->len += len;
+  b->buff[b->len] = 0;
+  return len;
 }
 
 int getData(char *ip, int port, char *page, char *responseBuffer, int responseBufferSize, int *responseSizePtr) {
@@ -503,11 +608,14 @@ int getData(char *ip, int port, char *page, char *responseBuffer, int responseBu
   bool connected = connectSocket(socketN, ip, port);
 
   char pageWithParams[256];
-  std::string version = std::string(PROGVERSION);
-  std::replace(version.begin(), version.end(), '.', '_');
+  char version[UPD_VERSION_LEN];
+  upd_version_param(PROGVERSION, version, sizeof(version));
 
-  char localBuff[4096];
-  sprintf(pageWithParams, "%s?deveui=%s&version=%s", page, devEui, version.c_str());
+  char *localBuff = (char *)io_lease(IO_HTTP_RAW_SIZE, "http_raw");
+  size_t localBuffSize = IO_HTTP_RAW_SIZE;
+  if (!localBuff)
+    return -1;
+  sprintf(pageWithParams, "%s?deveui=%s&version=%s", page, devEui, version);
   localBuff[0] = 0;
   sprintf(outBuf, "GET %s HTTP/1.1\r\n", pageWithParams);
   strcat(localBuff, outBuf);
@@ -515,43 +623,39 @@ int getData(char *ip, int port, char *page, char *responseBuffer, int responseBu
   strcat(localBuff, outBuf);
   strcat(localBuff, "\r\n");
 
-  int sentOk = sendData(socketN, localBuff, strlen(localBuff), localBuff, sizeof(localBuff));
+  int sentOk = sendData(socketN, localBuff, strlen(localBuff), localBuff, localBuffSize);
 
   if (sentOk < 0) {
     ESP_LOGE(TAG, "Error sending data");
+    io_release(localBuff);
     return -1;
   }
 
-  int bytesReceived = getReceivedBytes(socketN, localBuff, sizeof(localBuff));
-
-  if (bytesReceived < 0) {
-    ESP_LOGE(TAG, "failed sending data with error code: %d", bytesReceived);
-    responseCode = bytesReceived;
-  } else if (bytesReceived > 0) {
-    ESP_LOGD(TAG, "Received %d bytes", bytesReceived);
-    responseCode = parseResponseCode(localBuff, bytesReceived);
-    ESP_LOGD(TAG, "Response Code: %d", responseCode);
-
+  // body goes straight to the caller buffer
+  body_sink_t body = {responseBuffer, responseBufferSize, 0};
+  http_stream_t hs;
+  responseBuffer[0] = 0;
+  http_stream_init(&hs, bodyToBuffer, &body);
+  int res = receiveHttp(socketN, localBuff, &hs);
+  io_release(localBuff);
+  closeSocket(socketN);
+
+  if (res == HTTP_STREAM_DONE) {
+    responseCode = hs.status;
+    ESP_LOGD(TAG, "Response Code: %d, %u body bytes", responseCode,
+             hs.bodyBytes);
     if (responseCode != 200) {
       ESP_LOGE(TAG, "Error code: %d", responseCode);
       return responseCode;
     }
-
-    char* inputBuffer = new char[bytesReceived + 1];
-    memcpy(inputBuffer, localBuff, bytesReceived);
-    inputBuffer[bytesReceived] = 0;
-    int contentLength = parseContentLength(inputBuffer, bytesReceived);
-    int parsedData = parseData(inputBuffer, contentLength, localBuff, sizeof(localBuff));
-    delete inputBuffer;
-    if (parsedData >= 0) {
-      memcpy(responseBuffer, localBuff, parsedData);
-      *responseSizePtr = parsedData;
-      responseBuffer[parsedData] = 0;
-      return responseCode;
-    }
-  } else {
+    *responseSizePtr = body.len;
+    return responseCode;
+  } else if (res == -2) {
     ESP_LOGE(TAG, "Timeout");
     responseCode = 0;
+  } else {
+    ESP_LOGE(TAG, "failed receiving data with error code: %d", res);
+    responseCode = res;
   }
 
   ESP_LOGI(TAG, "Return code %d", responseCode);
@@ -564,39 +668,43 @@ int postPage(char *domainBuffer, int thisPort, char *page, char *thisData,
 
   ESP_LOGI(TAG, "connecting...");
 
+  char *buff = (char *)io_lease(IO_HTTP_RAW_SIZE, "postpage");
+  if (!buff)
+    return -1;
+
   if (connectModem(domainBuffer, thisPort)) {
     ESP_LOGI(TAG, "connected");
-    globalBuff[0] = 0;
+    buff[0] = 0;
     sprintf(outBuf, "PUT %s HTTP/1.1\r\n", page);
-    strcat(globalBuff, outBuf);
+    strcat(buff, outBuf);
     sprintf(outBuf, "Host: %s\r\n", domainBuffer);
-    strcat(globalBuff, outBuf);
+    strcat(buff, outBuf);
     sprintf(outBuf, "Connection: close\r\nContent-Type: application/json\r\n");
-    strcat(globalBuff, outBuf);
+    strcat(buff, outBuf);
     sprintf(outBuf, "IDENTITY_KEY: %s\r\n", identityKey);
-    strcat(globalBuff, outBuf);
+    strcat(buff, outBuf);
     sprintf(outBuf, "Content-Length: %u\r\n", strlen(thisData));
-    strcat(globalBuff, outBuf);
-    strcat(globalBuff, "\r\n");
-    strcat(globalBuff, thisData);
+    strcat(buff, outBuf);
+    strcat(buff, "\r\n");
+    strcat(buff, thisData);
 
     int responseCode = 0;
-    int bytesReceived = sendData(1, globalBuff, strlen(globalBuff), globalBuff, sizeof(globalBuff));
+    int bytesReceived = sendData(1, buff, strlen(buff), buff, IO_HTTP_RAW_SIZE);
     if (bytesReceived < 0) {
       cleanbuffer();
       ESP_LOGE(TAG, "failed sending data with error code: %d", bytesReceived);
       responseCode = bytesReceived;
     } else if (bytesReceived > 0) {
-      if (receiveData(globalBuff, bytesReceived, sizeof(globalBuff))) {
+      if (receiveData(buff, bytesReceived, IO_HTTP_RAW_SIZE)) {
         ESP_LOGD(TAG, "Received %d bytes", bytesReceived);
-        ESP_LOGD(TAG, "%s", globalBuff);
-        int bodyBytes = parseResponse(globalBuff, bytesReceived, &responseCode);
+        ESP_LOGD(TAG, "%s", buff);
+        int bodyBytes = parseResponse(buff, bytesReceived, &responseCode);
         if (bodyBytes < 0) {
           ESP_LOGE(TAG, "Error: %d while parsing response", bodyBytes);
           responseCode = -12;
         } else {
           ESP_LOGD(TAG, "Response Code: %d", responseCode);
-          ESP_LOGD(TAG, "Body: %s", globalBuff);
+          ESP_LOGD(TAG, "Body: %s", buff);
         }
       } else {
         cleanbuffer();
@@ -611,9 +719,11 @@ int postPage(char *domainBuffer, int thisPort, char *page, char *thisData,
     ESP_LOGI(TAG, "disconnecting.");
     disconnectModem();
     ESP_LOGI(TAG, "Return code %d", responseCode);
+    io_release(buff);
     return responseCode;
   } else {
     ESP_LOGE(TAG, "failed connecting");
+    io_release(buff);
     return -1;
   }
 }
@@ -629,33 +739,41 @@ bool checkMqttConnection() {
   return false;
 }
 
-int readMqttSubData(char *buff, int bufflen) {
-  char data[2048];
-  int bytesRead = readResponseBC(&bc95serial, data, sizeof(data));
+// +QMTRECV: 0,0,"<topic>",<message>\n
+static int parseMqttSubData(char *data, char *buff, int bufflen) {
+  char *response = strstr(data, "+QMTRECV: 0,0,");
+  if (response == NULL) return -1;
 
-  std::string response = std::string(data);
-  int firstResponse = response.find("+QMTRECV: 0,0,");
-  if (firstResponse == std::string::npos) return -1;
+  char *topic = strchr(response, '"');
+  if (topic == NULL) return -2;
 
-  int topicFirstQuote = response.find("\"", firstResponse);
-  if (topicFirstQuote == std::string::npos) return -2;
+  char *topicEnd = strchr(topic + 1, '"');
+  if (topicEnd == NULL) return -3;
 
-  int topicSecondQuote = response.find("\"", topicFirstQuote + 1);
-  if (topicSecondQuote == std::string::npos) return -3;
+  char *message = strchr(topicEnd + 1, ',');
+  if (message == NULL) return -4;
 
-  int messageComma = response.find(",", topicSecondQuote + 1);
-  if (messageComma == std::string::npos) return -4;
+  char *messageEnd = strchr(message + 1, '\n');
+  if (messageEnd == NULL) return -5;
 
-  int messageEnd = response.find("\n", messageComma + 1);
-  if (messageEnd == std::string::npos) return -5;
+  *topicEnd = 0;
+  *messageEnd = 0;
+  message++;
+  ESP_LOGD(TAG, "Message in Topic: %s", topic + 1);
+  ESP_LOGD(TAG, "Message: %s", message);
 
-  std::string topic = response.substr(topicFirstQuote + 1, topicSecondQuote - topicFirstQuote - 1);
-  std::string message = response.substr(messageComma + 1, messageEnd - messageComma - 1);
-  ESP_LOGD(TAG, "Message in Topic: %s", topic.c_str());
-  ESP_LOGD(TAG, "Message: %s", message.c_str());
+  strncpy(buff, message, bufflen);
+  return messageEnd - message;
+}
 
-  strncpy(buff, message.c_str(), bufflen);
-  return message.length();
+int readMqttSubData(char *buff, int bufflen) {
+  char *data = (char *)io_lease(IO_MODEM_RESP_SIZE, "mqtt_rx");
+  if (!data)
+    return -6;
+  readResponseBC(&bc95serial, data, IO_MODEM_RESP_SIZE);
+  int res = parseMqttSubData(data, buff, bufflen);
+  io_release(data);
+  return res;
 }
 
 bool dataAvailable() {
@@ -685,6 +803,7 @@ int connectMqtt(char *url, int port, char* username, char *password, char *clien
   configureMqtt();
   ESP_LOGI(TAG, "SENDING TO Modem: AT+QMTOPEN=0,\"%s\",%d", url, port);
 
+  crash_at("AT+QMTOPEN");
   bc95serial.print("AT+QMTOPEN=0,\"");
   bc95serial.print(url);
   bc95serial.print("\",");
@@ -714,6 +833,7 @@ int connectMqtt(char *url, int port, char* username, char *password, char *clien
   ESP_LOGI(TAG, "SENDING TO Modem: AT+QMTCONN=0,\"%s-%s\",\"%s\",\"%s\"",
            clientId, mqttRandomSeed, username, password);
 
+  crash_at("AT+QMTCONN");
   bc95serial.print("AT+QMTCONN=0,\"");
   bc95serial.print(clientId);
   bc95serial.print("-");
@@ -775,8 +895,10 @@ int unsubscribeMqtt(char *topic, int qos) {}
 int checkSubscriptionMqtt(char *message) {}
 
 int publishMqtt(char *topic, char *message, int qos) {
+  LAT_SCOPE(lat_mqtt_publish);
   ESP_LOGI(TAG, "SENDING TO Modem: AT+QMTPUB=0,0,0,0,\"%s\"", topic);
 
+  crash_at("AT+QMTPUB");
   bc95serial.print("AT+QMTPUB=0,0,0,0,\"");
   bc95serial.print(topic);
   bc95serial.println("\"");
@@ -793,6 +915,8 @@ int publishMqtt(char *topic, char *message, int qos) {
   bc95serial.write(26);
 
   responseBytes = readResponseWithStop(&bc95serial, data, 512, "+QMTPUB: 0,0,0", 5000);
+  wireCount("QMTPUB", strlen(topic) + strlen(message) + 24,
+            responseBytes > 0 ? responseBytes : 0);
   while (bc95serial.available()) {
     bc95serial.read();
   }
@@ -812,6 +936,212 @@ int disconnectMqtt() {
   return 0;
 }
 
+// =========================================================
+//  CoAP over UDP (AT+NSOCR=DGRAM / AT+NSOST), alternativa a MQTT
+// =========================================================
+
+static int coapSocket = -1;
+static char coapIp[16];
+static uint16_t coapPort;
+static uint16_t coapMid;
+
+// AT+QDNS resolves host names, dotted addresses are taken as they are
+static bool resolveHost(const char *host, char *ip, size_t size) {
+  unsigned a, b, c, d;
+  if (sscanf(host, "%u.%u.%u.%u", &a, &b, &c, &d) == 4) {
+    strlcpy(ip, host, size);
+    return true;
+  }
+
+  char command[80];
+  snprintf(command, sizeof(command), "AT+QDNS=0,\"%s\"", host);
+  char *resp = (char *)io_lease(IO_AT_RESP_SIZE, "modem");
+  if (!resp)
+    return false;
+  crash_at(command);
+  bc95serial.println(command);
+  int bytesRead = readResponseWithStop(&bc95serial, resp, IO_AT_RESP_SIZE,
+                                       "+QDNS:", 15000);
+  if (bytesRead > 0)
+    readResponseBC(&bc95serial, resp + bytesRead,
+                   IO_AT_RESP_SIZE - bytesRead, 500);
+  char *p = (bytesRead > 0) ? strstr(resp, "+QDNS:") : NULL;
+  bool ok = p && (sscanf(p + 6, "%u.%u.%u.%u", &a, &b, &c, &d) == 4);
+  if (ok)
+    snprintf(ip, size, "%u.%u.%u.%u", a, b, c, d);
+  io_release(resp);
+  if (!ok)
+    ESP_LOGE(TAG, "Could not resolve %s", host);
+  return ok;
+}
+
+static bool udpSend(int socket, const uint8_t *data, size_t len) {
+  char *command = (char *)io_lease(IO_ARENA_MEDIUM, "udp_tx");
+  if (!command)
+    return false;
+  int n = snprintf(command, IO_ARENA_MEDIUM, "AT+NSOST=%d,%s,%u,%u,", socket,
+                   coapIp, coapPort, len);
+  for (size_t i = 0; (i < len) && (n + 3 < IO_ARENA_MEDIUM); i++)
+    n += sprintf(command + n, "%02X", data[i]);
+  bool ok = sendAndReadOk(command, 500, IO_MODEM_RESP_SIZE);
+  io_release(command);
+  if (ok)
+    nbAirCount(nb_coap, 0, 0, NB_UDPIP_HEADER + len);
+  return ok;
+}
+
+// waits for +NSONMI:<socket>,<length>,<hex data> and decodes it into buf
+static int udpReceive(int socket, uint8_t *buf, size_t size,
+                      uint32_t timeout) {
+  char *line = (char *)io_lease(IO_ARENA_MEDIUM, "udp_rx");
+  if (!line)
+    return -1;
+  int res = -2, pos = 0, sock, len, data;
+  unsigned long startT = millis();
+
+  while ((res == -2) && (millis() - startT < timeout)) {
+    if (!bc95serial.available()) {
+      delay(1);
+      continue;
+    }
+    char c = bc95serial.read();
+    if (c != '\n') {
+      if ((c != '\r') && (pos < IO_ARENA_MEDIUM - 1))
+        line[pos++] = c;
+      continue;
+    }
+    line[pos] = 0;
+    wireCount("NSONMI", 0, pos + 2);
+    pos = 0;
+    if ((sscanf(line, "+NSONMI:%d,%d,%n", &sock, &len, &data) != 2) ||
+        (sock != socket))
+      continue;
+    if ((len > (int)size) || ((int)strlen(line + data) != 2 * len)) {
+      ESP_LOGE(TAG, "Size mismatch");
+      res = -1;
+      break;
+    }
+    nbAirCount(nb_coap, 0, 0, NB_UDPIP_HEADER + len);
+    for (int i = 0; i < len; i++)
+      buf[i] = nsonmi_hex(line[data + 2 * i]) << 4 |
+               nsonmi_hex(line[data + 2 * i + 1]);
+    res = len;
+  }
+  io_release(line);
+  return res;
+}
+
+int coapOpen(char *host, int port) {
+  if (coapSocket >= 0)
+    return 0;
+  if (!resolveHost(host, coapIp, sizeof(coapIp)))
+    return -1;
+  coapPort = port;
+  coapSocket = openSocketWith("AT+NSOCR=DGRAM,17,0,1");
+  if (coapSocket < 0)
+    return -2;
+  coapMid = esp_random();
+  ESP_LOGI(TAG, "CoAP socket %d to %s:%d", coapSocket, coapIp, port);
+  return 0;
+}
+
+void coapClose() {
+  if (coapSocket >= 0)
+    closeSocket(coapSocket);
+  coapSocket = -1;
+}
+
+// sends m confirmable and waits for its response, retransmitting with
+// doubled timeout, an empty ACK is followed by waiting for the separate
+// response. Datagrams that do not match count against the timeout of the
+// try. Returns 0 and the response in r, or < 0, -1 if receiving failed
+static int coapExchange(coap_msg_t *m, uint8_t *pdu, coap_msg_t *r) {
+  size_t len = coap_build(pdu, COAP_MAX_PDU, m);
+  uint32_t timeout = COAP_ACK_TIMEOUT_MS;
+  bool acked = false;
+
+  if (len == 0)
+    return -1;
+
+  for (int tries = 0; tries <= COAP_MAX_RETRANSMIT; tries++, timeout *= 2) {
+    if (!acked && !udpSend(coapSocket, pdu, len))
+      return -2;
+    int n = -2;
+    uint32_t start = millis();
+    for (uint32_t spent; (spent = millis() - start) < timeout;) {
+      n = udpReceive(coapSocket, pdu, COAP_MAX_PDU, timeout - spent);
+      if (n <= 0)
+        break;
+      if (coap_parse(pdu, n, r) < 0)
+        continue;
+      if ((r->type == COAP_RST) && (r->mid == m->mid))
+        return -3;
+      if ((r->type == COAP_ACK) && (r->mid == m->mid) &&
+          (r->code == COAP_EMPTY)) {
+        acked = true; // separate response follows
+        continue;
+      }
+      if ((r->tkl != m->tkl) || memcmp(r->token, m->token, m->tkl))
+        continue;
+      if (r->type == COAP_CON) {
+        coap_msg_t ack;
+        coap_init_msg(&ack, COAP_ACK, COAP_EMPTY, r->mid);
+        uint8_t a[4];
+        udpSend(coapSocket, a, coap_build(a, sizeof(a), &ack));
+      }
+      return 0;
+    }
+    if (n == -1)
+      return -1;
+    // rebuild, received datagrams overwrote pdu
+    len = coap_build(pdu, COAP_MAX_PDU, m);
+    ESP_LOGW(TAG, "CoAP timeout, mid %u try %d", m->mid, tries + 1);
+  }
+  return -4;
+}
+
+// confirmable POST of data, block-wise if larger than one block, response
+// payload of the last block is copied to resp, returns its length or < 0
+int coapPost(const char *path, const char *query, const uint8_t *data,
+             size_t len, uint8_t *resp, size_t respSize) {
+  if ((coapSocket < 0) || (len == 0))
+    return -1;
+  uint8_t *pdu = (uint8_t *)io_lease(COAP_MAX_PDU, "coap_pdu");
+  if (!pdu)
+    return -1;
+
+  coap_msg_t m, r;
+  uint32_t token = esp_random();
+  int res = 0;
+  bool more = true;
+
+  for (size_t num = 0; more; num++) {
+    coap_init_msg(&m, COAP_CON, COAP_POST, ++coapMid);
+    m.tkl = sizeof(token);
+    memcpy(m.token, &token, sizeof(token));
+    m.path = path;
+    m.query = query;
+    m.contentFormat = COAP_FORMAT_OCTETS;
+    more = coap_block1(&m, data, len, num);
+
+    res = coapExchange(&m, pdu, &r);
+    if (res < 0)
+      break;
+    if ((r.code >> 5) != 2) {
+      ESP_LOGE(TAG, "CoAP response %u.%02u", r.code >> 5, r.code & 0x1F);
+      res = -(int)r.code;
+      break;
+    }
+    if (!more) {
+      res = (r.len < respSize) ? r.len : respSize;
+      memcpy(resp, r.payload, res);
+    }
+  }
+
+  io_release(pdu);
+  return res;
+}
+
 // =========================================================
 //  Obtener IMEI del modem Quectel BC95-G  (AT+CGSN=1)
 // =========================================================
@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+"""Local CoAP stand-in for the NB-IoT CoAP uplink (nb.cnf "transport": "coap").
+
+Accepts confirmable POSTs on /up?d=<deveui>, reassembles Block1 transfers,
+prints the <port><length><data> records of each batch and answers 2.04
+Changed. A queued remote command (--cmd, hex) is returned once as payload
+of the next response. Datagram bytes including IP/UDP headers are summed
+per device, to compare with the MQTT figures the node logs.
+
+    python3 coap_server.py [--port 5683] [--cmd 8C]
+"""
+
+import argparse
+import socket
+import struct
+
+CON, NON, ACK, RST = range(4)
+POST, CHANGED, CONTINUE, BAD_REQUEST = 0x02, 0x44, 0x5F, 0x80
+URI_PATH, URI_QUERY, BLOCK1 = 11, 15, 27
+UDPIP_HEADER = 28
+
+
+def parse(pdu):
+    ver_t_tkl, code, mid = struct.unpack("!BBH", pdu[:4])
+    tkl = ver_t_tkl & 0x0F
+    msg = {"type": (ver_t_tkl >> 4) & 3, "code": code, "mid": mid,
+           "token": pdu[4:4 + tkl], "path": [], "query": [], "block1": None,
+           "payload": b""}
+    i, number = 4 + tkl, 0
+    while i < len(pdu):
+        if pdu[i] == 0xFF:
+            msg["payload"] = pdu[i + 1:]
+            break
+        delta, length = pdu[i] >> 4, pdu[i] & 0x0F
+        i += 1
+        vals = []
+        for v in (delta, length):
+            if v == 13:
+                v = 13 + pdu[i]
+                i += 1
+            elif v == 14:
+                v = 269 + (pdu[i] << 8 | pdu[i + 1])
+                i += 2
+            vals.append(v)
+        number += vals[0]
+        value = pdu[i:i + vals[1]]
+        i += vals[1]
+        if number == URI_PATH:
+            msg["path"].append(value.decode())
+        elif number == URI_QUERY:
+            msg["query"].append(value.decode())
+        elif number == BLOCK1:
+            msg["block1"] = int.from_bytes(value, "big")
+    return msg
+
+
+def option(last, number, value):
+    delta = number - last
+    assert delta < 13 and len(value) < 13
+    return bytes([delta << 4 | len(value)]) + value
+
+
+def response(req, code, block1=None, payload=b""):
+    out = struct.pack("!BBH", 0x40 | ACK << 4 | len(req["token"]), code,
+                      req["mid"]) + req["token"]
+    if block1 is not None:
+        value = block1.to_bytes(3, "big").lstrip(b"\0") or b""
+        out += bytes([0xD0 | len(value), BLOCK1 - 13]) + value
+    if payload:
+        out += b"\xff" + payload
+    return out
+
+
+def records(body):
+    i = 0
+    while i + 2 <= len(body):
+        port, size = body[i], body[i + 1]
+        yield port, body[i + 2:i + 2 + size]
+        i += 2 + size
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--port", type=int, default=5683)
+    ap.add_argument("--cmd", help="remote command returned once, hex")
+    args = ap.parse_args()
+    pending = bytes.fromhex(args.cmd) if args.cmd else b""
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("", args.port))
+    print("CoAP stand-in listening on udp/%d" % args.port)
+    blocks, seen, air = {}, {}, {}
+
+    while True:
+        pdu, peer = sock.recvfrom(2048)
+        req = parse(pdu)
+        if req["type"] != CON or req["code"] != POST:
+            continue
+        dev = dict(q.split("=", 1) for q in req["query"] if "=" in q).get("d", "?")
+        air[dev] = air.get(dev, 0) + UDPIP_HEADER + len(pdu)
+
+        # retransmission of a request already answered
+        if (peer, req["mid"]) in seen:
+            reply = seen[(peer, req["mid"])]
+        elif req["path"] != ["up"]:
+            reply = response(req, BAD_REQUEST)
+        else:
+            key = (peer, req["token"])
+            blocks.setdefault(key, b"")
+            blocks[key] += req["payload"]
+            b1 = req["block1"]
+            if b1 is not None and b1 & 0x08:
+                reply = response(req, CONTINUE, b1)
+            else:
+                body = blocks.pop(key)
+                for port, data in records(body):
+                    print("%s port %3d: %s" % (dev, port, data.hex()))
+                reply = response(req, CHANGED, b1, pending)
+                pending = b""
+            seen[(peer, req["mid"])] = reply
+        sock.sendto(reply, peer)
+        air[dev] += UDPIP_HEADER + len(reply)
+        print("%s: %d bytes on air so far" % (dev, air[dev]))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,260 @@
+#!/usr/bin/env python3
+"""Decodes the crash trace frames of CRASHPORT (crashtrace.h).
+
+Reads the frames as hex, one per line, in any order, frames of several
+traces mixed:
+
+    boot (low byte), frame index, frames total, deflated data ...
+
+The data of all frames of a trace is a raw length (u16) and one raw deflate
+stream. The inflated trace, all little endian:
+
+    version, reset reason, boot count u16, sd request in progress,
+    last task core 0, last task core 1, last AT command (16 bytes),
+    names n, n * (memory budget id, name \\0),
+    events n, n * (type, arg, val u16, delta ms varint),
+    task switches n, n * (type, arg, val u16, delta ms varint)
+
+Times are ms since the start of the traced run, the deltas of the first
+record of a ring count from 0.
+
+    python3 ctdecode.py frames.txt
+    python3 ctdecode.py --selftest
+"""
+
+import argparse
+import random
+import struct
+import sys
+import zlib
+
+VERSION = 1
+AT_LEN = 16     # CRASH_TRACE_AT
+FRAME_DATA = 48  # CRASH_FRAME_DATA
+NONE = 0xFF
+
+# esp_reset_reason_t
+REASONS = ["unknown", "power on", "reset pin", "software", "panic",
+           "interrupt watchdog", "task watchdog", "other watchdog",
+           "deep sleep", "brown out", "sdio"]
+# crash_cause_t, from 1
+CAUSES = ["resettimer", "MAX_UPTIME", "MEM_LOW heap", "MEM_LOW psram",
+          "update", "remote command", "wifi ota", "sd card lost"]
+# sd_req_type_t of include/sdservice.h
+SDREQ = ["line", "enqueue", "dequeue", "peek", "count", "call", "lend", "log"]
+# crash_event_t, from 1
+EVENTS = ["boot", "reset", "task", "queue", "heap", "at", "sd begin",
+          "sd end"]
+
+
+def pick(table, i, first=0):
+    i -= first
+    return table[i] if 0 <= i < len(table) else "#%d" % (i + first)
+
+
+class Trace:
+    def __init__(self):
+        self.reason = 0
+        self.boots = 0
+        self.sdop = NONE
+        self.task = [NONE, NONE]
+        self.at = ""
+        self.names = {}
+        self.events = []  # (ms, type, arg, val)
+        self.tasks = []
+
+    def name(self, i):
+        return self.names.get(i, "#%d" % i) if i != NONE else "-"
+
+
+def reassemble(lines):
+    """returns {boot: data} of all complete traces"""
+    parts = {}
+    for line in lines:
+        line = line.strip().replace(" ", "")
+        if not line:
+            continue
+        try:
+            b = bytes.fromhex(line)
+        except ValueError:
+            continue
+        if len(b) < 4 or b[1] >= b[2]:
+            continue
+        t = parts.setdefault(b[0], {})
+        t[b[1]] = (b[2], b[3:])
+    done = {}
+    for boot, t in parts.items():
+        total = next(iter(t.values()))[0]
+        if len(t) == total:
+            done[boot] = b"".join(t[i][1] for i in range(total))
+        else:
+            sys.stderr.write("trace of boot %d: %d of %d frames\n" %
+                             (boot, len(t), total))
+    return done
+
+
+def varint(b, p):
+    v = s = 0
+    while True:
+        c = b[p]
+        p += 1
+        v |= (c & 0x7F) << s
+        s += 7
+        if c < 0x80:
+            return v, p
+
+
+def records(b, p):
+    n = b[p]
+    p += 1
+    out, t = [], 0
+    for _ in range(n):
+        typ, arg, val = struct.unpack("<BBH", b[p:p + 4])
+        dt, p = varint(b, p + 4)
+        t += dt
+        out.append((t, typ, arg, val))
+    return out, p
+
+
+def parse(data):
+    raw_len = struct.unpack("<H", data[:2])[0]
+    b = zlib.decompress(data[2:], -15)
+    if len(b) != raw_len or b[0] != VERSION:
+        raise ValueError("bad trace, %d of %d bytes, version %d" %
+                         (len(b), raw_len, b[0] if b else -1))
+    t = Trace()
+    t.reason = b[1]
+    t.boots = struct.unpack("<H", b[2:4])[0]
+    t.sdop, t.task = b[4], [b[5], b[6]]
+    t.at = b[7:7 + AT_LEN].split(b"\0")[0].decode(errors="replace")
+    p = 7 + AT_LEN
+    n = b[p]
+    p += 1
+    for _ in range(n):
+        i = b[p]
+        e = b.index(b"\0", p + 1)
+        t.names[i] = b[p + 1:e].decode(errors="replace")
+        p = e + 1
+    t.events, p = records(b, p)
+    t.tasks, p = records(b, p)
+    return t
+
+
+def describe(t, typ, arg, val):
+    if typ == 1:
+        return "boot %d, reset reason %s" % (val, pick(REASONS, arg))
+    if typ == 2:
+        return "reset requested: %s, free heap %d" % (pick(CAUSES, arg, 1),
+                                                     val * 16)
+    if typ == 3:
+        return "core %d runs %s" % (arg, t.name(val))
+    if typ == 4:
+        return "queue %s: %d waiting" % (t.name(arg), val)
+    if typ == 5:
+        return "heap low water %d" % (val * 16)
+    if typ == 6:
+        return "AT+%s" % "".join(chr(c) for c in (arg, val >> 8, val & 0xFF)
+                                 if c)
+    if typ == 7:
+        return "sd %s begin" % pick(SDREQ, arg)
+    if typ == 8:
+        return "sd %s end, result %d" % (pick(SDREQ, arg),
+                                         val - 0x10000 if val & 0x8000 else val)
+    return "event %d arg %d val %d" % (typ, arg, val)
+
+
+def render(t, out):
+    out.write("Run %d ended by %s\n" % (t.boots, pick(REASONS, t.reason)))
+    out.write("  last AT command %s, sd request %s, tasks %s / %s\n" % (
+        ("AT+" + t.at) if t.at else "-",
+        pick(SDREQ, t.sdop) if t.sdop != NONE else "idle",
+        t.name(t.task[0]), t.name(t.task[1])))
+    merged = sorted(t.events + t.tasks, key=lambda r: r[0])
+    for ms, typ, arg, val in merged:
+        out.write("  %10.3f s  %s\n" % (ms / 1000.0, describe(t, typ, arg,
+                                                              val)))
+
+
+def pack_records(recs):
+    b, last = bytes([len(recs)]), 0
+    for ms, typ, arg, val in recs:
+        b += struct.pack("<BBH", typ, arg, val)
+        v = ms - last
+        last = ms
+        while v >= 0x80:
+            b += bytes([(v & 0x7F) | 0x80])
+            v >>= 7
+        b += bytes([v])
+    return b
+
+
+def selftest():
+    rng = random.Random(1)
+    names = {3: "nbtask", 4: "sdservice", 9: "lorasendqueue"}
+    events, ms = [(0, 1, 3, 7)], 0
+    for _ in range(120):
+        ms += rng.choice([1, 20, 300, 1000, 70000])
+        typ = rng.choice([4, 5, 6, 7, 8])
+        arg = 9 if typ == 4 else rng.randrange(8)
+        events.append((ms, typ, arg, rng.randrange(0x10000)))
+    events.append((ms + 5, 2, 3, 900))
+    tasks = [(ms - 30 + i, 3, i & 1, 3 if i % 3 else 4) for i in range(32)]
+
+    raw = bytes([VERSION, 6]) + struct.pack("<H", 7) + bytes([1, 3, 4])
+    raw += b"QMTPUB=0,0,0,0,".ljust(AT_LEN, b"\0")[:AT_LEN]
+    raw += bytes([len(names)])
+    for i, n in names.items():
+        raw += bytes([i]) + n.encode() + b"\0"
+    raw += pack_records(events) + pack_records(tasks)
+    c = zlib.compressobj(9, zlib.DEFLATED, -15)
+    data = struct.pack("<H", len(raw)) + c.compress(raw) + c.flush()
+
+    n = (len(data) + FRAME_DATA - 1) // FRAME_DATA
+    frames = [(bytes([7, i, n]) + data[i * FRAME_DATA:(i + 1) * FRAME_DATA])
+              for i in range(n)]
+    assert all(len(f) <= 51 for f in frames), "frame size"
+    rng.shuffle(frames)
+    lines = [f.hex() for f in frames] + ["0801", "zz"]
+    traces = reassemble(lines)
+    assert list(traces) == [7], "reassembly"
+    t = parse(traces[7])
+    assert t.events == events and t.tasks == tasks, "records"
+    assert t.names == names and t.task == [3, 4] and t.at == "QMTPUB=0,0,0,0,"
+    assert (t.reason, t.boots, t.sdop) == (6, 7, 1)
+    assert describe(t, 6, ord("Q"), (ord("M") << 8) | ord("T")) == "AT+QMT"
+    assert describe(t, 8, 1, 0xFFFF).endswith("result -1")
+    out = []
+
+    class Sink:
+        def write(self, s):
+            out.append(s)
+    render(t, Sink())
+    sys.stdout.write("".join(out[:4]) + "  ...\n" + "".join(out[-3:]))
+    print("%d events, %d bytes raw, %d deflated, %d frames" % (
+        len(events) + len(tasks), len(raw), len(data), n))
+    print("selftest ok")
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    ap.add_argument("files", nargs="*", help="hex frames, default stdin")
+    ap.add_argument("--selftest", action="store_true")
+    args = ap.parse_args()
+
+    if args.selftest:
+        selftest()
+        return
+
+    lines = []
+    for name in args.files or ["-"]:
+        f = sys.stdin if name == "-" else open(name, errors="replace")
+        lines.extend(f.readlines())
+    for boot, data in sorted(reassemble(lines).items()):
+        try:
+            render(parse(data), sys.stdout)
+        except (ValueError, IndexError, struct.error, zlib.error) as e:
+            sys.stderr.write("trace of boot %d: %s\n" % (boot, e))
+
+
+if __name__ == "__main__":
+    main()
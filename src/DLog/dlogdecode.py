@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+"""Renders the deferred log records of dlog.h written to the SD card.
+
+Reads paxdlog.csv of the SD card or a serial log, any text before "DLG," is
+ignored:
+
+    DLG,uptime ms,format id,arg,...
+
+The formats are read from the table in src/dlog.cpp, so the decoder always
+matches the firmware it is run next to. Arguments are 32 bit integers, %d
+and %i print them signed. A drop of the uptime marks a restart.
+
+    python3 dlogdecode.py paxdlog.csv
+    python3 dlogdecode.py --source ../dlog.cpp paxdlog.csv
+    python3 dlogdecode.py --selftest
+"""
+
+import argparse
+import os
+import re
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SOURCE = os.path.join(HERE, "..", "dlog.cpp")
+HEADER = os.path.join(HERE, "..", "..", "include", "dlog.h")
+ARGS = 6  # DLOG_ARGS
+
+ENTRY = re.compile(r'\{\s*ESP_LOG_(\w+)\s*,\s*"([^"]*)"\s*,\s*"((?:[^"\\]|\\.)*)"\s*\}')
+CONV = re.compile(r"%([-+ #0]*\d*(?:\.\d+)?)(hh|h|ll|l|z)?([diuxXoc%])")
+LEVELS = {"ERROR": "E", "WARN": "W", "INFO": "I", "DEBUG": "D",
+          "VERBOSE": "V"}
+
+
+class Format:
+    def __init__(self, level, tag, fmt):
+        self.level = LEVELS.get(level, "?")
+        self.tag = tag
+        self.c = fmt
+        self.kinds = []
+        self.py = CONV.sub(self._conv, fmt.replace("\\\"", "\""))
+
+    def _conv(self, m):
+        flags, _, kind = m.groups()
+        if kind == "%":
+            return "%%"
+        self.kinds.append(kind)
+        return "%" + flags + ("d" if kind == "i" else kind)
+
+    def render(self, args):
+        vals = []
+        for k, kind in enumerate(self.kinds):
+            v = args[k] if k < len(args) else 0
+            if kind in "di":
+                v = v - (1 << 32) if v & 0x80000000 else v
+            elif kind == "c":
+                v = chr(v & 0xFF)
+            vals.append(v)
+        return self.py % tuple(vals)
+
+
+def load_formats(path):
+    with open(path, encoding="utf-8") as f:
+        text = f.read()
+    start = text.find("formats[DLOG_IDS]")
+    if start < 0:
+        raise ValueError("%s: no format table" % path)
+    end = text.find("};", start)
+    return [Format(*m.groups()) for m in ENTRY.finditer(text[start:end])]
+
+
+def load_ids(path):
+    with open(path, encoding="utf-8") as f:
+        text = f.read()
+    body = text[text.find("typedef enum {"):text.find("} dlog_id_t;")]
+    body = re.sub(r"//.*", "", body)
+    return re.findall(r"\b(dlog_\w+)\s*,", body)
+
+
+def parse_line(line):
+    i = line.find("DLG,")
+    if i < 0:
+        return None
+    try:
+        f = [int(v) for v in line[i + 4:].strip().split(",")]
+    except ValueError:
+        return None  # cut line
+    if len(f) < 2:
+        return None
+    return f[0], f[1], f[2:]
+
+
+def render(lines, formats, out):
+    last = None
+    for line in lines:
+        rec = parse_line(line)
+        if rec is None:
+            continue
+        ms, fid, args = rec
+        if last is not None and ms < last:
+            out.write("--- restart ---\n")
+        last = ms
+        if fid < len(formats):
+            f = formats[fid]
+            text = f.render(args)
+            out.write("%10.3f s %s %-8s %s\n" % (ms / 1000.0, f.level, f.tag,
+                                                 text))
+        else:
+            out.write("%10.3f s ? format %d %s\n" % (ms / 1000.0, fid, args))
+
+
+def selftest(source):
+    formats = load_formats(source)
+    if os.path.exists(HEADER):
+        ids = load_ids(HEADER)
+        assert len(ids) == len(formats), "dlog.h has %d ids, table %d" % (
+            len(ids), len(formats))
+    for k, f in enumerate(formats):
+        assert len(f.kinds) <= ARGS, "format %d: %d arguments" % (k, len(
+            f.kinds))
+        f.render([0] * ARGS)
+
+    t = Format("DEBUG", "x", "RSSI %ddBi -> Hash %08X -> %u%% %c")
+    assert t.render([0xFFFFFFB5, 0xBEEF, 7, 65]) == \
+        "RSSI -75dBi -> Hash 0000BEEF -> 7% A", t.render([0xFFFFFFB5, 0xBEEF,
+                                                          7, 65])
+    assert parse_line("I (5) x: DLG,1500,2,3") == (1500, 2, [3])
+    assert parse_line("DLG,15") is None and parse_line("DLG,1,x") is None
+
+    lines = ["DLG,1000,%d,%u,%u,3,4,5,6" % (len(formats) - 1, 4294967295, 1),
+             "garbage", "DLG,200,0,7", "DLG,210,%d,1" % len(formats)]
+
+    class Sink:
+        text = ""
+
+        def write(self, s):
+            Sink.text += s
+    render(lines, formats, Sink())
+    sys.stdout.write(Sink.text)
+    assert Sink.text.count("\n") == 4 and "--- restart ---" in Sink.text
+    print("%d formats, selftest ok" % len(formats))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    ap.add_argument("files", nargs="*", help="log files, default stdin")
+    ap.add_argument("--source", default=SOURCE,
+                    help="dlog.cpp with the format table")
+    ap.add_argument("--selftest", action="store_true")
+    args = ap.parse_args()
+
+    if args.selftest:
+        selftest(args.source)
+        return
+
+    formats = load_formats(args.source)
+    lines = []
+    for name in args.files or ["-"]:
+        f = sys.stdin if name == "-" else open(name, errors="replace")
+        lines.extend(f.readlines())
+    render(lines, formats, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
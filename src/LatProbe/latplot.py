@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+"""Renders the latency histograms of the LAT_SCOPE() probes (latprobe.h).
+
+Reads the dump lines of latprobe.cpp from the csv log of the SD card or from
+a serial log, any text before "LAT," is ignored:
+
+    LAT,epoch,probe,cpu MHz,count,max cycles,first,bucket first,...,last
+
+or, with --hex, the answer frames of remote command 0x8F as hex, one per line:
+
+    0x8F, probe, probes, cpu MHz, count u32, max u32, first, n, n * u16
+
+all MSB first. Bucket 0 counts runs below 2^9 cycles, bucket i >= 1 runs of
+2^(i+8) to 2^(i+9) - 1 cycles. Only the newest dump of every probe is shown,
+unless --all is given.
+
+    python3 latplot.py paxcount.00
+    python3 latplot.py --hex frames.txt
+    python3 latplot.py --selftest
+"""
+
+import argparse
+import random
+import struct
+import sys
+
+BUCKETS = 24  # LAT_BUCKETS
+SHIFT = 8     # LAT_SHIFT
+# lat_id_t of include/latprobe.h, in order
+PROBES = ["mac_add", "SendPayload", "sdqueueEnqueue", "sdqueueDequeue",
+          "publishMqtt", "readResponseBC"]
+BAR = 40
+
+
+class Hist:
+    def __init__(self, name, mhz, count, maxc, buckets, epoch=0):
+        self.name = name
+        self.mhz = mhz
+        self.count = count
+        self.max = maxc
+        self.buckets = buckets
+        self.epoch = epoch
+
+
+def bucket_range(b):
+    lo = 0 if b == 0 else 1 << (b + SHIFT)
+    return lo, (1 << (b + SHIFT + 1)) - 1
+
+
+def parse_line(line):
+    i = line.find("LAT,")
+    if i < 0:
+        return None
+    f = line[i:].strip().split(",")
+    if len(f) < 8:
+        return None
+    try:
+        epoch, mhz, count, maxc, first = (int(f[1]), int(f[3]), int(f[4]),
+                                          int(f[5]), int(f[6]))
+        vals = [int(v) for v in f[7:]]
+    except ValueError:
+        return None  # cut line
+    buckets = [0] * BUCKETS
+    for k, v in enumerate(vals):
+        if first + k < BUCKETS:
+            buckets[first + k] = v
+    return Hist(f[2], mhz, count, maxc, buckets, epoch)
+
+
+def parse_frames(lines):
+    hists = {}
+    for line in lines:
+        line = line.strip().replace(" ", "")
+        if not line:
+            continue
+        b = bytes.fromhex(line)
+        if len(b) < 14 or b[0] != 0x8F:
+            continue
+        probe, _, mhz = b[1], b[2], b[3]
+        count, maxc = struct.unpack(">II", b[4:12])
+        first, n = b[12], b[13]
+        name = PROBES[probe] if probe < len(PROBES) else "probe%d" % probe
+        h = hists.setdefault(name, Hist(name, mhz, count, maxc, [0] * BUCKETS))
+        for k in range(n):
+            if first + k < BUCKETS and 14 + 2 * k + 2 <= len(b):
+                h.buckets[first + k] = struct.unpack(
+                    ">H", b[14 + 2 * k:16 + 2 * k])[0]
+    return list(hists.values())
+
+
+def percentile(h, p):
+    total = sum(h.buckets)
+    if not total:
+        return 0
+    acc = 0
+    for b, v in enumerate(h.buckets):
+        acc += v
+        if acc >= p * total:
+            hi = bucket_range(b)[1]
+            return min(hi, h.max) if h.max else hi
+    return h.max
+
+
+def us(cycles, mhz):
+    return cycles / mhz if mhz else 0.0
+
+
+def fmt_us(v):
+    if v >= 1e6:
+        return "%.2f s" % (v / 1e6)
+    if v >= 1e3:
+        return "%.1f ms" % (v / 1e3)
+    return "%.1f us" % v
+
+
+def render(h, out):
+    out.write("%s: %d runs, max %s, p50 <= %s, p90 <= %s, p99 <= %s "
+              "(%d MHz)\n" % (h.name, h.count, fmt_us(us(h.max, h.mhz)),
+                             fmt_us(us(percentile(h, 0.5), h.mhz)),
+                             fmt_us(us(percentile(h, 0.9), h.mhz)),
+                             fmt_us(us(percentile(h, 0.99), h.mhz)), h.mhz))
+    top = max(h.buckets) or 1
+    used = [b for b, v in enumerate(h.buckets) if v]
+    if not used:
+        return
+    for b in range(used[0], used[-1] + 1):
+        lo, hi = bucket_range(b)
+        bar = "#" * ((h.buckets[b] * BAR + top - 1) // top)
+        out.write("  %10s .. %-10s %10d %s\n" % (
+            fmt_us(us(lo, h.mhz)), fmt_us(us(hi, h.mhz)), h.buckets[b], bar))
+
+
+def selftest():
+    rng = random.Random(1)
+    buckets = [0] * BUCKETS
+    for _ in range(5000):
+        c = int(rng.lognormvariate(10, 1.2))
+        b = max(0, c.bit_length() - 1 - SHIFT)
+        buckets[min(b, BUCKETS - 1)] += 1
+    first = min(b for b, v in enumerate(buckets) if v)
+    last = max(b for b, v in enumerate(buckets) if v)
+    line = "I (123) latprobe: LAT,1760000000,mac_add,240,5000,%d,%d,%s" % (
+        bucket_range(last)[1],
+        first, ",".join(str(v) for v in buckets[first:last + 1]))
+    h = parse_line(line)
+    assert h and h.buckets == buckets and h.count == 5000, "line"
+
+    frames = []
+    for b in range(first, last + 1, 18):
+        n = min(last + 1 - b, 18)
+        f = bytes([0x8F, 0, len(PROBES), 240]) + struct.pack(">II", 5000, h.max)
+        f += bytes([b, n]) + b"".join(struct.pack(">H", min(v, 0xFFFF))
+                                      for v in buckets[b:b + n])
+        assert len(f) <= 51, "frame size"
+        frames.append(f.hex())
+    g = parse_frames(frames)
+    assert len(g) == 1 and g[0].buckets == buckets, "frames"
+    assert bucket_range(0) == (0, 511) and bucket_range(1) == (512, 1023)
+    render(h, sys.stdout)
+    print("selftest ok")
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    ap.add_argument("files", nargs="*", help="log files, default stdin")
+    ap.add_argument("--hex", action="store_true",
+                    help="input is hex frames of remote command 0x8F")
+    ap.add_argument("--all", action="store_true", help="show every dump")
+    ap.add_argument("--selftest", action="store_true")
+    args = ap.parse_args()
+
+    if args.selftest:
+        selftest()
+        return
+
+    lines = []
+    for name in args.files or ["-"]:
+        f = sys.stdin if name == "-" else open(name, errors="replace")
+        lines.extend(f.readlines())
+
+    if args.hex:
+        hists = parse_frames(lines)
+    else:
+        hists = [h for h in map(parse_line, lines) if h]
+        if not args.all:
+            newest = {}
+            for h in hists:
+                newest[h.name] = h  # logs are in time order
+            hists = list(newest.values())
+    for h in hists:
+        render(h, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
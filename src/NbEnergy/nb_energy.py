@@ -0,0 +1,199 @@
+#!/usr/bin/env python3
+"""Energy model of the BC95 NB-IoT modem for the nb.cnf "power" modes.
+
+A small modem emulator replays one day of what nbtask does in each mode:
+"on" publishes every queued message right away, answers the NB health check
+every minute and polls the modem status every minute, "psm" and "edrx" let
+the queue build up and send it in one window every NB_WINDOW_CYCLES send
+cycles. The emulator walks the modem through its radio states (connected,
+RRC inactivity, idle with DRX or eDRX paging, PSM) and integrates the supply
+current of each state into mAh per day.
+
+Currents are typical BC95-G figures at 3.6 V and good coverage, replace them
+with values measured on the board (--i-* options). Air bytes per message are
+the "bytes on air per msg" figures the node logs in bc95_printWireStats.
+
+    python3 nb_energy.py [--sendcycle 60] [--window 10] [--transport coap]
+"""
+
+import argparse
+
+# radio states, current [mA]
+CURRENTS = {
+    "tx": 110.0,      # transmitting and receiving, ECL 0
+    "connected": 6.0,  # RRC connected without data, until inactivity timer
+    "drx": 1.0,       # idle, paging every 2.56 s
+    "edrx": 0.15,     # idle, paging every eDRX cycle
+    "psm": 0.005,     # power saving mode
+}
+
+RRC_SETUP_S = 1.2      # random access and RRC connection setup
+RRC_INACTIVITY_S = 20  # network releases the connection after this idle time
+UPLINK_BPS = 2000      # effective uplink rate [bytes/s]
+AT_ACTIVE_S = 0.05     # modem awake per AT command when resting
+TAU_BYTES = 60         # periodic tracking area update
+MQTT_KEEPALIVE_S = 60  # AT+QMTCFG="keepalive", pings wake an eDRX modem
+MQTT_PING_BYTES = 2 * 40 + 4
+
+DAY_S = 24 * 3600
+
+
+class Modem:
+    """Emulated radio states of the modem, integrates charge over time."""
+
+    def __init__(self, idle, active_s, currents):
+        self.idle = idle            # "drx", "edrx" or "psm"
+        self.active_s = active_s    # psm: T3324 in idle before sleeping
+        self.i = currents
+        self.t = 0.0
+        self.charge = 0.0           # mA*s
+        self.connected_until = -1.0  # end of RRC inactivity timer
+        self.wakes = 0
+        self.tx_s = 0.0
+
+    def _idle_until(self, t):
+        # idle from end of connection, psm after the active timer
+        start = max(self.t, self.connected_until)
+        if t <= start:
+            return
+        if self.idle == "psm":
+            awake = min(t, self.connected_until + self.active_s) - start
+            awake = max(awake, 0.0)
+            self.charge += awake * self.i["drx"]
+            self.charge += (t - start - awake) * self.i["psm"]
+        else:
+            self.charge += (t - start) * self.i[self.idle]
+
+    def advance(self, t):
+        if self.t < self.connected_until:
+            end = min(t, self.connected_until)
+            self.charge += (end - self.t) * self.i["connected"]
+        self._idle_until(t)
+        self.t = t
+
+    def exchange(self, t, nbytes):
+        """Uplink of nbytes at time t, connection is set up if released."""
+        self.advance(t)
+        busy = nbytes / UPLINK_BPS
+        if t >= self.connected_until:
+            busy += RRC_SETUP_S
+            self.wakes += 1
+        self.charge += busy * self.i["tx"]
+        self.tx_s += busy
+        self.t = t + busy
+        self.connected_until = self.t + RRC_INACTIVITY_S
+
+    def at_commands(self, t, count):
+        """AT commands over uart, radio stays untouched."""
+        self.advance(t)
+        if self.idle == "psm" and t > self.connected_until + self.active_s:
+            self.charge += count * AT_ACTIVE_S * (self.i["drx"] - self.i["psm"])
+
+    def mah(self):
+        return self.charge / 3600.0
+
+
+def uplink_bytes(a, messages):
+    """Air bytes for messages, coap posts NB_COAP_BATCH per datagram."""
+    if a.transport == "mqtt":
+        return messages * a.bytes
+    batches = -(-messages // 8)
+    return batches * (28 + 8) + messages * (a.bytes - 28)
+
+
+def events(mode, a):
+    """(time, kind, value) of one day as nbtask produces them in mode."""
+    mqtt = a.transport == "mqtt"
+    status = 3 if mqtt else 2  # CEREG, CGPADDR and QMTCONN
+    ev = []
+
+    if mode == "on":
+        # every send cycle goes out at once, health check and status poll
+        # every minute, mqtt keepalive is covered by this traffic
+        for t in frange(0, a.sendcycle):
+            ev.append((t, "send", uplink_bytes(a, a.messages)))
+        for t in frange(30, 60):
+            ev.append((t, "send", uplink_bytes(a, 1)))
+            ev.append((t + 1, "at", status))
+        return ev
+
+    # window every n send cycles carries counters and health checks
+    period = a.sendcycle * a.window
+    per_window = a.messages * a.window + max(1, int(period // 60))
+    for t in frange(0, period):
+        size = uplink_bytes(a, per_window)
+        if mqtt and mode == "psm" and period > 1.5 * MQTT_KEEPALIVE_S:
+            size += a.mqtt_reconnect  # broker dropped the session
+        ev.append((t, "at", status + 1))  # wake probe first
+        ev.append((t, "send", size))
+        if mqtt and mode == "edrx":
+            # modem stack keeps the session alive between windows
+            for k in range(1, int(period // MQTT_KEEPALIVE_S)):
+                ev.append((t + k * MQTT_KEEPALIVE_S, "send", MQTT_PING_BYTES))
+    if mode == "psm":
+        for t in frange(a.tau, a.tau):
+            ev.append((t, "send", TAU_BYTES))
+    return ev
+
+
+def frange(start, step):
+    t = start
+    while t < DAY_S:
+        yield t
+        t += step
+
+
+def simulate(mode, a):
+    idle = {"on": "drx", "psm": "psm", "edrx": "edrx"}[mode]
+    m = Modem(idle, a.active, CURRENTS)
+    for t, kind, value in sorted(events(mode, a)):
+        t = max(t, m.t)
+        if kind == "send":
+            m.exchange(t, value)
+        else:
+            m.at_commands(t, value)
+    m.advance(DAY_S)
+    return m
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--sendcycle", type=float, default=60,
+                    help="payload send cycle [s], cfg.sendcycle * 2")
+    ap.add_argument("--window", type=int, default=10,
+                    help="NB_WINDOW_CYCLES, send cycles per window")
+    ap.add_argument("--messages", type=int, default=1,
+                    help="messages enqueued per send cycle")
+    ap.add_argument("--transport", choices=("mqtt", "coap"), default="mqtt")
+    ap.add_argument("--bytes", type=int, default=None,
+                    help="bytes on air per message (mqtt 330, coap 60)")
+    ap.add_argument("--mqtt-reconnect", type=int, default=400,
+                    help="bytes on air for mqtt connect and subscribe")
+    ap.add_argument("--active", type=float, default=20,
+                    help="NB_PSM_ACTIVE_S, T3324 [s]")
+    ap.add_argument("--tau", type=float, default=43200,
+                    help="NB_PSM_TAU_S, T3412 [s]")
+    ap.add_argument("--battery", type=float, default=3400,
+                    help="battery capacity [mAh]")
+    for state, value in CURRENTS.items():
+        ap.add_argument("--i-" + state, type=float, default=value,
+                        help="current in state %s [mA]" % state)
+    a = ap.parse_args()
+    if a.bytes is None:
+        a.bytes = 330 if a.transport == "mqtt" else 60
+    for state in CURRENTS:
+        CURRENTS[state] = getattr(a, "i_" + state)
+
+    print("%s, send cycle %g s, window every %d cycles" %
+          (a.transport, a.sendcycle, a.window))
+    print("%-5s %8s %10s %10s %10s" %
+          ("mode", "wakes/d", "tx s/d", "mAh/day", "days"))
+    for mode in ("on", "edrx", "psm"):
+        m = simulate(mode, a)
+        mah = m.mah()
+        print("%-5s %8d %10.0f %10.1f %10.0f" %
+              (mode, m.wakes, m.tx_s, mah, a.battery / mah))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,163 @@
+#!/usr/bin/env python3
+"""Converts the binary TX logs paxbin.NN of the SD card to csv.
+
+The node writes one frame per group commit (see include/sdlog.h):
+
+    frame:  magic "PXB1" u32, seq u32, len u16, crc u16, len bytes of records
+    record: ts u32, channel u8, reason u8, port u8, size u8, size bytes payload
+
+all little endian, crc is crc16 ccitt (0x1021, init 0xFFFF) over seq, len and
+the records. Frames with a bad crc are skipped and the reader resyncs on the
+next magic. Output lines are the ones written to paxcount.NN before:
+
+    TAG,epoch,port,size,HEX[,note]
+
+    python3 sdlog2csv.py paxbin.00 paxbin.01 > tx.csv
+    python3 sdlog2csv.py --selftest
+"""
+
+import argparse
+import random
+import struct
+import sys
+import time
+
+MAGIC = 0x31425850
+FRAME = struct.Struct("<IIHH")
+RECORD = struct.Struct("<IBBBB")
+
+# sdlog_channel_t and sdlog_reason_t of include/sdlog.h, in order
+CHANNELS = ["TX_LORA_OK", "TX_SD_ENQ", "TX_NB_ENQ", "TX_SD_ENQ_PURGE"]
+REASONS = ["", "NO_JOIN_PENDING", "NO_JOIN_QUEUE", "PENDING_AGE",
+           "PENDING_AGE_NO_NB", "BUSY_TIMEOUT", "TOO_LARGE", "TOO_LARGE_NO_NB",
+           "LMIC_ERROR", "LMIC_ERROR_NO_NB", "LORA_QUEUE_FULL"]
+
+
+def _crc_table():
+    table = []
+    for i in range(256):
+        crc = i << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+        table.append(crc & 0xFFFF)
+    return table
+
+
+CRC_TABLE = _crc_table()
+
+
+def crc16(data, crc=0xFFFF):
+    for b in data:
+        crc = ((crc << 8) & 0xFFFF) ^ CRC_TABLE[(crc >> 8) ^ b]
+    return crc
+
+
+def frames(data, stats):
+    """Yields the record bytes of every valid frame in data."""
+    magic = struct.pack("<I", MAGIC)
+    pos = 0
+    while True:
+        pos = data.find(magic, pos)
+        if pos < 0 or pos + FRAME.size > len(data):
+            return
+        _, seq, length, crc = FRAME.unpack_from(data, pos)
+        body = data[pos + FRAME.size:pos + FRAME.size + length]
+        if len(body) == length and \
+                crc16(body, crc16(data[pos + 4:pos + 10])) == crc:
+            stats["frames"] += 1
+            yield body
+            pos += FRAME.size + length
+        else:
+            stats["bad"] += 1
+            pos += 1
+
+
+def records(body):
+    pos = 0
+    while pos + RECORD.size <= len(body):
+        ts, channel, reason, port, size = RECORD.unpack_from(body, pos)
+        pos += RECORD.size
+        yield ts, channel, reason, port, body[pos:pos + size]
+        pos += size
+
+
+def csv_line(ts, channel, reason, port, payload):
+    tag = CHANNELS[channel] if channel < len(CHANNELS) else "CH%u" % channel
+    note = REASONS[reason] if reason < len(REASONS) else "R%u" % reason
+    line = "%s,%u,%u,%u,%s" % (tag, ts, port, len(payload),
+                               payload.hex().upper())
+    return line + "," + note if note else line
+
+
+def convert(data, out, stats):
+    n = 0
+    for body in frames(data, stats):
+        for rec in records(body):
+            out.write(csv_line(*rec) + "\n")
+            n += 1
+    return n
+
+
+def encode(recs, seq):
+    """Frame of recs as the node writes it, for the self test."""
+    body = b"".join(RECORD.pack(ts, ch, rs, port, len(p)) + p
+                    for ts, ch, rs, port, p in recs)
+    crc = crc16(body, crc16(struct.pack("<IH", seq, len(body))))
+    return FRAME.pack(MAGIC, seq, len(body), crc) + body
+
+
+def selftest():
+    rnd = random.Random(1)
+    recs, data = [], b""
+    for seq in range(2000):
+        frame = []
+        while sum(RECORD.size + len(r[4]) for r in frame) < 1536:
+            payload = bytes(rnd.randrange(256) for _ in range(rnd.randrange(1, 52)))
+            frame.append((1760000000 + len(recs) + len(frame), rnd.randrange(4),
+                          rnd.randrange(len(REASONS)), rnd.randrange(1, 10),
+                          payload))
+        recs += frame
+        data += encode(frame, seq)
+
+    # torn frame in the middle is skipped, the rest resyncs
+    torn = encode([(1, 0, 0, 1, b"\x01\x02")], 99999)[:-1]
+    half = len(data) // 2
+    half = data.find(struct.pack("<I", MAGIC), half)
+    data = data[:half] + torn + data[half:]
+
+    class Null:
+        def write(self, s):
+            pass
+
+    stats = {"frames": 0, "bad": 0}
+    t0 = time.time()
+    n = convert(data, Null(), stats)
+    dt = time.time() - t0
+    assert n == len(recs), (n, len(recs))
+    assert stats["frames"] == 2000 and stats["bad"] >= 1, stats
+    line = csv_line(*recs[0])
+    print("ok: %d records in %d frames, %.1f bytes/record, %.0f records/s"
+          % (n, stats["frames"], len(data) / n, n / dt))
+    print("first line: " + line)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("files", nargs="*", help="paxbin.NN files, in order")
+    ap.add_argument("--selftest", action="store_true",
+                    help="round trip synthetic frames incl. a torn one")
+    a = ap.parse_args()
+    if a.selftest:
+        selftest()
+        return
+    stats = {"frames": 0, "bad": 0}
+    n = 0
+    for name in a.files:
+        with open(name, "rb") as f:
+            n += convert(f.read(), sys.stdout, stats)
+    sys.stderr.write("%d records, %d frames, %d bad frames skipped\n"
+                     % (n, stats["frames"], stats["bad"]))
+
+
+if __name__ == "__main__":
+    main()
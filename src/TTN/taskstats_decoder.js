@@ -0,0 +1,48 @@
+// Decoder for the task stats report (remote command 0x8E on port 2, and the
+// tail of the health check on port 14 if TASKSTATS_HEALTH is set)
+// copy&paste to TTN Console -> Applications -> PayloadFormat -> Decoder, or
+// call decodeTaskStats() from your own decoder
+
+function decodeTaskStats(bytes, i) {
+  var report = {};
+  report.period = (bytes[i++] << 8) | bytes[i++];
+  report.load_core0 = bytes[i++];
+  report.load_core1 = bytes[i++];
+  report.tasks = [];
+  var n = bytes[i++];
+  for (var k = 0; k < n && i + 10 <= bytes.length; k++) {
+    var task = {};
+    task.name = "";
+    for (var c = 0; c < 6; c++, i++) {
+      if (bytes[i] !== 0) {
+        task.name += String.fromCharCode(bytes[i]);
+      }
+    }
+    // per mille of one core, shown in percent
+    task.cpu = ((bytes[i++] << 8) | bytes[i++]) / 10;
+    var stack = (bytes[i++] << 8) | bytes[i++];
+    if (stack !== 0xFFFF) {
+      task.stack_free = stack;
+    }
+    report.tasks.push(task);
+  }
+  return report;
+}
+
+function Decoder(bytes, port) {
+  var decoded = {};
+
+  // remote command answer: 0x8E, frame, tasks total, report
+  if (port === 2 && bytes.length >= 8 && bytes[0] === 0x8E) {
+    decoded = decodeTaskStats(bytes, 3);
+    decoded.frame = bytes[1];
+    decoded.tasks_total = bytes[2];
+  }
+
+  // health check: 21 bytes status, then the report
+  if (port === 14 && bytes.length >= 26) {
+    decoded = decodeTaskStats(bytes, 21);
+  }
+
+  return decoded;
+}
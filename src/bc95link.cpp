@@ -0,0 +1,122 @@
+/* bc95link negotiates the uart rate with the BC95 modem, see
+include/bc95link.h. A volatile AT+NATSPEED is sent first and confirmed by
+an AT at the new rate, only then is the rate made persistent, so a rate
+which does not work on the board makes the modem revert by itself. */
+
+#include <stdio.h>
+
+#include "bc95link.h"
+
+typedef enum {
+  baud_probe_stored, // try rate of last negotiation
+  baud_probe_default,
+  baud_probe_target, // last resort, modem may already be at target
+  baud_switch,       // request target rate, volatile
+  baud_verify,
+  baud_store,        // make target rate persistent in modem and nvs
+  baud_fallback,     // wait for modem to revert, then probe old rate
+  baud_done
+} baud_state_t;
+
+// modem answers AT at the current rate
+static bool probeAt(const bc95_link_t *l, int tries) {
+  while (tries--) {
+    if (l->command("AT", 300))
+      return true;
+  }
+  return false;
+}
+
+// AT+NATSPEED=<baud>,<timeout>,<store>,<sync mode>, modem falls back to
+// the old rate if it does not see an AT at the new rate within timeout
+static bool natspeed(const bc95_link_t *l, uint32_t baud, bool store) {
+  char command[40];
+  snprintf(command, sizeof(command), "AT+NATSPEED=%u,%u,%u,2", (unsigned)baud,
+           BC95_NATSPEED_TIMEOUT, store ? 1 : 0);
+  return l->command(command, 500);
+}
+
+uint32_t bc95_negotiate(const bc95_link_t *l, uint32_t stored,
+                        uint32_t target, bc95_baud_result_t *result) {
+  baud_state_t state = baud_probe_stored;
+  uint32_t current = BC95_BAUD_DEFAULT;
+
+  *result = bc95_baud_ok;
+  while (state != baud_done) {
+    switch (state) {
+
+    case baud_probe_stored:
+      state = baud_probe_default;
+      if (stored == BC95_BAUD_DEFAULT)
+        break;
+      l->setBaud(stored);
+      if (probeAt(l, 2)) {
+        current = stored;
+        state = (stored == target) ? baud_done : baud_switch;
+      }
+      break;
+
+    case baud_probe_default:
+      l->setBaud(BC95_BAUD_DEFAULT);
+      current = BC95_BAUD_DEFAULT;
+      if (probeAt(l, 3))
+        state = (target == BC95_BAUD_DEFAULT) ? baud_done : baud_switch;
+      else
+        state = baud_probe_target;
+      break;
+
+    case baud_probe_target:
+      // modem may keep target from a run whose nvs entry is lost
+      state = baud_done;
+      *result = bc95_baud_silent;
+      if ((target != BC95_BAUD_DEFAULT) && (target != stored)) {
+        l->setBaud(target);
+        if (probeAt(l, 2)) {
+          current = target;
+          *result = bc95_baud_ok;
+        }
+      }
+      break;
+
+    case baud_switch:
+      if (natspeed(l, target, false)) {
+        l->setBaud(target);
+        state = baud_verify;
+      } else {
+        *result = bc95_baud_refused;
+        state = baud_done;
+      }
+      break;
+
+    case baud_verify:
+      state = probeAt(l, 3) ? baud_store : baud_fallback;
+      break;
+
+    case baud_store:
+      if (natspeed(l, target, true) && probeAt(l, 3)) {
+        current = target;
+        state = baud_done;
+      } else
+        state = baud_fallback;
+      break;
+
+    case baud_fallback:
+      *result = bc95_baud_fallback;
+      l->wait(BC95_NATSPEED_TIMEOUT * 1000 + 500);
+      l->setBaud(current);
+      if (!probeAt(l, 3) && (current != BC95_BAUD_DEFAULT)) {
+        current = BC95_BAUD_DEFAULT;
+        l->setBaud(current);
+      }
+      state = baud_done;
+      break;
+
+    default:
+      state = baud_done;
+      break;
+    }
+  }
+
+  l->setBaud(current);
+  return current;
+}
@@ -7,7 +7,7 @@ static const char TAG[] = __FILE__;
 
 bmeStatus_t bme_status = {0};
 
-Ticker bmecycler;
+int bmecycleJob = -1;
 
 #define SEALEVELPRESSURE_HPA (1013.25)
 
@@ -132,8 +132,8 @@ int bme_init(void) {
 
 finish:
   I2C_MUTEX_UNLOCK(); // release i2c bus access
-  if (rc)
-    bmecycler.attach(BMECYCLE, bmecycle);
+  if (rc && (bmecycleJob < 0))
+    bmecycleJob = sched_add("bmecycle", bmecycle, BMECYCLE * 1000, 0, 1);
   return rc;
 
 } // bme_init()
@@ -0,0 +1,202 @@
+/* coap encodes and decodes CoAP messages for the NB-IoT UDP uplink.
+Only what a constrained client needs is supported: Uri-Path, Uri-Query,
+Content-Format and Block1 options on requests, Block1 on responses, other
+response options are skipped. The codec keeps no platform dependencies, so
+it can be built on a host and used against a local server. */
+
+#include "coap.h"
+
+#include <string.h>
+
+#define COAP_VERSION 1
+#define COAP_PAYLOAD_MARKER 0xFF
+
+void coap_init_msg(coap_msg_t *m, uint8_t type, uint8_t code, uint16_t mid) {
+  memset(m, 0, sizeof(*m));
+  m->type = type;
+  m->code = code;
+  m->mid = mid;
+  m->contentFormat = COAP_FORMAT_NONE;
+  m->block1 = -1;
+}
+
+// option delta or length nibble with 8 or 16 bit extension
+static uint8_t nibble(size_t v) { return v < 13 ? v : (v < 269 ? 13 : 14); }
+
+static size_t put_ext(uint8_t *p, size_t v) {
+  if (v < 13)
+    return 0;
+  if (v < 269) {
+    p[0] = v - 13;
+    return 1;
+  }
+  v -= 269;
+  p[0] = v >> 8;
+  p[1] = v & 0xFF;
+  return 2;
+}
+
+// appends one option, returns bytes written or 0 if it does not fit
+static size_t put_option(uint8_t *p, size_t room, uint16_t *last,
+                         uint16_t number, const uint8_t *value, size_t len) {
+  size_t delta = number - *last, n = 1;
+  uint8_t ext[4];
+
+  n += put_ext(ext, delta);
+  size_t e = n - 1;
+  n += put_ext(ext + e, len);
+  if (n + len > room)
+    return 0;
+  p[0] = (nibble(delta) << 4) | nibble(len);
+  memcpy(p + 1, ext, n - 1);
+  memcpy(p + n, value, len);
+  *last = number;
+  return n + len;
+}
+
+// minimal big endian encoding of an unsigned option value
+static size_t uint_value(uint8_t *v, uint32_t x) {
+  size_t n = 0;
+  uint8_t tmp[4];
+  while (x) {
+    tmp[n++] = x & 0xFF;
+    x >>= 8;
+  }
+  for (size_t i = 0; i < n; i++)
+    v[i] = tmp[n - 1 - i];
+  return n;
+}
+
+// one option per '/' or '&' separated segment of s
+static size_t put_segments(uint8_t *p, size_t room, uint16_t *last,
+                           uint16_t number, const char *s, char sep) {
+  size_t used = 0;
+  while (s && *s) {
+    const char *end = strchr(s, sep);
+    size_t len = end ? (size_t)(end - s) : strlen(s);
+    size_t n = put_option(p + used, room - used, last, number,
+                          (const uint8_t *)s, len);
+    if (n == 0)
+      return 0;
+    used += n;
+    s = end ? end + 1 : NULL;
+  }
+  return used;
+}
+
+// encodes m into pdu, returns pdu length or 0 if it does not fit
+size_t coap_build(uint8_t *pdu, size_t size, const coap_msg_t *m) {
+  uint16_t last = 0;
+  uint8_t v[4];
+  size_t n, pos = 4 + m->tkl;
+
+  if ((size < pos) || (m->tkl > COAP_MAX_TOKEN))
+    return 0;
+  pdu[0] = (COAP_VERSION << 6) | (m->type << 4) | m->tkl;
+  pdu[1] = m->code;
+  pdu[2] = m->mid >> 8;
+  pdu[3] = m->mid & 0xFF;
+  memcpy(pdu + 4, m->token, m->tkl);
+
+  // options in ascending number order
+  if (m->path) {
+    if ((n = put_segments(pdu + pos, size - pos, &last, COAP_OPT_URI_PATH,
+                          m->path, '/')) == 0)
+      return 0;
+    pos += n;
+  }
+  if (m->contentFormat != COAP_FORMAT_NONE) {
+    if ((n = put_option(pdu + pos, size - pos, &last, COAP_OPT_CONTENT_FORMAT,
+                        v, uint_value(v, m->contentFormat))) == 0)
+      return 0;
+    pos += n;
+  }
+  if (m->query) {
+    if ((n = put_segments(pdu + pos, size - pos, &last, COAP_OPT_URI_QUERY,
+                          m->query, '&')) == 0)
+      return 0;
+    pos += n;
+  }
+  if (m->block1 >= 0) {
+    if ((n = put_option(pdu + pos, size - pos, &last, COAP_OPT_BLOCK1, v,
+                        uint_value(v, m->block1))) == 0)
+      return 0;
+    pos += n;
+  }
+
+  if (m->len) {
+    if (pos + 1 + m->len > size)
+      return 0;
+    pdu[pos++] = COAP_PAYLOAD_MARKER;
+    memcpy(pdu + pos, m->payload, m->len);
+    pos += m->len;
+  }
+  return pos;
+}
+
+// sets payload and Block1 option of m to block num of data, data fitting
+// one block goes whole without Block1, returns true if more blocks follow
+bool coap_block1(coap_msg_t *m, const uint8_t *data, size_t len, size_t num) {
+  size_t off = num * COAP_BLOCK_SIZE;
+  bool more = len - off > COAP_BLOCK_SIZE;
+
+  m->payload = data + off;
+  m->len = more ? COAP_BLOCK_SIZE : len - off;
+  m->block1 = (len > COAP_BLOCK_SIZE) ? COAP_BLOCK1(num, more, COAP_BLOCK_SZX)
+                                      : -1;
+  return more;
+}
+
+// reads option delta or length extension, returns -1 on truncation
+static int get_ext(const uint8_t **p, const uint8_t *end, uint8_t nib) {
+  if (nib < 13)
+    return nib;
+  if (nib == 13) {
+    if (*p + 1 > end)
+      return -1;
+    return 13 + *(*p)++;
+  }
+  if ((nib == 14) && (*p + 2 <= end)) {
+    int v = ((*p)[0] << 8 | (*p)[1]) + 269;
+    *p += 2;
+    return v;
+  }
+  return -1;
+}
+
+// decodes pdu into m, payload points into pdu, returns 0 or -1 if malformed
+int coap_parse(const uint8_t *pdu, size_t len, coap_msg_t *m) {
+  const uint8_t *p = pdu + 4, *end = pdu + len;
+  uint16_t number = 0;
+
+  if ((len < 4) || ((pdu[0] >> 6) != COAP_VERSION))
+    return -1;
+  coap_init_msg(m, (pdu[0] >> 4) & 3, pdu[1], pdu[2] << 8 | pdu[3]);
+  m->tkl = pdu[0] & 0x0F;
+  if ((m->tkl > COAP_MAX_TOKEN) || (p + m->tkl > end))
+    return -1;
+  memcpy(m->token, p, m->tkl);
+  p += m->tkl;
+
+  while (p < end) {
+    if (*p == COAP_PAYLOAD_MARKER) {
+      p++;
+      m->payload = p;
+      m->len = end - p;
+      return m->len ? 0 : -1;
+    }
+    uint8_t head = *p++;
+    int delta = get_ext(&p, end, head >> 4);
+    int olen = get_ext(&p, end, head & 0x0F);
+    if ((delta < 0) || (olen < 0) || (p + olen > end))
+      return -1;
+    number += delta;
+    if ((number == COAP_OPT_BLOCK1) && (olen <= 3)) {
+      m->block1 = 0;
+      for (int i = 0; i < olen; i++)
+        m->block1 = (m->block1 << 8) | p[i];
+    }
+    p += olen;
+  }
+  return 0;
+}
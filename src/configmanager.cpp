@@ -1,6 +1,7 @@
 /* configmanager persists runtime configuration using NVRAM of ESP32*/
 
 #include "globals.h"
+#include <rom/crc.h>
 
 // Local logging tag
 static const char TAG[] = "flash";
@@ -8,6 +9,57 @@ static const char TAG[] = "flash";
 nvs_handle my_handle;
 esp_err_t err;
 
+// configData_t is stored as one blob behind this header, crc over the data
+typedef struct {
+  uint32_t magic;
+  uint16_t version; // layout of data, CONFIG_BLOB_VERSION of the writer
+  uint16_t len;     // sizeof(configData_t) of the writer
+  uint32_t crc;     // crc32_le
+} cfgBlobHdr_t;
+
+// per key layout of firmware before the blob, width is the stored integer
+typedef struct {
+  const char *key;
+  uint16_t offset;
+  uint8_t size;  // of the field in configData_t
+  uint8_t width; // of the nvs integer
+} cfgKey_t;
+
+#define CFG_KEY(k, f, w)                                                       \
+  { k, offsetof(configData_t, f), sizeof(((configData_t *)0)->f), w }
+
+static const cfgKey_t legacyKeys[] = {
+    CFG_KEY("loradr", loradr, 1),
+    CFG_KEY("txpower", txpower, 1),
+    CFG_KEY("adrmode", adrmode, 1),
+    CFG_KEY("screensaver", screensaver, 1),
+    CFG_KEY("screenon", screenon, 1),
+    CFG_KEY("countermode", countermode, 1),
+    CFG_KEY("sendcycle", sendcycle, 1),
+    CFG_KEY("wifichancycle", wifichancycle, 1),
+    CFG_KEY("blescantime", blescantime, 1),
+    CFG_KEY("blescanmode", blescan, 1),
+    CFG_KEY("btscanmode", btscan, 1),
+    CFG_KEY("wifiscanmode", wifiscan, 1),
+    CFG_KEY("wifiant", wifiant, 1),
+    CFG_KEY("vendorfilter", vendorfilter, 1),
+    CFG_KEY("rgblum", rgblum, 1),
+    CFG_KEY("payloadmask", payloadmask, 1),
+    CFG_KEY("monitormode", monitormode, 1),
+    CFG_KEY("rssilimit", rssilimit, 2),
+    CFG_KEY("salt", salt, 4),
+    CFG_KEY("saltversion", saltVersion, 4),
+    CFG_KEY("salttimestamp", saltTimestamp, 4),
+    CFG_KEY("resettimer", resettimer, 1),
+};
+
+static int cfgSaveJob = -1;
+static volatile bool cfgPending = false;
+static uint32_t cfgPendingSince = 0;
+static bool cfgStored = false; // cfgStoredCrc matches the blob in NVS
+static uint32_t cfgStoredCrc = 0;
+static uint32_t cfgSaves = 0, cfgWrites = 0;
+
 #define PAYLOADMASK                                  \
   ((GPS_DATA | ALARM_DATA | MEMS_DATA | COUNT_DATA | \
     SENSOR1_DATA | SENSOR2_DATA | SENSOR3_DATA) &    \
@@ -43,6 +95,7 @@ void defaultConfig() {
       0}; // init BSEC state for BME680 sensor
   strncpy(cfg.version, PROGVERSION, sizeof(cfg.version) - 1);
   cfg.resettimer = 0xFF; // reset timer, 0xFF = no timer set
+  cfg.slidewindow = SLIDING_WINDOW; // countermode 4 window [minutes]
 }
 
 void open_storage() {
@@ -67,6 +120,9 @@ void open_storage() {
 // erase all keys and values in NVRAM
 void eraseConfig() {
   ESP_LOGI(TAG, "Clearing settings in NVS");
+  cfgPending = false; // a pending save would restore them
+  sched_stop(cfgSaveJob);
+  cfgStored = false;
   open_storage();
   if (err == ESP_OK) {
     nvs_erase_all(my_handle);
@@ -78,122 +134,35 @@ void eraseConfig() {
   }
 }
 
-// save current configuration from RAM to NVRAM
-void saveConfig() {
+// write cfg to NVS as one blob, skipped if it equals the stored one
+static void writeConfig(void) {
+  uint8_t buf[sizeof(cfgBlobHdr_t) + sizeof(configData_t)];
+  cfgBlobHdr_t *h = (cfgBlobHdr_t *)buf;
+
+  memcpy(buf + sizeof(*h), &cfg, sizeof(cfg));
+  h->magic = CONFIG_BLOB_MAGIC;
+  h->version = CONFIG_BLOB_VERSION;
+  h->len = sizeof(cfg);
+  h->crc = crc32_le(0, buf + sizeof(*h), sizeof(cfg));
+
+  if (cfgStored && (h->crc == cfgStoredCrc)) {
+    ESP_LOGD(TAG, "Settings unchanged, NVS not written");
+    return;
+  }
+
   ESP_LOGI(TAG, "Storing settings in NVS");
   open_storage();
   if (err == ESP_OK) {
-    int8_t flash8 = 0;
-    int16_t flash16 = 0;
-    int32_t flash32 = 0;
-    size_t required_size;
-    uint8_t bsecstate_buffer[BSEC_MAX_STATE_BLOB_SIZE + 1];
-    char storedversion[10];
-
-    if (nvs_get_blob(my_handle, "bsecstate", bsecstate_buffer,
-                     &required_size) != ESP_OK ||
-        memcmp(bsecstate_buffer, cfg.bsecstate, BSEC_MAX_STATE_BLOB_SIZE + 1) !=
-            0)
-      nvs_set_blob(my_handle, "bsecstate", cfg.bsecstate,
-                   BSEC_MAX_STATE_BLOB_SIZE + 1);
-
-    if (nvs_get_str(my_handle, "version", storedversion, &required_size) !=
-            ESP_OK ||
-        strcmp(storedversion, cfg.version) != 0)
-      nvs_set_str(my_handle, "version", cfg.version);
-
-    if (nvs_get_i8(my_handle, "loradr", &flash8) != ESP_OK ||
-        flash8 != cfg.loradr)
-      nvs_set_i8(my_handle, "loradr", cfg.loradr);
-
-    if (nvs_get_i8(my_handle, "txpower", &flash8) != ESP_OK ||
-        flash8 != cfg.txpower)
-      nvs_set_i8(my_handle, "txpower", cfg.txpower);
-
-    if (nvs_get_i8(my_handle, "adrmode", &flash8) != ESP_OK ||
-        flash8 != cfg.adrmode)
-      nvs_set_i8(my_handle, "adrmode", cfg.adrmode);
-
-    if (nvs_get_i8(my_handle, "screensaver", &flash8) != ESP_OK ||
-        flash8 != cfg.screensaver)
-      nvs_set_i8(my_handle, "screensaver", cfg.screensaver);
-
-    if (nvs_get_i8(my_handle, "screenon", &flash8) != ESP_OK ||
-        flash8 != cfg.screenon)
-      nvs_set_i8(my_handle, "screenon", cfg.screenon);
-
-    if (nvs_get_i8(my_handle, "countermode", &flash8) != ESP_OK ||
-        flash8 != cfg.countermode)
-      nvs_set_i8(my_handle, "countermode", cfg.countermode);
-
-    if (nvs_get_i8(my_handle, "sendcycle", &flash8) != ESP_OK ||
-        flash8 != cfg.sendcycle)
-      nvs_set_i8(my_handle, "sendcycle", cfg.sendcycle);
-
-    if (nvs_get_i8(my_handle, "wifichancycle", &flash8) != ESP_OK ||
-        flash8 != cfg.wifichancycle)
-      nvs_set_i8(my_handle, "wifichancycle", cfg.wifichancycle);
-
-    if (nvs_get_i8(my_handle, "blescantime", &flash8) != ESP_OK ||
-        flash8 != cfg.blescantime)
-      nvs_set_i8(my_handle, "blescantime", cfg.blescantime);
-
-    if (nvs_get_i8(my_handle, "blescanmode", &flash8) != ESP_OK ||
-        flash8 != cfg.blescan)
-      nvs_set_i8(my_handle, "blescanmode", cfg.blescan);
-
-    if (nvs_get_i8(my_handle, "btscanmode", &flash8) != ESP_OK ||
-        flash8 != cfg.btscan)
-      nvs_set_i8(my_handle, "btscanmode", cfg.btscan);
-
-    if (nvs_get_i8(my_handle, "wifiscanmode", &flash8) != ESP_OK ||
-        flash8 != cfg.wifiscan)
-      nvs_set_i8(my_handle, "wifiscanmode", cfg.wifiscan);
-
-    if (nvs_get_i8(my_handle, "wifiant", &flash8) != ESP_OK ||
-        flash8 != cfg.wifiant)
-      nvs_set_i8(my_handle, "wifiant", cfg.wifiant);
-
-    if (nvs_get_i8(my_handle, "vendorfilter", &flash8) != ESP_OK ||
-        flash8 != cfg.vendorfilter)
-      nvs_set_i8(my_handle, "vendorfilter", cfg.vendorfilter);
-
-    if (nvs_get_i8(my_handle, "rgblum", &flash8) != ESP_OK ||
-        flash8 != cfg.rgblum)
-      nvs_set_i8(my_handle, "rgblum", cfg.rgblum);
-
-    if (nvs_get_i8(my_handle, "payloadmask", &flash8) != ESP_OK ||
-        flash8 != cfg.payloadmask)
-      nvs_set_i8(my_handle, "payloadmask", cfg.payloadmask);
-
-    if (nvs_get_i8(my_handle, "monitormode", &flash8) != ESP_OK ||
-        flash8 != cfg.monitormode)
-      nvs_set_i8(my_handle, "monitormode", cfg.monitormode);
-
-    if (nvs_get_i16(my_handle, "rssilimit", &flash16) != ESP_OK ||
-        flash16 != cfg.rssilimit)
-      nvs_set_i16(my_handle, "rssilimit", cfg.rssilimit);
-
-    if (nvs_get_i32(my_handle, "salt", &flash32) != ESP_OK ||
-        flash32 != cfg.salt)
-      nvs_set_i32(my_handle, "salt", cfg.salt);
-
-    if (nvs_get_i32(my_handle, "saltversion", &flash32) != ESP_OK ||
-        flash32 != cfg.saltVersion)
-      nvs_set_i32(my_handle, "saltversion", cfg.saltVersion);
-
-    if (nvs_get_i32(my_handle, "salttimestamp", &flash32) != ESP_OK ||
-        flash32 != cfg.saltTimestamp)
-      nvs_set_i32(my_handle, "salttimestamp", cfg.saltTimestamp);
-
-    if (nvs_get_i8(my_handle, "resettimer", &flash8) != ESP_OK ||
-        flash8 != cfg.resettimer)
-      nvs_set_i8(my_handle, "resettimer", cfg.resettimer);
-
-    err = nvs_commit(my_handle);
+    err = nvs_set_blob(my_handle, CONFIG_BLOB_KEY, buf, sizeof(buf));
+    if (err == ESP_OK)
+      err = nvs_commit(my_handle);
     nvs_close(my_handle);
     if (err == ESP_OK) {
-      ESP_LOGI(TAG, "Done");
+      cfgStored = true;
+      cfgStoredCrc = h->crc;
+      cfgWrites++;
+      ESP_LOGI(TAG, "Done, %u writes for %u save requests", cfgWrites,
+               cfgSaves);
     } else {
       ESP_LOGW(TAG, "NVS config write failed");
     }
@@ -202,232 +171,174 @@ void saveConfig() {
   }
 }
 
-// set and save cfg.version
-void migrateVersion() {
-  snprintf(cfg.version, 10, "%s", PROGVERSION);
-  ESP_LOGI(TAG, "version set to %s", cfg.version);
-  saveConfig();
+// write a pending save now, e.g. before restart
+void flushConfig(void) {
+  if (!cfgPending)
+    return;
+  cfgPending = false;
+  writeConfig();
 }
 
-// load configuration from NVRAM into RAM and make it current
-void loadConfig() {
-  defaultConfig(); // start with factory settings
-  ESP_LOGI(TAG, "Reading settings from NVS");
-  open_storage();
-  if (err != ESP_OK) {
-    ESP_LOGW(TAG, "Error (%d) opening NVS handle, storing defaults", err);
-    saveConfig();
-  } // saves factory settings to NVRAM
-  else {
-    int8_t flash8 = 0;
-    int16_t flash16 = 0;
-    int32_t flash32 = 0;
-    size_t required_size;
-
-    // check if configuration stored in NVRAM matches PROGVERSION
-    if (nvs_get_str(my_handle, "version", NULL, &required_size) == ESP_OK) {
-      nvs_get_str(my_handle, "version", cfg.version, &required_size);
-      ESP_LOGI(TAG, "NVRAM settings version = %s", cfg.version);
-      if (strcmp(cfg.version, PROGVERSION)) {
-        ESP_LOGI(TAG, "migrating NVRAM settings to new version %s",
-                 PROGVERSION);
-        nvs_close(my_handle);
-        migrateVersion();
-      }
-    } else {
-      ESP_LOGI(TAG, "new version %s, deleting NVRAM settings", PROGVERSION);
-      nvs_close(my_handle);
-      eraseConfig();
-      migrateVersion();
-    }
-
-    // populate pre set defaults with current values from NVRAM
-
-    if (nvs_get_blob(my_handle, "bsecstate", NULL, &required_size) == ESP_OK) {
-      nvs_get_blob(my_handle, "bsecstate", cfg.bsecstate, &required_size);
-      ESP_LOGI(TAG, "bsecstate = %d", cfg.bsecstate[BSEC_MAX_STATE_BLOB_SIZE]);
-    };
-
-    if (nvs_get_i8(my_handle, "loradr", &flash8) == ESP_OK) {
-      cfg.loradr = flash8;
-      ESP_LOGI(TAG, "loradr = %d", flash8);
-    } else {
-      ESP_LOGI(TAG, "loradr set to default %d", cfg.loradr);
-      saveConfig();
-    }
-
-    if (nvs_get_i8(my_handle, "txpower", &flash8) == ESP_OK) {
-      cfg.txpower = flash8;
-      ESP_LOGI(TAG, "txpower = %d", flash8);
-    } else {
-      ESP_LOGI(TAG, "txpower set to default %d", cfg.txpower);
-      saveConfig();
-    }
-
-    if (nvs_get_i8(my_handle, "adrmode", &flash8) == ESP_OK) {
-      cfg.adrmode = flash8;
-      ESP_LOGI(TAG, "adrmode = %d", flash8);
-    } else {
-      ESP_LOGI(TAG, "adrmode set to default %d", cfg.adrmode);
-      saveConfig();
-    }
-
-    if (nvs_get_i8(my_handle, "screensaver", &flash8) == ESP_OK) {
-      cfg.screensaver = flash8;
-      ESP_LOGI(TAG, "screensaver = %d", flash8);
-    } else {
-      ESP_LOGI(TAG, "screensaver set to default %d", cfg.screensaver);
-      saveConfig();
-    }
-
-    if (nvs_get_i8(my_handle, "screenon", &flash8) == ESP_OK) {
-      cfg.screenon = flash8;
-      ESP_LOGI(TAG, "screenon = %d", flash8);
-    } else {
-      ESP_LOGI(TAG, "screenon set to default %d", cfg.screenon);
-      saveConfig();
-    }
-
-    if (nvs_get_i8(my_handle, "countermode", &flash8) == ESP_OK) {
-      cfg.countermode = flash8;
-      ESP_LOGI(TAG, "countermode = %d", flash8);
-    } else {
-      ESP_LOGI(TAG, "countermode set to default %d", cfg.countermode);
-      saveConfig();
-    }
-
-    if (nvs_get_i8(my_handle, "sendcycle", &flash8) == ESP_OK) {
-      cfg.sendcycle = flash8;
-      ESP_LOGI(TAG, "sendcycle = %d", flash8);
-    } else {
-      ESP_LOGI(TAG, "Payload send cycle set to default %d", cfg.sendcycle);
-      saveConfig();
-    }
-
-    if (nvs_get_i8(my_handle, "wifichancycle", &flash8) == ESP_OK) {
-      cfg.wifichancycle = flash8;
-      ESP_LOGI(TAG, "wifichancycle = %d", flash8);
-    } else {
-      ESP_LOGI(TAG, "WIFI channel cycle set to default %d", cfg.wifichancycle);
-      saveConfig();
-    }
-
-    if (nvs_get_i8(my_handle, "wifiant", &flash8) == ESP_OK) {
-      cfg.wifiant = flash8;
-      ESP_LOGI(TAG, "wifiantenna = %d", flash8);
-    } else {
-      ESP_LOGI(TAG, "WIFI antenna switch set to default %d", cfg.wifiant);
-      saveConfig();
-    }
-
-    if (nvs_get_i8(my_handle, "vendorfilter", &flash8) == ESP_OK) {
-      cfg.vendorfilter = flash8;
-      ESP_LOGI(TAG, "vendorfilter = %d", flash8);
-    } else {
-      ESP_LOGI(TAG, "Vendorfilter mode set to default %d", cfg.vendorfilter);
-      saveConfig();
-    }
+// save current configuration from RAM to NVRAM. The write is deferred by
+// CONFIG_SAVE_DELAY_MS, so a burst of remote commands writes flash once.
+void saveConfig() {
+  cfgSaves++;
+  if (cfgSaveJob < 0) { // no scheduler yet
+    writeConfig();
+    return;
+  }
 
-    if (nvs_get_i8(my_handle, "rgblum", &flash8) == ESP_OK) {
-      cfg.rgblum = flash8;
-      ESP_LOGI(TAG, "rgbluminosity = %d", flash8);
-    } else {
-      ESP_LOGI(TAG, "RGB luminosity set to default %d", cfg.rgblum);
-      saveConfig();
-    }
+  uint32_t now = millis();
+  if (!cfgPending) {
+    cfgPendingSince = now;
+    cfgPending = true;
+  }
+  uint32_t age = now - cfgPendingSince, delay_ms = CONFIG_SAVE_DELAY_MS;
+  if (age + delay_ms > CONFIG_SAVE_MAX_MS)
+    delay_ms = (age < CONFIG_SAVE_MAX_MS) ? CONFIG_SAVE_MAX_MS - age : 0;
+  sched_trigger(cfgSaveJob, delay_ms);
+}
 
-    if (nvs_get_i8(my_handle, "blescantime", &flash8) == ESP_OK) {
-      cfg.blescantime = flash8;
-      ESP_LOGI(TAG, "blescantime = %d", flash8);
+// read settings of the per key layout into cfg, keys missing keep defaults
+static void migrateKeys(void) {
+  size_t required_size;
+
+  for (const cfgKey_t &k : legacyKeys) {
+    int32_t val;
+    esp_err_t e;
+    if (k.width == 1) {
+      int8_t v;
+      e = nvs_get_i8(my_handle, k.key, &v);
+      val = (uint8_t)v; // unsigned fields were stored as i8
+    } else if (k.width == 2) {
+      int16_t v;
+      e = nvs_get_i16(my_handle, k.key, &v);
+      val = v;
     } else {
-      ESP_LOGI(TAG, "BLEscantime set to default %d", cfg.blescantime);
-      saveConfig();
+      e = nvs_get_i32(my_handle, k.key, &val);
     }
+    if (e == ESP_OK)
+      memcpy((uint8_t *)&cfg + k.offset, &val, k.size); // little endian
+    else
+      ESP_LOGI(TAG, "%s not in NVS, set to default", k.key);
+  }
 
-    if (nvs_get_i8(my_handle, "blescanmode", &flash8) == ESP_OK) {
-      cfg.blescan = flash8;
-      ESP_LOGI(TAG, "BLEscanmode = %d", flash8);
-    } else {
-      ESP_LOGI(TAG, "BLEscanmode set to default %d", cfg.blescan);
-      saveConfig();
-    }
+  required_size = sizeof(cfg.bsecstate);
+  if (nvs_get_blob(my_handle, "bsecstate", cfg.bsecstate, &required_size) ==
+      ESP_OK)
+    ESP_LOGI(TAG, "bsecstate = %d", cfg.bsecstate[BSEC_MAX_STATE_BLOB_SIZE]);
 
-    if (nvs_get_i8(my_handle, "btscanmode", &flash8) == ESP_OK) {
-      cfg.btscan = flash8;
-      ESP_LOGI(TAG, "BTscanmode = %d", flash8);
-    } else {
-      ESP_LOGI(TAG, "BTscanmode set to default %d", cfg.btscan);
-      saveConfig();
-    }
+  required_size = sizeof(cfg.version);
+  nvs_get_str(my_handle, "version", cfg.version, &required_size);
+}
 
-    if (nvs_get_i8(my_handle, "wifiscanmode", &flash8) == ESP_OK) {
-      cfg.wifiscan = flash8;
-      ESP_LOGI(TAG, "WIFIscanmode = %d", flash8);
-    } else {
-      ESP_LOGI(TAG, "WIFIscanmode set to default %d", cfg.wifiscan);
-      saveConfig();
-    }
+// drop the keys of the per key layout once the blob is stored
+static void eraseKeys(void) {
+  for (const cfgKey_t &k : legacyKeys)
+    nvs_erase_key(my_handle, k.key);
+  nvs_erase_key(my_handle, "bsecstate");
+  nvs_erase_key(my_handle, "version");
+  nvs_commit(my_handle);
+}
 
-    if (nvs_get_i16(my_handle, "rssilimit", &flash16) == ESP_OK) {
-      cfg.rssilimit = flash16;
-      ESP_LOGI(TAG, "rssilimit = %d", flash16);
-    } else {
-      ESP_LOGI(TAG, "rssilimit set to default %d", cfg.rssilimit);
-      saveConfig();
-    }
+// bring settings of an older layout to CONFIG_BLOB_VERSION, one case per
+// layout falling through to the next one. Layout 0 is one NVS key per field,
+// data then is NULL. Fields only appended to configData_t need no case.
+static void migrateVersion(int from, const uint8_t *data, size_t len) {
+  ESP_LOGI(TAG, "migrating NVRAM settings from layout %d to %d", from,
+           CONFIG_BLOB_VERSION);
+  (void)data; // for the cases of later layouts
+  (void)len;
+  switch (from) {
+  case 0:
+    migrateKeys();
+    // fall through
+  default:
+    break;
+  }
+}
 
-    if (nvs_get_i8(my_handle, "payloadmask", &flash8) == ESP_OK) {
-      cfg.payloadmask = flash8;
-      ESP_LOGI(TAG, "payloadmask = %hhu", flash8);
-    } else {
-      ESP_LOGI(TAG, "payloadmask set to default %hhu", cfg.payloadmask);
-      saveConfig();
-    }
+// read blob into cfg, returns its layout version, -1 if there is none
+static int readBlob(void) {
+  size_t len = 0;
+  int ver = -1;
+
+  if ((nvs_get_blob(my_handle, CONFIG_BLOB_KEY, NULL, &len) != ESP_OK) ||
+      (len < sizeof(cfgBlobHdr_t)))
+    return -1;
+  uint8_t *buf = (uint8_t *)malloc(len);
+  if (!buf)
+    return -1;
+
+  cfgBlobHdr_t *h = (cfgBlobHdr_t *)buf;
+  const uint8_t *data = buf + sizeof(*h);
+  if ((nvs_get_blob(my_handle, CONFIG_BLOB_KEY, buf, &len) != ESP_OK) ||
+      (h->magic != CONFIG_BLOB_MAGIC) || (h->len != len - sizeof(*h)) ||
+      (h->crc != crc32_le(0, data, h->len)) || !h->version ||
+      (h->version > CONFIG_BLOB_VERSION)) {
+    ESP_LOGW(TAG, "Settings blob in NVS not readable, ignored");
+  } else if (h->version == CONFIG_BLOB_VERSION) {
+    // a shorter blob lacks appended fields, they keep their defaults
+    memcpy(&cfg, data, (h->len < sizeof(cfg)) ? h->len : sizeof(cfg));
+    cfgStored = (h->len == sizeof(cfg));
+    cfgStoredCrc = h->crc;
+    ver = h->version;
+  } else {
+    migrateVersion(h->version, data, h->len);
+    ver = h->version;
+  }
 
-    if (nvs_get_i8(my_handle, "monitormode", &flash8) == ESP_OK) {
-      cfg.monitormode = flash8;
-      ESP_LOGI(TAG, "Monitor mode = %d", flash8);
-    } else {
-      ESP_LOGI(TAG, "Monitor mode set to default %d", cfg.monitormode);
-      saveConfig();
-    }
+  free(buf);
+  return ver;
+}
 
-    if (nvs_get_i32(my_handle, "salt", &flash32) == ESP_OK) {
-      cfg.salt = flash32;
-      ESP_LOGI(TAG, "Salt = %d", flash32);
-    } else {
-      cfg.salt = 0x12345678;
-      ESP_LOGI(TAG, "Salt set to default %d", cfg.salt);
-      saveConfig();
+// load configuration from NVRAM into RAM and make it current
+void loadConfig() {
+  defaultConfig(); // start with factory settings
+  ESP_LOGI(TAG, "Reading settings from NVS");
+  open_storage();
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Error (%d) opening NVS handle, storing defaults", err);
+    writeConfig(); // saves factory settings to NVRAM
+  } else {
+    size_t required_size;
+    bool keys = (nvs_get_str(my_handle, "version", NULL, &required_size) ==
+                 ESP_OK);
+    int from = readBlob();
+
+    if ((from < 0) && keys) {
+      from = 0;
+      migrateVersion(0, NULL, 0);
+    } else if (from < 0) {
+      ESP_LOGI(TAG, "new version %s, deleting NVRAM settings", PROGVERSION);
+      nvs_erase_all(my_handle);
+      nvs_commit(my_handle);
     }
+    if (keys && (from > 0))
+      eraseKeys(); // left over from an interrupted migration
+    nvs_close(my_handle);
 
-    if (nvs_get_i32(my_handle, "saltversion", &flash32) == ESP_OK) {
-      cfg.saltVersion = flash32;
-      ESP_LOGI(TAG, "Salt Version = %d", flash32);
-    } else {
-      cfg.saltVersion = 0x00;
-      ESP_LOGI(TAG, "Salt version set to default %d", cfg.saltVersion);
-      saveConfig();
+    // check if configuration stored in NVRAM matches PROGVERSION
+    ESP_LOGI(TAG, "NVRAM settings version = %s", cfg.version);
+    if (strcmp(cfg.version, PROGVERSION)) {
+      ESP_LOGI(TAG, "migrating NVRAM settings to new version %s",
+               PROGVERSION);
+      snprintf(cfg.version, sizeof(cfg.version), "%s", PROGVERSION);
     }
 
-    if (nvs_get_i32(my_handle, "salttimestamp", &flash32) == ESP_OK) {
-      cfg.saltTimestamp = flash32;
-      ESP_LOGI(TAG, "Salt Timestamp = %d", flash32);
-    } else {
-      cfg.saltTimestamp = 0x00;
-      ESP_LOGI(TAG, "Salt timestamp set to default %d", cfg.saltTimestamp);
-      saveConfig();
-    }
+    // writes only if something changed
+    writeConfig();
 
-    if (nvs_get_i8(my_handle, "resettimer", &flash8) == ESP_OK) {
-      cfg.resettimer = flash8;
-      ESP_LOGI(TAG, "Reset Timer mode = %d", flash8);
-    } else {
-      ESP_LOGI(TAG, "Reset Timer mode set to default %d", cfg.resettimer);
-      saveConfig();
+    if (keys && (from == 0) && cfgStored) {
+      open_storage();
+      if (err == ESP_OK) {
+        eraseKeys();
+        nvs_close(my_handle);
+      }
     }
-
-    nvs_close(my_handle);
     ESP_LOGI(TAG, "Done");
   }
+
+  if (cfgSaveJob < 0)
+    cfgSaveJob = sched_add("cfgsave", flushConfig, 0, 0, 1);
 } // loadConfig()
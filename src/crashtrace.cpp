@@ -0,0 +1,359 @@
+/* crashtrace keeps the last moments before a reset. Resets from the task
+watchdog, a panic, MAX_UPTIME or MEM_LOW used to leave only the reset reason
+byte of the health check. Events go to a ring in RTC memory, which keeps its
+content over every reset but power on and brown out: reset requests with
+their cause, the AT command sent last, begin and end of each SD service
+request, changes of send queue depths and of the heap low water mark, and
+the budgeted task running on each core. Task switches are seen from the
+tick hook, so at 1 ms resolution, and have their own ring to not flush the
+rest within a second.
+
+At boot the ring of the previous run is packed, deflated with sdqzip and, if
+the run did not end by power loss or deep sleep, sent on CRASHPORT through
+SendPayload(), which routes it to LoRa or NB-IoT like any other payload. */
+
+// Basic Config
+#include "globals.h"
+#include "crashtrace.h"
+#include "sdqzip.h"
+#include <esp_freertos_hooks.h>
+
+#if (CRASH_TRACE)
+
+// Local logging tag
+static const char TAG[] = "crashtrace";
+
+#define CT_MAGIC 0x43545231 // "CTR1"
+#define CT_VERSION 1
+#define CT_NONE 0xFF // no task, no sd request
+
+typedef struct {
+  uint32_t ms; // since boot
+  uint8_t type, arg;
+  uint16_t val;
+} ct_rec_t;
+
+typedef struct {
+  uint32_t magic;
+  uint16_t boots;
+  uint16_t head, events;  // event ring
+  uint8_t thead, tevents; // task ring
+  uint8_t sdop;           // sd request in progress
+  uint8_t task[2];        // budgeted task which ran last, per core
+  char at[CRASH_TRACE_AT];
+  ct_rec_t ev[CRASH_TRACE_EVENTS];
+  ct_rec_t tk[CRASH_TRACE_TASKS];
+} ct_ring_t;
+
+// kept over resets, validated at boot
+static RTC_NOINIT_ATTR ct_ring_t ring;
+
+static bool ready = false;
+static portMUX_TYPE ctMux = portMUX_INITIALIZER_UNLOCKED;
+static portMUX_TYPE tickMux = portMUX_INITIALIZER_UNLOCKED;
+
+// budgeted tasks, looked up by the tick hook
+static TaskHandle_t taskHandle[MEM_BUDGET_COUNT];
+static uint8_t taskId[MEM_BUDGET_COUNT];
+static uint8_t taskCount = 0;
+static TaskHandle_t lastTask[2];
+
+// sampled state, events are written on change only
+static int16_t queueDepth[MEM_BUDGET_COUNT];
+static uint32_t heapLow = 0;
+
+// deflated trace of the previous run, until all frames are sent
+static uint8_t *trace = NULL;
+static uint16_t traceLen = 0;
+static uint8_t traceBoot, frames, nextFrame;
+
+static void IRAM_ATTR crash_put(ct_rec_t *r, uint16_t *head, uint16_t *count,
+                                uint16_t size, uint8_t type, uint8_t arg,
+                                uint16_t val) {
+  ct_rec_t *e = &r[*head];
+  e->ms = (uint32_t)(esp_timer_get_time() / 1000);
+  e->type = type;
+  e->arg = arg;
+  e->val = val;
+  *head = (*head + 1) % size;
+  if (*count < size)
+    (*count)++;
+}
+
+void crash_note(crash_event_t type, uint8_t arg, uint16_t val) {
+  if (!ready)
+    return;
+  portENTER_CRITICAL(&ctMux);
+  if (type == ct_sd_begin)
+    ring.sdop = arg;
+  else if (type == ct_sd_end)
+    ring.sdop = CT_NONE;
+  crash_put(ring.ev, &ring.head, &ring.events, CRASH_TRACE_EVENTS, type, arg,
+            val);
+  portEXIT_CRITICAL(&ctMux);
+}
+
+void crash_reset(crash_cause_t cause) {
+  crash_note(ct_reset, cause, min(ESP.getFreeHeap() / 16, (uint32_t)0xFFFF));
+}
+
+void crash_at(const char *command) {
+  char name[3] = {0, 0, 0};
+  int n = 0;
+
+  if (!ready)
+    return;
+  if (strncmp(command, "AT+", 3) == 0)
+    command += 3;
+  portENTER_CRITICAL(&ctMux);
+  for (int i = 0; i < CRASH_TRACE_AT; i++) {
+    if (command[n] && !strchr("\r\n", command[n]) && (i < CRASH_TRACE_AT - 1))
+      n++;
+    ring.at[i] = (i < n) ? command[i] : 0;
+  }
+  portEXIT_CRITICAL(&ctMux);
+  for (int i = 0; i < 3 && i < n; i++)
+    name[i] = command[i];
+  crash_note(ct_at, name[0], (name[1] << 8) | name[2]);
+}
+
+// tick interrupt, both cores, runs while the flash cache is off
+static void IRAM_ATTR crash_tick(void) {
+  int core = xPortGetCoreID();
+  TaskHandle_t h = xTaskGetCurrentTaskHandleForCPU(core);
+
+  if (h == lastTask[core])
+    return;
+  lastTask[core] = h;
+
+  portENTER_CRITICAL_ISR(&tickMux);
+  int i = 0;
+  while ((i < taskCount) && (taskHandle[i] != h))
+    i++;
+  if ((i < taskCount) && (ring.task[core] != taskId[i])) {
+    uint16_t head = ring.thead, count = ring.tevents;
+    ring.task[core] = taskId[i];
+    crash_put(ring.tk, &head, &count, CRASH_TRACE_TASKS, ct_task, core,
+              taskId[i]);
+    ring.thead = head;
+    ring.tevents = count;
+  }
+  portEXIT_CRITICAL_ISR(&tickMux);
+}
+
+// scheduler job, picks up new tasks and samples queues and heap
+static void crash_sample(void) {
+  for (int i = 0; i < MEM_BUDGET_COUNT; i++) {
+    void *h = mem_budget_handle((mem_id_t)i);
+    if (h == NULL)
+      continue;
+
+    if (mem_budget_kind((mem_id_t)i) == mem_task) {
+      int k = 0;
+      while ((k < taskCount) && (taskId[k] != i))
+        k++;
+      if (k == taskCount) {
+        portENTER_CRITICAL(&tickMux);
+        taskHandle[k] = (TaskHandle_t)h;
+        taskId[k] = i;
+        taskCount++;
+        portEXIT_CRITICAL(&tickMux);
+      }
+    } else if (mem_budget_kind((mem_id_t)i) == mem_queue) {
+      int16_t n = uxQueueMessagesWaiting((QueueHandle_t)h);
+      if (n != queueDepth[i]) {
+        queueDepth[i] = n;
+        crash_note(ct_queue, i, n);
+      }
+    }
+  }
+
+  uint32_t low = ESP.getMinFreeHeap() / 16;
+  if (low != heapLow) {
+    heapLow = low;
+    crash_note(ct_heap, 0, min(low, (uint32_t)0xFFFF));
+  }
+}
+
+static uint8_t *put_varint(uint8_t *p, uint32_t v) {
+  while (v >= 0x80) {
+    *p++ = (v & 0x7F) | 0x80;
+    v >>= 7;
+  }
+  *p++ = v;
+  return p;
+}
+
+// events oldest first, time as delta to the previous event
+static uint8_t *put_records(uint8_t *p, const ct_rec_t *r, uint16_t head,
+                            uint16_t count, uint16_t size, uint16_t skip) {
+  uint32_t t = 0;
+  *p++ = count - skip;
+  for (uint16_t i = skip; i < count; i++) {
+    const ct_rec_t *e = &r[(head + size - count + i) % size];
+    *p++ = e->type;
+    *p++ = e->arg;
+    *p++ = e->val & 0xFF;
+    *p++ = e->val >> 8;
+    p = put_varint(p, e->ms - t);
+    t = e->ms;
+  }
+  return p;
+}
+
+// memory budget id is named in the trace if an event refers to it
+static bool crash_named(uint16_t skip, int id) {
+  for (uint16_t i = 0; i < ring.tevents; i++)
+    if (ring.tk[i].val == id)
+      return true;
+  for (uint16_t i = skip; i < ring.events; i++) {
+    const ct_rec_t *e =
+        &ring.ev[(ring.head + CRASH_TRACE_EVENTS - ring.events + i) %
+                 CRASH_TRACE_EVENTS];
+    if ((e->type == ct_queue) && (e->arg == id))
+      return true;
+  }
+  return (ring.task[0] == id) || (ring.task[1] == id);
+}
+
+// packs the ring without its skip oldest events, returns the packed length
+static uint16_t crash_pack(uint8_t *buf, uint8_t reason, uint16_t skip) {
+  uint8_t *p = buf, *names;
+
+  *p++ = CT_VERSION;
+  *p++ = reason;
+  *p++ = ring.boots & 0xFF;
+  *p++ = ring.boots >> 8;
+  *p++ = ring.sdop;
+  *p++ = ring.task[0];
+  *p++ = ring.task[1];
+  memcpy(p, ring.at, CRASH_TRACE_AT);
+  p += CRASH_TRACE_AT;
+
+  names = p++;
+  *names = 0;
+  for (int i = 0; i < MEM_BUDGET_COUNT; i++) {
+    if (!crash_named(skip, i))
+      continue;
+    const char *name = mem_budget_name((mem_id_t)i);
+    *p++ = i;
+    strcpy((char *)p, name);
+    p += strlen(name) + 1;
+    (*names)++;
+  }
+
+  p = put_records(p, ring.ev, ring.head, ring.events, CRASH_TRACE_EVENTS,
+                  skip);
+  p = put_records(p, ring.tk, ring.thead, ring.tevents, CRASH_TRACE_TASKS, 0);
+  return p - buf;
+}
+
+// deflates the trace of the previous run, oldest events are dropped until it
+// fits CRASH_MAX_FRAMES
+static void crash_deflate(uint8_t reason) {
+  const size_t size = 32 + MEM_BUDGET_COUNT * 24 +
+                      (CRASH_TRACE_EVENTS + CRASH_TRACE_TASKS) * 9;
+  uint8_t *raw = (uint8_t *)malloc(size);
+  if (raw == NULL)
+    return;
+
+  for (uint16_t skip = 0; skip <= ring.events; skip += 16) {
+    uint16_t len = crash_pack(raw, reason, skip), zLen;
+    uint8_t *z = sdqzip_deflate(raw, len, &zLen);
+    if (z == NULL)
+      break;
+    if (zLen + 2 <= CRASH_MAX_FRAMES * CRASH_FRAME_DATA) {
+      trace = (uint8_t *)malloc(zLen + 2);
+      if (trace) {
+        trace[0] = len & 0xFF;
+        trace[1] = len >> 8;
+        memcpy(trace + 2, z, zLen);
+        traceLen = zLen + 2;
+        traceBoot = ring.boots & 0xFF;
+        frames = (traceLen + CRASH_FRAME_DATA - 1) / CRASH_FRAME_DATA;
+        nextFrame = 0;
+        ESP_LOGI(TAG,
+                 "Trace of boot %u: %u events, %u bytes, %u deflated, "
+                 "%u frames",
+                 ring.boots, ring.events - skip + ring.tevents, len, zLen,
+                 frames);
+      }
+      free(z);
+      break;
+    }
+    free(z);
+  }
+  free(raw);
+}
+
+esp_err_t crash_init(void) {
+  esp_reset_reason_t reason = esp_reset_reason();
+  bool valid = (ring.magic == CT_MAGIC) &&
+               (ring.head < CRASH_TRACE_EVENTS) &&
+               (ring.events <= CRASH_TRACE_EVENTS) &&
+               (ring.thead < CRASH_TRACE_TASKS) &&
+               (ring.tevents <= CRASH_TRACE_TASKS);
+
+  switch (reason) {
+
+  case ESP_RST_POWERON:  // rtc memory content is undefined
+  case ESP_RST_BROWNOUT:
+  case ESP_RST_UNKNOWN:
+    valid = false;
+    break;
+
+  case ESP_RST_DEEPSLEEP: // the trace goes on
+    break;
+
+  default: // software, panic, watchdogs, reset pin
+    if (valid && (ring.events || ring.tevents))
+      crash_deflate(reason);
+    valid = false;
+    break;
+  }
+
+  if (!valid) {
+    uint16_t boots = (ring.magic == CT_MAGIC) ? ring.boots : 0;
+    memset(&ring, 0, sizeof(ring));
+    ring.magic = CT_MAGIC;
+    ring.boots = boots;
+  }
+  ring.boots++;
+  ring.sdop = CT_NONE;
+  ring.task[0] = ring.task[1] = CT_NONE;
+  for (int i = 0; i < MEM_BUDGET_COUNT; i++)
+    queueDepth[i] = -1;
+
+  ready = true;
+  crash_note(ct_boot, reason, ring.boots);
+
+  for (int c = 0; c < 2; c++)
+    if (esp_register_freertos_tick_hook_for_cpu(crash_tick, c) != ESP_OK)
+      return ESP_FAIL;
+  if (sched_add("crashtrace", crash_sample, CRASH_SAMPLE_MS, 0, 1) < 0)
+    return ESP_FAIL;
+  return ESP_OK;
+}
+
+// called each send cycle, sends the next frames of a pending trace
+void crash_send(void) {
+  for (int i = 0; (i < CRASH_BURST) && trace && (nextFrame < frames); i++) {
+    uint16_t pos = nextFrame * CRASH_FRAME_DATA;
+    uint16_t len = min(traceLen - pos, CRASH_FRAME_DATA);
+    payload.reset();
+    payload.addByte(traceBoot);
+    payload.addByte(nextFrame);
+    payload.addByte(frames);
+    for (uint16_t k = 0; k < len; k++)
+      payload.addByte(trace[pos + k]);
+    SendPayload(CRASHPORT, prio_low);
+    nextFrame++;
+  }
+  if (trace && (nextFrame == frames)) {
+    ESP_LOGI(TAG, "Trace of boot %u sent in %u frames", traceBoot, frames);
+    free(trace);
+    trace = NULL;
+  }
+}
+
+#endif // CRASH_TRACE
@@ -7,11 +7,9 @@
 // Local logging tag
 static const char TAG[] = __FILE__;
 
-Ticker housekeeper;
+int housekeepingJob = -1;
 
-void housekeeping() {
-  xTaskNotifyFromISR(irqHandlerTask, CYCLIC_IRQ, eSetBits, NULL);
-}
+void housekeeping() { xTaskNotify(irqHandlerTask, CYCLIC_IRQ, eSetBits); }
 
 // do all housekeeping
 void doHousekeeping() {
@@ -21,11 +19,13 @@ void doHousekeeping() {
 
   if(cfg.resettimer != 0xFF && cfg.resettimer * 3600 < uptime() / 1000) {
     ESP_LOGI(TAG, "Resetting device after %d hours", cfg.resettimer);
+    crash_reset(ct_rst_timer);
     do_reset(true);
   }
 
   if(MAX_UPTIME != 0 && MAX_UPTIME * 3600 < uptime() / 1000) {
     ESP_LOGI(TAG, "Resetting device after %d hours because MAX UPTIME was triggered", cfg.resettimer);
+    crash_reset(ct_rst_uptime);
     do_reset(true);
   }
 
@@ -58,6 +58,7 @@ if(nSent > 0)
   if (RTC_runmode == RUNMODE_UPDATE) {
     // check battery status if we can before doing ota
     if (batt_sufficient()) {
+      crash_reset(ct_rst_update);
       do_reset(true); // warmstart to runmode update
     } else {
       ESP_LOGE(TAG, "Battery voltage %dmV too low for OTA", batt_voltage);
@@ -79,10 +80,12 @@ if(nSent > 0)
 #if (HAS_GPS)
   ESP_LOGD(TAG, "Gpsloop %d bytes left | Taskstate = %d",
            uxTaskGetStackHighWaterMark(GpsTask), eTaskGetState(GpsTask));
+  gps_print_stats();
 #endif
 #ifdef HAS_SPI
   ESP_LOGD(TAG, "spiloop %d bytes left | Taskstate = %d",
            uxTaskGetStackHighWaterMark(spiTask), eTaskGetState(spiTask));
+  spi_print_stats();
 #endif
 
 #if (defined HAS_DCF77 || defined HAS_IF482)
@@ -96,6 +99,31 @@ if(nSent > 0)
            eTaskGetState(ledLoopTask));
 #endif
 
+  // scheduler job timing and memory budget high water marks
+  sched_print_stats();
+  mem_budget_print();
+  io_arena_print();
+#if (OCCUPANCY_SERIES)
+  occ_print_stats();
+#endif
+  slide_print_stats();
+#if (TASKSTATS)
+  taskstat_print();
+#endif
+#if (DEFERRED_LOG)
+  dlog_print_stats();
+#endif
+#ifdef HAS_DISPLAY
+  dp_print_stats();
+#endif
+#if (HAS_NBIOT)
+  bc95_printWireStats();
+#endif
+#ifdef HAS_SDCARD
+  sd_print_stats();
+  sdlog_print_stats();
+#endif
+
 // read battery voltage into global variable
 #if (defined BAT_MEASURE_ADC || defined HAS_PMU)
   batt_voltage = read_voltage();
@@ -131,8 +159,10 @@ if(nSent > 0)
     reset_counters(); // clear macs container and reset all counters
     get_salt();       // get new salt for salting hashes
 
-    if (ESP.getMinFreeHeap() <= MEM_LOW) // check again
-      do_reset(true);                    // memory leak, reset device
+    if (ESP.getMinFreeHeap() <= MEM_LOW) { // check again
+      crash_reset(ct_rst_memlow);
+      do_reset(true); // memory leak, reset device
+    }
   }
 
 // check free PSRAM memory
@@ -142,8 +172,10 @@ if(nSent > 0)
     reset_counters(); // clear macs container and reset all counters
     get_salt();       // get new salt for salting hashes
 
-    if (ESP.getMinFreePsram() <= MEM_LOW) // check again
-      do_reset(true);                     // memory leak, reset device
+    if (ESP.getMinFreePsram() <= MEM_LOW) { // check again
+      crash_reset(ct_rst_psramlow);
+      do_reset(true); // memory leak, reset device
+    }
   }
 #endif
 } // doHousekeeping()
@@ -171,6 +203,7 @@ void reset_counters() {
   macs_list_wifi.clear();   // clear all macs container
   macs_list_ble.clear();   // clear all macs container
   macs_list_bt.clear();   // clear all macs container
+  slide_reset();          // clear sliding window
   macs_total = 0; // reset all counters
   macs_wifi = 0;
   macs_ble = 0;
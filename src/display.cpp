@@ -41,6 +41,18 @@ uint8_t displaybuf[MY_DISPLAY_WIDTH * MY_DISPLAY_HEIGHT / 8] = {0};
 static uint8_t plotbuf[MY_DISPLAY_WIDTH * MY_DISPLAY_HEIGHT / 8] = {0};
 static int dp_row = 0, dp_col = 0, dp_font = 0;
 
+// what the panel shows, frames are composed in displaybuf and only the parts
+// differing from this shadow go over the bus
+static uint8_t dp_shadow[MY_DISPLAY_WIDTH * MY_DISPLAY_HEIGHT / 8] = {0};
+static bool dp_shadowValid = false;
+
+static struct {
+  uint32_t frames, identical; // composed, of which equal to the panel
+  uint32_t chunks;            // 16 byte blocks sent
+  uint32_t busy_us;           // i2c mutex held for the display
+  uint32_t since;             // [ms] start of interval
+} dpStats;
+
 QRCode qrcode;
 
 #ifdef HAS_DISPLAY
@@ -67,6 +79,7 @@ void dp_setup(int contrast) {
   obdSetBackBuffer(&ssoled, displaybuf);
   obdSetTextWrap(&ssoled, true);
   dp_font = MY_FONT_NORMAL;
+  dp_shadowValid = false; // panel content unknown, first dump is a full one
 
 #elif (HAS_DISPLAY) == 2 // SPI TFT
 
@@ -169,8 +182,10 @@ void dp_init(bool verbose) {
 void dp_refresh(bool nextPage) {
 
 #ifndef HAS_BUTTON
-  static uint32_t framecounter = 0;
+  static uint32_t pageSince = 0;
 #endif
+  static uint32_t frameSince = 0;
+  static uint8_t unchanged = 0; // frames in a row equal to the panel
 
   // update histogram
   dp_plotCurve(macs_total, false);
@@ -179,35 +194,79 @@ void dp_refresh(bool nextPage) {
   if (!DisplayIsOn && (DisplayIsOn == cfg.screenon))
     return;
 
+#ifndef HAS_BUTTON
+  // auto flip page if we are in unattended mode
+  if (millis() - pageSince >= DISPLAYCYCLE * 1000UL) {
+    pageSince = millis();
+    nextPage = true;
+  }
+#endif
+
+  // static screen, compose at the idle rate only
+  if (!nextPage && (DisplayIsOn == cfg.screenon) &&
+      (unchanged >= DISPLAYIDLE_FRAMES) &&
+      (millis() - frameSince < DISPLAYIDLE_MS))
+    return;
+  frameSince = millis();
+
   const time_t t =
       myTZ.toLocal(now()); // note: call now() here *before* locking mutex!
 
+#if (HAS_DISPLAY) == 1
+  // the frame is composed in displaybuf without bus access, the bus is only
+  // taken if it differs from what the panel shows
+  dp_drawPage(t, nextPage);
+  dpStats.frames++;
+  bool changed =
+      !dp_shadowValid || memcmp(displaybuf, dp_shadow, sizeof(dp_shadow));
+  if (changed)
+    unchanged = 0;
+  else if (unchanged < 255)
+    unchanged++;
+  if (!changed && (DisplayIsOn == cfg.screenon)) {
+    dpStats.identical++;
+    return;
+  }
+#endif
+
   // block i2c bus access
   if (!I2C_MUTEX_LOCK())
     ESP_LOGV(TAG, "[%0.3f] i2c mutex lock failed", millis() / 1000.0);
   else {
+    uint32_t t0 = micros();
+
     // set display on/off according to current device configuration
     if (DisplayIsOn != cfg.screenon) {
       DisplayIsOn = cfg.screenon;
       dp_power(cfg.screenon);
     }
 
-#ifndef HAS_BUTTON
-    // auto flip page if we are in unattended mode
-    if ((++framecounter) > (DISPLAYCYCLE * 1000 / DISPLAYREFRESH_MS)) {
-      framecounter = 0;
-      nextPage = true;
-    }
-#endif
-
+#if (HAS_DISPLAY) == 2
     dp_drawPage(t, nextPage);
+#endif
     dp_dump(displaybuf);
 
+    dpStats.busy_us += micros() - t0;
     I2C_MUTEX_UNLOCK(); // release i2c bus access
 
   } // mutex
 } // refreshDisplay()
 
+void dp_print_stats(void) {
+  uint32_t ms = millis() - dpStats.since;
+  if (!ms)
+    return;
+  // a full dump of every DISPLAYREFRESH_MS frame for comparison
+  uint32_t full = ms / DISPLAYREFRESH_MS * sizeof(dp_shadow);
+  ESP_LOGD(TAG,
+           "%u frames, %u identical, %u bytes sent (%u at full refresh), "
+           "i2c held %u ms in %u ms",
+           dpStats.frames, dpStats.identical, dpStats.chunks * 16, full,
+           dpStats.busy_us / 1000, ms);
+  memset(&dpStats, 0, sizeof(dpStats));
+  dpStats.since = millis();
+}
+
 void dp_drawPage(time_t t, bool nextpage) {
 
   // write display content to display buffer
@@ -437,10 +496,10 @@ void dp_drawPage(time_t t, bool nextpage) {
   // ---------- page 5: pax graph ----------
   case 5:
 
+    memcpy(displaybuf, plotbuf, sizeof(displaybuf));
     dp_setFont(MY_FONT_NORMAL);
     dp_setTextCursor(0, 0);
     dp_printf("Pax graph");
-    dp_dump(plotbuf);
     break;
 
   // ---------- page 6: blank screen ----------
@@ -549,7 +608,22 @@ void dp_printf(const char *format, ...) {
 
 void dp_dump(uint8_t *pBuffer) {
 #if (HAS_DISPLAY) == 1
+  if (dp_shadowValid) {
+    // obdDumpBuffer() sends only the 16 byte blocks which differ from the
+    // back buffer, so the shadow of the panel is the back buffer meanwhile
+    for (uint16_t i = 0; i < sizeof(dp_shadow); i += 16)
+      if (memcmp(pBuffer + i, dp_shadow + i, 16))
+        dpStats.chunks++;
+    obdSetBackBuffer(&ssoled, dp_shadow);
+  } else {
+    // dumping the back buffer itself sends all of it
+    dpStats.chunks += sizeof(dp_shadow) / 16;
+    obdSetBackBuffer(&ssoled, pBuffer);
+  }
   obdDumpBuffer(&ssoled, pBuffer);
+  obdSetBackBuffer(&ssoled, displaybuf);
+  memcpy(dp_shadow, pBuffer, sizeof(dp_shadow));
+  dp_shadowValid = true;
 #elif (HAS_DISPLAY) == 2
   // probably oled buffer stucture is not suitable for tft -> to be checked
   tft.drawBitmap(0, 0, pBuffer, MY_DISPLAY_WIDTH, MY_DISPLAY_HEIGHT,
@@ -560,7 +634,7 @@ void dp_dump(uint8_t *pBuffer) {
 void dp_clear(void) {
   dp_setTextCursor(0, 0);
 #if (HAS_DISPLAY) == 1
-  obdFill(&ssoled, 0, 1);
+  obdFill(&ssoled, 0, 0); // buffer only, the panel follows with dp_dump()
 #elif (HAS_DISPLAY) == 2
   tft.fillScreen(MY_DISPLAY_BGCOLOR);
 #endif
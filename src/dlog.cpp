@@ -0,0 +1,267 @@
+/* dlog takes formatted logging off the hot paths. A call site reserves a
+ring slot with one compare-and-set on the head index, writes the format id,
+the uptime and the raw arguments, then publishes the slot by storing its
+sequence number. No lock is taken, so callers on both cores never wait for
+each other or for the uart. If the ring is lapped, the oldest records are
+overwritten and counted as dropped.
+
+A low priority task drains the ring every DLOG_DRAIN_MS: it formats the
+records for the serial console when VERBOSE is set, and with DLOG_SD collects
+them as csv lines, handed to the sd service once per cycle and appended to
+DLOG_FILE_NAME, which src/DLog/dlogdecode.py turns back into text on the
+host. Raw MACs never go to the card. */
+
+// Basic Config
+#include "globals.h"
+#include "dlog.h"
+#include <stdarg.h>
+
+#if (DEFERRED_LOG)
+
+#if (DLOG_SD) && defined(HAS_SDCARD)
+#include "sdcard.h"
+#endif
+
+// Local logging tag
+static const char TAG[] = "dlog";
+
+typedef struct {
+  esp_log_level_t level;
+  const char *tag;
+  const char *fmt; // integer conversions only, up to DLOG_ARGS
+} dlog_fmt_t;
+
+// indexed by dlog_id_t, src/DLog/dlogdecode.py reads this table
+static const dlog_fmt_t formats[DLOG_IDS] = {
+    {ESP_LOG_WARN, "dlog", "%u records dropped"},
+    {ESP_LOG_DEBUG, "macsniff", "new   WiFi RSSI %ddBi -> Hash %08X -> WiFi:%u  BLE:%u -> BLTH:%u -> %u Bytes left"},
+    {ESP_LOG_DEBUG, "macsniff", "new   BLE RSSI %ddBi -> Hash %08X -> WiFi:%u  BLE:%u -> BLTH:%u -> %u Bytes left"},
+    {ESP_LOG_DEBUG, "macsniff", "new   BLTH RSSI %ddBi -> Hash %08X -> WiFi:%u  BLE:%u -> BLTH:%u -> %u Bytes left"},
+    {ESP_LOG_ERROR, "macsniff", "MAC is: %02X%02X%02X%02X%02X%02X"},
+    {ESP_LOG_DEBUG, "nbiot", "nb_enqueue: port=%u size=%u prio=%u queue=%u/%u"},
+    {ESP_LOG_INFO, "nbiot", "HIGH priority message enqueued to NB RAM (port=%u)"},
+    {ESP_LOG_DEBUG, "nbiot", "Normal priority message enqueued to NB RAM (port=%u)"},
+    {ESP_LOG_INFO, "nbiot", "Message saved to SD (NB RAM full) - port=%u size=%u [SD fallbacks: %u]"},
+    {ESP_LOG_INFO, "nbiot", "NB Stats: Total=%u RAM=%u SD=%u Evictions=%u Failures=%u"},
+    {ESP_LOG_INFO, "SD_QUEUE", "Paquete salvado en cola SD (port %u, %u bytes, count=%u)"},
+    {ESP_LOG_INFO, "SD_QUEUE", "Recuperado de SD y enviado. Pendientes: %u"},
+    {ESP_LOG_INFO, "SD_FLUSH", "Starting flush cycle: %u messages pending"},
+    {ESP_LOG_INFO, "SD_FLUSH", "DIAG peek result: %d"},
+    {ESP_LOG_INFO, "SD_FLUSH", "Message delivered from SD (port %u, %u bytes, %u remaining)"},
+};
+
+typedef struct {
+  volatile uint32_t seq; // position + 1 when published, 0 while written
+  uint32_t ms;
+  uint8_t id, n;
+  uint16_t reserved;
+  uint32_t arg[DLOG_ARGS];
+} dlog_rec_t;
+
+static dlog_rec_t ring[DLOG_RING];
+static volatile uint32_t head = 0; // next position to reserve
+static uint32_t tail = 0;          // next position to drain, task only
+static uint32_t records = 0, dropped = 0, reported = 0;
+
+#if (DLOG_SD) && defined(HAS_SDCARD)
+// lines of this cycle, the sd service owns and frees the batch once posted
+static char *sdBatch = NULL;
+static size_t sdFill = 0;
+static uint32_t sdLost = 0; // batches not written: no card, memory or room
+
+// runs on the sd service task, owns and frees buf
+static int dlog_card_append(void *arg) {
+  char *buf = (char *)arg;
+  size_t n = strlen(buf);
+  int ret = -1;
+  FileMySD f = mySD.open(DLOG_FILE_NAME, FILE_WRITE);
+  if (f && (f.size() + n > DLOG_FILE_MAX)) {
+    f.close();
+    mySD.remove((char *)DLOG_FILE_NAME);
+    f = mySD.open(DLOG_FILE_NAME, FILE_WRITE);
+  }
+  if (f) {
+    if (f.write((const uint8_t *)buf, n) == n)
+      ret = 0;
+    f.close();
+  }
+  free(buf);
+  return ret;
+}
+
+static void dlog_card_done(int result, void *ctx) {
+  if (result < 0)
+    sdLost++;
+}
+
+static void dlog_sd_post(void) {
+  if (!sdBatch)
+    return;
+  sd_req_t req;
+  req.type = sd_req_call;
+  req.done = dlog_card_done;
+  req.ctx = NULL;
+  req.u.call.fn = dlog_card_append;
+  req.u.call.arg = sdBatch;
+  if (!isSDCardAvailable() || !sd_post(&req, 0)) {
+    free(sdBatch);
+    sdLost++;
+  }
+  sdBatch = NULL;
+  sdFill = 0;
+}
+
+static void dlog_sd_line(const char *line, size_t len) {
+  if (sdBatch && (sdFill + len + 2 > DLOG_SD_BATCH))
+    dlog_sd_post();
+  if (!sdBatch) {
+    sdBatch = (char *)malloc(DLOG_SD_BATCH);
+    if (!sdBatch) {
+      sdLost++;
+      return;
+    }
+  }
+  memcpy(sdBatch + sdFill, line, len);
+  sdFill += len;
+  sdBatch[sdFill++] = '\n';
+  sdBatch[sdFill] = 0;
+}
+#endif
+
+static TaskHandle_t dlogTask = NULL;
+
+void dlog_put(dlog_id_t id, int n, ...) {
+  uint32_t pos, set;
+
+  // reserve a slot, retried only if another caller got in between
+  do {
+    pos = head;
+    set = pos + 1;
+    uxPortCompareSet(&head, pos, &set);
+  } while (set != pos);
+
+  dlog_rec_t *r = &ring[pos & (DLOG_RING - 1)];
+  r->seq = 0;
+  __sync_synchronize();
+  r->ms = millis();
+  r->id = id;
+  r->n = n;
+
+  va_list ap;
+  va_start(ap, n);
+  for (int i = 0; i < n; i++)
+    r->arg[i] = va_arg(ap, uint32_t);
+  va_end(ap);
+
+  __sync_synchronize();
+  r->seq = pos + 1;
+}
+
+static void dlog_emit(const dlog_rec_t *r) {
+#if (VERBOSE)
+  const dlog_fmt_t *f = &formats[r->id < DLOG_IDS ? r->id : dlog_dropped];
+  char text[128];
+  // unused trailing arguments are ignored by snprintf
+  snprintf(text, sizeof(text), f->fmt, r->arg[0], r->arg[1], r->arg[2],
+           r->arg[3], r->arg[4], r->arg[5]);
+  switch (f->level) {
+  case ESP_LOG_ERROR:
+    ESP_LOGE(f->tag, "[%u] %s", r->ms, text);
+    break;
+  case ESP_LOG_WARN:
+    ESP_LOGW(f->tag, "[%u] %s", r->ms, text);
+    break;
+  case ESP_LOG_INFO:
+    ESP_LOGI(f->tag, "[%u] %s", r->ms, text);
+    break;
+  case ESP_LOG_DEBUG:
+    ESP_LOGD(f->tag, "[%u] %s", r->ms, text);
+    break;
+  default:
+    ESP_LOGV(f->tag, "[%u] %s", r->ms, text);
+    break;
+  }
+#endif
+
+#if (DLOG_SD) && defined(HAS_SDCARD)
+  if (r->id == dlog_mac_raw)
+    return;
+  char line[16 + 11 * (DLOG_ARGS + 2)];
+  int len = snprintf(line, sizeof(line), "DLG,%u,%u", r->ms, r->id);
+  for (uint8_t i = 0; (i < r->n) && (i < DLOG_ARGS); i++)
+    len += snprintf(line + len, sizeof(line) - len, ",%u", r->arg[i]);
+  dlog_sd_line(line, len);
+#endif
+}
+
+// single consumer, the task below
+static void dlog_drain(void) {
+  dlog_rec_t r;
+  uint32_t h = head;
+
+  if (h - tail > DLOG_RING) { // lapped, oldest records are gone
+    dropped += h - tail - DLOG_RING;
+    tail = h - DLOG_RING;
+  }
+
+  while (tail != h) {
+    dlog_rec_t *s = &ring[tail & (DLOG_RING - 1)];
+    uint32_t seq = s->seq;
+    if (seq != tail + 1) {
+      if ((int32_t)(seq - (tail + 1)) > 0) { // overwritten by a later lap
+        dropped++;
+        tail++;
+        continue;
+      }
+      break; // still being written, next cycle
+    }
+    memcpy(&r, s, sizeof(r));
+    __sync_synchronize();
+    if (s->seq != seq) { // overwritten while copied
+      dropped++;
+      tail++;
+      continue;
+    }
+    tail++;
+    records++;
+    dlog_emit(&r);
+  }
+
+  if (dropped != reported) {
+    r.ms = millis();
+    r.id = dlog_dropped;
+    r.n = 1;
+    r.arg[0] = dropped - reported;
+    reported = dropped;
+    dlog_emit(&r);
+  }
+
+#if (DLOG_SD) && defined(HAS_SDCARD)
+  dlog_sd_post();
+#endif
+}
+
+static void dlog_loop(void *pvParameters) {
+  for (;;) {
+    vTaskDelay(pdMS_TO_TICKS(DLOG_DRAIN_MS));
+    dlog_drain();
+  }
+}
+
+esp_err_t dlog_init(void) {
+  if (mem_task_create(MEM_TASK_DLOG, dlog_loop, NULL, 1, &dlogTask, 1) !=
+      pdPASS)
+    return ESP_FAIL;
+  return ESP_OK;
+}
+
+void dlog_print_stats(void) {
+  ESP_LOGD(TAG, "Deferred log: %u records, %u dropped, %u pending", records,
+           dropped, head - tail);
+#if (DLOG_SD) && defined(HAS_SDCARD)
+  ESP_LOGD(TAG, "Deferred log: %u batches not written to %s", sdLost,
+           DLOG_FILE_NAME);
+#endif
+}
+
+#endif // DEFERRED_LOG
@@ -0,0 +1,223 @@
+/* fragdec recovers lost fragments of a TS004 fragmentation session from its
+coded fragments, see include/fragdec.h. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fragdec.h"
+
+static inline bool bitGet(const uint8_t *b, uint32_t i) {
+  return (b[i >> 3] >> (i & 7)) & 1;
+}
+static inline void bitSet(uint8_t *b, uint32_t i) { b[i >> 3] |= 1 << (i & 7); }
+static inline void xorBuf(uint8_t *dst, const uint8_t *src, size_t n) {
+  while (n--)
+    *dst++ ^= *src++;
+}
+
+static void *dec_alloc(frag_dec_t *d, size_t n) {
+  void *p = calloc(n, 1);
+  if (p)
+    d->bytes += n;
+  return p;
+}
+
+static uint32_t prbs23(uint32_t x) {
+  uint32_t b0 = x & 1, b1 = (x & 0x20) >> 5;
+  return (x >> 1) + ((b0 ^ b1) << 22);
+}
+
+void frag_parity_line(uint32_t n, uint32_t m, uint8_t *line) {
+  uint32_t mTemp = ((m & (m - 1)) == 0) ? 1 : 0;
+  uint32_t x = 1 + 1001 * n, r;
+  memset(line, 0, (m + 7) / 8);
+  for (uint32_t nbCoeff = 0; nbCoeff < (m >> 1); nbCoeff++) {
+    r = 1 << 16;
+    while (r >= m) {
+      x = prbs23(x);
+      r = x % (m + mTemp);
+    }
+    bitSet(line, r);
+  }
+}
+
+// lost index of fragment (0 based), -1 if fragment was received before freeze
+static int lost_index(const frag_dec_t *d, uint16_t frag) {
+  int lo = 0, hi = (int)d->lost - 1;
+  while (lo <= hi) {
+    int mid = (lo + hi) >> 1;
+    if (d->missing[mid] == frag)
+      return mid;
+    if (d->missing[mid] < frag)
+      lo = mid + 1;
+    else
+      hi = mid - 1;
+  }
+  return -1;
+}
+
+static void dec_free(frag_dec_t *d, void *p, size_t n) {
+  if (p)
+    d->bytes -= n;
+  free(p);
+}
+
+static void free_matrix(frag_dec_t *d) {
+  dec_free(d, d->missing, d->lost * sizeof(uint16_t) + 1);
+  dec_free(d, d->matrix, d->lost * d->rowBytes + 1);
+  dec_free(d, d->pivot, d->rowBytes + 1);
+  dec_free(d, d->row, d->rowBytes + 1);
+  d->missing = NULL;
+  d->matrix = d->pivot = d->row = NULL;
+}
+
+// fix the set of lost fragments, from now on all fragments are equations
+static int freeze(frag_dec_t *d) {
+  d->lost = d->nbFrag - d->received;
+  if (d->lost > d->maxLost) {
+    d->memError = true;
+    return FRAG_DEC_NOMEM;
+  }
+  d->rowBytes = (d->lost + 7) / 8;
+  d->missing = (uint16_t *)dec_alloc(d, d->lost * sizeof(uint16_t) + 1);
+  d->matrix = (uint8_t *)dec_alloc(d, d->lost * d->rowBytes + 1);
+  d->pivot = (uint8_t *)dec_alloc(d, d->rowBytes + 1);
+  d->row = (uint8_t *)dec_alloc(d, d->rowBytes + 1);
+  if (!d->missing || !d->matrix || !d->pivot || !d->row) {
+    free_matrix(d);
+    d->memError = true;
+    return FRAG_DEC_NOMEM;
+  }
+  for (uint16_t i = 0, k = 0; i < d->nbFrag; i++)
+    if (!bitGet(d->rcvd, i))
+      d->missing[k++] = i;
+  d->memError = false;
+  d->frozen = true;
+  d->rank = 0;
+  return FRAG_DEC_MORE;
+}
+
+// back substitution, all lost fragments are known afterwards
+static bool solve(frag_dec_t *d) {
+  for (int i = d->lost - 1; i >= 0; i--) {
+    const uint8_t *row = d->matrix + i * d->rowBytes;
+    if (!d->read(d->missing[i] * d->fragSize, d->data, d->fragSize))
+      return false;
+    for (uint16_t j = i + 1; j < d->lost; j++) {
+      if (!bitGet(row, j))
+        continue;
+      if (!d->read(d->missing[j] * d->fragSize, d->tmp, d->fragSize))
+        return false;
+      xorBuf(d->data, d->tmp, d->fragSize);
+    }
+    if (!d->write(d->missing[i] * d->fragSize, d->data, d->fragSize))
+      return false;
+  }
+  return true;
+}
+
+// reduce equation (row, data) against pivot rows and store it if it adds
+// information
+static bool add_row(frag_dec_t *d) {
+  for (uint16_t i = 0; i < d->lost; i++) {
+    if (!bitGet(d->row, i))
+      continue;
+    if (bitGet(d->pivot, i)) {
+      xorBuf(d->row, d->matrix + i * d->rowBytes, d->rowBytes);
+      if (!d->read(d->missing[i] * d->fragSize, d->tmp, d->fragSize))
+        return false;
+      xorBuf(d->data, d->tmp, d->fragSize);
+      continue;
+    }
+    memcpy(d->matrix + i * d->rowBytes, d->row, d->rowBytes);
+    bitSet(d->pivot, i);
+    d->rank++;
+    return d->write(d->missing[i] * d->fragSize, d->data, d->fragSize);
+  }
+  // row reduced to zero, fragment carried no new information
+  return true;
+}
+
+bool frag_dec_init(frag_dec_t *d, uint16_t nbFrag, uint8_t fragSize,
+                   uint16_t maxLost, frag_read_t read, frag_write_t write) {
+  memset(d, 0, sizeof(*d));
+  d->nbFrag = nbFrag;
+  d->fragSize = fragSize;
+  d->maxLost = maxLost;
+  d->read = read;
+  d->write = write;
+  d->rcvd = (uint8_t *)dec_alloc(d, (nbFrag + 7) / 8);
+  d->line = (uint8_t *)dec_alloc(d, (nbFrag + 7) / 8);
+  d->data = (uint8_t *)dec_alloc(d, fragSize);
+  d->tmp = (uint8_t *)dec_alloc(d, fragSize);
+  return d->rcvd && d->line && d->data && d->tmp;
+}
+
+void frag_dec_free(frag_dec_t *d) {
+  if (d->frozen)
+    free_matrix(d);
+  free(d->rcvd);
+  free(d->line);
+  free(d->data);
+  free(d->tmp);
+  memset(d, 0, sizeof(*d));
+}
+
+int frag_dec_add(frag_dec_t *d, uint16_t n, const uint8_t *data) {
+  if (!n || (d->received == d->nbFrag) ||
+      (d->frozen && (d->rank == d->lost)))
+    return FRAG_DEC_DONE;
+
+  if (n <= d->nbFrag) {
+    uint16_t frag = n - 1;
+    if (bitGet(d->rcvd, frag))
+      return FRAG_DEC_MORE; // duplicate
+    bitSet(d->rcvd, frag);
+    d->received++;
+    if (!d->frozen) {
+      if (!d->write(frag * d->fragSize, data, d->fragSize))
+        return FRAG_DEC_STORE;
+      return d->received == d->nbFrag ? FRAG_DEC_DONE : FRAG_DEC_MORE;
+    }
+    // lost fragment arrived late, it is an equation with one coefficient
+    int k = lost_index(d, frag);
+    if (k < 0)
+      return FRAG_DEC_MORE;
+    memset(d->row, 0, d->rowBytes);
+    bitSet(d->row, k);
+    memcpy(d->data, data, d->fragSize);
+  } else {
+    if (!d->frozen) {
+      int ret = freeze(d);
+      if (ret != FRAG_DEC_MORE)
+        return ret;
+    }
+    d->codedRx++;
+    frag_parity_line(n - d->nbFrag, d->nbFrag, d->line);
+    memset(d->row, 0, d->rowBytes);
+    memcpy(d->data, data, d->fragSize);
+    for (uint16_t j = 0; j < d->nbFrag; j++) {
+      if (!bitGet(d->line, j))
+        continue;
+      int k = lost_index(d, j);
+      if (k >= 0) {
+        bitSet(d->row, k);
+      } else {
+        // known fragment, eliminate it from the equation
+        if (!d->read(j * d->fragSize, d->tmp, d->fragSize))
+          return FRAG_DEC_STORE;
+        xorBuf(d->data, d->tmp, d->fragSize);
+      }
+    }
+  }
+
+  if (!add_row(d))
+    return FRAG_DEC_STORE;
+  if (d->rank < d->lost)
+    return FRAG_DEC_MORE;
+  return solve(d) ? FRAG_DEC_DONE : FRAG_DEC_STORE;
+}
+
+uint16_t frag_dec_missing(const frag_dec_t *d) {
+  return d->frozen ? d->lost - d->rank : d->nbFrag - d->received;
+}
@@ -0,0 +1,409 @@
+/* fuota receives firmware images via the LoRaWAN Fragmented Data Block
+Transport (TS004). Fragments are stored in a fragment store (PSRAM if
+available, else a file on SD card), lost fragments are recovered from the
+coded fragments by the FEC decoder in fragdec.cpp. The reassembled gz image
+is handed to the gz flasher in updates.cpp. */
+
+#if (HAS_LORA) && (USE_FUOTA)
+
+#include "fuota.h"
+#include "fragdec.h"
+#include "updates.h"
+
+// Local logging tag
+static const char TAG[] = "fuota";
+
+#define FUOTA_STORE_FILE UPDATE_FOLDER "/fuota.bin"
+#define FUOTA_FINAL_FILE UPDATE_FOLDER "/final.gz"
+#define FUOTA_QUEUE_SIZE 8
+
+TaskHandle_t fuotaTask = NULL;
+static QueueHandle_t FuotaQueue;
+
+typedef struct {
+  uint16_t len;
+  uint8_t data[FUOTA_MAX_FRAGSIZE + 3]; // cmd + IndexAndN + fragment
+} FuotaMsg_t;
+
+// state of the (single) fragmentation session
+static struct {
+  bool active;
+  bool complete;
+  uint8_t index;
+  uint8_t padding;
+  uint16_t received;   // uncoded fragments received, kept after completion
+  uint32_t descriptor; // CRC32 of the image, 0 = not checked
+  uint8_t *storeRam;   // fragment store in PSRAM
+  frag_dec_t dec;
+} fs;
+
+static FileMySD storeFile; // fragment store on SD card, if no PSRAM
+
+static uint8_t tmpBuf[FUOTA_MAX_FRAGSIZE];
+
+// ---------------- fragment store ----------------
+
+static bool store_open(uint32_t size) {
+#ifdef BOARD_HAS_PSRAM
+  fs.storeRam = (uint8_t *)ps_calloc(size, 1);
+  if (fs.storeRam)
+    return true;
+#endif
+  if (!isSDCardAvailable())
+    return false;
+  // card is borrowed from the sd service per store operation or chunk only
+  if (!sd_borrow())
+    return false;
+  bool ok = (folderExists(UPDATE_FOLDER) || createFolder(UPDATE_FOLDER)) &&
+            createFile(FUOTA_STORE_FILE, storeFile);
+  sd_return();
+  // preallocate, fragments arrive in any order
+  memset(tmpBuf, 0, sizeof(tmpBuf));
+  for (uint32_t pos = 0; ok && (pos < size); pos += sizeof(tmpBuf)) {
+    size_t n = (size - pos) < sizeof(tmpBuf) ? (size - pos) : sizeof(tmpBuf);
+    if (!sd_borrow()) {
+      ok = false;
+      break;
+    }
+    if (storeFile.write(tmpBuf, n) != n) {
+      storeFile.close();
+      ok = false;
+    }
+    sd_return();
+  }
+  if (ok && sd_borrow()) {
+    storeFile.flush();
+    sd_return();
+  }
+  return ok;
+}
+
+static void store_close(bool remove) {
+  if (fs.storeRam) {
+    free(fs.storeRam);
+    fs.storeRam = NULL;
+  }
+  if (storeFile && sd_borrow()) {
+    storeFile.close();
+    if (remove)
+      deleteFile(FUOTA_STORE_FILE);
+    sd_return();
+  }
+}
+
+static bool store_read(uint32_t offset, uint8_t *buf, size_t len) {
+  if (fs.storeRam) {
+    memcpy(buf, fs.storeRam + offset, len);
+    return true;
+  }
+  if (!sd_borrow())
+    return false;
+  bool ok = storeFile.seek(offset) && (storeFile.read(buf, len) == len);
+  sd_return();
+  return ok;
+}
+
+static bool store_write(uint32_t offset, const uint8_t *buf, size_t len) {
+  if (fs.storeRam) {
+    memcpy(fs.storeRam + offset, buf, len);
+    return true;
+  }
+  if (!sd_borrow())
+    return false;
+  bool ok = storeFile.seek(offset) && (storeFile.write(buf, len) == len);
+  sd_return();
+  return ok;
+}
+
+// ---------------- session handling ----------------
+
+static void fuota_flash(void *pvParameters) {
+  if (!batt_sufficient()) {
+    ESP_LOGE(TAG, "Battery voltage %dmV too low for update", batt_voltage);
+  } else {
+    ESP_LOGI(TAG, "Flashing firmware received via FUOTA");
+    // restarts device on success. The gz streamer reads the image in one go,
+    // so the card stays lent until then, csv lines are parked meanwhile
+    if (!sd_borrow())
+      ESP_LOGE(TAG, "SD card busy, FUOTA image not flashed");
+    else {
+      if (!updateFromFS())
+        ESP_LOGE(TAG, "Flashing FUOTA image failed");
+      sd_return();
+    }
+  }
+  vTaskDelete(NULL);
+}
+
+static void frag_finish(void) {
+  uint32_t size = fs.dec.nbFrag * fs.dec.fragSize - fs.padding;
+  uint32_t coded = fs.dec.codedRx;
+  uint32_t t = millis();
+
+  fs.complete = true;
+  fs.received = fs.dec.received;
+  frag_dec_free(&fs.dec);
+
+  // verify image and copy it to the file the gz flasher expects, the card
+  // is borrowed per chunk, other requests are served in between
+  FileMySD out;
+  bool ok = sd_borrow();
+  if (ok) {
+    ok = createFile(FUOTA_FINAL_FILE, out);
+    sd_return();
+  }
+  if (!ok) {
+    ESP_LOGE(TAG, "Failed to create %s", FUOTA_FINAL_FILE);
+    store_close(true);
+    return;
+  }
+  CRC32 crc;
+  crc.reset();
+  for (uint32_t pos = 0; ok && (pos < size); pos += sizeof(tmpBuf)) {
+    size_t n = (size - pos) < sizeof(tmpBuf) ? (size - pos) : sizeof(tmpBuf);
+    ok = store_read(pos, tmpBuf, n) && sd_borrow();
+    if (ok) {
+      ok = out.write(tmpBuf, n) == n;
+      sd_return();
+    }
+    crc.update(tmpBuf, n);
+  }
+  if (sd_borrow()) {
+    out.close();
+    sd_return();
+  }
+  store_close(true);
+  if (!ok) {
+    ESP_LOGE(TAG, "Failed to write %s", FUOTA_FINAL_FILE);
+    return;
+  }
+
+  uint32_t checksum = crc.finalize();
+  if (fs.descriptor && (checksum != fs.descriptor)) {
+    ESP_LOGE(TAG, "FUOTA image CRC mismatch, got %08X, expected %08X",
+             checksum, fs.descriptor);
+    if (sd_borrow()) {
+      deleteFile(FUOTA_FINAL_FILE);
+      sd_return();
+    }
+    return;
+  }
+  ESP_LOGI(TAG, "FUOTA image complete, %u bytes, %u coded fragments used, "
+                "verified in %u ms",
+           size, coded, millis() - t);
+
+  xTaskCreatePinnedToCore(fuota_flash, "fuotaflash", 16384, NULL, 1, NULL, 1);
+}
+
+static void frag_delete(void) {
+  frag_dec_free(&fs.dec);
+  store_close(true);
+  memset(&fs, 0, sizeof(fs));
+}
+
+static uint8_t frag_setup(const uint8_t *p) {
+  uint8_t index = (p[0] >> 4) & 0x03;
+  uint16_t nbFrag = p[1] | (p[2] << 8);
+  uint8_t fragSize = p[3];
+  uint8_t matrix = (p[4] >> 3) & 0x07;
+  uint8_t status = index << 6;
+
+  if (matrix != 0)
+    status |= FRAG_SETUP_ENCODING_UNSUPPORTED;
+  if (index != 0)
+    status |= FRAG_SETUP_INDEX_UNSUPPORTED;
+  if (!nbFrag || (nbFrag > FUOTA_MAX_NB_FRAG) || !fragSize ||
+      (fragSize > FUOTA_MAX_FRAGSIZE))
+    status |= FRAG_SETUP_NOT_ENOUGH_MEMORY;
+  if (status & 0x0F)
+    return status;
+
+  frag_delete();
+  fs.index = index;
+  fs.padding = p[5];
+  fs.descriptor = p[6] | (p[7] << 8) | (p[8] << 16) | ((uint32_t)p[9] << 24);
+
+  if (!frag_dec_init(&fs.dec, nbFrag, fragSize, FUOTA_MAX_REDUNDANCY,
+                     store_read, store_write) ||
+      !store_open((uint32_t)nbFrag * fragSize)) {
+    ESP_LOGE(TAG, "No space for %u x %u bytes fragment store", nbFrag,
+             fragSize);
+    frag_delete();
+    return status | FRAG_SETUP_NOT_ENOUGH_MEMORY;
+  }
+
+  fs.active = true;
+  ESP_LOGI(TAG, "Fragmentation session %u: %u fragments of %u bytes, %s store",
+           index, nbFrag, fragSize, fs.storeRam ? "PSRAM" : "SD");
+  return status;
+}
+
+static void frag_data(uint16_t n, const uint8_t *data) {
+  if (!fs.active || fs.complete || !n)
+    return;
+
+  bool frozen = fs.dec.frozen;
+  switch (frag_dec_add(&fs.dec, n, data)) {
+  case FRAG_DEC_MORE:
+    if (!frozen && fs.dec.frozen)
+      ESP_LOGI(TAG, "FEC decoding started, %u of %u fragments lost, %u bytes",
+               fs.dec.lost, fs.dec.nbFrag, fs.dec.bytes);
+    break;
+  case FRAG_DEC_DONE:
+    if (fs.dec.frozen)
+      ESP_LOGI(TAG,
+               "All lost fragments recovered, %u coded fragments received",
+               fs.dec.codedRx);
+    frag_finish();
+    break;
+  case FRAG_DEC_NOMEM:
+    ESP_LOGW(TAG, "%u fragments lost, FEC can recover max. %u",
+             fs.dec.nbFrag - fs.dec.received, FUOTA_MAX_REDUNDANCY);
+    break;
+  case FRAG_DEC_STORE:
+  default:
+    // the matrix no longer matches the store, the session cannot complete
+    ESP_LOGE(TAG, "Fragment store access failed, session %u aborted",
+             fs.index);
+    frag_delete();
+    break;
+  }
+}
+
+static uint16_t frag_missing(void) {
+  if (!fs.active || fs.complete)
+    return 0;
+  return frag_dec_missing(&fs.dec);
+}
+
+// process one downlink on FRAGPORT, answers are collected in ans
+static void fuota_process(const uint8_t *p, size_t len, MessageBuffer_t *ans) {
+  size_t i = 0;
+  uint8_t *a = ans->Message;
+
+#define ANS_SPACE(n) (ans->MessageSize + (n) <= PAYLOAD_BUFFER_SIZE)
+
+  while (i < len) {
+    switch (p[i]) {
+
+    case FRAG_PACKAGE_VERSION_REQ:
+      i += 1;
+      if (ANS_SPACE(3)) {
+        a[ans->MessageSize++] = FRAG_PACKAGE_VERSION_REQ;
+        a[ans->MessageSize++] = FRAG_PACKAGE_ID;
+        a[ans->MessageSize++] = FRAG_PACKAGE_VERSION;
+      }
+      break;
+
+    case FRAG_SESSION_STATUS_REQ: {
+      if (i + 2 > len)
+        return;
+      bool participants = p[i + 1] & 0x01;
+      uint8_t index = (p[i + 1] >> 1) & 0x03;
+      i += 2;
+      uint16_t missing = frag_missing();
+      // devices without missing fragments only answer if asked to
+      if ((index != fs.index) || !fs.active || (!participants && !missing))
+        break;
+      if (ANS_SPACE(5)) {
+        uint16_t rx =
+            (fs.complete ? fs.received : fs.dec.received) & 0x3FFF;
+        a[ans->MessageSize++] = FRAG_SESSION_STATUS_REQ;
+        a[ans->MessageSize++] = rx & 0xFF;
+        a[ans->MessageSize++] = (rx >> 8) | (index << 6);
+        a[ans->MessageSize++] = missing > 255 ? 255 : missing;
+        a[ans->MessageSize++] = fs.dec.memError ? 0x01 : 0x00;
+      }
+      break;
+    }
+
+    case FRAG_SESSION_SETUP_REQ: {
+      if (i + 11 > len)
+        return;
+      uint8_t status = frag_setup(p + i + 1);
+      i += 11;
+      if (ANS_SPACE(2)) {
+        a[ans->MessageSize++] = FRAG_SESSION_SETUP_REQ;
+        a[ans->MessageSize++] = status;
+      }
+      break;
+    }
+
+    case FRAG_SESSION_DELETE_REQ: {
+      if (i + 2 > len)
+        return;
+      uint8_t index = p[i + 1] & 0x03;
+      uint8_t status = index;
+      i += 2;
+      if (fs.active && (index == fs.index)) {
+        ESP_LOGI(TAG, "Fragmentation session %u deleted", index);
+        frag_delete();
+      } else
+        status |= 0x04; // session does not exist
+      if (ANS_SPACE(2)) {
+        a[ans->MessageSize++] = FRAG_SESSION_DELETE_REQ;
+        a[ans->MessageSize++] = status;
+      }
+      break;
+    }
+
+    case FRAG_DATA_FRAGMENT: {
+      // fragment uses rest of the downlink
+      if (i + 3 > len)
+        return;
+      uint16_t indexAndN = p[i + 1] | (p[i + 2] << 8);
+      if (((indexAndN >> 14) == fs.index) &&
+          (len - i - 3 >= fs.dec.fragSize))
+        frag_data(indexAndN & 0x3FFF, p + i + 3);
+      return;
+    }
+
+    default:
+      ESP_LOGD(TAG, "Unknown fragmentation command 0x%02X", p[i]);
+      return;
+    }
+  }
+#undef ANS_SPACE
+}
+
+// called from LMIC rx callback, keep it short
+void fuota_rx(const uint8_t *buf, size_t len) {
+  FuotaMsg_t msg;
+  if (!FuotaQueue || !len || len > sizeof(msg.data))
+    return;
+  msg.len = len;
+  memcpy(msg.data, buf, len);
+  if (xQueueSendToBack(FuotaQueue, &msg, 0) != pdTRUE)
+    ESP_LOGW(TAG, "FUOTA queue full, fragment dropped");
+}
+
+void fuota_task(void *pvParameters) {
+  configASSERT(((uint32_t)pvParameters) == 1);
+
+  FuotaMsg_t msg;
+  MessageBuffer_t ans;
+
+  while (1) {
+    if (xQueueReceive(FuotaQueue, &msg, portMAX_DELAY) != pdTRUE)
+      continue;
+    memset(&ans, 0, sizeof(ans));
+    ans.MessagePort = FRAGPORT;
+    ans.MessagePrio = prio_normal;
+    fuota_process(msg.data, msg.len, &ans);
+    if (ans.MessageSize)
+      lora_enqueuedata(&ans);
+  }
+}
+
+esp_err_t fuota_init(void) {
+  memset(&fs, 0, sizeof(fs));
+  FuotaQueue = xQueueCreate(FUOTA_QUEUE_SIZE, sizeof(FuotaMsg_t));
+  if (FuotaQueue == 0) {
+    ESP_LOGE(TAG, "Could not create FUOTA queue. Aborting.");
+    return ESP_FAIL;
+  }
+  mem_task_create(MEM_TASK_FUOTA, fuota_task, (void *)1, 1, &fuotaTask, 1);
+  return ESP_OK;
+}
+
+#endif // HAS_LORA && USE_FUOTA
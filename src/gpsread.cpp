@@ -9,11 +9,21 @@ static const char TAG[] = __FILE__;
 // $GPZDA gives time for preceding pps pulse, but does not has a constant offset
 TinyGPSPlus gps;
 TinyGPSCustom gpstime(gps, "GPZDA", 1); // field 1 = UTC time
-static const String ZDA_Request = "$EIGPQ,ZDA*39\r\n";
 
-gpsStatus_t gps_status = {0};
+gpsStatus_t gps_status = {};
 TaskHandle_t GpsTask;
 
+static volatile bool gpsFast = false; // fetch_gpsTime() waits for an answer
+static volatile bool gpsOn = true;    // receiver running
+static uint32_t gpsOnSince = 0, gpsOffSince = 0, gpsFixAt = 0; // [ms]
+
+static struct {
+  uint32_t wakeups, bytes;
+  uint32_t parsed, skipped; // sentences
+  uint32_t on_ms;           // receiver running, closed intervals
+  uint32_t since;           // [ms] start of interval
+} gpsStats;
+
 #ifdef GPS_SERIAL
 HardwareSerial GPS_Serial(1); // use UART #1
 static uint16_t nmea_txDelay_ms =
@@ -22,17 +32,29 @@ static uint16_t nmea_txDelay_ms =
 static uint16_t nmea_txDelay_ms = 0;
 #endif
 
+// sends body as NMEA sentence, "$" and checksum are added
+static void gps_send_nmea(const char *body) {
+  char buf[NMEA_FRAME_SIZE + 1];
+  uint8_t cs = 0;
+  for (const char *p = body; *p; p++)
+    cs ^= *p;
+  int n = snprintf(buf, sizeof(buf), "$%s*%02X\r\n", body, cs);
+#ifdef GPS_SERIAL
+  GPS_Serial.write((const uint8_t *)buf, n);
+#elif defined GPS_I2C
+  Wire.beginTransmission(GPS_ADDR);
+  Wire.write((const uint8_t *)buf, n);
+  Wire.endTransmission();
+#endif
+}
+
 // initialize and configure GPS
 int gps_init(void) {
 
   int ret = 1;
 
-  if (!gps_config()) {
-    ESP_LOGE(TAG, "GPS chip initializiation error");
-    return 0;
-  }
-
 #ifdef GPS_SERIAL
+  GPS_Serial.setRxBufferSize(GPS_RX_BUFFER); // before begin()
   GPS_Serial.begin(GPS_SERIAL);
   ESP_LOGI(TAG, "Using serial GPS");
 #elif defined GPS_I2C
@@ -52,6 +74,13 @@ int gps_init(void) {
   }
 #endif
 
+  // configure after the bus is up, otherwise the commands get lost
+  if (ret && !gps_config()) {
+    ESP_LOGE(TAG, "GPS chip initializiation error");
+    return 0;
+  }
+
+  gpsOnSince = gpsStats.since = millis();
   return ret;
 } // gps_init()
 
@@ -60,6 +89,15 @@ int gps_config() {
   int rslt = 1; // success
 #if defined GPS_SERIAL
 
+  // u-blox: only RMC, GGA (and ZDA on request) are used, the other default
+  // sentences are switched off on all ports to cut uart traffic
+  static const char *const unused[] = {"GLL", "GSA", "GSV", "VTG"};
+  char body[32];
+  for (const char *msg : unused) {
+    snprintf(body, sizeof(body), "PUBX,40,%s,0,0,0,0,0,0", msg);
+    gps_send_nmea(body);
+  }
+
   /* insert user configuration here, if needed */
 
 #elif defined GPS_I2C
@@ -96,14 +134,22 @@ time_t fetch_gpsTime(uint16_t *msec) {
 
   time_t time_sec = 0;
 
+  // receiver is resting, it has no current time
+  if (!gpsOn)
+    return 0;
+
+  // gps task polls every 2 ms until the answer is in, so its age stays exact
+  gpsFast = true;
+  if (GpsTask)
+    xTaskNotifyGive(GpsTask);
+
   // poll NMEA $GPZDA sentence
+  gps_send_nmea("EIGPQ,ZDA");
 #ifdef GPS_SERIAL
-  GPS_Serial.print(ZDA_Request);
   // wait for gps NMEA answer
   vTaskDelay(tx_Ticks(NMEA_FRAME_SIZE, GPS_SERIAL));
-#elif defined GPS_I2C
-  Wire.print(ZDA_Request);
 #endif
+  gpsFast = false;
 
   // did we get a current time?
   if (gpstime.isUpdated() && gpstime.isValid()) {
@@ -140,37 +186,167 @@ time_t fetch_gpsTime(void) {
   return fetch_gpsTime(&msec);
 }
 
-// GPS serial feed FreeRTos Task
-void gps_loop(void *pvParameters) {
+#ifdef GPS_SERIAL
+// u-blox UBX-CFG-RST, resetMode 0x08 stops and 0x09 starts GNSS, ephemeris is
+// kept in battery backed ram, so the restart is a hot start
+static void gps_ubx_rst(uint8_t mode) {
+  uint8_t m[] = {0xB5, 0x62, 0x06, 0x04, 4, 0, 0x00, 0x00, mode, 0x00, 0, 0};
+  for (size_t i = 2; i < sizeof(m) - 2; i++) {
+    m[sizeof(m) - 2] += m[i];
+    m[sizeof(m) - 1] += m[sizeof(m) - 2];
+  }
+  GPS_Serial.write(m, sizeof(m));
+}
+#endif
+
+static void gps_power(bool on) {
+  if (on == gpsOn)
+    return;
+  uint32_t now = millis();
+#ifdef GPS_SERIAL
+  gps_ubx_rst(on ? 0x09 : 0x08);
+#elif defined GPS_I2C
+  gps_send_nmea(on ? "PMTK101" : "PMTK161,0"); // hot restart, standby
+#endif
+  if (on) {
+    gpsOnSince = now;
+    gpsFixAt = 0;
+  } else {
+    gpsOffSince = now;
+    gpsStats.on_ms +=
+        now - (gpsOnSince > gpsStats.since ? gpsOnSince : gpsStats.since);
+  }
+  gpsOn = on;
+  ESP_LOGI(TAG, "GPS receiver %s", on ? "started" : "resting");
+}
 
-  configASSERT(((uint32_t)pvParameters) == 1); // FreeRTOS check
+// without GPS_DATA in the payload the receiver is needed for time sync only,
+// so it runs until it has a fix, syncs time and then rests for GPS_REST_S
+static void gps_duty(void) {
+  uint32_t now = millis();
 
-  while (1) {
+  if (cfg.payloadmask & GPS_DATA) {
+    gps_power(true);
+    return;
+  }
+
+  if (!gpsOn) {
+    if (now - gpsOffSince >= GPS_REST_S * 1000UL)
+      gps_power(true);
+    return;
+  }
+
+  if (gps_hasfix() && gps.time.isValid()) {
+    if (!gpsFixAt) {
+      gpsFixAt = now;
+#if (TIME_SYNC_INTERVAL)
+      timeSync(); // take the time while the receiver has it
+#endif
+    }
+    if (now - gpsFixAt >= GPS_SYNC_GRACE_S * 1000UL)
+      gps_power(false);
+  } else if (now - gpsOnSince >= GPS_FIX_TIMEOUT_S * 1000UL) {
+    gps_power(false);
+  }
+}
+
+// assembles sentences of a bulk read, only RMC, GGA and ZDA go to the decoder
+static void gps_feed(const uint8_t *buf, int n) {
+  static char line[NMEA_FRAME_SIZE + 3]; // incl. cr lf
+  static uint8_t len = 0;
+
+  gpsStats.bytes += n;
+  for (int i = 0; i < n; i++) {
+    char c = buf[i];
+    if (c == '$')
+      len = 0;
+    if (len < sizeof(line))
+      line[len++] = c;
+    if (c != '\n')
+      continue;
+
+    // $ttSSS..., talker tt, sentence SSS
+    if ((len > 7) && (line[0] == '$') && (line[len - 1] == '\n') &&
+        (!strncmp(line + 3, "RMC", 3) || !strncmp(line + 3, "GGA", 3) ||
+         !strncmp(line + 3, "ZDA", 3))) {
+      for (uint8_t j = 0; j < len; j++)
+        gps.encode(line[j]);
+      gpsStats.parsed++;
+    } else if (len > 1) {
+      gpsStats.skipped++;
+    }
+    len = 0;
+  }
+}
 
-    if (cfg.payloadmask & GPS_DATA) {
+// drains what the receiver sent since the last call
+static void gps_read(void) {
+  uint8_t buf[128];
 #ifdef GPS_SERIAL
-      // feed GPS decoder with serial NMEA data from GPS device
-      while (GPS_Serial.available()) {
-        gps.encode(GPS_Serial.read());
-      }
+  int n;
+  while ((n = GPS_Serial.available()) > 0) {
+    if (n > (int)sizeof(buf))
+      n = sizeof(buf);
+    gps_feed(buf, GPS_Serial.readBytes(buf, n));
+  }
 #elif defined GPS_I2C
-      Wire.requestFrom(GPS_ADDR, 32); // caution: this is a blocking call
-      while (Wire.available()) {
-        gps.encode(Wire.read());
-        delay(2); // 2ms delay according L76 datasheet
-      }
+  // L76 pads with '\n' once its buffer is empty, 2 ms between two reads
+  // according to the datasheet
+  for (int i = 0; i < GPS_RX_BUFFER / sizeof(buf); i++) {
+    Wire.requestFrom(GPS_ADDR, (int)sizeof(buf)); // caution: blocking call
+    int n = 0;
+    bool data = false;
+    while (Wire.available() && (n < sizeof(buf))) {
+      buf[n] = Wire.read();
+      data |= (buf[n++] != '\n');
+    }
+    gps_feed(buf, n);
+    if (!data)
+      break;
+    delay(2);
+  }
 #endif
-    } // if
+}
+
+// GPS serial feed FreeRTos Task
+void gps_loop(void *pvParameters) {
+
+  configASSERT(((uintptr_t)pvParameters) == 1); // FreeRTOS check
+
+  while (1) {
+
+    // bulk read every GPS_POLL_MS, fetch_gpsTime() wakes us early
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(gpsFast ? 2 : GPS_POLL_MS));
+    gpsStats.wakeups++;
+
+    // feed GPS decoder with NMEA data from GPS device
+    gps_read();
+    gps_duty();
 
     // show NMEA data in verbose mode, useful for debugging GPS, bu tvery noisy
     // ESP_LOGV(TAG, "GPS NMEA data: passed %u / failed: %u / with fix: %u",
     //         gps.passedChecksum(), gps.failedChecksum(),
     //         gps.sentencesWithFix());
 
-    delay(2); // yield to CPU
-
   } // end of infinite loop
 
 } // gps_loop()
 
-#endif // HAS_GPS
\ No newline at end of file
+void gps_print_stats(void) {
+  uint32_t now = millis(), ms = now - gpsStats.since;
+  if (!ms)
+    return;
+  uint32_t on = gpsStats.on_ms;
+  if (gpsOn)
+    on += now - (gpsOnSince > gpsStats.since ? gpsOnSince : gpsStats.since);
+  ESP_LOGD(TAG,
+           "GPS %u.%u wakeups/s, %u bytes, %u sentences parsed, %u skipped, "
+           "receiver on %u%%",
+           gpsStats.wakeups * 1000 / ms, gpsStats.wakeups * 10000 / ms % 10,
+           gpsStats.bytes, gpsStats.parsed, gpsStats.skipped,
+           (uint32_t)((uint64_t)on * 100 / ms));
+  memset(&gpsStats, 0, sizeof(gpsStats));
+  gpsStats.since = now;
+}
+
+#endif // HAS_GPS
@@ -0,0 +1,179 @@
+/* httpstream parses an HTTP/1.1 response while it arrives from the modem.
+Status and header lines are collected in a small line buffer, everything else
+is passed through: body bytes of a Content-Length, chunked or close delimited
+response go straight to the caller sink. Segments may split a response at any
+byte, each byte is looked at once. The parser keeps no platform dependencies,
+so it can be built on a host for profiling. */
+
+#include "httpstream.h"
+
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+
+void http_stream_init(http_stream_t *hs, http_sink_t sink, void *ctx) {
+  memset(hs, 0, sizeof(*hs));
+  hs->state = http_status;
+  hs->contentLength = -1;
+  hs->sink = sink;
+  hs->ctx = ctx;
+}
+
+static const char *skip_space(const char *p) {
+  while (*p == ' ' || *p == '\t')
+    p++;
+  return p;
+}
+
+// "HTTP/1.1 200 OK"
+static bool parse_status(http_stream_t *hs) {
+  if (strncmp(hs->line, "HTTP/", 5) != 0)
+    return false;
+  const char *p = strchr(hs->line, ' ');
+  if (p == NULL)
+    return false;
+  char *end;
+  long code = strtol(p + 1, &end, 10);
+  if ((end == p + 1) || (code < 100) || (code > 999))
+    return false;
+  hs->status = code;
+  return true;
+}
+
+static void parse_header(http_stream_t *hs) {
+  if (strncasecmp(hs->line, "content-length:", 15) == 0)
+    hs->contentLength = strtol(skip_space(hs->line + 15), NULL, 10);
+  else if (strncasecmp(hs->line, "transfer-encoding:", 18) == 0)
+    hs->chunked =
+        strncasecmp(skip_space(hs->line + 18), "chunked", 7) == 0;
+}
+
+// empty line after headers, decides how the body is delimited
+static void end_of_headers(http_stream_t *hs) {
+  if (hs->chunked)
+    hs->state = http_chunk_size;
+  else if (hs->contentLength == 0)
+    hs->state = http_done;
+  else {
+    hs->state = http_body;
+    hs->remaining = hs->contentLength; // -1: read until connection closes
+  }
+}
+
+// a complete line was collected, returns false on syntax error
+static bool parse_line(http_stream_t *hs) {
+  char *end;
+
+  switch (hs->state) {
+
+  case http_status:
+    if (!parse_status(hs))
+      return false;
+    hs->state = http_header;
+    break;
+
+  case http_header:
+    if (hs->linelen == 0)
+      end_of_headers(hs);
+    else
+      parse_header(hs);
+    break;
+
+  case http_chunk_size:
+    hs->remaining = strtoul(hs->line, &end, 16);
+    if (end == hs->line)
+      return false;
+    hs->state = hs->remaining ? http_chunk_data : http_trailer;
+    break;
+
+  case http_chunk_end:
+    if (hs->linelen != 0)
+      return false;
+    hs->state = http_chunk_size;
+    break;
+
+  case http_trailer:
+    if (hs->linelen == 0)
+      hs->state = http_done;
+    break;
+
+  default:
+    break;
+  }
+  return true;
+}
+
+static int sink_body(http_stream_t *hs, const uint8_t *data, size_t len) {
+  if (hs->sink && (hs->sink(data, len, hs->ctx) < 0)) {
+    hs->state = http_error;
+    return HTTP_STREAM_SINK;
+  }
+  hs->bodyBytes += len;
+  return HTTP_STREAM_MORE;
+}
+
+// feeds a received segment, returns HTTP_STREAM_MORE, _DONE or an error
+int http_stream_feed(http_stream_t *hs, const uint8_t *data, size_t len) {
+  size_t i = 0;
+
+  while (i < len) {
+
+    switch (hs->state) {
+
+    case http_done:
+      return HTTP_STREAM_DONE; // trailing bytes are ignored
+
+    case http_error:
+      return HTTP_STREAM_SYNTAX;
+
+    case http_body:
+    case http_chunk_data: {
+      size_t n = len - i;
+      bool delimited = (hs->state == http_chunk_data) || (hs->contentLength >= 0);
+      if (delimited && (n > hs->remaining))
+        n = hs->remaining;
+      int res = sink_body(hs, data + i, n);
+      if (res < 0)
+        return res;
+      i += n;
+      if (delimited && ((hs->remaining -= n) == 0))
+        hs->state = (hs->state == http_chunk_data) ? http_chunk_end : http_done;
+      break;
+    }
+
+    default: {
+      // line oriented states
+      char c = data[i++];
+      if (c == '\r')
+        break;
+      if (c != '\n') {
+        if (hs->linelen < HTTP_LINE_MAX - 1)
+          hs->line[hs->linelen++] = c;
+        break;
+      }
+      hs->line[hs->linelen] = 0;
+      bool ok = parse_line(hs);
+      hs->linelen = 0;
+      if (!ok) {
+        hs->state = http_error;
+        return HTTP_STREAM_SYNTAX;
+      }
+      break;
+    }
+    }
+  }
+
+  return (hs->state == http_done) ? HTTP_STREAM_DONE : HTTP_STREAM_MORE;
+}
+
+// connection was closed by peer, ends a close delimited body
+int http_stream_close(http_stream_t *hs) {
+  if ((hs->state == http_body) && (hs->contentLength < 0))
+    hs->state = http_done;
+  if (hs->state == http_done)
+    return HTTP_STREAM_DONE;
+  if (hs->state == http_error)
+    return HTTP_STREAM_SYNTAX;
+  hs->state = http_error;
+  return HTTP_STREAM_SHORT;
+}
@@ -0,0 +1,129 @@
+/* ioarena leases fixed size i/o blocks to the modem, http and update paths.
+The arena is one entry of the memory budget, split into blocks of three
+size classes. A lease takes the smallest free block which fits and must be
+given back with io_release() by the task which took it. With VERBOSE set,
+ownership is checked on release and released blocks are poisoned, so
+stale pointers show up early. */
+
+// Basic Config
+#include "ioarena.h"
+
+// Local logging tag
+static const char TAG[] = "ioarena";
+
+#define IO_POISON 0xDD // fill pattern of released blocks, debug builds
+
+typedef struct {
+  uint8_t *buf;
+  uint16_t size;
+  bool leased;
+  const char *owner;
+  TaskHandle_t task;
+} io_block_t;
+
+static io_block_t blocks[IO_ARENA_BLOCKS];
+static io_arena_stats_t stats = {};
+static portMUX_TYPE arenaMux = portMUX_INITIALIZER_UNLOCKED;
+
+// split budget entry into blocks, ordered by size class
+esp_err_t io_arena_init(void) {
+  static const uint16_t classes[][2] = {
+      {IO_ARENA_SMALL, IO_ARENA_SMALL_BLOCKS},
+      {IO_ARENA_MEDIUM, IO_ARENA_MEDIUM_BLOCKS},
+      {IO_ARENA_LARGE, IO_ARENA_LARGE_BLOCKS}};
+
+  if (blocks[0].buf != NULL)
+    return ESP_OK;
+
+  uint8_t *p = (uint8_t *)mem_buffer_get(MEM_BUF_IOARENA);
+  if (p == NULL)
+    return ESP_FAIL;
+
+  int n = 0;
+  for (int c = 0; c < 3; c++)
+    for (int i = 0; i < classes[c][1]; i++, n++) {
+      blocks[n].buf = p;
+      blocks[n].size = classes[c][0];
+      p += classes[c][0];
+    }
+  ESP_LOGI(TAG, "I/O arena %u bytes in %u blocks", IO_ARENA_BYTES,
+           IO_ARENA_BLOCKS);
+  return ESP_OK;
+}
+
+static int io_find(const void *buf) {
+  for (int i = 0; i < IO_ARENA_BLOCKS; i++)
+    if (blocks[i].buf == buf)
+      return i;
+  return -1;
+}
+
+// lease a block of at least size bytes, returns NULL if none is free
+void *io_lease(size_t size, const char *owner) {
+  void *buf = NULL;
+  portENTER_CRITICAL(&arenaMux);
+  for (int i = 0; i < IO_ARENA_BLOCKS; i++) {
+    if (blocks[i].leased || (blocks[i].size < size))
+      continue;
+    blocks[i].leased = true;
+    blocks[i].owner = owner;
+    blocks[i].task = xTaskGetCurrentTaskHandle();
+    buf = blocks[i].buf;
+    stats.leases++;
+    if (++stats.inuse > stats.peak)
+      stats.peak = stats.inuse;
+    break;
+  }
+  if (buf == NULL)
+    stats.failures++;
+  portEXIT_CRITICAL(&arenaMux);
+
+  if (buf == NULL)
+    ESP_LOGE(TAG, "No block of %u bytes free for %s", (unsigned)size, owner);
+  return buf;
+}
+
+void io_release(void *buf) {
+  if (buf == NULL)
+    return;
+
+  int i = io_find(buf);
+  if ((i < 0) || !blocks[i].leased) {
+    ESP_LOGE(TAG, "Release of %p which is not leased", buf);
+    assert(0);
+    return;
+  }
+
+#if (VERBOSE)
+  if (blocks[i].task != xTaskGetCurrentTaskHandle()) {
+    ESP_LOGE(TAG, "Block of %s released by foreign task %s", blocks[i].owner,
+             pcTaskGetTaskName(NULL));
+    assert(0);
+  }
+  memset(blocks[i].buf, IO_POISON, blocks[i].size);
+#endif
+
+  portENTER_CRITICAL(&arenaMux);
+  blocks[i].leased = false;
+  blocks[i].owner = NULL;
+  blocks[i].task = NULL;
+  stats.inuse--;
+  portEXIT_CRITICAL(&arenaMux);
+}
+
+size_t io_lease_size(const void *buf) {
+  int i = io_find(buf);
+  return (i < 0) ? 0 : blocks[i].size;
+}
+
+const io_arena_stats_t *io_arena_stats(void) { return &stats; }
+
+void io_arena_print(void) {
+  ESP_LOGD(TAG, "I/O arena %u leases, %u refused, %u/%u blocks in use, peak %u",
+           stats.leases, stats.failures, stats.inuse, IO_ARENA_BLOCKS,
+           stats.peak);
+  for (int i = 0; i < IO_ARENA_BLOCKS; i++)
+    if (blocks[i].leased)
+      ESP_LOGD(TAG, "Block %d (%u bytes) leased by %s", i, blocks[i].size,
+               blocks[i].owner);
+}
@@ -89,6 +89,19 @@ void irqHandler(void *pvParameters) {
       checkQueue();
       InterruptStatus &= ~SENDCYCLE_IRQ;
     }
+
+    // health check telemetry
+    if (InterruptStatus & HEALTHCHECK_IRQ) {
+      sendHealthCheck();
+      InterruptStatus &= ~HEALTHCHECK_IRQ;
+    }
+
+#if (HAS_NBIOT)
+    if (InterruptStatus & NB_HEALTHCHECK_IRQ) {
+      sendNbHealthCheck();
+      InterruptStatus &= ~NB_HEALTHCHECK_IRQ;
+    }
+#endif
   } // for
 } // irqHandler()
 
@@ -0,0 +1,76 @@
+/* latprobe keeps the latency histograms of LAT_SCOPE() probes. Recording is
+inline in latprobe.h: a cycle count, one NSAU and three increments. This
+file names the probes and dumps the histograms, every LAT_DUMP_MS as lines
+to the serial log and the csv log of the SD card, and on remote command
+0x8F. src/LatProbe/latplot.py renders both. Line format:
+
+  LAT,epoch,probe,cpu MHz,count,max cycles,first,bucket first,...,last
+
+with the buckets from the first to the last one that counted. */
+
+// Basic Config
+#include "globals.h"
+#include "latprobe.h"
+
+#if (LATENCY_PROBES)
+
+#ifdef HAS_SDCARD
+#include "sdcard.h"
+#endif
+
+// Local logging tag
+static const char TAG[] = "latprobe";
+
+lat_hist_t latHist[LAT_PROBES];
+
+// order must match lat_id_t, names go into dumps and must not contain ','
+static const char *const latNames[LAT_PROBES] = {
+    "mac_add", "SendPayload", "sdqueueEnqueue", "sdqueueDequeue",
+    "publishMqtt", "readResponseBC"};
+
+const char *lat_name(lat_id_t id) { return latNames[id]; }
+
+// copy of one histogram, may be torn by a concurrent count
+void lat_get(lat_id_t id, lat_hist_t *out) {
+  memcpy(out, &latHist[id], sizeof(*out));
+}
+
+void lat_reset(void) { memset(latHist, 0, sizeof(latHist)); }
+
+int lat_line(lat_id_t id, char *buf, size_t len) {
+  lat_hist_t h;
+  lat_get(id, &h);
+  int first = 0, last = LAT_BUCKETS - 1;
+  while ((first < last) && !h.bucket[first])
+    first++;
+  while ((last > first) && !h.bucket[last])
+    last--;
+
+  int n = snprintf(buf, len, "LAT,%lu,%s,%u,%u,%u,%d", (unsigned long)now(),
+                   latNames[id], getCpuFrequencyMhz(), h.count, h.max, first);
+  for (int b = first; (b <= last) && (n > 0) && (n < (int)len); b++)
+    n += snprintf(buf + n, len - n, ",%u", h.bucket[b]);
+  return n;
+}
+
+void lat_print(void) {
+  char line[LAT_LINE_LEN];
+  for (int i = 0; i < LAT_PROBES; i++) {
+    if (!latHist[i].count)
+      continue;
+    lat_line((lat_id_t)i, line, sizeof(line));
+    ESP_LOGI(TAG, "%s", line);
+#ifdef HAS_SDCARD
+    sdcardWriteLine(line);
+#endif
+  }
+}
+
+esp_err_t lat_init(void) {
+  lat_reset();
+  if (sched_add("latdump", lat_print, LAT_DUMP_MS, 0, 1) < 0)
+    return ESP_FAIL;
+  return ESP_OK;
+}
+
+#endif // LATENCY_PROBES
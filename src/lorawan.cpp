@@ -34,12 +34,15 @@ RTC_NOINIT_ATTR int RTCseqnoUp, RTCseqnoDn;
 QueueHandle_t LoraSendQueue;
 TaskHandle_t lmicTask = NULL, lorasendTask = NULL;
 
+static bool loraDoJoin = true;
+static volatile bool loraRejoinRequest = false;
+
 // ===== SD persistent queue hooks & logging to paxcount.xx =====
 #ifdef HAS_SDCARD
 extern bool isSDCardAvailable(void);
 extern bool sdqueueEnqueue(MessageBuffer_t *msg);
 extern void sdqueueStartFlusher(void);
-extern void sdcardWriteLine(const char *line);
+#include "sdlog.h"
 #endif
 
 // ===== NB hooks =====
@@ -49,33 +52,208 @@ extern bool nb_enqueuedata(MessageBuffer_t *message);
 extern bool nb_isEnabled();
 #endif
 
-// ===== Small helper: hex to text for paxcount logging =====
-static void _hex_of_payload(const uint8_t *b, size_t n, char *out, size_t outcap) {
-    size_t p = 0;
-    for (size_t i = 0; i < n && (p + 2) < outcap; i++) {
-        p += snprintf(out + p, outcap - p, "%02X", b[i]);
+// ===== Log a TX event into the binary TX log paxbin.xx =====
+static void _sd_log_tx(uint8_t channel, const MessageBuffer_t *m, uint8_t reason) {
+#ifdef HAS_SDCARD
+    sdlog_write(channel, reason, m);
+#endif
+}
+
+// =============================================================
+// ADEMUX: sesion LMIC persistida en NVS (sobrevive power cycles)
+// =============================================================
+#define LORA_SESSION_NVS "lmic"
+#define LORA_SESSION_MAGIC 0x4C534531 // "LSE1"
+#define LORA_SESSION_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t devEui[8]; // session is only valid for the keys it was joined with
+    uint8_t artEui[8];
+    u4_t netid;
+    devaddr_t devaddr;
+    u1_t nwkKey[16];
+    u1_t artKey[16];
+    u4_t seqnoUpLimit; // write-ahead limit, uplink counter never goes below
+    u4_t seqnoDn;
+    uint8_t channelMap[sizeof(LMIC.channelMap)];
+#if CFG_LMIC_EU_like
+    uint8_t channelFreq[sizeof(LMIC.channelFreq)];
+    uint8_t channelDrMap[sizeof(LMIC.channelDrMap)];
+#endif
+    dr_t datarate;
+    s1_t adrTxPow;
+    u1_t rx1DrOffset;
+    dr_t dn2Dr;
+    u4_t dn2Freq;
+    u1_t rxDelay;
+} loraSession_t;
+
+static u4_t sessionSeqnoLimit = 0;    // seqnoUp limit currently stored in NVS
+static u4_t sessionSeqnoDn = 0;       // seqnoDn currently stored in NVS
+// a session restored from NVS after a power cycle is verified with confirmed
+// uplinks, the ack is the network's answer. LinkCheckReq would do without
+// the ack, but the LMIC version in use only sends it on its own after
+// ADR_ACK_LIMIT uplinks. Deep sleep wakeups use the RTC session unverified
+static bool sessionUnverified = false; // restored session not yet acked
+static uint8_t sessionValidateTries = 0;
+// NVS writes are done by lmictask after the event callback
+static volatile bool sessionSaveDue = false, sessionSaveForce = false;
+
+// store LMIC session to NVS. Without force, this happens only when the uplink
+// counter reached the write-ahead limit of the last write, so flash is
+// written once every LORA_SEQNO_MARGIN uplinks, or when a downlink moved the
+// downlink counter, which must never go back.
+void lora_session_save(bool force) {
+#if (LORA_SESSION_PERSIST)
+    if (!LMIC.devaddr) return;
+    if (!force && (LMIC.seqnoUp < sessionSeqnoLimit) &&
+        (LMIC.seqnoDn == sessionSeqnoDn))
+        return;
+
+    loraSession_t s;
+    memset(&s, 0, sizeof(s));
+    s.magic = LORA_SESSION_MAGIC;
+    s.version = LORA_SESSION_VERSION;
+    os_getDevEui(s.devEui);
+    os_getArtEui(s.artEui);
+    LMIC_getSessionKeys(&s.netid, &s.devaddr, s.nwkKey, s.artKey);
+    s.seqnoUpLimit = LMIC.seqnoUp + LORA_SEQNO_MARGIN;
+    s.seqnoDn = LMIC.seqnoDn;
+    memcpy(s.channelMap, &LMIC.channelMap, sizeof(s.channelMap));
+#if CFG_LMIC_EU_like
+    memcpy(s.channelFreq, LMIC.channelFreq, sizeof(s.channelFreq));
+    memcpy(s.channelDrMap, LMIC.channelDrMap, sizeof(s.channelDrMap));
+#endif
+    s.datarate = LMIC.datarate;
+    s.adrTxPow = LMIC.adrTxPow;
+    s.rx1DrOffset = LMIC.rx1DrOffset;
+    s.dn2Dr = LMIC.dn2Dr;
+    s.dn2Freq = LMIC.dn2Freq;
+    s.rxDelay = LMIC.rxDelay;
+
+    nvs_handle h;
+    esp_err_t e = nvs_open(LORA_SESSION_NVS, NVS_READWRITE, &h);
+    if (e == ESP_OK) {
+        e = nvs_set_blob(h, "session", &s, sizeof(s));
+        if (e == ESP_OK) e = nvs_commit(h);
+        nvs_close(h);
     }
-    out[(p < outcap) ? p : (outcap - 1)] = 0;
+    if (e == ESP_OK) {
+        sessionSeqnoLimit = s.seqnoUpLimit;
+        sessionSeqnoDn = s.seqnoDn;
+        ESP_LOGI(TAG, "LoRaWAN session stored, seqnoUp %u (limit %u), seqnoDn %u",
+                 LMIC.seqnoUp, sessionSeqnoLimit, sessionSeqnoDn);
+    } else {
+        ESP_LOGW(TAG, "Could not store LoRaWAN session (%d)", e);
+    }
+#endif
 }
 
-// ===== Log a TX event into paxcount.xx (plain) =====
-static void _sd_log_tx(const char *tag, const MessageBuffer_t *m, const char *note) {
-#ifdef HAS_SDCARD
-    if (!isSDCardAvailable() || !m) return;
-    // line: TAG,epoch,port,size,HEX[,note]
-    char hex[2 * 256 + 1] = {0}; // ajusta si tu Message[] > 256
-    _hex_of_payload(m->Message, m->MessageSize, hex, sizeof(hex));
-
-    char line[512];
-    snprintf(line, sizeof(line), "%s,%lu,%u,%u,%s%s%s",
-             tag,
-             (unsigned long)now(),
-             (unsigned)m->MessagePort,
-             (unsigned)m->MessageSize,
-             hex,
-             (note && note[0]) ? "," : "",
-             (note && note[0]) ? note : "");
-    sdcardWriteLine(line);
+#if (LORA_SESSION_PERSIST)
+// reads the stored session, true if it is one of this device
+static bool lora_session_load(loraSession_t &s) {
+    size_t len = sizeof(s);
+    nvs_handle h;
+    uint8_t eui[8];
+
+    if (nvs_open(LORA_SESSION_NVS, NVS_READONLY, &h) != ESP_OK) return false;
+    esp_err_t e = nvs_get_blob(h, "session", &s, &len);
+    nvs_close(h);
+
+    if ((e != ESP_OK) || (len != sizeof(s)) || (s.magic != LORA_SESSION_MAGIC) ||
+        (s.version != LORA_SESSION_VERSION) || !s.devaddr) {
+        ESP_LOGI(TAG, "No stored LoRaWAN session found");
+        return false;
+    }
+    os_getDevEui(eui);
+    if (memcmp(eui, s.devEui, 8)) {
+        ESP_LOGW(TAG, "Stored LoRaWAN session belongs to other DevEUI, discarded");
+        return false;
+    }
+    os_getArtEui(eui);
+    if (memcmp(eui, s.artEui, 8)) {
+        ESP_LOGW(TAG, "Stored LoRaWAN session belongs to other AppEUI, discarded");
+        return false;
+    }
+    return true;
+}
+#endif
+
+// restore LMIC session from NVS, returns true if device can send without join
+bool lora_session_restore(void) {
+#if (LORA_SESSION_PERSIST)
+    loraSession_t s;
+    if (!lora_session_load(s)) return false;
+
+    // LMIC_setSession() resets channels and counters, so restore them after
+    LMIC_setSession(s.netid, s.devaddr, s.nwkKey, s.artKey);
+    memcpy(&LMIC.channelMap, s.channelMap, sizeof(s.channelMap));
+#if CFG_LMIC_EU_like
+    memcpy(LMIC.channelFreq, s.channelFreq, sizeof(s.channelFreq));
+    memcpy(LMIC.channelDrMap, s.channelDrMap, sizeof(s.channelDrMap));
+#endif
+    LMIC.datarate = s.datarate;
+    LMIC.adrTxPow = s.adrTxPow;
+    LMIC.rx1DrOffset = s.rx1DrOffset;
+    LMIC.dn2Dr = s.dn2Dr;
+    LMIC.dn2Freq = s.dn2Freq;
+    LMIC.rxDelay = s.rxDelay;
+    // counter may have advanced up to the limit before power loss, never reuse
+    LMIC.seqnoUp = s.seqnoUpLimit;
+    LMIC.seqnoDn = s.seqnoDn;
+    sessionSeqnoLimit = s.seqnoUpLimit;
+    sessionSeqnoDn = s.seqnoDn;
+
+    LMIC_setAdrMode(cfg.adrmode);
+    if (!cfg.adrmode) LMIC_setDrTxpow(assertDR(cfg.loradr), cfg.txpower);
+    LMIC_setLinkCheckMode(true);
+
+    LMIC_getSessionKeys(&RTCnetid, &RTCdevaddr, RTCnwkKey, RTCartKey);
+    RTCseqnoUp = LMIC.seqnoUp;
+    RTCseqnoDn = LMIC.seqnoDn;
+
+    // first uplinks are sent confirmed until the network acks the session
+    sessionUnverified = true;
+    sessionValidateTries = 0;
+    ESP_LOGI(TAG, "LoRaWAN session restored from NVS, DEVaddr: %08X, seqnoUp %u",
+             LMIC.devaddr, LMIC.seqnoUp);
+    return true;
+#else
+    return false;
+#endif
+}
+
+// session of a deep sleep wakeup, kept in RTC memory. Only the write-ahead
+// state of the NVS copy is read, so it is not written again on each wakeup
+static void lora_session_wakeup(void) {
+    LMIC_setSession(RTCnetid, RTCdevaddr, RTCnwkKey, RTCartKey);
+    LMIC.seqnoUp = RTCseqnoUp;
+    LMIC.seqnoDn = RTCseqnoDn;
+    lora_setupForNetwork(false);
+#if (LORA_SESSION_PERSIST)
+    loraSession_t s;
+    if (lora_session_load(s) && (s.devaddr == RTCdevaddr)) {
+        sessionSeqnoLimit = s.seqnoUpLimit;
+        sessionSeqnoDn = s.seqnoDn;
+    }
+#endif
+    ESP_LOGI(TAG, "LoRaWAN session kept over deep sleep, DEVaddr: %08X, "
+                  "seqnoUp %u", LMIC.devaddr, LMIC.seqnoUp);
+}
+
+// drop stored session, next start will join again
+void lora_session_erase(void) {
+#if (LORA_SESSION_PERSIST)
+    nvs_handle h;
+    if (nvs_open(LORA_SESSION_NVS, NVS_READWRITE, &h) == ESP_OK) {
+        nvs_erase_key(h, "session");
+        nvs_commit(h);
+        nvs_close(h);
+    }
+    sessionSeqnoLimit = 0;
+    ESP_LOGI(TAG, "Stored LoRaWAN session erased");
 #endif
 }
 
@@ -271,7 +449,7 @@ if (isSDCardAvailable() && sdqueueCount() > 50 &&
 #ifdef HAS_SDCARD
                 if (isSDCardAvailable()) {
                     sdqueueEnqueue(&Pending);
-                    _sd_log_tx("TX_SD_ENQ", &Pending, "NO_JOIN_PENDING");
+                    _sd_log_tx(SDLOG_TX_SD_ENQ, &Pending, SDLOG_NO_JOIN_PENDING);
                 }
 #endif
                 havePending = false;
@@ -283,7 +461,7 @@ if (isSDCardAvailable() && sdqueueCount() > 50 &&
 #ifdef HAS_SDCARD
                 if (isSDCardAvailable()) {
                     sdqueueEnqueue(&m);
-                    _sd_log_tx("TX_SD_ENQ", &m, "NO_JOIN_QUEUE");
+                    _sd_log_tx(SDLOG_TX_SD_ENQ, &m, SDLOG_NO_JOIN_QUEUE);
                 }
 #endif
             }
@@ -312,12 +490,12 @@ if (isSDCardAvailable() && sdqueueCount() > 50 &&
             nb_enable(true);
             bool oknb = nb_enqueuedata(&Pending);
             if (oknb) {
-                _sd_log_tx("TX_NB_ENQ", &Pending, "PENDING_AGE");
+                _sd_log_tx(SDLOG_TX_NB_ENQ, &Pending, SDLOG_PENDING_AGE);
             } else {
 #ifdef HAS_SDCARD
                 if (isSDCardAvailable()) {
                     sdqueueEnqueue(&Pending);
-                    _sd_log_tx("TX_SD_ENQ", &Pending, "PENDING_AGE");
+                    _sd_log_tx(SDLOG_TX_SD_ENQ, &Pending, SDLOG_PENDING_AGE);
                 }
 #endif
             }
@@ -325,7 +503,7 @@ if (isSDCardAvailable() && sdqueueCount() > 50 &&
 #ifdef HAS_SDCARD
             if (isSDCardAvailable()) {
                 sdqueueEnqueue(&Pending);
-                _sd_log_tx("TX_SD_ENQ", &Pending, "PENDING_AGE_NO_NB");
+                _sd_log_tx(SDLOG_TX_SD_ENQ, &Pending, SDLOG_PENDING_AGE_NO_NB);
             }
 #endif
 #endif
@@ -353,12 +531,12 @@ if (isSDCardAvailable() && sdqueueCount() > 50 &&
                 nb_enable(true);
                 bool oknb = nb_enqueuedata(&Pending);
                 if (oknb) {
-                    _sd_log_tx("TX_NB_ENQ", &Pending, "BUSY_TIMEOUT");
+                    _sd_log_tx(SDLOG_TX_NB_ENQ, &Pending, SDLOG_BUSY_TIMEOUT);
                 } else {
 #ifdef HAS_SDCARD
                     if (isSDCardAvailable()) {
                         sdqueueEnqueue(&Pending);
-                        _sd_log_tx("TX_SD_ENQ", &Pending, "BUSY_TIMEOUT");
+                        _sd_log_tx(SDLOG_TX_SD_ENQ, &Pending, SDLOG_BUSY_TIMEOUT);
                     }
 #endif
                 }
@@ -393,7 +571,8 @@ if (isSDCardAvailable() && sdqueueCount() > 50 &&
         }
 #endif
 
-        bool confirmedNow = sendConfirmed || ((cfg.countermode & 0x02) != 0);
+        bool confirmedNow = sendConfirmed || sessionUnverified ||
+                            ((cfg.countermode & 0x02) != 0);
 
         // intentamos transmitir payload
         switch (LMIC_sendWithCallback(
@@ -407,7 +586,7 @@ if (isSDCardAvailable() && sdqueueCount() > 50 &&
         case LMIC_ERROR_SUCCESS:
             ESP_LOGI(TAG, "%d byte(s) sent to LORA", Pending.MessageSize);
 #ifdef HAS_SDCARD
-            _sd_log_tx("TX_LORA_OK", &Pending, "");
+            _sd_log_tx(SDLOG_TX_LORA_OK, &Pending, SDLOG_NONE);
 #endif
             if (confirmedNow) {
                 ESP_LOGD(TAG, "Sending confirmed lora message");
@@ -430,13 +609,13 @@ if (isSDCardAvailable() && sdqueueCount() > 50 &&
             nb_enable(true);
             if (nb_enqueuedata(&Pending)) {
 #ifdef HAS_SDCARD
-                _sd_log_tx("TX_NB_ENQ", &Pending, "TOO_LARGE");
+                _sd_log_tx(SDLOG_TX_NB_ENQ, &Pending, SDLOG_TOO_LARGE);
 #endif
             } else {
 #ifdef HAS_SDCARD
                 if (isSDCardAvailable()) {
                     sdqueueEnqueue(&Pending);
-                    _sd_log_tx("TX_SD_ENQ", &Pending, "TOO_LARGE");
+                    _sd_log_tx(SDLOG_TX_SD_ENQ, &Pending, SDLOG_TOO_LARGE);
                 }
 #endif
             }
@@ -444,7 +623,7 @@ if (isSDCardAvailable() && sdqueueCount() > 50 &&
 #ifdef HAS_SDCARD
             if (isSDCardAvailable()) {
                 sdqueueEnqueue(&Pending);
-                _sd_log_tx("TX_SD_ENQ", &Pending, "TOO_LARGE_NO_NB");
+                _sd_log_tx(SDLOG_TX_SD_ENQ, &Pending, SDLOG_TOO_LARGE_NO_NB);
             }
 #endif
 #endif
@@ -458,13 +637,13 @@ if (isSDCardAvailable() && sdqueueCount() > 50 &&
             nb_enable(true);
             if (nb_enqueuedata(&Pending)) {
 #ifdef HAS_SDCARD
-                _sd_log_tx("TX_NB_ENQ", &Pending, "LMIC_ERROR");
+                _sd_log_tx(SDLOG_TX_NB_ENQ, &Pending, SDLOG_LMIC_ERROR);
 #endif
             } else {
 #ifdef HAS_SDCARD
                 if (isSDCardAvailable()) {
                     sdqueueEnqueue(&Pending);
-                    _sd_log_tx("TX_SD_ENQ", &Pending, "LMIC_ERROR");
+                    _sd_log_tx(SDLOG_TX_SD_ENQ, &Pending, SDLOG_LMIC_ERROR);
                 }
 #endif
             }
@@ -472,7 +651,7 @@ if (isSDCardAvailable() && sdqueueCount() > 50 &&
 #ifdef HAS_SDCARD
             if (isSDCardAvailable()) {
                 sdqueueEnqueue(&Pending);
-                _sd_log_tx("TX_SD_ENQ", &Pending, "LMIC_ERROR_NO_NB");
+                _sd_log_tx(SDLOG_TX_SD_ENQ, &Pending, SDLOG_LMIC_ERROR_NO_NB);
             }
 #endif
 #endif
@@ -487,7 +666,7 @@ if (isSDCardAvailable() && sdqueueCount() > 50 &&
 
 esp_err_t lora_stack_init(bool do_join) {
     assert(SEND_QUEUE_SIZE);
-    LoraSendQueue = xQueueCreate(SEND_QUEUE_SIZE, sizeof(MessageBuffer_t));
+    LoraSendQueue = mem_queue_create(MEM_QUEUE_LORASEND);
     if (LoraSendQueue == 0) {
         ESP_LOGE(TAG, "Could not create LORA send queue. Aborting.");
         return ESP_FAIL;
@@ -496,21 +675,18 @@ esp_err_t lora_stack_init(bool do_join) {
     ESP_LOGI(TAG, "LORA send queue created, size %d Bytes",
              SEND_QUEUE_SIZE * sizeof(MessageBuffer_t));
 
+    // session restore or join is done by lmictask after LMIC_reset()
+    loraDoJoin = do_join;
+
     ESP_LOGI(TAG, "Starting LMIC...");
-    xTaskCreatePinnedToCore(lmictask, "lmictask", 4096, (void *)1, 2, &lmicTask, 1);
+    mem_task_create(MEM_TASK_LMIC, lmictask, (void *)1, 2, &lmicTask, 1);
 
-    if (do_join) {
-        lastJoinAttemptTime = millis();
-        if (!LMIC_startJoining())
-            ESP_LOGI(TAG, "Already joined");
-    } else {
-        LMIC_reset();
-        LMIC_setSession(RTCnetid, RTCdevaddr, RTCnwkKey, RTCartKey);
-        LMIC.seqnoUp = RTCseqnoUp;
-        LMIC.seqnoDn = RTCseqnoDn;
-    }
+    mem_task_create(MEM_TASK_LORASEND, lora_send, (void *)1, 1, &lorasendTask, 1);
 
-    xTaskCreatePinnedToCore(lora_send, "lorasendtask", 4096, (void *)1, 1, &lorasendTask, 1);
+#if (USE_FUOTA)
+    if (fuota_init() != ESP_OK)
+        ESP_LOGW(TAG, "FUOTA not available");
+#endif
     return ESP_OK;
 }
 
@@ -538,7 +714,7 @@ bool lora_enqueuedata(MessageBuffer_t *message) {
 #ifdef HAS_SDCARD
                 if (isSDCardAvailable()) {
                     sdqueueEnqueue(&DummyBuffer);
-                    _sd_log_tx("TX_SD_ENQ_PURGE", &DummyBuffer, "LORA_QUEUE_FULL");
+                    _sd_log_tx(SDLOG_TX_SD_ENQ_PURGE, &DummyBuffer, SDLOG_LORA_QUEUE_FULL);
                     ESP_LOGW(TAG, "LORA sendqueue purged -> moved to SD persistent queue (paxqueue.q)");
                 }
 #endif
@@ -631,9 +807,37 @@ void lmictask(void *pvParameters) {
     LMIC_setClockError(CLOCK_ERROR_PROCENTAGE * MAX_CLOCK_ERROR / 1000);
 #endif
 
+    // deep sleep wakeup (no join requested): RTC memory holds the exact
+    // counters, the NVS copy may lag behind. Else use the stored session if
+    // we have one, or join
+    if (!loraDoJoin && RTCdevaddr) {
+        lora_session_wakeup();
+    } else if (!lora_session_restore()) {
+        lastJoinAttemptTime = millis();
+        if (!LMIC_startJoining())
+            ESP_LOGI(TAG, "Already joined");
+    }
+
     while (1) {
         os_runloop_once();
         delay(2);
+
+        if (sessionSaveDue) {
+            bool force = sessionSaveForce;
+            sessionSaveDue = sessionSaveForce = false;
+            lora_session_save(force);
+        }
+
+        // restored session was rejected by network -> fresh join
+        if (loraRejoinRequest) {
+            loraRejoinRequest = false;
+            LMIC_reset();
+#ifdef CLOCK_ERROR_PROCENTAGE
+            LMIC_setClockError(CLOCK_ERROR_PROCENTAGE * MAX_CLOCK_ERROR / 1000);
+#endif
+            lastJoinAttemptTime = millis();
+            LMIC_startJoining();
+        }
 #if (HAS_NBIOT)
         checkJoinProcedure();
 #endif
@@ -657,6 +861,9 @@ void myEventCallback(void *pUserData, ev_t ev) {
 
     case EV_JOINED:
         lora_setupForNetwork(false);
+        sessionUnverified = false;
+        sessionSaveForce = true;
+        sessionSaveDue = true;
 #if (HAS_NBIOT)
         firstJoin = false;
         // NB-IoT siempre activo — no llamar nb_disable()
@@ -678,6 +885,20 @@ void myEventCallback(void *pUserData, ev_t ev) {
     case EV_TXCOMPLETE:
         RTCseqnoUp = LMIC.seqnoUp;
         RTCseqnoDn = LMIC.seqnoDn;
+        if (sessionUnverified) {
+            if (LMIC.txrxFlags & TXRX_ACK) {
+                sessionUnverified = false;
+                ESP_LOGI(TAG, "Restored LoRaWAN session confirmed by network, "
+                              "first ack %lu ms after boot", millis());
+            } else if (++sessionValidateTries >= LORA_SESSION_VALIDATE_TRIES) {
+                ESP_LOGW(TAG, "Restored LoRaWAN session not acked after %u "
+                              "uplinks, rejoining", sessionValidateTries);
+                sessionUnverified = false;
+                lora_session_erase();
+                loraRejoinRequest = true;
+            }
+        }
+        sessionSaveDue = true;
         if (LMIC.txrxFlags & TXRX_ACK) {
             ESP_LOGI(TAG, "Received ack");
             if (nb_data_mode) {
@@ -713,6 +934,7 @@ void myEventCallback(void *pUserData, ev_t ev) {
             nb_data_mode = true;
         }
 #endif
+        lora_session_erase();
         lastJoinAttemptTime = millis();
         LMIC_startJoining();
         break;
@@ -750,6 +972,11 @@ void myRxCallback(void *pUserData, uint8_t port, const uint8_t *pMsg, size_t nMs
     case RCMDPORT:
         rcommand(pMsg, nMsg);
         break;
+#if (USE_FUOTA)
+    case FRAGPORT:
+        fuota_rx(pMsg, nMsg);
+        break;
+#endif
     default:
 #if (TIME_SYNC_LORASERVER)
         if (port == TIMEPORT) {
@@ -42,6 +42,7 @@ uint64_t macConvert(uint8_t *paddr) {
   return (__builtin_bswap64(*mac) >> 16);
 }
 bool mac_add(uint8_t *paddr, int8_t rssi, uint8_t sniff_type) {
+  LAT_SCOPE(lat_mac_add);
   if (!salt) // ensure we have salt (appears after radio is turned on)
     return false;
 
@@ -75,6 +76,10 @@ bool mac_add(uint8_t *paddr, int8_t rssi, uint8_t sniff_type) {
 #endif
 
 if (macAllowed) {
+#if (OCCUPANCY_SERIES)
+    occ_add(sniff_type, paddr);
+#endif
+
     // salt and hash MAC, and if new unique one, store identifier in container
     // and increment counter on display
     // https://en.wikipedia.org/wiki/MAC_Address_Anonymization
@@ -118,9 +123,6 @@ if (macAllowed) {
 
     hashedmac = (uint32_t) strtoul(out, NULL, 16);
 
-    char hashedmacbuff[20];
-    snprintf(hashedmacbuff, sizeof(hashedmacbuff), "%08X", hashedmac);
-
     switch (sniff_type) {
     case MAC_SNIFF_WIFI: {
       auto newmac =
@@ -167,6 +169,10 @@ if (macAllowed) {
     }
     }
 
+    // countermode 4 counts the window, overrides the counters set above
+    if (cfg.countermode == COUNTER_SLIDING)
+      slide_mac(sniff_type, hashedmac);
+
     // in beacon monitor mode check if seen MAC is a known beacon
     if (cfg.monitormode) {
 
@@ -188,21 +194,14 @@ if (macAllowed) {
 
     // Log scan result
     if (added) { // DESCOMENTAR PARA LOG CAMBIAR TODO:
-      ESP_LOGD(TAG, "%s salt", salt);
-
-      ESP_LOGD(TAG,
-               "%s %s RSSI %ddBi -> salted MAC %s -> Hash %s -> WiFi:%d  "
-               "BLE:%d -> BLTH:%d -> "
-               "%d Bytes left",
-               added ? "new  " : "known",
-               sniff_type == MAC_SNIFF_WIFI  ? "WiFi"
-               : sniff_type == MAC_SNIFF_BLE ? "BLE"
-                                             : "BLTH",
-               rssi, out, hashedmacbuff, macs_wifi, macs_ble, macs_bt,
-               getFreeRAM());
-      //ESP_LOGV(TAG, "MAC is: %02X%02X%02X%02X%02X%02X",
-      ESP_LOGE(TAG, "MAC is: %02X%02X%02X%02X%02X%02X",   //para ver solo las lineas de macs
-      paddr[0],paddr[1],paddr[2],paddr[3],paddr[4],paddr[5]);
+      // deferred, formatted by the dlog task, see dlog.h
+      DLOG((dlog_id_t)(dlog_mac_wifi + sniff_type), rssi, hashedmac, macs_wifi,
+           macs_ble, macs_bt, getFreeRAM());
+#if (VERBOSE)
+      // serial console only, dlog keeps raw MACs off the card
+      DLOG(dlog_mac_raw, paddr[0], paddr[1], paddr[2], paddr[3], paddr[4],
+           paddr[5]);
+#endif
     }
 
 
@@ -34,9 +34,11 @@ IDLE          0     0     ESP32 arduino scheduler -> runs wifi sniffer
 lmictask      1     2     MCCI LMiC LORAWAN stack
 clockloop     1     4     generates realtime telegrams for external clock
 timesync_req  1     3     processes realtime time sync requests
+sched1        1     3     timer wheel, runs cyclic jobs (scheduler.h)
 irqhandler    1     1     cyclic tasks (i.e. displayrefresh) triggered by timers
 gpsloop       1     1     reads data from GPS via serial or i2c
 lorasendtask  1     1     feeds data from lora sendqueue to lmcic
+fuotatask     1     1     reassembles firmware fragments received via LoRaWAN
 IDLE          1     0     ESP32 arduino scheduler -> runs wifi channel rotator
 
 Low priority numbers denote low priority tasks.
@@ -60,11 +62,13 @@ CLOCKIRQ        -> esp32 timer 1  -> ClockTask (Core 1)
 ButtonIRQ       -> external gpio  -> irqHandlerTask (Core 1)
 PMUIRQ          -> PMU chip gpio  -> irqHandlerTask (Core 1)
 
-fired by software (Ticker.h)
-TIMESYNC_IRQ    -> timeSync()     -> irqHandlerTask (Core 1)
-CYCLIC_IRQ      -> housekeeping() -> irqHandlerTask (Core 1)
-SENDCYCLE_IRQ   -> sendcycle()    -> irqHandlerTask (Core 1)
-BME_IRQ         -> bmecycle()     -> irqHandlerTask (Core 1)
+fired by software (scheduler.h timer wheel jobs)
+TIMESYNC_IRQ       -> timeSync()      -> irqHandlerTask (Core 1)
+CYCLIC_IRQ         -> housekeeping()  -> irqHandlerTask (Core 1)
+SENDCYCLE_IRQ      -> sendcycle()     -> irqHandlerTask (Core 1)
+BME_IRQ            -> bmecycle()      -> irqHandlerTask (Core 1)
+HEALTHCHECK_IRQ    -> healthcheck()   -> irqHandlerTask (Core 1)
+NB_HEALTHCHECK_IRQ -> nbhealthcheck() -> irqHandlerTask (Core 1)
 
 
 // External RTC timer (if present)
@@ -188,6 +192,13 @@ void setup() {
 
   do_after_reset(rtc_get_reset_reason(0));
 
+  // timer wheel for all cyclic jobs, and memory budget of long lived tasks
+  sched_init();
+  mem_budget_init();
+#if (CRASH_TRACE)
+  assert(crash_init() == ESP_OK);
+#endif
+
   // print chip information on startup if in verbose mode after coldstart
   #if (VERBOSE)
 
@@ -298,13 +309,12 @@ void setup() {
   #if (HAS_LED != NOT_A_PIN) || defined(HAS_RGB_LED)
     // start led loop
     ESP_LOGI(TAG, "Starting LED Controller...");
-    xTaskCreatePinnedToCore(ledLoop,      // task function
-                            "ledloop",    // name of task
-                            1024,         // stack size of task
-                            (void *)1,    // parameter of the task
-                            3,            // priority of the task
-                            &ledLoopTask, // task handle
-                            0);           // CPU core
+    mem_task_create(MEM_TASK_LEDLOOP, // budget entry
+                    ledLoop,          // task function
+                    (void *)1,        // parameter of the task
+                    3,                // priority of the task
+                    &ledLoopTask,     // task handle
+                    0);               // CPU core
   #endif
 
   // initialize wifi antenna
@@ -346,13 +356,12 @@ void setup() {
       //initBT();
       //BTCycler.attach(BTLE_SCAN_TIME, BTCycle);
     }
-    xTaskCreatePinnedToCore(btHandler,      // task function
-                            "bthandler",    // name of task
-                            4096,            // stack size of task
-                            (void *)1,       // parameter of the task
-                            0,               // priority of the task
-                            &btHandlerTask, // task handle
-                            1);              // CPU core
+    mem_task_create(MEM_TASK_BTHANDLER, // budget entry
+                    btHandler,          // task function
+                    (void *)1,          // parameter of the task
+                    0,                  // priority of the task
+                    &btHandlerTask,     // task handle
+                    1);                 // CPU core
   #endif
   ESP_ERROR_CHECK(esp_coex_preference_set(
       ESP_COEX_PREFER_WIFI)); // configure Wifi/BT coexist lib
@@ -362,13 +371,12 @@ void setup() {
     strcat_P(features, " GPS");
     if (gps_init()) {
       ESP_LOGI(TAG, "Starting GPS Feed...");
-      xTaskCreatePinnedToCore(gps_loop,  // task function
-                              "gpsloop", // name of task
-                              2048,      // stack size of task
-                              (void *)1, // parameter of the task
-                              1,         // priority of the task
-                              &GpsTask,  // task handle
-                              1);        // CPU core
+      mem_task_create(MEM_TASK_GPSLOOP, // budget entry
+                      gps_loop,         // task function
+                      (void *)1,        // parameter of the task
+                      1,                // priority of the task
+                      &GpsTask,         // task handle
+                      1);               // CPU core
     }
   #endif
 
@@ -384,6 +392,9 @@ void setup() {
     // kick off join, except we come from sleep
     assert(lora_stack_init(RTC_runmode == RUNMODE_WAKEUP ? false : true) ==
           ESP_OK);
+  #if (USE_FUOTA)
+    strcat_P(features, " FUOTA");
+  #endif
   #endif
 
   #if (HAS_NBIOT)
@@ -402,13 +413,27 @@ void setup() {
     assert(spi_init() == ESP_OK);
   #endif
 
+#if (OCCUPANCY_SERIES)
+  assert(occ_init() == ESP_OK);
+#endif
+  assert(slide_init() == ESP_OK);
+#if (TASKSTATS)
+  assert(taskstat_init() == ESP_OK);
+#endif
+#if (LATENCY_PROBES)
+  assert(lat_init() == ESP_OK);
+#endif
+#if (DEFERRED_LOG)
+  assert(dlog_init() == ESP_OK);
+#endif
+
 #ifdef HAS_SDCARD
   if (sdcardInit()) {
     strcat_P(features, " SD");
   } else {
     ESP_LOGW(TAG, "⚠️ No SD detected at startup. NB-IoT config will load when card is inserted.");
     startSDWatcher();  // inicia el detector de inserción
-    xTaskCreatePinnedToCore(sdReinsertMonitor, "sdReinsertMonitor", 2048, NULL, 1, NULL, 1);
+    mem_task_create(MEM_TASK_SDREINSERT, sdReinsertMonitor, NULL, 1, NULL, 1);
   }
 #endif
 
@@ -467,13 +492,12 @@ void setup() {
 
   // start state machine
   ESP_LOGI(TAG, "Starting Interrupt Handler...");
-  xTaskCreatePinnedToCore(irqHandler,      // task function
-                          "irqhandler",    // name of task
-                          4096,            // stack size of task
-                          (void *)1,       // parameter of the task
-                          2,               // priority of the task
-                          &irqHandlerTask, // task handle
-                          1);              // CPU core
+  mem_task_create(MEM_TASK_IRQHANDLER, // budget entry
+                  irqHandler,          // task function
+                  (void *)1,           // parameter of the task
+                  2,                   // priority of the task
+                  &irqHandlerTask,     // task handle
+                  1);                  // CPU core
 
   // initialize BME sensor (BME280/BME680)
   #if (HAS_BME)
@@ -524,12 +548,18 @@ void setup() {
   #endif // HAS_BUTTON
 
   // cyclic function interrupts
-  sendcycler.attach(cfg.sendcycle * 2, sendcycle);
-  housekeeper.attach(HOMECYCLE, housekeeping);
+  sendcycleJob = sched_add("sendcycle", sendcycle, cfg.sendcycle * 2 * 1000, 0, 1);
+  housekeepingJob = sched_add("housekeeping", housekeeping, HOMECYCLE * 1000,
+                              5000, 1);
+  sched_add("healthcheck", healthcheck, HEALTHCHECK_INTERVAL_MINUTES * 60 * 1000,
+            30000, 1);
+#if (HAS_NBIOT)
+  sched_add("nbhealthcheck", nbhealthcheck,
+            NB_HEALTHCHECK_INTERVAL_MINUTES * 60 * 1000, 30000, 1);
+#endif
 
   //adicion para la escritura en SD de los datos que se envian
-  Ticker sdLogger;
-  sdLogger.attach(30, logDataToSD);  // Guarda cada 30 segundos
+  sched_add("sdlog", logDataToSD, 30 * 1000, 5000, 1); // Guarda cada 30 segundos
 
 
   #if (TIME_SYNC_INTERVAL)
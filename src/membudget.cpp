@@ -0,0 +1,290 @@
+/* membudget carves every long lived task stack, send queue and large i/o
+buffer from one table, instead of each module guessing a size and pulling it
+from the heap at some point of runtime. Each entry is carved once on first
+use and never freed, task stacks from internal RAM, queue storage and i/o
+buffers from PSRAM where present. High water marks are collected for every
+entry (stack watermark, sampled queue fill level, touched buffer bytes), so
+the sizes below can be trimmed by measurement, see remote command 0x8C. */
+
+// Basic Config
+#include "membudget.h"
+#ifdef HAS_SDCARD
+#include "sdservice.h"
+#endif
+
+// Local logging tag
+static const char TAG[] = "membudget";
+
+#define MEM_CANARY 0xA5 // fill pattern of unused i/o buffer bytes
+
+typedef struct {
+  const char *name;
+  mem_kind_t kind;
+  uint32_t size;     // task: stack bytes, queue: items, buffer: bytes
+  uint32_t itemsize; // queue: item size
+} mem_budget_t;
+
+typedef struct {
+  void *mem;      // stack, queue storage or buffer
+  void *ctrl;     // StaticTask_t or StaticQueue_t
+  void *handle;   // TaskHandle_t or QueueHandle_t
+  uint32_t peak;  // queue: highest fill level seen, buffer: as reported
+} mem_entry_t;
+
+// the budget, order must match mem_id_t in membudget.h
+static const mem_budget_t budget[] = {
+    // task stacks [bytes]
+    {"irqhandler", mem_task, 4096, 0},
+#if (HAS_LED != NOT_A_PIN) || defined(HAS_RGB_LED)
+    {"ledloop", mem_task, 1024, 0},
+#endif
+#if (BLECOUNTER)
+    {"bthandler", mem_task, 4096, 0},
+#endif
+#if (HAS_GPS)
+    {"gpsloop", mem_task, 2048, 0},
+#endif
+#ifdef HAS_SPI
+    {"spiloop", mem_task, 4096, 0},
+#endif
+#if (HAS_LORA)
+    {"lmictask", mem_task, 4096, 0},
+    {"lorasendtask", mem_task, 4096, 0},
+#if (USE_FUOTA)
+    {"fuotatask", mem_task, 4096, 0},
+#endif
+#endif
+#if (HAS_NBIOT)
+    // 16 KB before, 8 KB of http/mqtt buffers moved to the i/o arena
+    {"nbtask", mem_task, 8192, 0},
+#endif
+#ifdef HAS_SDCARD
+    {"sdservice", mem_task, 6144, 0},
+    {"sdqFlusher", mem_task, 4096, 0},
+    {"sdReinsertMonitor", mem_task, 2048, 0},
+#endif
+#if (defined HAS_IF482 || defined HAS_DCF77)
+    {"clockloop", mem_task, 2048, 0},
+#endif
+#if (TIME_SYNC_LORASERVER)
+    {"timesync_req", mem_task, 2048, 0},
+#endif
+#if (DEFERRED_LOG)
+    {"dlog", mem_task, DLOG_TASK_STACK, 0},
+#endif
+    {"sched0", mem_task, SCHED_TASK_STACK, 0},
+    {"sched1", mem_task, SCHED_TASK_STACK, 0},
+    // send queues [items]
+#if (HAS_LORA)
+    {"lorasendqueue", mem_queue, SEND_QUEUE_SIZE, sizeof(MessageBuffer_t)},
+#endif
+#if (HAS_NBIOT)
+    {"nbsendqueue", mem_queue, SEND_QUEUE_SIZE, sizeof(MessageBuffer_t)},
+#endif
+#ifdef HAS_SPI
+    {"spisendqueue", mem_queue, SEND_QUEUE_SIZE, sizeof(MessageBuffer_t)},
+#endif
+#ifdef HAS_SDCARD
+    {"sdrequests", mem_queue, SD_REQ_QUEUE_SIZE, sizeof(sd_req_t)},
+#endif
+    // i/o buffers [bytes]
+    {"ioarena", mem_buffer, IO_ARENA_BYTES, 0},
+    {"slidewin", mem_buffer, SLIDE_BYTES(SLIDING_CAPACITY), 0},
+#ifdef HAS_SDCARD
+    {"sdlines", mem_buffer, SD_LINE_OVERFLOW, 0},
+#endif
+};
+
+static_assert(sizeof(budget) / sizeof(budget[0]) == MEM_BUDGET_COUNT,
+              "memory budget table does not match mem_id_t");
+
+static mem_entry_t entries[MEM_BUDGET_COUNT];
+static portMUX_TYPE memMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void *mem_carve_internal(size_t size) {
+  return heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+}
+
+static void *mem_carve_data(size_t size) {
+  void *p = NULL;
+#ifdef BOARD_HAS_PSRAM
+  p = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#endif
+  if (p == NULL)
+    p = mem_carve_internal(size);
+  return p;
+}
+
+BaseType_t mem_task_create(mem_id_t id, TaskFunction_t fn, void *param,
+                           UBaseType_t prio, TaskHandle_t *handle,
+                           BaseType_t core) {
+  const mem_budget_t *b = &budget[id];
+  mem_entry_t *e = &entries[id];
+  TaskHandle_t task = NULL;
+
+  assert(b->kind == mem_task);
+
+  if (e->handle != NULL) {
+    ESP_LOGE(TAG, "Task %s already started", b->name);
+    return pdFAIL;
+  }
+
+  if (e->mem == NULL) {
+    e->mem = mem_carve_internal(b->size);
+    e->ctrl = mem_carve_internal(sizeof(StaticTask_t));
+  }
+
+  if (e->mem && e->ctrl)
+    task = xTaskCreateStaticPinnedToCore(fn, b->name, b->size, param, prio,
+                                         (StackType_t *)e->mem,
+                                         (StaticTask_t *)e->ctrl, core);
+  else
+    ESP_LOGE(TAG, "Could not carve %u bytes stack for task %s", b->size,
+             b->name);
+
+  e->handle = task;
+  if (handle)
+    *handle = task;
+  return task ? pdPASS : pdFAIL;
+}
+
+QueueHandle_t mem_queue_create(mem_id_t id) {
+  const mem_budget_t *b = &budget[id];
+  mem_entry_t *e = &entries[id];
+
+  assert(b->kind == mem_queue);
+
+  if (e->handle != NULL)
+    return (QueueHandle_t)e->handle;
+
+  e->mem = mem_carve_data(b->size * b->itemsize);
+  e->ctrl = mem_carve_internal(sizeof(StaticQueue_t));
+
+  if (e->mem && e->ctrl)
+    e->handle = xQueueCreateStatic(b->size, b->itemsize, (uint8_t *)e->mem,
+                                   (StaticQueue_t *)e->ctrl);
+  else
+    ESP_LOGE(TAG, "Could not carve %u bytes storage for queue %s",
+             b->size * b->itemsize, b->name);
+
+  return (QueueHandle_t)e->handle;
+}
+
+// returns buffer of entry, or NULL if it could not be carved
+void *mem_buffer_get(mem_id_t id) {
+  const mem_budget_t *b = &budget[id];
+  mem_entry_t *e = &entries[id];
+
+  assert(b->kind == mem_buffer);
+
+  if (e->mem == NULL) {
+    e->mem = mem_carve_data(b->size);
+    if (e->mem)
+      memset(e->mem, MEM_CANARY, b->size);
+    else
+      ESP_LOGE(TAG, "Could not carve %u bytes for buffer %s", b->size,
+               b->name);
+  }
+  return e->mem;
+}
+
+size_t mem_buffer_size(mem_id_t id) { return budget[id].size; }
+
+// high water mark of a buffer its owner keeps track of, for buffers that are
+// cleared as a whole so the canary cannot tell their use
+void mem_buffer_used(mem_id_t id, uint32_t used) {
+  assert(budget[id].kind == mem_buffer);
+  portENTER_CRITICAL(&memMux);
+  if (used > entries[id].peak)
+    entries[id].peak = used;
+  portEXIT_CRITICAL(&memMux);
+}
+
+uint32_t mem_budget_size(mem_id_t id) { return budget[id].size; }
+
+mem_kind_t mem_budget_kind(mem_id_t id) { return budget[id].kind; }
+
+const char *mem_budget_name(mem_id_t id) { return budget[id].name; }
+
+// task or queue handle of entry, NULL if not started or a buffer
+void *mem_budget_handle(mem_id_t id) { return entries[id].handle; }
+
+// budget entry of a running task, -1 if it was not started from the budget
+int mem_task_find(TaskHandle_t handle) {
+  for (int i = 0; i < MEM_BUDGET_COUNT; i++)
+    if ((budget[i].kind == mem_task) && handle && (entries[i].handle == handle))
+      return i;
+  return -1;
+}
+
+// high water mark of entry, -1 if entry was not carved yet
+int32_t mem_budget_peak(mem_id_t id) {
+  const mem_budget_t *b = &budget[id];
+  mem_entry_t *e = &entries[id];
+  uint32_t i;
+
+  switch (b->kind) {
+
+  case mem_task:
+    if (e->handle == NULL)
+      return -1;
+    return b->size - uxTaskGetStackHighWaterMark((TaskHandle_t)e->handle);
+
+  case mem_queue:
+    if (e->handle == NULL)
+      return -1;
+    return e->peak;
+
+  case mem_buffer:
+    if (e->mem == NULL)
+      return -1;
+    if (e->peak)
+      return e->peak;
+    // first byte of untouched tail marks buffer usage
+    for (i = b->size; i > 0; i--)
+      if (((uint8_t *)e->mem)[i - 1] != MEM_CANARY)
+        break;
+    return i;
+  }
+  return -1;
+}
+
+// scheduler job, samples fill level of all queues
+static void mem_sample(void) {
+  for (int i = 0; i < MEM_BUDGET_COUNT; i++) {
+    if ((budget[i].kind != mem_queue) || (entries[i].handle == NULL))
+      continue;
+    uint32_t n = uxQueueMessagesWaiting((QueueHandle_t)entries[i].handle);
+    portENTER_CRITICAL(&memMux);
+    if (n > entries[i].peak)
+      entries[i].peak = n;
+    portEXIT_CRITICAL(&memMux);
+  }
+}
+
+esp_err_t mem_budget_init(void) {
+  uint32_t stacks = 0, data = 0;
+
+  for (int i = 0; i < MEM_BUDGET_COUNT; i++) {
+    if (budget[i].kind == mem_task)
+      stacks += budget[i].size;
+    else
+      data += budget[i].size * (budget[i].itemsize ? budget[i].itemsize : 1);
+  }
+  ESP_LOGI(TAG, "Memory budget %u bytes task stacks, %u bytes queues/buffers",
+           stacks, data);
+
+  if (sched_add("memsample", mem_sample, MEM_SAMPLE_MS, MEM_SAMPLE_MS, 1) < 0)
+    return ESP_FAIL;
+  return ESP_OK;
+}
+
+void mem_budget_print(void) {
+  for (int i = 0; i < MEM_BUDGET_COUNT; i++) {
+    int32_t peak = mem_budget_peak((mem_id_t)i);
+    if (peak >= 0)
+      ESP_LOGD(TAG, "%s peak %d of %u %s", budget[i].name, peak,
+               budget[i].size,
+               budget[i].kind == mem_queue ? "items" : "bytes");
+  }
+}
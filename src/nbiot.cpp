@@ -14,12 +14,55 @@ uint8_t nb_status_failures = 0;
 // nb_status_rssi eliminado — sustituido por nb_status_rsrp (en BC95.cpp)
 bool nb_module_ok = false;
 
+// bring-up telemetry: fast path taken, time to first publish since boot
+bool nb_warm_start = false;
+uint16_t nb_ttfp = 0xFFFF; // [100 ms], 0xFFFF = nothing published yet
+static bool nbWarmTried = false;
+static uint32_t nbBringupMs = 0, nbReadyMs = 0, nbFirstPublishMs = 0;
+
+static void nb_published(void) {
+    if (nbFirstPublishMs)
+        return;
+    nbFirstPublishMs = millis();
+    nb_ttfp = min(nbFirstPublishMs / 100, (uint32_t)0xFFFE);
+    ESP_LOGI(TAG, "Time to first publish %u ms (%s start, bring-up %u ms)",
+             nbFirstPublishMs, nb_warm_start ? "warm" : "cold",
+             nbReadyMs - nbBringupMs);
+}
+
 // Indica si NB puede usarse como transporte (no solo si la cola RAM existe)
 bool nbTransportAvailable = true;
 
 // === ADEMUX: puntero global al manager para nb_send_direct() ===
 static NbIotManager *g_manager = nullptr;
 
+// periodic modem work, flagged by scheduler jobs and run by nbtask
+static int nbStatusJob = -1, nbUpdateJob = -1;
+static volatile bool nbStatusDue = true, nbUpdateDue = false;
+
+static void nb_statusdue(void) { nbStatusDue = true; }
+static void nb_updatedue(void) { nbUpdateDue = true; }
+
+// psm/edrx: queue goes out in windows, modem rests in between
+static volatile bool nbWindowDue = true;
+static bool nbWindowOpen = false;
+static uint32_t nbWindowStart = 0;
+static uint8_t nbWindowCycles = 0;
+
+static void nb_wake(void) {
+    nbWindowDue = true;
+    if (nbIotTask)
+        xTaskNotifyGive(nbIotTask);
+}
+
+// called once per send cycle after the payloads were enqueued
+void nb_sendcycle(void) {
+    if (++nbWindowCycles >= NB_WINDOW_CYCLES) {
+        nbWindowCycles = 0;
+        nb_wake();
+    }
+}
+
 
 // =============================================================================
 // VERSIÓN MEJORADA DE nb_enqueuedata() CON GESTIÓN INTELIGENTE DE COLAS
@@ -78,12 +121,8 @@ bool nb_enqueuedata(MessageBuffer_t *message) {
     UBaseType_t spaces_available = uxQueueSpacesAvailable(NbSendQueue);
     UBaseType_t messages_waiting = uxQueueMessagesWaiting(NbSendQueue);
 
-    ESP_LOGD(TAG, "nb_enqueue: port=%u size=%u prio=%u queue=%u/%u",
-             message->MessagePort,
-             message->MessageSize,
-             prio,
-             messages_waiting,
-             messages_waiting + spaces_available);
+    DLOG(dlog_nb_enqueue, message->MessagePort, message->MessageSize, prio,
+         messages_waiting, messages_waiting + spaces_available);
 
     if (prio == prio_high) {
         if (spaces_available == 0) {
@@ -124,9 +163,12 @@ bool nb_enqueuedata(MessageBuffer_t *message) {
         if (ret == pdTRUE) {
             ram_enqueued++;
             total_enqueued++;
-            ESP_LOGI(TAG,
-                     "✓ HIGH priority message enqueued to NB RAM (port=%u)",
-                     message->MessagePort);
+            // counters are high priority to survive eviction only, they
+            // wait for the window, everything else wakes the modem
+            if ((message->MessagePort != COUNTERPORT) &&
+                (xTaskGetCurrentTaskHandle() != nbIotTask))
+                nb_wake();
+            DLOG(dlog_nb_high, message->MessagePort);
             return true;
         }
     }
@@ -135,9 +177,7 @@ bool nb_enqueuedata(MessageBuffer_t *message) {
         if (ret == pdTRUE) {
             ram_enqueued++;
             total_enqueued++;
-            ESP_LOGD(TAG,
-                     "✓ Normal priority message enqueued to NB RAM (port=%u)",
-                     message->MessagePort);
+            DLOG(dlog_nb_normal, message->MessagePort);
             return true;
         }
     }
@@ -151,15 +191,11 @@ bool nb_enqueuedata(MessageBuffer_t *message) {
             if (sdqueueEnqueue(message)) {
                 sd_fallback++;
                 total_enqueued++;
-                ESP_LOGI(TAG,
-                         "✓ Message saved to SD (NB RAM full) - port=%u size=%u [SD fallbacks: %u]",
-                         message->MessagePort,
-                         message->MessageSize,
-                         sd_fallback);
+                DLOG(dlog_nb_sd_fallback, message->MessagePort,
+                     message->MessageSize, sd_fallback);
                 if (sd_fallback % 10 == 0) {
-                    ESP_LOGI(TAG,
-                             "📊 NB Stats: Total=%u RAM=%u SD=%u Evictions=%u Failures=%u",
-                             total_enqueued, ram_enqueued, sd_fallback, evictions, failures);
+                    DLOG(dlog_nb_stats, total_enqueued, ram_enqueued,
+                         sd_fallback, evictions, failures);
                 }
                 return true;
             } else {
@@ -191,6 +227,7 @@ bool nb_enqueuedata(MessageBuffer_t *message) {
 
 // Forward declaration necesaria porque sendNbMqtt se define más abajo en el archivo
 int sendNbMqtt(MessageBuffer_t *message, ConfigBuffer_t *config, char *devEui);
+int sendNbCoap(MessageBuffer_t *messages, int count, ConfigBuffer_t *config, char *devEui);
 
 // =============================================================================
 // nb_send_direct: envío inmediato por NB-IoT sin pasar por cola
@@ -204,6 +241,24 @@ int nb_send_direct(MessageBuffer_t *message) {
         ESP_LOGE(TAG, "nb_send_direct: message is NULL");
         return -1;
     }
+    // resting modem is not woken for telemetry, it rides the next window
+    if (g_manager->powerSaving()) {
+        ESP_LOGD(TAG, "nb_send_direct: power saving, port=%u queued",
+                 message->MessagePort);
+        return nb_enqueuedata(message) ? 0 : -1;
+    }
+    // coap shares socket, message ids and modem uart with nbtask, which may
+    // be in an exchange right now. The message goes first in its next batch
+    if (g_manager->nbConfig.transport == nb_coap) {
+        MessageBuffer_t first = *message;
+        first.MessagePrio = prio_high;
+        if (!nb_enqueuedata(&first))
+            return -1;
+        nb_wake();
+        ESP_LOGI(TAG, "nb_send_direct: port=%u handed to nbtask",
+                 message->MessagePort);
+        return 0;
+    }
     ESP_LOGI(TAG, "nb_send_direct: sending port=%u size=%u directly",
              message->MessagePort, message->MessageSize);
     int result = sendNbMqtt(message, &g_manager->nbConfig, g_manager->devEui);
@@ -273,26 +328,31 @@ uint16_t getCount(uint8_t *buffer) {
 }
 
 bool NbIotManager::nb_checkLastSoftwareVersion() {
-    char buff[2048];
     int responseSize = 0;
-    lastUpdateCheck = millis();
-    if (getData(UPDATES_SERVER_IP, UPDATES_SERVER_PORT, UPDATES_SERVER_INDEX, buff,
-                sizeof(buff), &responseSize) >= 0) {
+    nbUpdateDue = false;
+    sched_trigger(nbUpdateJob, UPDATES_CHECK_INTERVAL);
+    char *buff = (char *)io_lease(IO_HTTP_BODY_SIZE, "update_index");
+    if (!buff)
+        return false;
+    int res = getData(UPDATES_SERVER_IP, UPDATES_SERVER_PORT, UPDATES_SERVER_INDEX, buff,
+                      IO_HTTP_BODY_SIZE, &responseSize);
+    if (res >= 0) {
         ESP_LOGD(TAG, "INDEX: %s", buff);
         ESP_LOGD(TAG, "DATALEN: %d", responseSize);
-        strcpy(updatesServerResponse, buff);
+        strlcpy(updatesServerResponse, buff, sizeof(updatesServerResponse));
+    }
+    io_release(buff);
+    if (res >= 0) {
         if (responseSize <= 0) {
             ESP_LOGD(TAG, "No response from server");
             return false;
         }
         ESP_LOGD(TAG, "Current Version: %s", PROGVERSION);
-        std::string bufferString = std::string(updatesServerResponse);
-        std::size_t found = bufferString.find("\r\n");
-        if (found != std::string::npos) {
-            std::string version = bufferString.substr(0, found);
-            ESP_LOGD(TAG, "Latest Version: %s", version.c_str());
-            if (strcmp(version.c_str(), PROGVERSION) != 0) {
-                ESP_LOGI(TAG, "New Version available: %s", version.c_str());
+        char version[UPD_VERSION_LEN];
+        if (upd_index_version(updatesServerResponse, version, sizeof(version))) {
+            ESP_LOGD(TAG, "Latest Version: %s", version);
+            if (strcmp(version, PROGVERSION) != 0) {
+                ESP_LOGI(TAG, "New Version available: %s", version);
                 return true;
             }
         }
@@ -311,7 +371,10 @@ void nb_send(void *pvParameters) {
             xQueueReceive(NbControlQueue, &controlMessage, portMAX_DELAY);
             manager.set_enabled(controlMessage);
         }
-        delay(100);
+        if (manager.resting())
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(NB_IDLE_POLL_MS));
+        else
+            delay(100);
     }
 }
 
@@ -334,29 +397,48 @@ void NbIotManager::nb_init() {
         this->initializeFailures++;
         return;
     }
-    if (!preConfigModem()) {
-        resetModem();
+    if (!nbBringupMs)
+        nbBringupMs = millis();
+
+    // fast path once per boot, modem may have survived our reset attached
+    bool warm = !nbWarmTried && modemWarm();
+    nbWarmTried = true;
+    if (warm) {
+        this->registered = true;
+        this->connected = true;
+        nb_status_registered = 1;
+        nb_status_connected = 1;
+        if (nbConfig.transport == nb_mqtt)
+            this->mqttConnected = checkMqttConnection();
+        nb_warm_start = true;
+        nbStatusDue = false;
+        sched_trigger(nbStatusJob, NB_STATUS_CHECK_TIME_MS);
+    } else {
         if (!preConfigModem()) {
-            ESP_LOGE(TAG, "Could not preconfig modem");
+            resetModem();
+            if (!preConfigModem()) {
+                ESP_LOGE(TAG, "Could not preconfig modem");
+                this->initializeFailures++;
+                return;
+            }
+        }
+        resetModem();
+        if (!configModem()) {
+            ESP_LOGE(TAG, "Could not config modem");
+            this->initializeFailures++;
+            return;
+        }
+        if (!attachNetwork()) {
+            ESP_LOGE(TAG, "Could not attach network");
             this->initializeFailures++;
             return;
         }
     }
-    resetModem();
-    if (!configModem()) {
-        ESP_LOGE(TAG, "Could not config modem");
-        this->initializeFailures++;
-        return;
-    }
-    if (!attachNetwork()) {
-        ESP_LOGE(TAG, "Could not attach network");
-        this->initializeFailures++;
-        return;
-    }
+    setPowerSaving(nbConfig.power);
     this->initializeFailures = 0;
     initialized = true;
     nb_module_ok = true;
-    this->lastUpdateCheck = millis() - UPDATES_CHECK_INTERVAL;
+    nbUpdateDue = true;
     this->updateReadyToInstall = false;
     nbTransportAvailable = true;
 
@@ -393,8 +475,45 @@ int sendNbMqtt(MessageBuffer_t *message, ConfigBuffer_t *config, char *devEui) {
     doc["data"] = base64;
     doc["deviceName"] = devEui;
     doc["devEUI"] = devEui;
-    serializeJson(doc, messageBuffer);
-    return publishMqtt(topic, messageBuffer, 0);
+    size_t len = serializeJson(doc, messageBuffer);
+    res = publishMqtt(topic, messageBuffer, 0);
+    if (res == 0) {
+        nb_published();
+        // publish segment with mqtt header plus the bare tcp ack of the server
+        nbAirCount(nb_mqtt, 1, message->MessageSize,
+                   NB_TCPIP_HEADER + 4 + strlen(topic) + len + NB_TCPIP_HEADER);
+    }
+    return res;
+}
+
+// one confirmable POST per batch, payload is <port><length><data> per
+// message, the response payload carries a pending remote command, if any
+int sendNbCoap(MessageBuffer_t *messages, int count, ConfigBuffer_t *config, char *devEui) {
+    uint8_t payload[NB_COAP_BATCH * (PAYLOAD_BUFFER_SIZE + 2)];
+    uint8_t resp[PAYLOAD_BUFFER_SIZE];
+    char query[24];
+    size_t len = 0, size = 0;
+
+    for (int i = 0; i < count; i++) {
+        payload[len++] = messages[i].MessagePort;
+        payload[len++] = messages[i].MessageSize;
+        memcpy(payload + len, messages[i].Message, messages[i].MessageSize);
+        len += messages[i].MessageSize;
+        size += messages[i].MessageSize;
+    }
+    snprintf(query, sizeof(query), "d=%s", devEui);
+
+    int res = coapPost(NB_COAP_PATH, query, payload, len, resp, sizeof(resp));
+    if (res < 0) {
+        ESP_LOGE(TAG, "CoAP post of %d messages failed (%d)", count, res);
+        return res;
+    }
+    nb_published();
+    nbAirCount(nb_coap, count, size, 0);
+    ESP_LOGD(TAG, "CoAP posted %d messages, %u bytes", count, len);
+    if (res > 0)
+        rcommand(resp, res);
+    return 0;
 }
 
 void NbIotManager::nb_registerNetwork() {
@@ -423,6 +542,19 @@ void NbIotManager::nb_connectMqtt() {
     return;
 }
 
+void NbIotManager::nb_openCoap() {
+    sprintf(this->devEui, "%02x%02x%02x%02x%02x%02x%02x%02x", DEVEUI[0], DEVEUI[1], DEVEUI[2],
+            DEVEUI[3], DEVEUI[4], DEVEUI[5], DEVEUI[6], DEVEUI[7]);
+    if (coapOpen(nbConfig.ServerAddress, nbConfig.coapPort) == 0) {
+        ESP_LOGD(TAG, "COAP READY");
+        coapReady = true;
+        this->coapFailures = 0;
+    } else {
+        ESP_LOGD(TAG, "COAP SOCKET FAILED");
+        this->coapFailures++;
+    }
+}
+
 void NbIotManager::nb_subscribeMqtt() {
     char topic[64];
     sprintf(topic, "%s/application/%s/device/%s/tx", nbConfig.GatewayId, nbConfig.ApplicationId,
@@ -450,6 +582,9 @@ void NbIotManager::nb_resetStatus() {
     connectFailures = 0;
     mqttConnectFailures = 0;
     subscribeFailures = 0;
+    coapReady = false;
+    coapFailures = 0;
+    coapClose();
 
     nb_status_registered = 0;
     nb_status_connected = 0;
@@ -490,10 +625,10 @@ bool NbIotManager::nb_checkMqttConnected() {
 }
 
 bool NbIotManager::nb_checkStatus() {
-    if (millis() - this->nbLastStatusCheck < NB_STATUS_CHECK_TIME_MS)
+    if (!nbStatusDue)
         return true;
 
-    this->nbLastStatusCheck = millis();
+    nbStatusDue = false;
 
     if (!this->nb_checkNetworkRegister()) {
         this->registered = false;
@@ -505,7 +640,7 @@ bool NbIotManager::nb_checkStatus() {
         ESP_LOGD(TAG, "Network disconnected");
         return false;
     }
-    if (!this->nb_checkMqttConnected()) {
+    if ((nbConfig.transport != nb_coap) && !this->nb_checkMqttConnected()) {
         this->mqttConnected = false;
         this->subscribed = false;
         ESP_LOGD(TAG, "MQTT disconnected");
@@ -526,7 +661,8 @@ if ( this->consecutiveFailures > MAX_CONSECUTIVE_FAILURES  ||
      this->registerFailures    > MAX_REGISTER_FAILURES     ||
      this->connectFailures     > MAX_CONNECT_FAILURES      ||
      this->mqttConnectFailures > MAX_MQTT_CONNECT_FAILURES ||
-     this->subscribeFailures   > MAX_MQTT_SUBSCRIBE_FAILURES ) {
+     this->subscribeFailures   > MAX_MQTT_SUBSCRIBE_FAILURES ||
+     this->coapFailures        > MAX_COAP_OPEN_FAILURES ) {
 
     ESP_LOGE(TAG, "Too many consecutive failures");
     this->nb_resetStatus();
@@ -549,31 +685,66 @@ if ( this->consecutiveFailures > MAX_CONSECUTIVE_FAILURES  ||
     return;
 }
 
+    // bring-up steps run back to back, loop is left at the first one failing
     if (!this->initialized) {
         this->nb_init();
-        return;
+        if (!this->initialized)
+            return;
     }
 
 #ifdef UPDATES_ENABLED
+    // first check waits until queued messages had their chance to go out
     bool shouldCheckForUpdates =
-        this->lastUpdateCheck + UPDATES_CHECK_INTERVAL < millis();
+        nbUpdateDue && (nbFirstPublishMs || !uxQueueMessagesWaiting(NbSendQueue));
 #endif
 
     if (!this->registered) {
         this->nb_registerNetwork();
-        return;
+        if (!this->registered)
+            return;
     }
     if (!this->connected) {
         this->nb_connectNetwork();
-        return;
+        if (!this->connected)
+            return;
     }
-    if (!this->mqttConnected) {
-        this->nb_connectMqtt();
-        return;
+    if (nbConfig.transport == nb_coap) {
+        if (!this->coapReady) {
+            this->nb_openCoap();
+            if (!this->coapReady)
+                return;
+        }
+    } else {
+        if (!this->mqttConnected) {
+            this->nb_connectMqtt();
+            if (!this->mqttConnected)
+                return;
+        }
+        if (!this->subscribed) {
+            this->nb_subscribeMqtt();
+            if (!this->subscribed)
+                return;
+        }
     }
-    if (!this->subscribed) {
-        this->nb_subscribeMqtt();
-        return;
+    if (!nbReadyMs) {
+        nbReadyMs = millis();
+        ESP_LOGI(TAG, "NB ready after %u ms (%s start)", nbReadyMs - nbBringupMs,
+                 nb_warm_start ? "warm" : "cold");
+    }
+    if (this->powerSaving() && !nbWindowOpen) {
+        // no status polling between windows, edrx may still deliver downlinks
+        if ((nbConfig.transport != nb_coap) && dataAvailable())
+            this->nb_readMessages();
+        if (!nbWindowDue)
+            return;
+        nbWindowDue = false;
+        nbWindowOpen = true;
+        nbWindowStart = millis();
+        nbStatusDue = true;
+        if (!wakeModem())
+            ESP_LOGW(TAG, "Modem does not wake up");
+        ESP_LOGD(TAG, "NB window open, %u messages queued",
+                 uxQueueMessagesWaiting(NbSendQueue));
     }
     if (!this->nb_checkStatus()) {
         ESP_LOGD(TAG, "NB status changed");
@@ -581,80 +752,133 @@ if ( this->consecutiveFailures > MAX_CONSECUTIVE_FAILURES  ||
     }
 #ifdef UPDATES_ENABLED
     if (shouldCheckForUpdates && this->nb_checkLastSoftwareVersion()) {
-        if (downloadUpdates(std::string(updatesServerResponse))) {
+        if (downloadUpdates(updatesServerResponse)) {
             this->updateReadyToInstall = true;
         } else {
             ESP_LOGD(TAG, "Updates not downloaded, set to retry");
             this->updateReadyToInstall = false;
-            this->lastUpdateCheck = millis() - UPDATES_CHECK_INTERVAL + UPDATES_CHECK_RETRY_INTERVAL;
+            sched_trigger(nbUpdateJob, UPDATES_CHECK_RETRY_INTERVAL);
         }
     }
     if (this->updateReadyToInstall) {
         ESP_LOGD(TAG, "Updates downloaded");
-        if (updateFromFS()) {
-            ESP_LOGD(TAG, "Updates installed");
+        // the gz streamer reads the image in one go, the card stays lent
+        // until it is flashed, csv lines are parked meanwhile
+        if (!sd_borrow()) {
+            ESP_LOGE(TAG, "SD card busy, updates not installed");
         } else {
-            ESP_LOGE(TAG, "Updates installation failed");
-            removeUpdateFiles(std::string(updatesServerResponse));
+            if (updateFromFS()) {
+                ESP_LOGD(TAG, "Updates installed");
+            } else {
+                ESP_LOGE(TAG, "Updates installation failed");
+                removeUpdateFiles(updatesServerResponse);
+            }
+            sd_return();
         }
         sdcardInit();
     }
 #endif
 
-    this->nb_readMessages();
+    if (nbConfig.transport != nb_coap)
+        this->nb_readMessages();
 
     if (uxQueueMessagesWaiting(NbSendQueue) > 0) {
         this->nb_sendMessages();
     }
     this->consecutiveFailures = 0;
+
+    if (nbWindowOpen) {
+        uint32_t open = millis() - nbWindowStart;
+        if ((!uxQueueMessagesWaiting(NbSendQueue) && (open >= NB_WINDOW_LINGER_MS)) ||
+            (open >= NB_WINDOW_MAX_MS)) {
+            nbWindowOpen = false;
+            ESP_LOGD(TAG, "NB window closed after %u ms, %u messages left", open,
+                     uxQueueMessagesWaiting(NbSendQueue));
+        }
+    }
 }
 
-void NbIotManager::nb_sendMessages() {
-    MessageBuffer_t SendBuffer;
-    if (uxQueueMessagesWaiting(NbSendQueue) > 0) {
-        ESP_LOGD(TAG, "NB messages pending, sending");
-        while (uxQueueMessagesWaiting(NbSendQueue) > 0) {
-            xQueueReceive(NbSendQueue, &SendBuffer, portMAX_DELAY);
-            int result = sendNbMqtt(&SendBuffer, &this->nbConfig, this->devEui);
-            if (result == 0) {
-                mqttSendFailures = 0;
-                continue;
-            }
+bool NbIotManager::powerSaving() {
+    return this->initialized && (nbConfig.power != nb_power_on);
+}
 
-ESP_LOGE(TAG, "Could not send MQTT message");
-this->mqttSendFailures++;
-this->mqttPublishFailures++;
-SendBuffer.MessagePrio = prio_high;
+// modem rests until the next window, task may block
+bool NbIotManager::resting() {
+    return this->powerSaving() && !nbWindowOpen && !nbWindowDue;
+}
 
-#if (HAS_LORA)
-  if (LMIC.devaddr && check_queue_available()) {
-    ESP_LOGW(TAG, "NB failed -> moving message to LoRa queue (priority LoRa)");
-    lora_enqueuedata(&SendBuffer);
-    this->mqttPublishFailures = 0;
-    continue;
-  }
+// puts the batch back at the front of the NB queue in its original order,
+// what does not fit goes to SD
+static void nb_putback(MessageBuffer_t *SendBuffer, int count) {
+    for (int i = count - 1; i >= 0; i--) {
+        if (xQueueSendToFront(NbSendQueue, &SendBuffer[i], 0) == pdTRUE)
+            continue;
+#ifdef HAS_SDCARD
+        if (isSDCardAvailable() && sdqueueEnqueue(&SendBuffer[i])) {
+            ESP_LOGW(TAG, "NB failed and NB queue full -> moved to SD persistent queue");
+            continue;
+        }
 #endif
-
-if (this->mqttPublishFailures >= MAX_MQTT_PUBLISH_FAILURES) {
-    ESP_LOGW(TAG, "MQTT publish failures threshold reached (%d), forcing reconnect",
-             this->mqttPublishFailures);
-    this->mqttPublishFailures = 0;
-    this->mqttConnected = false;
-    this->subscribed = false;
-    nb_enqueuedata(&SendBuffer);
-    break;
+        ESP_LOGE(TAG, "NB failed and NB queue full -> message lost (port=%u)",
+                 SendBuffer[i].MessagePort);
+    }
 }
 
-if (!nb_enqueuedata(&SendBuffer)) {
-#ifdef HAS_SDCARD
-  if (isSDCardAvailable()) {
-    sdqueueEnqueue(&SendBuffer);
-    ESP_LOGW(TAG, "NB failed and NB queue full -> moved to SD persistent queue");
-  }
+// batch could not be sent: LoRa, NB queue again or SD, counts as one
+// failure. Returns false if the send loop has to stop because the transport
+// is reconnected
+bool NbIotManager::nb_requeue(MessageBuffer_t *SendBuffer, int count) {
+    ESP_LOGE(TAG, "Could not send %d NB message(s)", count);
+    this->mqttSendFailures++;
+    this->mqttPublishFailures++;
+
+#if (HAS_LORA)
+    if (LMIC.devaddr && check_queue_available()) {
+        ESP_LOGW(TAG, "NB failed -> moving messages to LoRa queue (priority LoRa)");
+        for (int i = 0; i < count; i++)
+            lora_enqueuedata(&SendBuffer[i]);
+        this->mqttPublishFailures = 0;
+        return true;
+    }
 #endif
+
+    nb_putback(SendBuffer, count);
+    if (this->mqttPublishFailures >= MAX_MQTT_PUBLISH_FAILURES) {
+        ESP_LOGW(TAG, "NB publish failures threshold reached (%d), forcing reconnect",
+                 this->mqttPublishFailures);
+        this->mqttPublishFailures = 0;
+        if (nbConfig.transport == nb_coap) {
+            coapClose();
+            this->coapReady = false;
+        } else {
+            this->mqttConnected = false;
+            this->subscribed = false;
+        }
+        return false;
+    }
+    return true;
 }
-continue;
 
+void NbIotManager::nb_sendMessages() {
+    MessageBuffer_t SendBuffer[NB_COAP_BATCH];
+    if (uxQueueMessagesWaiting(NbSendQueue) > 0) {
+        ESP_LOGD(TAG, "NB messages pending, sending");
+        while (uxQueueMessagesWaiting(NbSendQueue) > 0) {
+            // mqtt publishes one message, coap posts a batch
+            int count = 0;
+            int batch = (nbConfig.transport == nb_coap) ? NB_COAP_BATCH : 1;
+            while ((count < batch) &&
+                   (xQueueReceive(NbSendQueue, &SendBuffer[count], 0) == pdTRUE))
+                count++;
+            int result = (nbConfig.transport == nb_coap)
+                             ? sendNbCoap(SendBuffer, count, &this->nbConfig, this->devEui)
+                             : sendNbMqtt(SendBuffer, &this->nbConfig, this->devEui);
+            if (result == 0) {
+                mqttSendFailures = 0;
+                continue;
+            }
+            if (!this->nb_requeue(SendBuffer, count))
+                break;
         }
     }
 
@@ -666,40 +890,47 @@ continue;
 
 void NbIotManager::nb_readMessages() {
     if (dataAvailable()) {
-        char data[2048];
-        int bytesRead = readMqttSubData(data, sizeof(data));
+        char *data = (char *)io_lease(IO_ARENA_MEDIUM, "mqtt_msg");
+        if (!data)
+            return;
+        int bytesRead = readMqttSubData(data, IO_ARENA_MEDIUM);
         if (bytesRead > 0) {
             ESP_LOGD(TAG, "MQTT message received");
             StaticJsonDocument<1024> doc;
+            // parses in place, strings of doc point into the lease until
+            // it is released below
             DeserializationError error = deserializeJson(doc, data, bytesRead);
-            if (error) {
-                ESP_LOGE(TAG, "DeserializeJson() failed: %s", error.c_str());
-                return;
-            }
             const char *data64 = doc["data"];
-            const unsigned char *dataPtr = reinterpret_cast<const unsigned char *>(data64);
-            ESP_LOGD(TAG, "MQTT message data: %s", data64);
-
-            unsigned int base64_length;
+            size_t base64_length = 0;
             unsigned char base64Decoded[64];
-            int res = mbedtls_base64_decode(base64Decoded, sizeof(base64Decoded), &base64_length,
-                                           dataPtr, strlen(data64));
-            if (base64Decoded == NULL) {
-                ESP_LOGE(TAG, "base64_decode() failed");
-                return;
-            }
-            if (bytesRead > 0) {
-                rcommand((uint8_t *)base64Decoded, base64_length);
+            if (error) {
+                ESP_LOGE(TAG, "DeserializeJson() failed: %s", error.c_str());
+            } else if (data64 == NULL) {
+                ESP_LOGE(TAG, "MQTT message without data");
+            } else {
+                ESP_LOGD(TAG, "MQTT message data: %s", data64);
+                int res = mbedtls_base64_decode(
+                    base64Decoded, sizeof(base64Decoded), &base64_length,
+                    reinterpret_cast<const unsigned char *>(data64), strlen(data64));
+                if (res != 0)
+                    ESP_LOGE(TAG, "base64_decode() failed with code %d", res);
+                else
+                    rcommand((uint8_t *)base64Decoded, base64_length);
             }
         } else {
             ESP_LOGE(TAG, "MQTT message read failed with code %d", bytesRead);
         }
+        io_release(data);
     }
 }
 
 esp_err_t nb_iot_init() {
     assert(NB_QUEUE_SIZE);
-    NbSendQueue = xQueueCreate(NB_QUEUE_SIZE, sizeof(MessageBuffer_t));
+    NbSendQueue = mem_queue_create(MEM_QUEUE_NBSEND);
+    if (io_arena_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Could not carve NBIOT i/o arena. Aborting.");
+        return ESP_FAIL;
+    }
     NbControlQueue = xQueueCreate(2, sizeof(int));
     if (NbSendQueue == 0) {
         ESP_LOGE(TAG, "Could not create NBIOT send queue. Aborting.");
@@ -708,9 +939,14 @@ esp_err_t nb_iot_init() {
     ESP_LOGI(TAG, "NBIOT send queue created, size %d Bytes", SEND_QUEUE_SIZE * sizeof(MessageBuffer_t));
     initModem();
 
+    nbStatusJob = sched_add("nbstatus", nb_statusdue, NB_STATUS_CHECK_TIME_MS,
+                            NB_STATUS_CHECK_TIME_MS / 10, 1);
+    nbUpdateJob = sched_add("nbupdate", nb_updatedue, UPDATES_CHECK_INTERVAL,
+                            UPDATES_CHECK_RETRY_INTERVAL, 1);
+
     ESP_LOGI(TAG, "Starting NBIOT TASK...");
     lastMessage = millis();
-    xTaskCreatePinnedToCore(nb_send, "nbtask", 16384, (void *)1, 1, &nbIotTask, 1);
+    mem_task_create(MEM_TASK_NB, nb_send, (void *)1, 1, &nbIotTask, 1);
     return ESP_OK;
 }
 
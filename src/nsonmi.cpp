@@ -0,0 +1,79 @@
+/* nsonmi turns the receive output of a BC95 socket into a byte stream for
+the http parser, see include/nsonmi.h. Each character is looked at once,
+decoded bytes are passed on in small batches. */
+
+#include "nsonmi.h"
+
+#include <stdio.h>
+#include <string.h>
+
+void nsonmi_init(nsonmi_scan_t *s, int socket) {
+  memset(s, 0, sizeof(*s));
+  s->socket = socket;
+  s->nibble = -1;
+}
+
+int nsonmi_hex(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return -1;
+}
+
+static int scanFlush(nsonmi_scan_t *s, http_stream_t *hs) {
+  int res = HTTP_STREAM_MORE;
+  if (s->outlen && s->mine)
+    res = http_stream_feed(hs, s->out, s->outlen);
+  s->outlen = 0;
+  return res;
+}
+
+int nsonmi_feed(nsonmi_scan_t *s, char c, http_stream_t *hs) {
+  int res, sock, len;
+
+  if (s->data) {
+    int v = nsonmi_hex(c);
+    if (v >= 0) {
+      if (s->nibble < 0) {
+        s->nibble = v;
+        return HTTP_STREAM_MORE;
+      }
+      s->out[s->outlen++] = (s->nibble << 4) | v;
+      s->nibble = -1;
+      s->got++;
+      return (s->outlen == sizeof(s->out)) ? scanFlush(s, hs)
+                                           : HTTP_STREAM_MORE;
+    }
+    // end of segment
+    res = scanFlush(s, hs);
+    s->data = false;
+    s->headlen = 0;
+    if (s->mine && (s->got != s->expected))
+      return NSONMI_SIZE;
+    return res;
+  }
+
+  if ((c == '\r') || (c == '\n')) {
+    s->head[s->headlen] = 0;
+    s->headlen = 0;
+    if ((sscanf(s->head, "+NSOCLI:%d", &sock) == 1) && (sock == s->socket))
+      return http_stream_close(hs);
+    return HTTP_STREAM_MORE;
+  }
+
+  if (s->headlen < sizeof(s->head) - 1)
+    s->head[s->headlen++] = c;
+  s->head[s->headlen] = 0;
+  // hex data follows second comma
+  if ((c == ',') && (sscanf(s->head, "+NSONMI:%d,%d,", &sock, &len) == 2)) {
+    s->data = true;
+    s->mine = (sock == s->socket);
+    s->expected = len;
+    s->got = 0;
+    s->nibble = -1;
+  }
+  return HTTP_STREAM_MORE;
+}
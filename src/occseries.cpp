@@ -0,0 +1,173 @@
+/* occseries keeps unique device counts of the last hours and days in ring
+buffers of fixed size. A minute stores the exact uniques per sniff type from
+its hash set, the same number a send cycle of one minute counts. Quarter
+hours and hours are not sums of minutes: the HyperLogLog sketch of every
+closed minute is merged (register maximum) into the open quarter and hour
+sketches, so their estimate is that of all samples of the bucket. */
+
+#include <math.h>
+#include <string.h>
+
+#include "occseries.h"
+
+const uint8_t occ_level_min[OCC_LEVELS] = {1, 15, 60};
+
+// fnv-1a over the mac, keyed, then the murmur3 finalizer
+uint32_t occ_hash(const uint8_t *mac, uint32_t key) {
+  uint32_t h = 0x811C9DC5 ^ key;
+  for (int i = 0; i < 6; i++)
+    h = (h ^ mac[i]) * 0x01000193;
+  h ^= h >> 16;
+  h *= 0x85EBCA6B;
+  h ^= h >> 13;
+  h *= 0xC2B2AE35;
+  h ^= h >> 16;
+  return h;
+}
+
+// register: position of the first set bit of the remaining hash bits
+void occ_sketch_add(occ_sketch_t *s, uint8_t type, uint32_t hash) {
+  uint32_t idx = hash >> (32 - OCC_HLL_BITS);
+  uint32_t w = hash << OCC_HLL_BITS;
+  uint8_t rank = w ? __builtin_clz(w) + 1 : 32 - OCC_HLL_BITS + 1;
+  if (rank > s->reg[type][idx])
+    s->reg[type][idx] = rank;
+}
+
+void occ_sketch_merge(occ_sketch_t *dst, const occ_sketch_t *src) {
+  for (int t = 0; t < OCC_TYPES; t++)
+    for (int i = 0; i < OCC_REGS; i++)
+      if (src->reg[t][i] > dst->reg[t][i])
+        dst->reg[t][i] = src->reg[t][i];
+}
+
+// raw estimate, linear counting while registers are still empty
+uint16_t occ_sketch_estimate(const occ_sketch_t *s, uint8_t type) {
+  const float m = OCC_REGS;
+  float sum = 0;
+  int zeros = 0;
+  for (int i = 0; i < OCC_REGS; i++) {
+    sum += ldexpf(1.0f, -s->reg[type][i]);
+    if (!s->reg[type][i])
+      zeros++;
+  }
+  float e = 0.7213f / (1.0f + 1.079f / m) * m * m / sum;
+  if ((e <= 2.5f * m) && zeros)
+    e = m * logf(m / zeros);
+  e += 0.5f;
+  return (e >= OCC_NODATA) ? OCC_NODATA - 1 : (uint16_t)e;
+}
+
+// linear probing, the type goes into the low bits so it is part of the key
+void occ_minute_add(occ_minute_t *m, uint32_t *set, uint8_t type,
+                    uint32_t hash) {
+  uint32_t key = (hash & ~3u) | (type + 1);
+  uint32_t i = (key >> 2) % OCC_MIN_HASHES;
+
+  occ_sketch_add(&m->sketch, type, hash);
+  while (set[i]) {
+    if (set[i] == key)
+      return;
+    i = (i + 1) % OCC_MIN_HASHES;
+  }
+  if (m->used >= OCC_MIN_HASHES / 4 * 3) {
+    m->full = true;
+    return;
+  }
+  set[i] = key;
+  m->used++;
+  m->n[type]++;
+}
+
+static uint16_t (*occ_ring(occ_series_t *ts, uint8_t level,
+                           uint16_t *slots))[OCC_TYPES] {
+  switch (level) {
+  case occ_minute:
+    *slots = OCC_MIN_SLOTS;
+    return ts->minute;
+  case occ_quarter:
+    *slots = OCC_QH_SLOTS;
+    return ts->quarter;
+  default:
+    *slots = OCC_HOUR_SLOTS;
+    return ts->hour;
+  }
+}
+
+// stores bucket no, buckets skipped since the last one get OCC_NODATA
+static void occ_put(occ_series_t *ts, uint8_t level, uint32_t no,
+                    const uint16_t v[OCC_TYPES]) {
+  uint16_t slots;
+  uint16_t(*ring)[OCC_TYPES] = occ_ring(ts, level, &slots);
+  uint32_t last = ts->last[level];
+
+  if (last && (no <= last))
+    return;
+  uint32_t gap = last ? no - last - 1 : slots;
+  if (gap > slots)
+    gap = slots;
+  for (uint32_t i = 1; i <= gap; i++)
+    for (int t = 0; t < OCC_TYPES; t++)
+      ring[(no - i) % slots][t] = OCC_NODATA;
+  memcpy(ring[no % slots], v, sizeof(ring[0]));
+  ts->last[level] = no;
+}
+
+static void occ_close_open(occ_series_t *ts, uint8_t level) {
+  occ_sketch_t *s = &ts->open[level - 1];
+  uint16_t v[OCC_TYPES];
+  for (int t = 0; t < OCC_TYPES; t++)
+    v[t] = occ_sketch_estimate(s, t);
+  occ_put(ts, level, ts->openNo[level], v);
+  memset(s, 0, sizeof(*s));
+  ts->openNo[level] = 0;
+}
+
+void occ_series_reset(occ_series_t *ts) { memset(ts, 0, sizeof(*ts)); }
+
+bool occ_series_close(occ_series_t *ts, uint32_t minute,
+                      const occ_minute_t *m) {
+  uint32_t last = ts->last[occ_minute];
+  if (last && (minute <= last)) {
+    // clock went back by more than the minute ring, start over
+    if (last - minute < OCC_MIN_SLOTS)
+      return false;
+    occ_series_reset(ts);
+  }
+
+  uint16_t v[OCC_TYPES];
+  for (int t = 0; t < OCC_TYPES; t++) {
+    v[t] = m->n[t];
+    if (m->full && (occ_sketch_estimate(&m->sketch, t) > v[t]))
+      v[t] = occ_sketch_estimate(&m->sketch, t);
+  }
+  occ_put(ts, occ_minute, minute, v);
+
+  for (uint8_t level = occ_quarter; level < OCC_LEVELS; level++) {
+    uint32_t no = minute / occ_level_min[level];
+    if (ts->openNo[level] && (ts->openNo[level] != no))
+      occ_close_open(ts, level); // its last minutes are missing
+    occ_sketch_merge(&ts->open[level - 1], &m->sketch);
+    ts->openNo[level] = no;
+    if ((minute + 1) % occ_level_min[level] == 0)
+      occ_close_open(ts, level);
+  }
+  return true;
+}
+
+void occ_series_query(const occ_series_t *ts, uint8_t level, uint32_t first,
+                      uint8_t n, uint16_t (*out)[OCC_TYPES]) {
+  uint16_t slots;
+  const uint16_t(*ring)[OCC_TYPES] =
+      occ_ring((occ_series_t *)ts, level, &slots);
+  uint32_t last = ts->last[level];
+
+  for (uint8_t i = 0; i < n; i++) {
+    uint32_t no = first + i;
+    if (!last || (no > last) || (last - no >= slots))
+      for (int t = 0; t < OCC_TYPES; t++)
+        out[i][t] = OCC_NODATA;
+    else
+      memcpy(out[i], ring[no % slots], sizeof(out[0]));
+  }
+}
@@ -0,0 +1,234 @@
+/* occupancy feeds the occupancy time series of occseries.cpp. Sniffed MACs
+go into the hash set and sketch of the current minute, kept by minute
+parity, so the scheduler job can close a minute while the next one is
+filled. The hash key is a secret drawn at boot and changes every hour; hash
+sets and sketches hold no MAC related data beyond that hour. After every
+quarter hour the series is copied and written to the SD card by the sd
+service, it is restored from there when the card is mounted at boot. */
+
+// Basic Config
+#include "globals.h"
+#include "occupancy.h"
+#include <rom/crc.h>
+
+#if (OCCUPANCY_SERIES)
+
+#ifdef HAS_SDCARD
+#include "sdcard.h"
+#endif
+
+// Local logging tag
+static const char TAG[] = "occ";
+
+typedef struct {
+  uint32_t magic;
+  uint32_t len; // sizeof(occ_series_t) of the writer
+  uint32_t crc; // crc32_le over the series
+} occFileHdr_t;
+
+static occ_series_t occ;         // closed buckets, guarded by occMutex
+static occ_minute_t occMin[2];   // open minutes, guarded by occMux
+static uint32_t occMinSet[2][OCC_MIN_HASHES]; // their hash sets, same
+static uint32_t occMinNo[2] = {0, 0};
+static uint32_t occKey = 0;
+static uint32_t occLastTick = 0; // newest minute the job has closed
+static SemaphoreHandle_t occMutex = NULL;
+static portMUX_TYPE occMux = portMUX_INITIALIZER_UNLOCKED;
+
+static struct {
+  uint32_t samples;
+  uint32_t dropped; // minutes overwritten before the job closed them
+  uint32_t minutes, checkpoints, failed;
+} occStats;
+
+// any task, counts a sighting in the current minute
+void occ_add(uint8_t type, const uint8_t *mac) {
+  time_t t = now();
+  if ((type >= OCC_TYPES) || !occMutex || !timeIsValid(t))
+    return;
+
+  uint32_t minute = t / 60;
+  uint32_t h = occ_hash(mac, occKey ^ (minute / 60));
+  uint8_t i = minute & 1;
+
+  portENTER_CRITICAL(&occMux);
+  if (occMinNo[i] != minute) {
+    if (occMinNo[i])
+      occStats.dropped++;
+    memset(&occMin[i], 0, sizeof(occMin[i]));
+    memset(occMinSet[i], 0, sizeof(occMinSet[i]));
+    occMinNo[i] = minute;
+  }
+  occ_minute_add(&occMin[i], occMinSet[i], type, h);
+  occStats.samples++;
+  portEXIT_CRITICAL(&occMux);
+}
+
+#ifdef HAS_SDCARD
+// runs on the sd service task, owns and frees buf
+static int occ_card_save(void *arg) {
+  uint8_t *buf = (uint8_t *)arg;
+  int ret = -1;
+  FileMySD f = mySD.open(OCC_FILE_NAME, FILE_WRITE);
+  if (f) {
+    uint32_t n = sizeof(occFileHdr_t) + sizeof(occ_series_t);
+    // same size every time, rewritten in place
+    if (f.seek(0) && (f.write(buf, n) == n))
+      ret = 0;
+    f.close();
+  }
+  free(buf);
+  return ret;
+}
+
+static void occ_saved(int result, void *ctx) {
+  if (result == 0)
+    occStats.checkpoints++;
+  else
+    occStats.failed++;
+}
+
+static void occ_checkpoint(void) {
+  if (!isSDCardAvailable())
+    return;
+  uint8_t *buf = (uint8_t *)malloc(sizeof(occFileHdr_t) + sizeof(occ));
+  if (!buf) {
+    occStats.failed++;
+    return;
+  }
+
+  occFileHdr_t *h = (occFileHdr_t *)buf;
+  xSemaphoreTake(occMutex, portMAX_DELAY);
+  memcpy(buf + sizeof(*h), &occ, sizeof(occ));
+  xSemaphoreGive(occMutex);
+  h->magic = OCC_MAGIC;
+  h->len = sizeof(occ);
+  h->crc = crc32_le(0, buf + sizeof(*h), sizeof(occ));
+
+  sd_req_t req;
+  req.type = sd_req_call;
+  req.done = occ_saved;
+  req.ctx = NULL;
+  req.u.call.fn = occ_card_save;
+  req.u.call.arg = buf;
+  if (!sd_post(&req, 0)) {
+    free(buf);
+    occStats.failed++;
+  }
+}
+
+// restores the checkpoint if it is newer than what we have
+void occ_card_load(void) {
+  if (!occMutex)
+    return;
+  FileMySD f = mySD.open(OCC_FILE_NAME, FILE_READ);
+  if (!f)
+    return;
+
+  uint32_t n = sizeof(occFileHdr_t) + sizeof(occ_series_t);
+  uint8_t *buf = (uint8_t *)malloc(n);
+  bool ok = buf && (f.size() == n) && (f.read(buf, n) == (int)n);
+  f.close();
+
+  occFileHdr_t *h = (occFileHdr_t *)buf;
+  occ_series_t *ts = (occ_series_t *)(buf + sizeof(*h));
+  ok = ok && (h->magic == OCC_MAGIC) && (h->len == sizeof(occ_series_t)) &&
+       (h->crc == crc32_le(0, (uint8_t *)ts, sizeof(occ_series_t)));
+  if (ok) {
+    xSemaphoreTake(occMutex, portMAX_DELAY);
+    ok = ts->last[occ_minute] > occ.last[occ_minute];
+    if (ok)
+      memcpy(&occ, ts, sizeof(occ));
+    xSemaphoreGive(occMutex);
+    if (ok)
+      ESP_LOGI(TAG, "Occupancy series restored up to minute %u",
+               occ.last[occ_minute]);
+  } else {
+    ESP_LOGW(TAG, "Occupancy checkpoint %s not readable, ignored",
+             OCC_FILE_NAME);
+  }
+  free(buf);
+}
+#endif
+
+// scheduler job, closes every elapsed minute, empty ones count zero
+static void occ_tick(void) {
+  time_t t = now();
+  if (!timeIsValid(t))
+    return;
+
+  uint32_t minute = t / 60;
+  // first run, or the clock was set: skipped minutes become OCC_NODATA
+  if (!occLastTick || (minute <= occLastTick) ||
+      (minute - occLastTick > OCC_MIN_SLOTS))
+    occLastTick = minute - 2;
+
+  for (uint32_t m = occLastTick + 1; m < minute; m++) {
+    static occ_minute_t s; // job task only, keeps it off the stack
+    uint8_t i = m & 1;
+
+    portENTER_CRITICAL(&occMux);
+    if (occMinNo[i] == m) {
+      memcpy(&s, &occMin[i], sizeof(s));
+      occMinNo[i] = 0;
+    } else {
+      memset(&s, 0, sizeof(s));
+    }
+    portEXIT_CRITICAL(&occMux);
+
+    xSemaphoreTake(occMutex, portMAX_DELAY);
+    if (occ_series_close(&occ, m, &s))
+      occStats.minutes++;
+    xSemaphoreGive(occMutex);
+
+#ifdef HAS_SDCARD
+    if ((m + 1) % occ_level_min[occ_quarter] == 0)
+      occ_checkpoint();
+#endif
+  }
+  occLastTick = minute - 1;
+}
+
+esp_err_t occ_init(void) {
+  occ_series_reset(&occ);
+  occKey = esp_random();
+  occMutex = xSemaphoreCreateMutex();
+  if (!occMutex)
+    return ESP_FAIL;
+  if (sched_add("occupancy", occ_tick, OCC_TICK_MS, OCC_TICK_MS / 2, 1) < 0)
+    return ESP_FAIL;
+  ESP_LOGI(TAG, "Occupancy series %u bytes, %u/%u/%u buckets",
+           sizeof(occ) + sizeof(occMin) + sizeof(occMinSet), OCC_MIN_SLOTS,
+           OCC_QH_SLOTS, OCC_HOUR_SLOTS);
+  return ESP_OK;
+}
+
+// n buckets of level starting with the one holding epoch from, returns the
+// number copied and in *first the bucket number of out[0]
+uint8_t occ_query(uint8_t level, uint32_t from, uint8_t n, uint32_t *first,
+                  uint16_t (*out)[OCC_TYPES]) {
+  if ((level >= OCC_LEVELS) || !occMutex)
+    return 0;
+  if (n > OCC_QUERY_MAX)
+    n = OCC_QUERY_MAX;
+  *first = from / (60UL * occ_level_min[level]);
+  xSemaphoreTake(occMutex, portMAX_DELAY);
+  occ_series_query(&occ, level, *first, n, out);
+  xSemaphoreGive(occMutex);
+  return n;
+}
+
+void occ_print_stats(void) {
+  uint16_t v[1][OCC_TYPES];
+  xSemaphoreTake(occMutex, portMAX_DELAY);
+  occ_series_query(&occ, occ_minute, occ.last[occ_minute], 1, v);
+  xSemaphoreGive(occMutex);
+  ESP_LOGD(TAG,
+           "%u samples, %u minutes closed, %u dropped, %u checkpoints, %u "
+           "failed | last minute wifi %u ble %u bt %u",
+           occStats.samples, occStats.minutes, occStats.dropped,
+           occStats.checkpoints, occStats.failed, v[0][MAC_SNIFF_WIFI],
+           v[0][MAC_SNIFF_BLE], v[0][MAC_SNIFF_BT]);
+}
+
+#endif // OCCUPANCY_SERIES
@@ -103,6 +103,7 @@ end:
   ESP_LOGI(TAG, "Rebooting to %s firmware", (ret == 0) ? "new" : "current");
   ota_display(5, "**", ""); // mark line rebooting
   delay(5000);
+  crash_reset(ct_rst_ota);
   do_reset(false);
 
 } // start_ota_update
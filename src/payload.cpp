@@ -90,17 +90,19 @@ void PayloadConvert::addConfig(configData_t value) {
   cursor += 10;
 }
 
-// === ADEMUX: addStatus extendido a 19 bytes ===
+// === ADEMUX: addStatus extendido a 21 bytes ===
 // Offset 14: nb_rsrp (antes nb_rssi/CSQ) — encoding: (-rsrp_dBm)-44, 0xFF=N/A
 // Offset 17: nb_snr  — encoding: snr_dB+20, 0xFF=N/A
 // Offset 18: nb_ecl  — directo 0/1/2, 0xFF=N/A
+// Offset 19-20: nb_ttfp — tiempo hasta primer envío NB [100 ms], 0xFFFF=N/A
 void PayloadConvert::addStatus(uint32_t uptime, uint8_t cputemp,
                                uint16_t free_heap_div16, uint16_t min_heap_div16,
                                uint8_t reset_reason, uint8_t flags1, uint8_t flags2,
                                uint8_t lora_rssi, int8_t lora_snr,
                                uint8_t nb_rsrp, uint8_t nb_failures,
                                uint8_t flags3,
-                               uint8_t nb_snr_encoded, uint8_t nb_ecl) {
+                               uint8_t nb_snr_encoded, uint8_t nb_ecl,
+                               uint16_t nb_ttfp) {
   // Offset 0-3: uptime (uint32, big-endian)
   buffer[cursor++] = (byte)((uptime & 0xFF000000) >> 24);
   buffer[cursor++] = (byte)((uptime & 0x00FF0000) >> 16);
@@ -134,6 +136,9 @@ void PayloadConvert::addStatus(uint32_t uptime, uint8_t cputemp,
   buffer[cursor++] = nb_snr_encoded;
   // Offset 18: nb_ecl — 0/1/2 directo, 0xFF=N/A
   buffer[cursor++] = nb_ecl;
+  // Offset 19-20: nb_ttfp — tiempo hasta primer envío NB [100 ms], 0xFFFF=N/A
+  buffer[cursor++] = highByte(nb_ttfp);
+  buffer[cursor++] = lowByte(nb_ttfp);
 }
 
 void PayloadConvert::addGPS(gpsStatus_t value) {
@@ -236,14 +241,15 @@ void PayloadConvert::addConfig(configData_t value) {
   writeVersion(value.version);
 }
 
-// === ADEMUX: addStatus extendido a 19 bytes ===
+// === ADEMUX: addStatus extendido a 21 bytes ===
 void PayloadConvert::addStatus(uint32_t uptime, uint8_t cputemp,
                                uint16_t free_heap_div16, uint16_t min_heap_div16,
                                uint8_t reset_reason, uint8_t flags1, uint8_t flags2,
                                uint8_t lora_rssi, int8_t lora_snr,
                                uint8_t nb_rsrp, uint8_t nb_failures,
                                uint8_t flags3,
-                               uint8_t nb_snr_encoded, uint8_t nb_ecl) {
+                               uint8_t nb_snr_encoded, uint8_t nb_ecl,
+                               uint16_t nb_ttfp) {
   writeUint32(uptime);           // 0-3
   writeUint8(cputemp);           // 4
   writeUint16(free_heap_div16);  // 5-6
@@ -258,6 +264,7 @@ void PayloadConvert::addStatus(uint32_t uptime, uint8_t cputemp,
   writeUint8(flags3);            // 16
   writeUint8(nb_snr_encoded);    // 17 nuevo
   writeUint8(nb_ecl);            // 18 nuevo
+  writeUint16(nb_ttfp);          // 19-20 tiempo primer envío NB [100 ms]
 }
 
 void PayloadConvert::addGPS(gpsStatus_t value) {
@@ -419,7 +426,8 @@ void PayloadConvert::addStatus(uint32_t uptime, uint8_t cputemp,
                                uint8_t lora_rssi, int8_t lora_snr,
                                uint8_t nb_rsrp, uint8_t nb_failures,
                                uint8_t flags3,
-                               uint8_t nb_snr_encoded, uint8_t nb_ecl) {
+                               uint8_t nb_snr_encoded, uint8_t nb_ecl,
+                               uint16_t nb_ttfp) {
   // Cayenne LPP solo envía temperatura; datos completos van en raw por TELEMETRYPORT
   uint16_t temp = (uint16_t)cputemp * 10;
 #if (PAYLOAD_ENCODER == 3)
@@ -51,6 +51,7 @@ void set_reset(uint8_t val[]) {
   switch (val[0]) {
   case 0:
     ESP_LOGI(TAG, "Remote command: restart device cold");
+    crash_reset(ct_rst_remote);
     do_reset(false);
     break;
   case 1:
@@ -68,6 +69,7 @@ void set_reset(uint8_t val[]) {
     break;
   case 4:
     ESP_LOGI(TAG, "Remote command: restart device warm");
+    crash_reset(ct_rst_remote);
     do_reset(true);
     break;
   case 9:
@@ -109,8 +111,7 @@ void get_userSalt(uint8_t val[]) {
 
 void set_sendcycle(uint8_t val[]) {
   cfg.sendcycle = val[0] * 256 + val[1];
-  sendcycler.detach();
-  sendcycler.attach(cfg.sendcycle * 2, sendcycle);
+  sched_set_period(sendcycleJob, cfg.sendcycle * 2 * 1000);
   ESP_LOGI(TAG, "Remote command: set send cycle to %d seconds", cfg.sendcycle * 2);
 }
 
@@ -143,6 +144,10 @@ void set_countmode(uint8_t val[]) {
     cfg.countermode = 2;
     ESP_LOGI(TAG, "Remote command: set counter mode to cyclic confirmed");
     break;
+  case COUNTER_SLIDING:
+    cfg.countermode = COUNTER_SLIDING;
+    ESP_LOGI(TAG, "Remote command: set counter mode to sliding window");
+    break;
   default:
     ESP_LOGW(TAG, "Remote command: set counter mode called with invalid parameter(s)");
     return;
@@ -358,6 +363,7 @@ void get_status(uint8_t val[]) {
   uint8_t nb_snr_encoded  = 0xFF;
   uint8_t nb_ecl_val      = 0xFF;
   uint8_t nb_failures     = 0;
+  uint16_t nb_ttfp_val    = 0xFFFF;
 #if (HAS_NBIOT)
   if (nb_status_rsrp != 127) {
     int rsrp_abs = -((int)nb_status_rsrp);
@@ -371,6 +377,7 @@ void get_status(uint8_t val[]) {
   }
   nb_ecl_val  = nb_status_ecl;
   nb_failures = nb_status_failures;
+  nb_ttfp_val = nb_ttfp;
 #endif
 
   uint8_t flags3 = 0;
@@ -392,7 +399,7 @@ void get_status(uint8_t val[]) {
                     reset_reason, flags1, flags2,
                     lora_rssi, lora_snr,
                     nb_rsrp_encoded, nb_failures, flags3,
-                    nb_snr_encoded, nb_ecl_val);
+                    nb_snr_encoded, nb_ecl_val, nb_ttfp_val);
   send_response_direct(STATUSPORT, prio_high);
 };
 
@@ -543,6 +550,169 @@ void set_nb_port(uint8_t val[]) {
   sdSaveNbConfig(&conf);
 };
 
+// 0 = MQTT, 1 = CoAP, used from next NB initialization on
+void set_nb_transport(uint8_t val[]) {
+  ESP_LOGI(TAG, "Remote command: set_nb_transport");
+  ConfigBuffer_t conf;
+  sdLoadNbConfig(&conf);
+  conf.transport = val[0] ? nb_coap : nb_mqtt;
+  ESP_LOGI(TAG, "Setting NB transport to: %s", val[0] ? "CoAP" : "MQTT");
+  sdSaveNbConfig(&conf);
+};
+
+// 0 = always on, 1 = PSM, 2 = eDRX, used from next NB initialization on
+void set_nb_power(uint8_t val[]) {
+  static const char *names[] = {"on", "PSM", "eDRX"};
+  ESP_LOGI(TAG, "Remote command: set_nb_power");
+  if (val[0] > nb_power_edrx) {
+    ESP_LOGW(TAG, "Unknown NB power mode %u", val[0]);
+    return;
+  }
+  ConfigBuffer_t conf;
+  sdLoadNbConfig(&conf);
+  conf.power = (nbpower_t)val[0];
+  ESP_LOGI(TAG, "Setting NB power mode to: %s", names[val[0]]);
+  sdSaveNbConfig(&conf);
+};
+
+void set_slidewindow(uint8_t val[]) {
+  if ((val[0] < 1) || (val[0] >= SLIDE_HIST)) {
+    ESP_LOGW(TAG, "Remote command: sliding window %u minutes out of range",
+             val[0]);
+    return;
+  }
+  cfg.slidewindow = val[0];
+  ESP_LOGI(TAG, "Remote command: set sliding window to %u minutes",
+           cfg.slidewindow);
+}
+
+// answers one frame per 6 budget entries: 0x8C, frame, entries total, then per
+// entry id, size and peak (tasks/buffers bytes, queues items), 3 bytes each,
+// MSB first
+void get_membudget(uint8_t val[]) {
+  ESP_LOGI(TAG, "Remote command: get memory budget");
+  const uint8_t perframe = (PAYLOAD_BUFFER_SIZE - 3) / 7;
+
+  for (uint8_t i = 0; i < MEM_BUDGET_COUNT; i += perframe) {
+    payload.reset();
+    payload.addByte(0x8C);
+    payload.addByte(i / perframe);
+    payload.addByte(MEM_BUDGET_COUNT);
+    for (uint8_t id = i; (id < i + perframe) && (id < MEM_BUDGET_COUNT); id++) {
+      uint32_t size = mem_budget_size((mem_id_t)id);
+      int32_t peak = mem_budget_peak((mem_id_t)id);
+      uint32_t used = (peak < 0) ? 0xFFFFFF : min((uint32_t)peak, (uint32_t)0xFFFFFE);
+      size = min(size, (uint32_t)0xFFFFFE);
+      payload.addByte(id);
+      payload.addByte(size >> 16);
+      payload.addByte((size >> 8) & 0xFF);
+      payload.addByte(size & 0xFF);
+      payload.addByte(used >> 16);
+      payload.addByte((used >> 8) & 0xFF);
+      payload.addByte(used & 0xFF);
+    }
+    send_response_direct(RCMDPORT, prio_high);
+  }
+}
+
+#if (TASKSTATS)
+// answers one frame per 4 tasks: 0x8E, frame, tasks total, then the report
+// block of taskstats.h, busiest task first
+void get_taskstats(uint8_t val[]) {
+  ESP_LOGI(TAG, "Remote command: get task stats");
+  const uint8_t perframe =
+      (PAYLOAD_BUFFER_SIZE - 3 - TASKSTAT_HEAD) / TASKSTAT_ENTRY;
+  uint8_t total = taskstat_count();
+  uint8_t i = 0;
+  do {
+    payload.reset();
+    payload.addByte(0x8E);
+    payload.addByte(i / perframe);
+    payload.addByte(total);
+    i += taskstat_add(i, perframe);
+    send_response_direct(RCMDPORT, prio_high);
+  } while (i < total);
+}
+#endif
+
+#if (LATENCY_PROBES)
+// answers per probe one or more frames: 0x8F, probe, probes total, cpu MHz,
+// count, max cycles, first bucket, n, then n buckets (2 bytes, saturated).
+// Parameter 1 clears the histograms after sending
+void get_latency(uint8_t val[]) {
+  ESP_LOGI(TAG, "Remote command: get latency histograms");
+  const uint8_t perframe = (PAYLOAD_BUFFER_SIZE - 14) / 2;
+  lat_hist_t h;
+
+  for (uint8_t id = 0; id < LAT_PROBES; id++) {
+    lat_get((lat_id_t)id, &h);
+    uint8_t first = 0, last = LAT_BUCKETS - 1;
+    while ((first < last) && !h.bucket[first])
+      first++;
+    while ((last > first) && !h.bucket[last])
+      last--;
+
+    for (uint8_t b = first; b <= last; b += perframe) {
+      uint8_t n = min((uint8_t)(last + 1 - b), perframe);
+      payload.reset();
+      payload.addByte(0x8F);
+      payload.addByte(id);
+      payload.addByte(LAT_PROBES);
+      payload.addByte(getCpuFrequencyMhz());
+      for (int s = 24; s >= 0; s -= 8)
+        payload.addByte(h.count >> s);
+      for (int s = 24; s >= 0; s -= 8)
+        payload.addByte(h.max >> s);
+      payload.addByte(b);
+      payload.addByte(n);
+      for (uint8_t i = b; i < b + n; i++) {
+        uint16_t v = min(h.bucket[i], (uint32_t)0xFFFF);
+        payload.addByte(v >> 8);
+        payload.addByte(v & 0xFF);
+      }
+      send_response_direct(RCMDPORT, prio_high);
+    }
+  }
+  if (val[0] == 1)
+    lat_reset();
+}
+#endif
+
+#if (OCCUPANCY_SERIES)
+// answers one frame per 7 buckets: 0x8D, level, epoch of the first bucket,
+// number of buckets, then per bucket wifi, ble and bt uniques
+void get_occupancy(uint8_t val[]) {
+  uint32_t from = ((uint32_t)val[1] << 24) | ((uint32_t)val[2] << 16) |
+                  ((uint32_t)val[3] << 8) | val[4];
+  ESP_LOGI(TAG, "Remote command: get occupancy level %d from %u, %d buckets",
+           val[0], from, val[5]);
+  const uint8_t perframe = (PAYLOAD_BUFFER_SIZE - 7) / (2 * OCC_TYPES);
+  static uint16_t v[OCC_QUERY_MAX][OCC_TYPES];
+  uint32_t first;
+  uint8_t n = occ_query(val[0], from, val[5], &first, v);
+  uint32_t len = 60UL * occ_level_min[val[0] < OCC_LEVELS ? val[0] : 0];
+
+  for (uint8_t i = 0; i < n; i += perframe) {
+    uint32_t epoch = (first + i) * len;
+    uint8_t k = min((uint8_t)(n - i), perframe);
+    payload.reset();
+    payload.addByte(0x8D);
+    payload.addByte(val[0]);
+    payload.addByte(epoch >> 24);
+    payload.addByte(epoch >> 16);
+    payload.addByte(epoch >> 8);
+    payload.addByte(epoch & 0xFF);
+    payload.addByte(k);
+    for (uint8_t b = i; b < i + k; b++)
+      for (uint8_t t = 0; t < OCC_TYPES; t++) {
+        payload.addByte(v[b][t] >> 8);
+        payload.addByte(v[b][t] & 0xFF);
+      }
+    send_response_direct(RCMDPORT, prio_high);
+  }
+}
+#endif
+
 void set_reset_time(uint8_t val[]) {
   ESP_LOGI(TAG, "Remote command: set_reset_time");
   cfg.resettimer = val[0];
@@ -630,7 +800,8 @@ static cmd_t table[] = {
     {0x1B, set_nb_password, 45, true}, {0x1C, set_nb_app_id, 5, true},
     {0x1D, set_nb_app_name, 31, true}, {0x1E, set_nb_port, 2, true},
     {0x1F, set_nb_gateway_id, 45, true}, {0x20, set_rtc_timestamp, 4, true},
-    {0x21, set_nb_username, 45, true},
+    {0x21, set_nb_username, 45, true}, {0x22, set_nb_transport, 1, true},
+    {0x23, set_nb_power, 1, true}, {0x24, set_slidewindow, 1, true},
 
     {0x80, get_config, 0, false},
     {0x81, get_status, 0, false},
@@ -641,6 +812,16 @@ static cmd_t table[] = {
     {0x87, set_time, 0, false},
     {0x88, get_userSalt, 0, false},
     {0x89, set_reset_time, 1, true},
+    {0x8C, get_membudget, 0, false},
+#if (OCCUPANCY_SERIES)
+    {0x8D, get_occupancy, 6, false},
+#endif
+#if (TASKSTATS)
+    {0x8E, get_taskstats, 0, false},
+#endif
+#if (LATENCY_PROBES)
+    {0x8F, get_latency, 1, false},
+#endif
 
 #if (HAS_NBIOT)
     {0x8A, get_imei, 0, false},
@@ -658,7 +839,6 @@ void rcommand(const uint8_t cmd[], const uint8_t cmdlength) {
     return;
 
   uint8_t foundcmd[cmdlength], cursor = 0;
-  bool storeflag = false;
 
   while (cursor < cmdlength) {
     int i = cmdtablesize;
@@ -668,9 +848,10 @@ void rcommand(const uint8_t cmd[], const uint8_t cmdlength) {
         if ((cursor + table[i].params) <= cmdlength) {
           memmove(foundcmd, cmd + cursor, table[i].params);
           cursor += table[i].params;
-          if (table[i].store)
-            storeflag = true;
           table[i].func(foundcmd);
+          // deferred and coalesced, a following reset command flushes it
+          if (table[i].store)
+            saveConfig();
         } else
           ESP_LOGI(TAG,
                    "Remote command x%02X called with missing parameter(s), skipped",
@@ -684,7 +865,4 @@ void rcommand(const uint8_t cmd[], const uint8_t cmdlength) {
       break;
     }
   }
-
-  if (storeflag)
-    saveConfig();
 }
\ No newline at end of file
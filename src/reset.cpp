@@ -9,6 +9,12 @@ static const char TAG[] = __FILE__;
 RTC_NOINIT_ATTR runmode_t RTC_runmode;
 
 void do_reset(bool warmstart) {
+  flushConfig(); // pending settings of remote commands
+#if (HAS_LORA)
+  // store LMIC session in NVS, restored on next start without join
+  if (RTC_runmode == RUNMODE_NORMAL)
+    lora_session_save(true);
+#endif
   if (warmstart) {
     // store LMIC keys and counters in RTC memory
     ESP_LOGI(TAG, "restarting device (warmstart), keeping runmode %d",
@@ -40,9 +46,7 @@ void do_after_reset(int reason) {
 
   case DEEPSLEEP_RESET: // 0x05 Deep Sleep reset digital core
     RTC_runmode = RUNMODE_WAKEUP;
-#if (HAS_LORA)
-    // to be done: restore LoRaWAN channel configuration and datarate here
-#endif
+    // LoRaWAN session and channel configuration are restored by lmictask
     break;
 
   case SW_RESET:         // 0x03 Software reset digital core
@@ -74,10 +78,13 @@ void enter_deepsleep(const int wakeup_sec, const gpio_num_t wakeup_gpio) {
   if (os_queryTimeCriticalJobs(ms2osticks(10000)))
     return;
 
-    // to be done: save LoRaWAN channel configuration here
+  // save LoRaWAN session incl. channel configuration
+  lora_session_save(true);
 
 #endif
 
+  flushConfig();
+
   // set up power domains
   esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_SLOW_MEM, ESP_PD_OPTION_ON);
 
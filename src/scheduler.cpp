@@ -0,0 +1,367 @@
+/* scheduler runs all periodic jobs of the application from one hierarchical
+timer wheel per cpu core. Jobs declare period, jitter tolerance and core.
+A job with jitter tolerance is filed into an already occupied slot if there is
+one within its tolerance, and moves to a slot occupied later on if that is
+still within its tolerance, so related wakeups are coalesced and the worker
+sleeps longer between events. Due times are kept phase locked to the start
+time of a job, so run time and lateness do not accumulate to drift. */
+
+// Basic Config
+#include "scheduler.h"
+#include <esp_timer.h>
+
+// Local logging tag
+static const char TAG[] = "sched";
+
+#define WHEEL0_SIZE (1 << SCHED_WHEEL0_BITS)
+#define WHEELN_SIZE (1 << SCHED_WHEELN_BITS)
+#define WHEEL0_MASK (WHEEL0_SIZE - 1)
+#define WHEELN_MASK (WHEELN_SIZE - 1)
+#define WHEEL1_SPAN ((uint32_t)WHEEL0_SIZE * WHEELN_SIZE)
+#define WHEEL2_SPAN (WHEEL1_SPAN * WHEELN_SIZE)
+
+typedef enum { job_idle, job_filed, job_running } jobstate_t;
+
+typedef struct {
+  const char *name;
+  sched_fn_t fn;
+  uint32_t period;  // [ticks], 0 = one shot
+  uint32_t jitter;  // [ticks]
+  uint32_t due;     // nominal due tick
+  uint32_t expires; // tick the job is filed for
+  int8_t next;      // next job in same wheel slot, -1 = end of list
+  int8_t *slot;     // wheel slot the job is filed in
+  uint8_t core;
+  jobstate_t state;
+  bool rearmed; // due time was changed while job was running
+  sched_stats_t stats;
+} sched_job_t;
+
+typedef struct {
+  int8_t slot0[WHEEL0_SIZE];
+  int8_t slot1[WHEELN_SIZE];
+  int8_t slot2[WHEELN_SIZE];
+  uint32_t tick; // wheel time, advanced by worker up to real time
+  TaskHandle_t task;
+} sched_wheel_t;
+
+static sched_job_t jobs[SCHED_MAX_JOBS];
+static uint8_t jobCount = 0;
+static sched_wheel_t wheels[portNUM_PROCESSORS];
+static portMUX_TYPE schedMux = portMUX_INITIALIZER_UNLOCKED;
+
+static inline uint32_t sched_now(void) {
+  return (uint32_t)(esp_timer_get_time() / (SCHED_TICK_MS * 1000));
+}
+
+static inline uint32_t ms2ticks(uint32_t ms) {
+  return (ms + SCHED_TICK_MS - 1) / SCHED_TICK_MS;
+}
+
+// file job into wheel slot matching its expiry, call with schedMux held
+static void wheel_insert(sched_wheel_t *w, int8_t id) {
+  sched_job_t *j = &jobs[id];
+  int32_t delta = (int32_t)(j->expires - w->tick);
+
+  if (delta <= 0) { // already due, run on next wheel step
+    j->expires = w->tick + 1;
+    delta = 1;
+  }
+  if (delta < WHEEL0_SIZE)
+    j->slot = &w->slot0[j->expires & WHEEL0_MASK];
+  else if (delta < (int32_t)WHEEL1_SPAN)
+    j->slot = &w->slot1[(j->expires >> SCHED_WHEEL0_BITS) & WHEELN_MASK];
+  else {
+    if (delta >= (int32_t)WHEEL2_SPAN)
+      j->expires = w->tick + WHEEL2_SPAN - 1;
+    j->slot = &w->slot2[(j->expires >> (SCHED_WHEEL0_BITS + SCHED_WHEELN_BITS)) &
+                        WHEELN_MASK];
+  }
+  j->next = *j->slot;
+  *j->slot = id;
+  j->state = job_filed;
+}
+
+// unlink job from its wheel slot, call with schedMux held
+static void wheel_remove(int8_t id) {
+  sched_job_t *j = &jobs[id];
+  int8_t *p = j->slot;
+  while (p && (*p >= 0)) {
+    if (*p == id) {
+      *p = j->next;
+      break;
+    }
+    p = &jobs[*p].next;
+  }
+  j->slot = NULL;
+  j->next = -1;
+  j->state = job_idle;
+}
+
+// choose expiry for nominal due time, coalescing with an occupied slot
+static void wheel_arm(sched_wheel_t *w, int8_t id) {
+  sched_job_t *j = &jobs[id];
+  j->expires = j->due;
+  if (j->jitter && ((int32_t)(j->due - w->tick) > 0)) {
+    for (uint32_t t = j->due; (t - j->due) <= j->jitter; t++) {
+      if ((int32_t)(t - w->tick) >= WHEEL0_SIZE)
+        break;
+      if (w->slot0[t & WHEEL0_MASK] >= 0) {
+        j->expires = t;
+        break;
+      }
+    }
+  }
+  bool newSlot = ((int32_t)(j->expires - w->tick) > 0) &&
+                 ((int32_t)(j->expires - w->tick) < WHEEL0_SIZE) &&
+                 (w->slot0[j->expires & WHEEL0_MASK] < 0);
+  wheel_insert(w, id);
+  if (!newSlot)
+    return;
+
+  // the slot is occupied now, so earlier slots whose jobs all tolerate
+  // running that late join it and save a wakeup
+  for (int8_t k = 0; k < jobCount; k++) {
+    sched_job_t *o = &jobs[k];
+    if ((o->state != job_filed) || (o->slot < w->slot0) ||
+        (o->slot >= w->slot0 + WHEEL0_SIZE) || (*o->slot != k) ||
+        ((int32_t)(j->expires - o->expires) <= 0))
+      continue;
+    int8_t i;
+    for (i = k; i >= 0; i = jobs[i].next)
+      if (!jobs[i].jitter ||
+          ((int32_t)(jobs[i].due + jobs[i].jitter - j->expires) < 0))
+        break;
+    if (i >= 0)
+      continue;
+    int8_t *slot = o->slot;
+    i = *slot;
+    *slot = -1;
+    while (i >= 0) {
+      int8_t next = jobs[i].next;
+      jobs[i].expires = j->expires;
+      wheel_insert(w, i);
+      i = next;
+    }
+  }
+}
+
+static void wheel_cascade(sched_wheel_t *w, int8_t *slot) {
+  int8_t id = *slot;
+  *slot = -1;
+  while (id >= 0) {
+    int8_t next = jobs[id].next;
+    wheel_insert(w, id);
+    id = next;
+  }
+}
+
+// advance wheel by one tick, returns list of expired jobs
+static int8_t wheel_step(sched_wheel_t *w) {
+  uint32_t t = ++w->tick;
+  if ((t & WHEEL0_MASK) == 0) {
+    if (((t >> SCHED_WHEEL0_BITS) & WHEELN_MASK) == 0)
+      wheel_cascade(
+          w, &w->slot2[(t >> (SCHED_WHEEL0_BITS + SCHED_WHEELN_BITS)) &
+                       WHEELN_MASK]);
+    wheel_cascade(w, &w->slot1[(t >> SCHED_WHEEL0_BITS) & WHEELN_MASK]);
+  }
+  int8_t *slot = &w->slot0[t & WHEEL0_MASK];
+  int8_t id = *slot;
+  *slot = -1;
+  for (int8_t i = id; i >= 0; i = jobs[i].next) {
+    jobs[i].state = job_running;
+    jobs[i].slot = NULL;
+  }
+  return id;
+}
+
+static void sched_run(sched_wheel_t *w, int8_t id) {
+  sched_job_t *j = &jobs[id];
+  int64_t start = esp_timer_get_time();
+  int64_t late = start / 1000 - (int64_t)j->due * SCHED_TICK_MS;
+
+  j->fn();
+
+  uint32_t runtime = (uint32_t)(esp_timer_get_time() - start);
+  j->stats.runs++;
+  j->stats.runSum_us += runtime;
+  if (runtime > j->stats.runMax_us)
+    j->stats.runMax_us = runtime;
+  if (late > 0) {
+    j->stats.lateSum_ms += late;
+    if (late > j->stats.lateMax_ms)
+      j->stats.lateMax_ms = late;
+  }
+
+  uint32_t now = sched_now();
+  portENTER_CRITICAL(&schedMux);
+  if (j->rearmed) {
+    j->rearmed = false;
+    wheel_arm(w, id);
+  } else if (j->period && (j->state == job_running)) {
+    // next nominal due, drop periods which passed while the job ran, the
+    // wheel itself may still lag behind real time
+    j->due += j->period;
+    while ((int32_t)(j->due - now) <= 0) {
+      j->due += j->period;
+      j->stats.skipped++;
+    }
+    wheel_arm(w, id);
+  } else if (j->state == job_running)
+    j->state = job_idle;
+  portEXIT_CRITICAL(&schedMux);
+}
+
+// worker task, one per core which has jobs
+static void sched_worker(void *pvParameters) {
+  sched_wheel_t *w = &wheels[(uintptr_t)pvParameters];
+
+  for (;;) {
+    // catch up wheel with real time and run all expired jobs
+    while ((int32_t)(sched_now() - w->tick) > 0) {
+      portENTER_CRITICAL(&schedMux);
+      int8_t id = wheel_step(w);
+      portEXIT_CRITICAL(&schedMux);
+      while (id >= 0) {
+        int8_t next = jobs[id].next;
+        sched_run(w, id);
+        id = next;
+      }
+    }
+
+    // sleep until next occupied slot, or next cascade of upper levels
+    uint32_t t = w->tick + 1;
+    portENTER_CRITICAL(&schedMux);
+    while ((t & WHEEL0_MASK) && (w->slot0[t & WHEEL0_MASK] < 0))
+      t++;
+    portEXIT_CRITICAL(&schedMux);
+    // relative to the wheel tick, which wraps unlike the timer
+    int64_t now_ms = esp_timer_get_time() / 1000;
+    int64_t sleep_ms =
+        (int64_t)(int32_t)(t - (uint32_t)(now_ms / SCHED_TICK_MS)) *
+            SCHED_TICK_MS -
+        now_ms % SCHED_TICK_MS + 1;
+    if (sleep_ms > 0)
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(sleep_ms));
+  }
+}
+
+esp_err_t sched_init(void) {
+  memset(jobs, 0, sizeof(jobs));
+  for (int i = 0; i < portNUM_PROCESSORS; i++) {
+    memset(wheels[i].slot0, -1, sizeof(wheels[i].slot0));
+    memset(wheels[i].slot1, -1, sizeof(wheels[i].slot1));
+    memset(wheels[i].slot2, -1, sizeof(wheels[i].slot2));
+    wheels[i].tick = sched_now();
+    wheels[i].task = NULL;
+  }
+  jobCount = 0;
+  ESP_LOGI(TAG, "Scheduler initialized, tick %d ms", SCHED_TICK_MS);
+  return ESP_OK;
+}
+
+// add periodic job, first run is one period from now. Returns job id or -1.
+int sched_add(const char *name, sched_fn_t fn, uint32_t period_ms,
+              uint32_t jitter_ms, BaseType_t core) {
+  if ((jobCount >= SCHED_MAX_JOBS) || !fn || (core < 0) ||
+      (core >= portNUM_PROCESSORS)) {
+    ESP_LOGE(TAG, "Could not add job %s", name);
+    return -1;
+  }
+
+  sched_wheel_t *w = &wheels[core];
+  if (w->task == NULL) {
+    mem_task_create((mem_id_t)(MEM_TASK_SCHED0 + core), sched_worker,
+                    (void *)(intptr_t)core, SCHED_TASK_PRIO, &w->task, core);
+  }
+
+  portENTER_CRITICAL(&schedMux);
+  int8_t id = jobCount++;
+  sched_job_t *j = &jobs[id];
+  j->name = name;
+  j->fn = fn;
+  j->core = core;
+  j->period = ms2ticks(period_ms);
+  j->jitter = jitter_ms / SCHED_TICK_MS;
+  j->next = -1;
+  j->slot = NULL;
+  j->state = job_idle;
+  if (j->period) {
+    j->due = sched_now() + j->period;
+    wheel_arm(w, id);
+  }
+  portEXIT_CRITICAL(&schedMux);
+
+  xTaskNotifyGive(w->task);
+  ESP_LOGD(TAG, "Job %s added, period %u ms, jitter %u ms, core %d", name,
+           period_ms, jitter_ms, core);
+  return id;
+}
+
+// run job once after delay, then continue with its period from there
+void sched_trigger(int id, uint32_t delay_ms) {
+  if ((id < 0) || (id >= jobCount))
+    return;
+  sched_job_t *j = &jobs[id];
+  sched_wheel_t *w = &wheels[j->core];
+
+  portENTER_CRITICAL(&schedMux);
+  j->due = sched_now() + ms2ticks(delay_ms);
+  if (j->state == job_running)
+    j->rearmed = true;
+  else {
+    if (j->state == job_filed)
+      wheel_remove(id);
+    wheel_arm(w, id);
+  }
+  portEXIT_CRITICAL(&schedMux);
+  if (w->task)
+    xTaskNotifyGive(w->task);
+}
+
+// change period of job, next run is one new period from now
+void sched_set_period(int id, uint32_t period_ms) {
+  if ((id < 0) || (id >= jobCount))
+    return;
+  jobs[id].period = ms2ticks(period_ms);
+  if (jobs[id].period)
+    sched_trigger(id, period_ms);
+  else
+    sched_stop(id);
+}
+
+void sched_stop(int id) {
+  if ((id < 0) || (id >= jobCount))
+    return;
+  portENTER_CRITICAL(&schedMux);
+  jobs[id].period = 0;
+  jobs[id].rearmed = false;
+  if (jobs[id].state == job_filed)
+    wheel_remove(id);
+  portEXIT_CRITICAL(&schedMux);
+}
+
+const sched_stats_t *sched_get_stats(int id, const char **name) {
+  if ((id < 0) || (id >= jobCount))
+    return NULL;
+  if (name)
+    *name = jobs[id].name;
+  return &jobs[id].stats;
+}
+
+uint8_t sched_jobcount(void) { return jobCount; }
+
+void sched_print_stats(void) {
+  for (int i = 0; i < jobCount; i++) {
+    const sched_job_t *j = &jobs[i];
+    uint32_t runs = j->stats.runs ? j->stats.runs : 1;
+    ESP_LOGD(TAG,
+             "Job %-10s core %u period %6u ms | runs %5u skipped %u | run "
+             "avg/max %u/%u us | late avg/max %u/%u ms",
+             j->name, j->core, j->period * SCHED_TICK_MS, j->stats.runs,
+             j->stats.skipped, (uint32_t)(j->stats.runSum_us / runs),
+             j->stats.runMax_us, (uint32_t)(j->stats.lateSum_ms / runs),
+             j->stats.lateMax_ms);
+  }
+}
@@ -3,6 +3,7 @@
 #if (HAS_SDCARD)
 
 #include "sdcard.h"
+#include "sdqzip.h"
 #include "esp_system.h"
 
 #if __has_include("esp_mac.h")
@@ -33,19 +34,17 @@ static const char TAG[] = "sdcard";
 static bool useSDCard = false;
 FileMySD fileSDCard; // global active log file handle
 
-// Log rotation
-#define MAX_LOG_FILE_SIZE (1ULL * 1024 * 1024 * 1024) // 1 GB
+// Log rotation, driven by the write offset of the open log
 static int currentFileIndex = 0;
 int fileIndex = 0;
+static uint32_t logOffset = 0;
 
-// CSV log filename (for pause/resume during queue operations)
+// CSV log filename, to reopen the log after a card reinit
 static char sdLogFilename[16] = {0};
 
-// Flag: queue operation in progress, CSV writers must not touch SD
-static volatile bool sdqBusy = false;
-
 // ----------------------- Helpers forward -----------------------
 static void createFile(void);
+static bool openLogFile(char *filename);
 static void checkAndRotateLogFile(void);
 
 // =======================================================
@@ -235,10 +234,13 @@ static bool nb_read_and_decrypt(const char* path, std::string& outJson) {
 static char PAXQUEUE_FILE[] = "/paxqueue.q";
 static char PAXQUEUE_TMP[]  = "/paxqueue.tmp";
 
-static SemaphoreHandle_t sdqMutex = NULL;
-
 static const uint32_t PAXQ_MAGIC = 0x31515850;
-static const uint8_t  PAXQ_VER   = 1;
+static const uint8_t  PAXQ_VER   = 1; // raw records from head to tail
+static const uint8_t  PAXQ_VER_Z = 2; // sealed blocks, then a raw staging area
+
+// version 2 layout: header, staging area, sealed blocks from head to tail
+static const uint32_t PAXQ_STAGE  = 512;
+static const uint32_t PAXQ_BLOCKS = PAXQ_STAGE + SDCARD_QUEUE_BLOCK;
 
 #pragma pack(push, 1)
 struct PaxQHeader {
@@ -250,9 +252,16 @@ struct PaxQHeader {
   uint32_t count;
   uint16_t hdrCrc;
   uint16_t pad;
+  // version 2 only
+  uint16_t headOff;   // raw bytes consumed of the head block
+  uint16_t stageHead; // raw bytes consumed of the staging area
+  uint16_t stageTail; // raw bytes in the staging area
+  uint16_t zpad;
 };
 #pragma pack(pop)
 
+static const uint32_t PAXQ_HDR_V1 = offsetof(PaxQHeader, headOff);
+
 #pragma pack(push, 1)
 struct PaxQRecHdr {
   uint16_t len;
@@ -263,7 +272,18 @@ struct PaxQRecHdr {
 };
 #pragma pack(pop)
 
-static uint16_t crc16_ccitt(const uint8_t *data, size_t len, uint16_t crc = 0xFFFF) {
+#pragma pack(push, 1)
+// precedes every sealed block, the records of the block follow deflated.
+// zLen == rawLen: stored as is, they did not compress
+struct PaxQBlkHdr {
+  uint16_t rawLen;
+  uint16_t zLen;
+  uint16_t records;
+  uint16_t crc; // over the fields above and the raw records
+};
+#pragma pack(pop)
+
+uint16_t crc16_ccitt(const uint8_t *data, size_t len, uint16_t crc) {
   while (len--) {
     crc ^= (uint16_t)(*data++) << 8;
     for (int i = 0; i < 8; i++) {
@@ -274,45 +294,33 @@ static uint16_t crc16_ccitt(const uint8_t *data, size_t len, uint16_t crc = 0xFF
   return crc;
 }
 
-static bool sdq_lock() {
-  if (!sdqMutex) sdqMutex = xSemaphoreCreateRecursiveMutex();
-  return sdqMutex &&
-         (xSemaphoreTakeRecursive(sdqMutex, pdMS_TO_TICKS(2000)) == pdTRUE);
+// queue and log file are only touched by the sd service task, both stay
+// open while the card is mounted
+static void sd_csv_reopen() {
+  if (sdLogFilename[0])
+    openLogFile(sdLogFilename);
 }
 
-static void sdq_unlock() {
-  if (sdqMutex) xSemaphoreGiveRecursive(sdqMutex);
-}
-
-// --- CSV pause/resume for SPI bus sharing ---
-static void sdq_pause_csv() {
-  sdqBusy = true;
-  if (fileSDCard) {
-    fileSDCard.flush();
-    fileSDCard.close();
-  }
-}
-
-static void sdq_resume_csv() {
-  if (sdLogFilename[0]) {
-    fileSDCard = mySD.open(sdLogFilename, FILE_WRITE);
-    if (fileSDCard) {
-      fileSDCard.seek(fileSDCard.size());
-    }
-  }
-  sdqBusy = false;
+static uint32_t header_size(const PaxQHeader &h) {
+  return h.version == PAXQ_VER_Z ? sizeof(PaxQHeader) : PAXQ_HDR_V1;
 }
 
 static uint16_t header_crc(const PaxQHeader &h) {
-  return crc16_ccitt((const uint8_t*)&h, sizeof(PaxQHeader) - sizeof(uint16_t) - sizeof(uint16_t));
+  uint16_t crc = crc16_ccitt((const uint8_t*)&h, offsetof(PaxQHeader, hdrCrc));
+  if (h.version == PAXQ_VER_Z)
+    crc = crc16_ccitt((const uint8_t*)&h.headOff, sizeof(PaxQHeader) - PAXQ_HDR_V1, crc);
+  return crc;
 }
 
 static bool readHeader(FileMySD &f, PaxQHeader &h) {
+  memset(&h, 0, sizeof(h));
   f.seek(0);
-  int bytesRead = f.read((uint8_t*)&h, sizeof(h));
-  if (bytesRead != (int)sizeof(h)) {
+  int bytesRead = f.read((uint8_t*)&h, PAXQ_HDR_V1);
+  if (bytesRead == (int)PAXQ_HDR_V1 && h.version == PAXQ_VER_Z)
+    bytesRead += f.read((uint8_t*)&h.headOff, sizeof(h) - PAXQ_HDR_V1);
+  if (bytesRead != (int)header_size(h)) {
     ESP_LOGE(TAG, "readHeader: read %d bytes, expected %d, filesize=%u",
-             bytesRead, (int)sizeof(h), f.size());
+             bytesRead, (int)header_size(h), f.size());
     return false;
   }
   if (h.magic != PAXQ_MAGIC) {
@@ -320,9 +328,9 @@ static bool readHeader(FileMySD &f, PaxQHeader &h) {
              h.magic, PAXQ_MAGIC);
     return false;
   }
-  if (h.version != PAXQ_VER) {
-    ESP_LOGE(TAG, "readHeader: bad version %d (expected %d)",
-             h.version, PAXQ_VER);
+  if (h.version != PAXQ_VER && h.version != PAXQ_VER_Z) {
+    ESP_LOGE(TAG, "readHeader: bad version %d (expected %d or %d)",
+             h.version, PAXQ_VER, PAXQ_VER_Z);
     return false;
   }
   uint16_t calc = header_crc(h);
@@ -337,188 +345,168 @@ static bool readHeader(FileMySD &f, PaxQHeader &h) {
 
 static bool writeHeader(FileMySD &f, PaxQHeader &h) {
   h.magic = PAXQ_MAGIC;
-  h.version = PAXQ_VER;
   h.hdrCrc = header_crc(h);
+  uint32_t n = header_size(h);
   f.seek(0);
-  if (f.write((uint8_t*)&h, sizeof(h)) != (int)sizeof(h)) return false;
+  if (f.write((uint8_t*)&h, n) != n) return false;
   f.flush();
   return true;
 }
 
-static bool copyFileAndRemove(char* srcPath, char* dstPath) {
-  FileMySD src = mySD.open(srcPath, FILE_READ);
-  if (!src) return false;
+// the queue file stays open while the card is mounted and its header is
+// cached, records are read and written by offset inside the preallocated
+// extent, so no FAT chain is walked per request
+static FileMySD qFile;
+static PaxQHeader qHdr;
 
-  if (mySD.exists(dstPath)) mySD.remove(dstPath);
+// version new queue files are created with
+static const uint8_t PAXQ_VER_NEW = SDCARD_QUEUE_COMPRESS ? PAXQ_VER_Z : PAXQ_VER;
 
-  FileMySD dst = mySD.open(dstPath, FILE_WRITE);
-  if (!dst) { src.close(); return false; }
+// raw records of the head block, or of a block being sealed. zCacheOff is the
+// file offset of the cached head block, 0 if none
+static uint8_t *zBuf = NULL;
+static uint32_t zCacheOff = 0;
+static PaxQBlkHdr zCacheHdr;
 
-  uint8_t buf[256];
-  int n;
-  while ((n = src.read(buf, sizeof(buf))) > 0) {
-    dst.write(buf, n);
-  }
-  dst.flush();
-  dst.close();
-  src.close();
+static bool sdq_zipped() { return qHdr.version == PAXQ_VER_Z; }
 
-  mySD.remove(srcPath);
-  return true;
+static uint32_t sdq_data_start() {
+  return sdq_zipped() ? PAXQ_BLOCKS : PAXQ_HDR_V1;
 }
 
-static bool sdq_compact_locked() {
-  if (!useSDCard) return false;
-  if (!mySD.exists(PAXQUEUE_FILE)) return true;
-
-  FileMySD in = mySD.open(PAXQUEUE_FILE, FILE_READ);
-  if (!in) return false;
-
-  PaxQHeader h;
-  if (!readHeader(in, h)) { in.close(); return false; }
-
-  if (h.count == 0) {
-    in.close();
-    mySD.remove(PAXQUEUE_FILE);
-    FileMySD nf = mySD.open(PAXQUEUE_FILE, FILE_WRITE);
-    if (!nf) return false;
-    PaxQHeader nh{};
-    nh.head  = sizeof(PaxQHeader);
-    nh.tail  = sizeof(PaxQHeader);
-    nh.count = 0;
-    bool ok = writeHeader(nf, nh);
-    nf.close();
-    return ok;
-  }
-
-  if (mySD.exists(PAXQUEUE_TMP)) mySD.remove(PAXQUEUE_TMP);
-  FileMySD out = mySD.open(PAXQUEUE_TMP, FILE_WRITE);
-  if (!out) { in.close(); return false; }
+static void sdq_reset_header() {
+  uint8_t version = qHdr.version;
+  memset(&qHdr, 0, sizeof(qHdr));
+  qHdr.version = version;
+  qHdr.head = sdq_data_start();
+  qHdr.tail = sdq_data_start();
+  zCacheOff = 0;
+}
 
-  PaxQHeader nh{};
-  nh.head  = sizeof(PaxQHeader);
-  nh.tail  = sizeof(PaxQHeader);
-  nh.count = h.count;
+// moves live records to the front of the file. Only done when they fit below
+// the head, an interrupted move then leaves the old records intact
+static bool sdq_compact_locked() {
+  if (!qFile) return false;
 
-  if (!writeHeader(out, nh)) { in.close(); out.close(); return false; }
+  uint32_t start = sdq_data_start();
+  uint32_t len = qHdr.tail - qHdr.head;
+  if (len > qHdr.head - start) return true;
 
-  const size_t BUFSZ = 256;
-  uint8_t buf[BUFSZ];
+  uint8_t buf[256];
+  uint32_t src = qHdr.head, dst = start;
+  while (src < qHdr.tail) {
+    uint32_t n = qHdr.tail - src;
+    if (n > sizeof(buf)) n = sizeof(buf);
+    qFile.seek(src);
+    if (qFile.read(buf, n) != (int)n) return false;
+    qFile.seek(dst);
+    if (qFile.write(buf, n) != n) return false;
+    src += n;
+    dst += n;
+  }
+  // records must be on the card before the header points to them
+  qFile.flush();
+  qHdr.head = start;
+  qHdr.tail = dst;
+  zCacheOff = 0;
+  ESP_LOGI(TAG, "paxqueue.q compacted, %u bytes moved", len);
+  return writeHeader(qFile, qHdr);
+}
 
-  uint32_t remaining = (h.tail > h.head) ? (h.tail - h.head) : 0;
-  in.seek(h.head);
+// new empty queue file with a preallocated contiguous extent
+static bool sdq_create() {
+  qFile = mySD.open(PAXQUEUE_FILE, FILE_WRITE);
+  if (!qFile) {
+    ESP_LOGE(TAG, "DIAG init: open(FILE_WRITE) FAILED");
+    bool sdAlive = mySD.exists("/");
+    ESP_LOGE(TAG, "DIAG init: mySD.exists('/')=%d", sdAlive);
+    if (sdAlive)
+      return false;
 
-  while (remaining > 0) {
-    size_t want = (remaining > BUFSZ) ? BUFSZ : remaining;
-    int r = in.read(buf, want);
-    if (r <= 0) break;
-    out.write(buf, r);
-    nh.tail += r;
-    remaining -= r;
+    ESP_LOGW(TAG, "DIAG init: SD not responding, reinitializing...");
+    if (fileSDCard) {
+      fileSDCard.close();
+    }
+    sdlog_card_close();
+    delay(100);
+    useSDCard = mySD.begin(SDCARD_CS, SDCARD_MOSI, SDCARD_MISO, SDCARD_SCLK);
+    if (!useSDCard) {
+      ESP_LOGE(TAG, "DIAG init: SD reinit FAILED -> rebooting");
+      crash_reset(ct_rst_sdcard);
+      delay(200);
+      esp_restart();
+    }
+    ESP_LOGI(TAG, "DIAG init: SD reinit OK, retrying...");
+    sd_csv_reopen();
+    sdlog_card_open();
+    qFile = mySD.open(PAXQUEUE_FILE, FILE_WRITE);
+    if (!qFile) {
+      ESP_LOGE(TAG, "DIAG init: open(FILE_WRITE) FAILED after reinit");
+      return false;
+    }
   }
+  if (!qFile.preAllocate(SDCARD_QUEUE_SIZE))
+    ESP_LOGW(TAG, "paxqueue.q: no contiguous space, file grows by cluster");
 
-  writeHeader(out, nh);
-
-  in.close();
-  out.flush();
-  out.close();
+  qHdr.version = PAXQ_VER_NEW;
+  sdq_reset_header();
+  bool ok = writeHeader(qFile, qHdr);
+  if (ok) {
+    ESP_LOGI(TAG, "DIAG init: file created OK");
+  } else {
+    ESP_LOGE(TAG, "DIAG init: writeHeader FAILED");
+    qFile.close();
+  }
+  return ok;
+}
 
+// drops the queue file and starts an empty one
+static bool sdq_rebuild() {
+  if (qFile)
+    qFile.close();
   mySD.remove(PAXQUEUE_FILE);
-  return copyFileAndRemove(PAXQUEUE_TMP, PAXQUEUE_FILE);
+  return sdq_create();
 }
 
-bool sdqueueInit() {
+static bool sdq_card_init() {
   if (!useSDCard) return false;
-  if (!sdqMutex) sdqMutex = xSemaphoreCreateRecursiveMutex();
-  if (!sdqMutex) return false;
+  if (qFile)
+    qFile.close();
+  if (mySD.exists(PAXQUEUE_TMP))
+    mySD.remove(PAXQUEUE_TMP); // left by older firmware
 
   if (!mySD.exists(PAXQUEUE_FILE)) {
     ESP_LOGW(TAG, "DIAG init: file not found, creating...");
-    FileMySD f = mySD.open(PAXQUEUE_FILE, FILE_WRITE);
-    if (!f) {
-      ESP_LOGE(TAG, "DIAG init: open(FILE_WRITE) FAILED");
-      bool sdAlive = mySD.exists("/");
-      ESP_LOGE(TAG, "DIAG init: mySD.exists('/')=%d", sdAlive);
-
-      if (!sdAlive) {
-        ESP_LOGW(TAG, "DIAG init: SD not responding, reinitializing...");
-        if (fileSDCard) {
-          fileSDCard.close();
-        }
-        delay(100);
-        useSDCard = mySD.begin(SDCARD_CS, SDCARD_MOSI, SDCARD_MISO, SDCARD_SCLK);
-        if (!useSDCard) {
-          ESP_LOGE(TAG, "DIAG init: SD reinit FAILED -> rebooting");
-          delay(200);
-          esp_restart();
-        }
-        ESP_LOGI(TAG, "DIAG init: SD reinit OK, retrying...");
-        sdq_resume_csv();
-        f = mySD.open(PAXQUEUE_FILE, FILE_WRITE);
-        if (!f) {
-          ESP_LOGE(TAG, "DIAG init: open(FILE_WRITE) FAILED after reinit");
-          return false;
-        }
-      } else {
-        return false;
-      }
-    }
-    PaxQHeader h{};
-    h.head  = sizeof(PaxQHeader);
-    h.tail  = sizeof(PaxQHeader);
-    h.count = 0;
-    bool ok = writeHeader(f, h);
-    f.close();
-    if (ok) {
-      ESP_LOGI(TAG, "DIAG init: file created OK");
-    } else {
-      ESP_LOGE(TAG, "DIAG init: writeHeader FAILED");
-    }
-    return ok;
+    return sdq_create();
   }
 
-  FileMySD f = mySD.open(PAXQUEUE_FILE, FILE_READ);
-  if (!f) return false;
+  qFile = mySD.open(PAXQUEUE_FILE, FILE_WRITE);
+  if (!qFile) return false;
+  zCacheOff = 0;
 
-  PaxQHeader h;
-  bool ok = readHeader(f, h);
-  f.close();
-
-  if (!ok) {
+  if (!readHeader(qFile, qHdr)) {
     ESP_LOGW(TAG, "paxqueue.q corrupted -> rebuilding");
-    mySD.remove(PAXQUEUE_FILE);
-    return sdqueueInit();
+    return sdq_rebuild();
+  }
+  if (!qFile.isContiguous() || (qHdr.version != PAXQ_VER_NEW)) {
+    // queue file of an older firmware or the other format, replaced once it
+    // is drained
+    if (qHdr.count == 0)
+      return sdq_rebuild();
+    ESP_LOGW(TAG, "paxqueue.q in old layout, %u records pending", qHdr.count);
   }
   return true;
 }
 
-uint32_t sdqueueCount() {
-  if (!useSDCard) return 0;
-  if (!sdq_lock()) return 0;
-
-  FileMySD f = mySD.open(PAXQUEUE_FILE, FILE_READ);
-  if (!f) { sdq_unlock(); return 0; }
-
-  PaxQHeader h;
-  bool ok = readHeader(f, h);
-  f.close();
-  sdq_unlock();
-  return ok ? h.count : 0;
+uint32_t sdq_card_count() {
+  if (!useSDCard || !qFile) return 0;
+  return qHdr.count;
 }
 
-static bool sdq_read_record_at(FileMySD &f, uint32_t offset, MessageBuffer_t *msg, uint32_t &nextOffset) {
-  PaxQRecHdr rh{};
-  f.seek(offset);
-  if (f.read((uint8_t*)&rh, sizeof(rh)) != (int)sizeof(rh)) return false;
-
-  const size_t MSGCAP = sizeof(msg->Message);
-  if (rh.len == 0 || rh.len > MSGCAP) return false;
-
-  uint8_t payload[MSGCAP];
-  if (f.read(payload, rh.len) != (int)rh.len) return false;
-
+// checks the record crc and copies it into msg
+static bool sdq_copy_record(const PaxQRecHdr &rh, const uint8_t *payload, MessageBuffer_t *msg) {
   uint16_t crc = 0xFFFF;
-  crc = crc16_ccitt((uint8_t*)&rh, sizeof(PaxQRecHdr) - sizeof(uint16_t), crc);
+  crc = crc16_ccitt((const uint8_t*)&rh, sizeof(PaxQRecHdr) - sizeof(uint16_t), crc);
   crc = crc16_ccitt(payload, rh.len, crc);
   if (crc != rh.crc) return false;
 
@@ -526,116 +514,262 @@ static bool sdq_read_record_at(FileMySD &f, uint32_t offset, MessageBuffer_t *ms
   msg->MessagePort = rh.port;
   msg->MessagePrio = (sendprio_t)rh.prio;
   memcpy(msg->Message, payload, rh.len);
+  return true;
+}
 
+// result of reading from the queue: a failed read or allocation is retried
+// later, a bad length or crc is skipped, see sdq_skip_locked()
+typedef enum { sdq_ok, sdq_retry, sdq_bad } sdq_res_t;
+
+// nextOffset is set unless the record length is bad
+static sdq_res_t sdq_read_record_at(FileMySD &f, uint32_t offset, MessageBuffer_t *msg, uint32_t &nextOffset) {
+  PaxQRecHdr rh{};
+  nextOffset = 0;
+  f.seek(offset);
+  if (f.read((uint8_t*)&rh, sizeof(rh)) != (int)sizeof(rh)) return sdq_retry;
+
+  const size_t MSGCAP = sizeof(msg->Message);
+  if (rh.len == 0 || rh.len > MSGCAP) return sdq_bad;
+
+  uint8_t payload[MSGCAP];
+  if (f.read(payload, rh.len) != (int)rh.len) return sdq_retry;
   nextOffset = offset + sizeof(PaxQRecHdr) + rh.len;
-  return true;
+  return sdq_copy_record(rh, payload, msg) ? sdq_ok : sdq_bad;
 }
 
-bool sdqueueDequeue(MessageBuffer_t *msg) {
-  if (!useSDCard || !msg) return false;
-  if (!sdq_lock()) return false;
+static bool sdq_zbuf() {
+  if (!zBuf)
+    zBuf = (uint8_t *)malloc(SDCARD_QUEUE_BLOCK);
+  return zBuf != NULL;
+}
 
-  sdq_pause_csv();
+// deflates the staged records into a block appended at tail. The block is on
+// the card before the header drops the staged records, a crash in between
+// leaves an unreferenced block behind tail
+static bool sdq_seal_locked() {
+  uint16_t rawLen = qHdr.stageTail - qHdr.stageHead;
+  if (!rawLen) return true;
+  if (!sdq_zbuf()) return false;
+  zCacheOff = 0; // zBuf is reused
+
+  qFile.seek(PAXQ_STAGE + qHdr.stageHead);
+  if (qFile.read(zBuf, rawLen) != (int)rawLen) return false;
+
+  PaxQBlkHdr bh{};
+  bh.rawLen = rawLen;
+  for (uint32_t o = 0; o + sizeof(PaxQRecHdr) <= rawLen; bh.records++) {
+    PaxQRecHdr rh;
+    memcpy(&rh, zBuf + o, sizeof(rh));
+    o += sizeof(rh) + rh.len;
+  }
 
-  FileMySD f = mySD.open(PAXQUEUE_FILE, FILE_READ);
-  ESP_LOGI(TAG, "DIAG peek: open=%d exists=%d filesize=%u", (bool)f, mySD.exists(PAXQUEUE_FILE), f ? f.size() : 0);
-  if (!f) { sdq_resume_csv(); sdq_unlock(); return false; }
+  uint32_t t0 = micros();
+  uint16_t zLen = 0;
+  uint8_t *z = sdqzip_deflate(zBuf, rawLen, &zLen);
+  uint32_t us = micros() - t0;
+  const uint8_t *data = z;
+  if (!z || zLen >= rawLen) {
+    data = zBuf; // stored
+    zLen = rawLen;
+  }
+  bh.zLen = zLen;
+  bh.crc = crc16_ccitt((const uint8_t*)&bh, offsetof(PaxQBlkHdr, crc));
+  bh.crc = crc16_ccitt(zBuf, rawLen, bh.crc);
+
+  uint32_t n = sizeof(bh) + zLen;
+  if (qHdr.tail + n > SDCARD_QUEUE_SIZE)
+    sdq_compact_locked();
+  bool ok = qFile.seek(qHdr.tail);
+  ok = ok && qFile.write((uint8_t*)&bh, sizeof(bh)) == sizeof(bh);
+  ok = ok && qFile.write(data, zLen) == zLen;
+  qFile.flush();
+  free(z);
+  if (!ok) {
+    ESP_LOGE(TAG, "paxqueue.q: could not write sealed block");
+    return false;
+  }
 
-  PaxQHeader h;
-  if (!readHeader(f, h)) { f.close(); sdq_resume_csv(); sdq_unlock(); return false; }
+  qHdr.tail += n;
+  qHdr.stageHead = 0;
+  qHdr.stageTail = 0;
+  ESP_LOGI(TAG, "paxqueue.q: sealed %u records, %u -> %u bytes in %u us",
+           bh.records, rawLen, zLen, us);
+  return writeHeader(qFile, qHdr);
+}
 
-  if (h.count == 0) { f.close(); sdq_resume_csv(); sdq_unlock(); return false; }
+// lengths of a block header that can be sealed, and that fit before tail
+static bool sdq_block_sane(const PaxQBlkHdr &bh, uint32_t off) {
+  return bh.rawLen && bh.rawLen <= SDCARD_QUEUE_BLOCK && bh.zLen &&
+         bh.zLen <= bh.rawLen && off + sizeof(bh) + bh.zLen <= qHdr.tail;
+}
 
-  uint32_t nextOffset = 0;
-  bool ok = sdq_read_record_at(f, h.head, msg, nextOffset);
-  f.close();
+// inflates the block at off into zBuf, unless it is cached already. A bad
+// block sets *next to the block behind it, 0 if its header is unusable
+static sdq_res_t sdq_load_block(uint32_t off, uint32_t *next) {
+  *next = 0;
+  if (zCacheOff == off) return sdq_ok;
+  if (!sdq_zbuf()) return sdq_retry;
+  zCacheOff = 0;
+
+  PaxQBlkHdr bh;
+  qFile.seek(off);
+  if (qFile.read((uint8_t*)&bh, sizeof(bh)) != (int)sizeof(bh)) return sdq_retry;
+  if (!sdq_block_sane(bh, off)) {
+    ESP_LOGE(TAG, "paxqueue.q: bad block header at %u", off);
+    return sdq_bad;
+  }
+  *next = off + sizeof(bh) + bh.zLen;
 
-  if (ok) {
-    h.head = nextOffset;
-    h.count--;
-
-    f = mySD.open(PAXQUEUE_FILE, FILE_WRITE);
-    if (f) {
-      writeHeader(f, h);
-      f.close();
-      ESP_LOGI("SD_QUEUE", "🚀 Recuperado de SD y enviado. Pendientes: %d", h.count);
+  bool inflated = true;
+  if (bh.zLen == bh.rawLen) {
+    if (qFile.read(zBuf, bh.rawLen) != (int)bh.rawLen) return sdq_retry;
+  } else {
+    uint8_t *z = (uint8_t *)malloc(bh.zLen);
+    if (!z) return sdq_retry;
+    bool read = qFile.read(z, bh.zLen) == (int)bh.zLen;
+    inflated = read && sdqzip_inflate(z, bh.zLen, zBuf, bh.rawLen);
+    free(z);
+    if (!read) return sdq_retry;
+  }
+  uint16_t crc = crc16_ccitt((const uint8_t*)&bh, offsetof(PaxQBlkHdr, crc));
+  if (!inflated || crc16_ccitt(zBuf, bh.rawLen, crc) != bh.crc) {
+    ESP_LOGE(TAG, "paxqueue.q: bad block at %u", off);
+    return sdq_bad;
+  }
+  zCacheOff = off;
+  zCacheHdr = bh;
+  return sdq_ok;
+}
+
+// oldest record of a version 2 queue, from the head block or, if all blocks
+// are consumed, from the staging area. Consumed if pop. On sdq_bad *next is
+// where reading can go on, 0 if unknown
+static sdq_res_t sdq_z_next(MessageBuffer_t *msg, bool pop, uint32_t *next) {
+  if (qHdr.head < qHdr.tail) {
+    sdq_res_t res = sdq_load_block(qHdr.head, next);
+    if (res != sdq_ok) return res;
+    // records of a block that passed its crc are sane, else skip the block
+    *next = qHdr.head + sizeof(PaxQBlkHdr) + zCacheHdr.zLen;
+
+    PaxQRecHdr rh;
+    uint32_t o = qHdr.headOff;
+    if (o + sizeof(rh) > zCacheHdr.rawLen) return sdq_bad;
+    memcpy(&rh, zBuf + o, sizeof(rh));
+    o += sizeof(rh);
+    if (rh.len == 0 || rh.len > sizeof(msg->Message) || o + rh.len > zCacheHdr.rawLen)
+      return sdq_bad;
+    if (!sdq_copy_record(rh, zBuf + o, msg)) return sdq_bad;
+
+    if (pop) {
+      qHdr.headOff = o + rh.len;
+      if (qHdr.headOff >= zCacheHdr.rawLen) {
+        qHdr.head += sizeof(PaxQBlkHdr) + zCacheHdr.zLen;
+        qHdr.headOff = 0;
+      }
     }
+    return sdq_ok;
+  }
 
-    if (h.count == 0 || h.head > 128000) {
-      sdq_compact_locked();
+  if (qHdr.stageHead >= qHdr.stageTail) return sdq_bad; // count is off
+  sdq_res_t res = sdq_read_record_at(qFile, PAXQ_STAGE + qHdr.stageHead, msg, *next);
+  if ((res == sdq_ok) && pop)
+    qHdr.stageHead = *next - PAXQ_STAGE;
+  return res;
+}
+
+// records from head to tail, and staged ones, as far as their headers can
+// be followed
+static uint32_t sdq_count_locked() {
+  uint32_t n = 0;
+  PaxQRecHdr rh;
+  if (sdq_zipped()) {
+    PaxQBlkHdr bh;
+    for (uint32_t off = qHdr.head; off < qHdr.tail; off += sizeof(bh) + bh.zLen) {
+      qFile.seek(off);
+      if ((qFile.read((uint8_t*)&bh, sizeof(bh)) != (int)sizeof(bh)) ||
+          !sdq_block_sane(bh, off))
+        break;
+      n += bh.records;
+    }
+    for (uint32_t o = qHdr.stageHead; o + sizeof(rh) <= qHdr.stageTail; o += sizeof(rh) + rh.len) {
+      qFile.seek(PAXQ_STAGE + o);
+      if ((qFile.read((uint8_t*)&rh, sizeof(rh)) != (int)sizeof(rh)) || !rh.len)
+        break;
+      n++;
+    }
+  } else {
+    for (uint32_t off = qHdr.head; off + sizeof(rh) <= qHdr.tail; off += sizeof(rh) + rh.len) {
+      qFile.seek(off);
+      if ((qFile.read((uint8_t*)&rh, sizeof(rh)) != (int)sizeof(rh)) ||
+          !rh.len || (rh.len > sizeof(((MessageBuffer_t *)0)->Message)))
+        break;
+      n++;
     }
   }
+  return n;
+}
 
-  sdq_resume_csv();
-  sdq_unlock();
-  return ok;
+// drops the bad block or record at head, next is the one behind it or 0 if
+// it cannot be found, then everything up to the staging area goes. The other
+// records stay queued
+static bool sdq_skip_locked(uint32_t next) {
+  uint32_t before = qHdr.count;
+  if (sdq_zipped() && (qHdr.head < qHdr.tail)) {
+    qHdr.head = next ? next : qHdr.tail;
+    qHdr.headOff = 0;
+    zCacheOff = 0;
+  } else if (sdq_zipped()) {
+    qHdr.stageHead = next ? next - PAXQ_STAGE : qHdr.stageTail;
+  } else {
+    qHdr.head = next ? next : qHdr.tail;
+  }
+  qHdr.count = sdq_count_locked();
+  if (qHdr.count > before)
+    qHdr.count = before;
+  ESP_LOGE(TAG, "paxqueue.q: skipped bad data, %u records lost, %u pending",
+           before - qHdr.count, qHdr.count);
+  if (qHdr.count == 0)
+    sdq_reset_header();
+  return writeHeader(qFile, qHdr);
 }
 
-bool sdqueueEnqueue(MessageBuffer_t *message) {
-#ifdef HAS_SDCARD
-    if (!useSDCard || !message)
-        return false;
+bool sdq_card_dequeue(MessageBuffer_t *msg) {
+  if (!useSDCard || !msg || !qFile) return false;
+  if (qHdr.count == 0) return false;
 
-    if (!sdq_lock())
-        return false;
+  // head was peeked before, a bad record is skipped there
+  uint32_t nextOffset = 0;
+  if (sdq_zipped()) {
+    if (sdq_z_next(msg, true, &nextOffset) != sdq_ok)
+      return false;
+  } else {
+    if (sdq_read_record_at(qFile, qHdr.head, msg, nextOffset) != sdq_ok)
+      return false;
+    qHdr.head = nextOffset;
+  }
 
-    sdq_pause_csv();
-
-    // 1. Leer cabecera actual
-    FileMySD f = mySD.open(PAXQUEUE_FILE, FILE_READ);
-    PaxQHeader h{};
-    bool ok = f && readHeader(f, h);
-    if (f) f.close();
-
-    if (!ok) {
-        // --- DIAGNÓSTICO TEMPORAL ---
-        FileMySD dbg = mySD.open(PAXQUEUE_FILE, FILE_READ);
-        if (dbg) {
-            uint32_t fsize = dbg.size();
-            uint8_t raw[24];
-            int n = dbg.read(raw, sizeof(raw));
-            dbg.close();
-            ESP_LOGE(TAG, "DIAG enqueue: filesize=%u, read %d bytes", fsize, n);
-            if (n > 0) {
-                char hex[80];
-                int pos = 0;
-                for (int i = 0; i < n && pos < 72; i++)
-                    pos += snprintf(hex + pos, sizeof(hex) - pos, "%02X ", raw[i]);
-                ESP_LOGE(TAG, "DIAG hex: %s", hex);
-            }
-        } else {
-            ESP_LOGE(TAG, "DIAG enqueue: file does not exist or cannot open");
-        }
-        // --- FIN DIAGNÓSTICO ---
+  qHdr.count--;
+  if (qHdr.count == 0) {
+    // drained, older queue files are replaced by a preallocated one
+    if (!qFile.isContiguous() || (qHdr.version != PAXQ_VER_NEW))
+      return sdq_rebuild();
+    sdq_reset_header();
+  }
+  if (writeHeader(qFile, qHdr))
+    DLOG(dlog_sdq_dequeue, qHdr.count);
 
-        ESP_LOGW(TAG, "paxqueue.q corrupta en enqueue -> rebuilding");
-        mySD.remove(PAXQUEUE_FILE);
-        if (!sdqueueInit()) {
-            sdq_resume_csv();
-            sdq_unlock();
-            return false;
-        }
-        f = mySD.open(PAXQUEUE_FILE, FILE_READ);
-        if (!f || !readHeader(f, h)) {
-            if (f) f.close();
-            sdq_resume_csv();
-            sdq_unlock();
-            return false;
-        }
-        f.close();
-    }
+  if (qHdr.head > SDCARD_QUEUE_COMPACT)
+    sdq_compact_locked();
+  return true;
+}
 
-    // 2. Abrir para escritura
-    FileMySD wf = mySD.open(PAXQUEUE_FILE, FILE_WRITE);
-    if (!wf) {
-        sdq_resume_csv();
-        sdq_unlock();
+bool sdq_card_enqueue(MessageBuffer_t *message) {
+    if (!useSDCard || !message)
+        return false;
+    if (!qFile && !sdq_card_init())
         return false;
-    }
-
-    wf.seek(h.tail);
 
-    // 3. Construir cabecera de registro
+    // 1. Construir cabecera de registro
     PaxQRecHdr rh{};
     rh.len  = message->MessageSize;
     rh.port = message->MessagePort;
@@ -647,76 +781,98 @@ bool sdqueueEnqueue(MessageBuffer_t *message) {
     crc = crc16_ccitt(message->Message, rh.len, crc);
     rh.crc = crc;
 
-    // 4. Escribir registro
-    bool okWrite = true;
-    okWrite &= wf.write((uint8_t *)&rh, sizeof(rh)) == (int)sizeof(rh);
-    okWrite &= wf.write(message->Message, rh.len) == (int)rh.len;
+    // 2. Hacer sitio: sellar el area de staging si esta llena (version 2), o
+    //    compactar dentro de la extension preasignada, si no el fichero crece
+    uint32_t recLen = sizeof(PaxQRecHdr) + rh.len;
+    uint32_t at;
+    if (sdq_zipped()) {
+        if ((qHdr.stageTail + recLen > SDCARD_QUEUE_BLOCK) && !sdq_seal_locked()) {
+            ESP_LOGE("SD_QUEUE", "⚠️ Error sellando bloque en paxqueue.q");
+            return false;
+        }
+        at = PAXQ_STAGE + qHdr.stageTail;
+    } else {
+        if (qHdr.tail + recLen > SDCARD_QUEUE_SIZE)
+            sdq_compact_locked();
+        at = qHdr.tail;
+    }
+
+    // 3. Escribir registro, antes que la cabecera que lo referencia
+    bool okWrite = qFile.seek(at);
+    okWrite = okWrite && qFile.write((uint8_t *)&rh, sizeof(rh)) == sizeof(rh);
+    okWrite = okWrite && qFile.write(message->Message, rh.len) == rh.len;
+    qFile.flush();
 
     if (!okWrite) {
-        wf.close();
-        sdq_resume_csv();
-        sdq_unlock();
         ESP_LOGE("SD_QUEUE", "⚠️ Error escribiendo registro en paxqueue.q");
         return false;
     }
 
-    // 5. Actualizar cabecera
-    h.tail += sizeof(PaxQRecHdr) + rh.len;
-    h.count++;
-
-    // 6. Reescribir cabecera
-    okWrite = writeHeader(wf, h);
-    wf.flush();
-    wf.close();
-
-    sdq_resume_csv();
-    sdq_unlock();
-
-    if (okWrite) {
-        ESP_LOGI("SD_QUEUE",
-                 "📦 Paquete salvado en cola SD (port %u, %u bytes, count=%u)",
-                 message->MessagePort, message->MessageSize, h.count);
+    // 4. Actualizar y reescribir cabecera
+    if (sdq_zipped())
+        qHdr.stageTail += recLen;
+    else
+        qHdr.tail += recLen;
+    qHdr.count++;
+    if (writeHeader(qFile, qHdr)) {
+        DLOG(dlog_sdq_enqueue, message->MessagePort, message->MessageSize,
+             qHdr.count);
         return true;
-    } else {
-        ESP_LOGE("SD_QUEUE", "⚠️ Error actualizando cabecera paxqueue.q");
-        return false;
     }
-#else
+    ESP_LOGE("SD_QUEUE", "⚠️ Error actualizando cabecera paxqueue.q");
     return false;
-#endif
 }
 
-bool sdqueuePeek(MessageBuffer_t *msg) {
-  if (!useSDCard) return false;
-  if (!sdq_lock()) return false;
+// oldest record. A failed read or allocation leaves the queue as it is, the
+// flusher tries again next cycle. Bad blocks or records are skipped one by
+// one, the queue is never dropped here
+bool sdq_card_peek(MessageBuffer_t *msg) {
+  if (!useSDCard || !qFile) return false;
+
+  while (qHdr.count) {
+    uint32_t nextOffset = 0;
+    sdq_res_t res = sdq_zipped()
+                        ? sdq_z_next(msg, false, &nextOffset)
+                        : sdq_read_record_at(qFile, qHdr.head, msg, nextOffset);
+    if (res == sdq_ok)
+      return true;
+    if (res == sdq_retry) {
+      ESP_LOGW(TAG, "DIAG peek: read or allocation failed, retried later");
+      return false;
+    }
+    if (!sdq_skip_locked(nextOffset))
+      return false;
+  }
+  return false;
+}
 
-  sdq_pause_csv();
+// public queue api, served by the sd service task
 
-  FileMySD f = mySD.open(PAXQUEUE_FILE, FILE_READ);
-  ESP_LOGI(TAG, "DIAG peek: open=%d exists=%d", (bool)f, mySD.exists(PAXQUEUE_FILE));
-  if (!f) { sdq_resume_csv(); sdq_unlock(); return false; }
+static int sdq_init_call(void *arg) { return sdq_card_init() ? 0 : -1; }
 
-  PaxQHeader h;
-  bool ok = readHeader(f, h);
-  ESP_LOGI(TAG, "DIAG peek: readHeader=%d count=%u head=%u tail=%u", ok, h.count, h.head, h.tail);
+bool sdqueueInit() { return sd_call(sdq_init_call, NULL) == 0; }
 
-  if (!ok || h.count == 0) { f.close(); sdq_resume_csv(); sdq_unlock(); return false; }
+bool sdqueueEnqueue(MessageBuffer_t *msg) {
+  if (!useSDCard || !msg) return false;
+  LAT_SCOPE(lat_sdq_enqueue);
+  return sd_request(sd_req_enqueue, msg) == 0;
+}
 
-  uint32_t nextOffset = 0;
-  ok = sdq_read_record_at(f, h.head, msg, nextOffset);
-  if (!ok) {
-      ESP_LOGE(TAG, "DIAG peek: record corrupted, purging queue");
-      f.close();
-      mySD.remove(PAXQUEUE_FILE);
-      sdqueueInit();
-      sdq_resume_csv();
-      sdq_unlock();
-      return false;
-  }
-  f.close();
-  sdq_resume_csv();
-  sdq_unlock();
-  return ok;
+bool sdqueueDequeue(MessageBuffer_t *msg) {
+  if (!useSDCard || !msg) return false;
+  LAT_SCOPE(lat_sdq_dequeue);
+  return sd_request(sd_req_dequeue, msg) == 0;
+}
+
+bool sdqueuePeek(MessageBuffer_t *msg) {
+  if (!useSDCard || !msg) return false;
+  return sd_request(sd_req_peek, msg) == 0;
+}
+
+uint32_t sdqueueCount() {
+  if (!useSDCard) return 0;
+  int n = sd_request(sd_req_count, NULL);
+  return n < 0 ? 0 : n;
 }
 
 void sdcardWriteFrame(MessageBuffer_t *message) {
@@ -728,7 +884,8 @@ void sdcardWriteFrame(MessageBuffer_t *message) {
 //                 SD BASE FUNCTIONS (LOG)
 // =======================================================
 
-bool sdcardInit() {
+// mounts the card and opens log and queue, runs on the sd service task
+bool sd_card_mount() {
   ESP_LOGI("SD", "🔍 Checking SD-card status...");
 
   if (useSDCard) {
@@ -737,6 +894,9 @@ bool sdcardInit() {
       fileSDCard.flush();
       fileSDCard.close();
     }
+    if (qFile)
+      qFile.close();
+    sdlog_card_close();
     useSDCard = false;
     delay(100);
   }
@@ -762,26 +922,32 @@ bool sdcardInit() {
   sprintf(filename, SDCARD_FILE_NAME, currentFileIndex);
   strncpy(sdLogFilename, filename, sizeof(sdLogFilename) - 1);
 
-  if (mySD.exists(filename)) {
+  if (mySD.exists(filename))
     ESP_LOGI("SD", "📂 Existing log file found: %s", filename);
-    fileSDCard = mySD.open(filename, FILE_WRITE);
-    fileSDCard.seek(fileSDCard.size());
-  } else {
+  else
     ESP_LOGI("SD", "🆕 Creating new log file: %s", filename);
-    fileSDCard = mySD.open(filename, FILE_WRITE);
-    if (fileSDCard) {
-      fileSDCard.println(SDCARD_FILE_HEADER);
-      fileSDCard.flush();
-    }
-  }
 
-  if (!fileSDCard) {
+  if (!openLogFile(filename)) {
     ESP_LOGE("SD", "❌ Failed to open file on SD.");
     useSDCard = false;
     return false;
   }
 
-  sdqueueInit();
+  sdq_card_init();
+  sdlog_card_open();
+#if (OCCUPANCY_SERIES)
+  occ_card_load();
+#endif
+  return true;
+}
+
+static int sd_mount_call(void *arg) { return sd_card_mount() ? 0 : -1; }
+
+bool sdcardInit() {
+  if (sd_service_init() != ESP_OK)
+    return false;
+  if (sd_call(sd_mount_call, NULL) != 0)
+    return false;
   sdqueueStartFlusher();
 
   ESP_LOGI("SD", "✅ SD-card initialized and ready for logging + persistent queue.");
@@ -790,23 +956,30 @@ bool sdcardInit() {
 
 bool isSDCardAvailable() { return useSDCard; }
 
-void sdcardWriteLine(const char *line) {
+// appends a csv line without flush, the service flushes batches of lines
+void sd_csv_append(const char *line) {
   if (!useSDCard) return;
-  if (sdqBusy) return;
   if (!fileSDCard) {
     ESP_LOGW("SD", "File closed, recreating...");
     createFile();
   }
   checkAndRotateLogFile();
-  fileSDCard.println(line);
-  fileSDCard.flush();
+  logOffset += fileSDCard.println(line);
 }
 
-void sdcardWriteData(uint16_t noWifi, uint16_t noBle) {
+void sd_csv_flush() {
+  if (fileSDCard)
+    fileSDCard.flush();
+}
+
+void sdcardWriteLine(const char *line) {
   if (!useSDCard) return;
-  if (sdqBusy) return;
+  if (!sd_post_line(line, NULL, NULL))
+    ESP_LOGW("SD", "SD service busy, log line dropped");
+}
 
-  if (!fileSDCard) createFile();
+void sdcardWriteData(uint16_t noWifi, uint16_t noBle) {
+  if (!useSDCard) return;
 
   String dataLine = String(noWifi) + "," + String(noBle);
 
@@ -815,22 +988,20 @@ void sdcardWriteData(uint16_t noWifi, uint16_t noBle) {
     dataLine += "," + String(voltage, 2);
   #endif
 
-  fileSDCard.println(dataLine);
-
-  ESP_LOGI("SD_CSV", "📝 Dato escrito en SD: WiFi=%d BLE=%d", noWifi, noBle);
-
-  static int writeCntr = 0;
-  if (++writeCntr > 5) {
-    fileSDCard.flush();
-    writeCntr = 0;
-  }
+  if (sd_post_line(dataLine.c_str(), NULL, NULL))
+    ESP_LOGI("SD_CSV", "📝 Dato escrito en SD: WiFi=%d BLE=%d", noWifi, noBle);
 }
 
 // =======================================================
 //             NB CONFIG SAVE/LOAD (SD independent)
 // =======================================================
 
-void sdSaveNbConfig(ConfigBuffer_t *config) {
+static const char *nbPowerName(nbpower_t power) {
+  return power == nb_power_psm ? "psm" : power == nb_power_edrx ? "edrx" : "on";
+}
+
+static int sd_save_nb_config(void *arg) {
+  ConfigBuffer_t *config = (ConfigBuffer_t *)arg;
   char path[] = "nb.cnf";
 
   if (mySD.exists(path)) mySD.remove(path);
@@ -843,20 +1014,28 @@ void sdSaveNbConfig(ConfigBuffer_t *config) {
   doc["applicationName"] = config->ApplicationName;
   doc["gatewayId"]       = config->GatewayId;
   doc["port"]            = config->port;
+  doc["transport"]       = (config->transport == nb_coap) ? "coap" : "mqtt";
+  doc["coapPort"]        = config->coapPort;
+  doc["power"]           = nbPowerName(config->power);
 
   char buff[512];
   size_t n = serializeJson(doc, buff, sizeof(buff));
   if (!n) {
     ESP_LOGE(TAG, "nb.cnf: serializeJson failed");
-    return;
+    return -1;
   }
 
   if (!nb_encrypt_and_write(path, (const uint8_t*)buff, n)) {
     ESP_LOGE(TAG, "nb.cnf: encrypted save failed");
-    return;
+    return -1;
   }
 
   ESP_LOGI(TAG, "🔒 nb.cnf encrypted and saved.");
+  return 0;
+}
+
+void sdSaveNbConfig(ConfigBuffer_t *config) {
+  sd_call(sd_save_nb_config, config);
 }
 
 static void saveDefaultNbConfig() {
@@ -870,11 +1049,15 @@ static void saveDefaultNbConfig() {
   strncpy(conf.ApplicationName, DEFAULT_APPNAME,    sizeof(conf.ApplicationName) - 1);
   strncpy(conf.GatewayId,       DEFAULT_GATEWAY_ID, sizeof(conf.GatewayId) - 1);
   conf.port = DEFAULT_PORT;
+  conf.transport = DEFAULT_TRANSPORT;
+  conf.coapPort = DEFAULT_COAP_PORT;
+  conf.power = DEFAULT_NB_POWER;
 
   sdSaveNbConfig(&conf);
 }
 
-int sdLoadNbConfig(ConfigBuffer_t *config) {
+static int sd_load_nb_config(void *arg) {
+  ConfigBuffer_t *config = (ConfigBuffer_t *)arg;
   if (!useSDCard) {
     ESP_LOGW(TAG, "SD not detected -> using DEFAULT NB config (SD independent mode).");
     memset(config, 0, sizeof(ConfigBuffer_t));
@@ -885,6 +1068,9 @@ int sdLoadNbConfig(ConfigBuffer_t *config) {
     strncpy(config->ApplicationName, DEFAULT_APPNAME,    sizeof(config->ApplicationName) - 1);
     strncpy(config->GatewayId,       DEFAULT_GATEWAY_ID, sizeof(config->GatewayId) - 1);
     config->port = DEFAULT_PORT;
+    config->transport = DEFAULT_TRANSPORT;
+    config->coapPort = DEFAULT_COAP_PORT;
+    config->power = DEFAULT_NB_POWER;
     ESP_LOGI(TAG, "✅ NB defaults loaded: server=%s port=%d appId=%s gw=%s",
              config->ServerAddress, config->port, config->ApplicationId, config->GatewayId);
     return 0;
@@ -922,6 +1108,14 @@ int sdLoadNbConfig(ConfigBuffer_t *config) {
   const char *applicationName = doc["applicationName"];
   const char *gatewayId       = doc["gatewayId"];
   config->port = doc["port"] | 0;
+  // files written before CoAP support have no transport and stay on MQTT
+  const char *transport = doc["transport"] | "mqtt";
+  config->transport = strcmp(transport, "coap") ? nb_mqtt : nb_coap;
+  config->coapPort = doc["coapPort"] | DEFAULT_COAP_PORT;
+  const char *power = doc["power"] | "on";
+  config->power = !strcmp(power, "psm")    ? nb_power_psm
+                  : !strcmp(power, "edrx") ? nb_power_edrx
+                                           : nb_power_on;
 
   if (!serverAddress || !serverPassword || !serverUsername ||
       !applicationId || !applicationName || !gatewayId) {
@@ -936,49 +1130,67 @@ int sdLoadNbConfig(ConfigBuffer_t *config) {
   strncpy(config->ApplicationName, applicationName, sizeof(config->ApplicationName) - 1);
   strncpy(config->GatewayId,       gatewayId,       sizeof(config->GatewayId) - 1);
 
-  ESP_LOGI(TAG, "✅ nb.cnf loaded (encrypted at rest).");
+  ESP_LOGI(TAG, "✅ nb.cnf loaded (encrypted at rest), transport %s, power %s.",
+           transport, nbPowerName(config->power));
   return 0;
 }
 
+int sdLoadNbConfig(ConfigBuffer_t *config) {
+  // defaults need no card and no running service
+  if (!useSDCard)
+    return sd_load_nb_config(config);
+  return sd_call(sd_load_nb_config, config);
+}
+
 // =======================================================
 //                 LOG FILE HELPERS
 // =======================================================
 
-static void createFile(void) {
-  char bufferFilename[16];
-  sprintf(bufferFilename, SDCARD_FILE_NAME, 0);
-  strncpy(sdLogFilename, bufferFilename, sizeof(sdLogFilename) - 1);
-  fileIndex = 0;
+// opens a log for appending, a new log gets SDCARD_LOG_SIZE preallocated as
+// one contiguous extent so appends need no FAT lookups or updates
+static bool openLogFile(char *filename) {
+  bool fresh = !mySD.exists(filename);
 
-  if (mySD.exists(bufferFilename)) mySD.remove(bufferFilename);
+  fileSDCard = mySD.open(filename, FILE_WRITE);
+  if (!fileSDCard) return false;
 
-  fileSDCard = mySD.open(bufferFilename, FILE_WRITE);
-  if (fileSDCard) {
+  if (fresh) {
+    if (!fileSDCard.preAllocate(SDCARD_LOG_SIZE))
+      ESP_LOGW("SD", "No contiguous space for %s, log grows by cluster", filename);
     fileSDCard.println(SDCARD_FILE_HEADER);
     fileSDCard.flush();
-    useSDCard = true;
+  } else if (!fileSDCard.isContiguous()) {
+    ESP_LOGW("SD", "%s is not contiguous, appends follow the FAT", filename);
   }
+  logOffset = fileSDCard.position();
+  return true;
 }
 
-static void checkAndRotateLogFile(void) {
-  if (!fileSDCard) return;
-
-  size_t size = fileSDCard.size();
+// (re)opens the log of currentFileIndex
+static void createFile(void) {
+  char bufferFilename[16];
+  sprintf(bufferFilename, SDCARD_FILE_NAME, currentFileIndex);
+  strncpy(sdLogFilename, bufferFilename, sizeof(sdLogFilename) - 1);
+  fileIndex = currentFileIndex;
 
-  // Sanity check: si size() devuelve un valor absurdo, ignorar
-  if (size > (2ULL * 1024 * 1024 * 1024)) {
-    ESP_LOGW("SD_ROT", "⚠️ fileSDCard.size() returned invalid value: %u, skipping rotation", size);
-    return;
-  }
+  if (openLogFile(bufferFilename))
+    useSDCard = true;
+}
 
-  if (size < MAX_LOG_FILE_SIZE) return;
+// rotates before a line could overrun the preallocated extent
+static void checkAndRotateLogFile(void) {
+  if (!fileSDCard) return;
+  if (logOffset + SD_LINE_MAX + 1 <= SDCARD_LOG_SIZE) return;
 
-  ESP_LOGW("SD_ROT", "🔄 Archivo lleno (%.2f MB). Rotando log...", size / (1024.0 * 1024.0));
+  ESP_LOGW("SD_ROT", "🔄 Archivo lleno (%.2f MB). Rotando log...", logOffset / (1024.0 * 1024.0));
 
   fileSDCard.flush();
   fileSDCard.close();
 
   currentFileIndex++;
+  char filename[16];
+  sprintf(filename, SDCARD_FILE_NAME, currentFileIndex);
+  if (mySD.exists(filename)) mySD.remove(filename);
   createFile();
 }
 
@@ -1019,22 +1231,17 @@ static void sdqueueFlusher(void *param) {
       continue;
     }
 
-    ESP_LOGI("SD_FLUSH", "📤 Starting flush cycle: %u messages pending", pending);
+    DLOG(dlog_sdq_flush_cycle, pending);
 
+    // this task is the only consumer, so head stays put between peek and
+    // dequeue, each call is one request to the sd service
     for (int i = 0; i < MAX_PER_CYCLE; i++) {
-      if (!sdq_lock()) {
-        ESP_LOGW("SD_FLUSH", "⚠️ Could not acquire SD mutex, skipping cycle");
-        break;
-      }
-
       MessageBuffer_t msg;
       bool has_msg = sdqueuePeek(&msg);
-      ESP_LOGI("SD_FLUSH", "DIAG peek result: %d", has_msg);
+      DLOG(dlog_sdq_peek, has_msg);
 
-      if (!has_msg) {
-        sdq_unlock();
+      if (!has_msg)
         break;
-      }
 
       bool delivered = false;
 
@@ -1055,15 +1262,11 @@ static void sdqueueFlusher(void *param) {
         MessageBuffer_t dumped;
         sdqueueDequeue(&dumped);
         uint32_t remaining = sdqueueCount();
-        sdq_unlock();
 
-        ESP_LOGI("SD_FLUSH",
-                 "✅ Message delivered from SD (port %u, %u bytes, %u remaining)",
-                 msg.MessagePort, msg.MessageSize, remaining);
+        DLOG(dlog_sdq_delivered, msg.MessagePort, msg.MessageSize, remaining);
 
         vTaskDelay(pdMS_TO_TICKS(20));
       } else {
-        sdq_unlock();
         ESP_LOGW("SD_FLUSH", "⏸Cannot deliver - queues full, will retry");
         break;
       }
@@ -1076,7 +1279,7 @@ static void sdqueueFlusher(void *param) {
 
 void sdqueueStartFlusher() {
   if (sdqFlusherTask) return;
-  xTaskCreatePinnedToCore(sdqueueFlusher, "sdqFlusher", 4096, NULL, 1, &sdqFlusherTask, 1);
+  mem_task_create(MEM_TASK_SDQFLUSHER, sdqueueFlusher, NULL, 1, &sdqFlusherTask, 1);
 }
 
 // ==========================================================
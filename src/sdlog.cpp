@@ -0,0 +1,183 @@
+/* sdlog keeps a compact binary log of TX events on the SD card. Producers
+append fixed records (timestamp, channel, reason, port, size, payload) to one
+of two RAM buffers, no formatting is done on their task. The sd service
+commits the filled buffer as one frame when it reaches SDLOG_WATERMARK or its
+oldest record is SDLOG_FLUSH_MS old, producers continue in the other buffer
+meanwhile. Every frame starts with a magic, a sequence number and a crc, so a
+reader can resync after a torn write. src/SdLog/sdlog2csv.py converts the
+files back to the csv lines that were written to paxcount.NN before. */
+
+// Basic Config
+#include "sdcard.h"
+
+#ifdef HAS_SDCARD
+
+// Local logging tag
+static const char TAG[] = "sdlog";
+
+// records start behind room for the frame header
+static uint8_t logBuf[2][sizeof(sdlog_frame_t) + SDLOG_BUF_SIZE];
+static uint8_t logActive = 0;    // buffer producers append to
+static uint16_t logFill = 0;     // record bytes in active buffer
+static uint16_t logRecords = 0;  // records in active buffer
+static uint32_t logSince = 0;    // [ms] first record of active buffer
+static bool logKicked = false;   // commit request posted
+static portMUX_TYPE logMux = portMUX_INITIALIZER_UNLOCKED;
+
+static FileMySD logFile;
+static int logIndex = 0;
+static uint32_t logOffset = 0; // write offset in logFile
+static uint32_t logSeq = 0;
+
+static struct {
+  uint32_t records, dropped; // dropped: buffer full
+  uint32_t frames, bytes, lost; // lost: frame not written
+  uint32_t max_us;              // slowest commit
+} logStats;
+
+static void sdlog_kick(void) {
+  sd_req_t req;
+  req.type = sd_req_log;
+  req.done = NULL;
+  if (!sd_post(&req, 0)) {
+    portENTER_CRITICAL(&logMux);
+    logKicked = false;
+    portEXIT_CRITICAL(&logMux);
+  }
+}
+
+// any task, copies the record into the active buffer
+bool sdlog_write(uint8_t channel, uint8_t reason, const MessageBuffer_t *m) {
+  if (!isSDCardAvailable() || !m)
+    return false;
+
+  sdlog_rec_t r;
+  r.ts = (uint32_t)now();
+  r.channel = channel;
+  r.reason = reason;
+  r.port = m->MessagePort;
+  r.size = m->MessageSize;
+  uint16_t n = sizeof(r) + r.size;
+
+  bool kick = false;
+  portENTER_CRITICAL(&logMux);
+  bool fits = (logFill + n) <= SDLOG_BUF_SIZE;
+  if (fits) {
+    uint8_t *p = logBuf[logActive] + sizeof(sdlog_frame_t) + logFill;
+    memcpy(p, &r, sizeof(r));
+    memcpy(p + sizeof(r), m->Message, r.size);
+    if (!logFill)
+      logSince = millis();
+    logFill += n;
+    logRecords++;
+    logStats.records++;
+    if ((logFill >= SDLOG_WATERMARK) && !logKicked)
+      kick = logKicked = true;
+  } else {
+    logStats.dropped++;
+  }
+  portEXIT_CRITICAL(&logMux);
+
+  if (kick)
+    sdlog_kick();
+  return fits;
+}
+
+static bool sdlog_open(bool rotate) {
+  char name[16];
+  snprintf(name, sizeof(name), SDLOG_FILE_NAME, logIndex);
+  if (rotate && mySD.exists(name))
+    mySD.remove(name);
+
+  bool fresh = !mySD.exists(name);
+  logFile = mySD.open(name, FILE_WRITE);
+  if (!logFile) {
+    ESP_LOGE(TAG, "Could not open %s", name);
+    return false;
+  }
+  if (fresh && !logFile.preAllocate(SDLOG_FILE_SIZE))
+    ESP_LOGW(TAG, "No contiguous space for %s, log grows by cluster", name);
+  logOffset = logFile.position();
+  ESP_LOGI(TAG, "Logging TX events to %s at offset %u", name, logOffset);
+  return true;
+}
+
+// continues the newest log, runs on the sd service task
+bool sdlog_card_open(void) {
+  sdlog_card_close();
+  logIndex = 0;
+  for (int i = 0; i < 100; i++) {
+    char name[16];
+    snprintf(name, sizeof(name), SDLOG_FILE_NAME, i);
+    if (!mySD.exists(name)) {
+      logIndex = i ? i - 1 : 0;
+      break;
+    }
+  }
+  return sdlog_open(false);
+}
+
+void sdlog_card_close(void) {
+  if (logFile) {
+    sdlog_commit(0);
+    logFile.close();
+  }
+}
+
+// writes the active buffer as one frame if it is due, on the sd service task
+void sdlog_commit(uint32_t maxAge) {
+  uint8_t *buf;
+  uint16_t len, records;
+
+  portENTER_CRITICAL(&logMux);
+  len = logFill;
+  records = logRecords;
+  bool due = len && ((len >= SDLOG_WATERMARK) || (millis() - logSince >= maxAge));
+  if (due) {
+    buf = logBuf[logActive];
+    logActive ^= 1;
+    logFill = 0;
+    logRecords = 0;
+    logKicked = false;
+  }
+  portEXIT_CRITICAL(&logMux);
+  if (!due)
+    return;
+
+  uint32_t t0 = micros();
+  sdlog_frame_t f;
+  f.magic = SDLOG_MAGIC;
+  f.seq = logSeq++;
+  f.len = len;
+  f.crc = crc16_ccitt((const uint8_t *)&f.seq, sizeof(f.seq) + sizeof(f.len));
+  f.crc = crc16_ccitt(buf + sizeof(f), len, f.crc);
+  memcpy(buf, &f, sizeof(f));
+
+  uint32_t n = sizeof(f) + len;
+  if (logFile && (logOffset + n > SDLOG_FILE_SIZE)) {
+    logFile.close();
+    logIndex = (logIndex + 1) % 100;
+    sdlog_open(true);
+  }
+  if (!logFile || (logFile.write(buf, n) != n)) {
+    logStats.lost += records;
+    return;
+  }
+  logFile.flush();
+  logOffset += n;
+
+  uint32_t us = micros() - t0;
+  logStats.frames++;
+  logStats.bytes += n;
+  if (us > logStats.max_us)
+    logStats.max_us = us;
+}
+
+void sdlog_print_stats(void) {
+  ESP_LOGD(TAG, "%u records, %u dropped, %u lost, %u frames %u bytes, "
+                "slowest commit %u us",
+           logStats.records, logStats.dropped, logStats.lost, logStats.frames,
+           logStats.bytes, logStats.max_us);
+}
+
+#endif // HAS_SDCARD
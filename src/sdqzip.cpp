@@ -0,0 +1,76 @@
+/* sdqzip compresses the sealed blocks of the SD queue with the deflater and
+inflater bundled in lib/ESP32-targz. A block is one raw deflate stream with a
+single static huffman block, the window covers the whole block, so no
+dictionary is kept between blocks and every block inflates on its own. */
+
+#include <stdlib.h>
+#include <string.h>
+
+// defl_static.h has no C linkage guard of its own
+extern "C" {
+#include <uzlib/uzlib.h>
+}
+
+#include "sdqzip.h"
+
+uint8_t *sdqzip_deflate(const uint8_t *raw, uint16_t len, uint16_t *zLen) {
+  struct uzlib_comp c;
+  memset(&c, 0, sizeof(c));
+  c.hash_bits = SDQZIP_HASH_BITS;
+  c.dict_size = len;
+  c.hash_table = (uzlib_hash_entry_t *)calloc(1 << SDQZIP_HASH_BITS,
+                                              sizeof(uzlib_hash_entry_t));
+  // worst case is 9 bits per literal, sized so outbits() never reallocs
+  c.out.outsize = len + len / 8 + 16;
+  c.out.outbuf = (unsigned char *)malloc(c.out.outsize);
+  if (!c.hash_table || !c.out.outbuf) {
+    free(c.hash_table);
+    free(c.out.outbuf);
+    return NULL;
+  }
+
+  zlib_start_block(&c.out);
+  uzlib_compress(&c, raw, len);
+  zlib_finish_block(&c.out);
+  free(c.hash_table);
+
+  *zLen = c.out.outlen;
+  return c.out.outbuf;
+}
+
+// source reader bounded by the block, the fork's uzlib_get_byte() does not
+// check source_limit itself
+struct sdqzip_src {
+  TINF_DATA d; // first, the callback gets its address
+  const uint8_t *p, *end;
+};
+
+static unsigned int sdqzip_read(TINF_DATA *d, unsigned char *out) {
+  sdqzip_src *s = (sdqzip_src *)d;
+  if (s->p >= s->end) {
+    *out = 0;
+    return (unsigned int)-1;
+  }
+  *out = *s->p++;
+  return 0;
+}
+
+static void sdqzip_nolog(const char *format, ...) {}
+
+bool sdqzip_inflate(const uint8_t *z, uint16_t zLen, uint8_t *raw,
+                    uint16_t rawLen) {
+  if (!rawLen)
+    return false;
+  sdqzip_src s;
+  memset(&s, 0, sizeof(s));
+  s.p = z;
+  s.end = z + zLen;
+  s.d.readSourceByte = sdqzip_read;
+  s.d.log = sdqzip_nolog;
+  s.d.destStart = s.d.dest = raw;
+  s.d.destSize = s.d.destRemaining = rawLen;
+
+  uzlib_uncompress_init(&s.d, NULL, 0);
+  int res = uzlib_uncompress(&s.d);
+  return (res == TINF_OK) && (s.d.dest == raw + rawLen);
+}
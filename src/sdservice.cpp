@@ -0,0 +1,345 @@
+/* sdservice serializes all SD card access on one task. The task owns the card,
+the csv log handle and the persistent queue file, other tasks post typed
+requests to its queue. CSV lines are appended without flush and flushed in
+batches every SD_FLUSH_MS, binary TX log records (sdlog.cpp) are committed
+on a fill watermark or when older than SDLOG_FLUSH_MS, queue requests are
+answered synchronously through their completion callback. Code that needs the card for a longer sequence
+of file operations (updater, FUOTA store) borrows it with sd_borrow(), the
+service flushes its handles and waits until the card is returned, requests
+posted meanwhile stay queued. Borrowers keep the card for one file chunk at
+a time, so queued requests are served between chunks. Requests of the
+borrower itself are served inline on its task. CSV lines that find the queue
+full are parked in an overflow buffer and appended, in order, once the queue
+has drained. Post to completion latency is collected per
+request type in log2 histograms, see sd_print_stats(). */
+
+// Basic Config
+#include "sdcard.h"
+
+#ifdef HAS_SDCARD
+
+// Local logging tag
+static const char TAG[] = "sdservice";
+
+typedef struct {
+  uint32_t count;
+  uint32_t dropped; // queue full, request not posted
+  uint32_t max_us;
+  uint32_t hist[SD_HIST_BUCKETS];
+} sd_stat_t;
+
+static const char *const reqName[SD_REQ_TYPES] = {
+    "line", "enqueue", "dequeue", "peek", "count", "call", "lend", "log"};
+
+static QueueHandle_t sdQueue = NULL;
+static TaskHandle_t sdTask = NULL;
+static TaskHandle_t borrower = NULL;
+static uint8_t borrowDepth = 0; // nested sd_borrow() of the borrower
+static SemaphoreHandle_t lendReturned = NULL;
+static char *overflow = NULL; // parked csv lines, '\0' terminated
+static uint32_t ovHead = 0, ovTail = 0;
+static uint32_t ovLost = 0; // lines dropped with overflow buffer full
+static portMUX_TYPE ovMux = portMUX_INITIALIZER_UNLOCKED;
+static StaticSemaphore_t lendReturnedBuf;
+static sd_stat_t stats[SD_REQ_TYPES];
+static portMUX_TYPE statMux = portMUX_INITIALIZER_UNLOCKED;
+
+static bool onServiceTask(void) {
+  return xTaskGetCurrentTaskHandle() == sdTask;
+}
+
+// the borrower owns the card, the service task is waiting for its return
+static bool onBorrower(void) {
+  return borrower && (borrower == xTaskGetCurrentTaskHandle());
+}
+
+static bool sd_overflow_pending(void) { return ovHead != ovTail; }
+
+static bool sd_overflow_put(const char *line) {
+  size_t len = strnlen(line, SD_LINE_MAX - 1);
+  bool ok = false;
+  portENTER_CRITICAL(&ovMux);
+  if (overflow && (ovTail + len + 1 <= SD_LINE_OVERFLOW)) {
+    memcpy(overflow + ovTail, line, len);
+    overflow[ovTail + len] = 0;
+    ovTail += len + 1;
+    ok = true;
+  } else
+    ovLost++;
+  portEXIT_CRITICAL(&ovMux);
+  return ok;
+}
+
+// appends parked lines, service task only. Returns true if any were written
+static bool sd_overflow_drain(void) {
+  char line[SD_LINE_MAX];
+  bool any = false;
+  while (sd_overflow_pending()) {
+    portENTER_CRITICAL(&ovMux);
+    size_t len = strlen(overflow + ovHead);
+    memcpy(line, overflow + ovHead, len + 1);
+    ovHead += len + 1;
+    if (ovHead == ovTail)
+      ovHead = ovTail = 0;
+    portEXIT_CRITICAL(&ovMux);
+    sd_csv_append(line);
+    any = true;
+  }
+  return any;
+}
+
+// bucket 0 is < 1 ms, bucket n holds [2^(n-1), 2^n) ms, last one the rest
+static void sd_account(uint8_t type, uint32_t us) {
+  uint32_t ms = us / 1000;
+  int b = 0;
+  while (ms && (b < SD_HIST_BUCKETS - 1)) {
+    ms >>= 1;
+    b++;
+  }
+  portENTER_CRITICAL(&statMux);
+  stats[type].count++;
+  stats[type].hist[b]++;
+  if (us > stats[type].max_us)
+    stats[type].max_us = us;
+  portEXIT_CRITICAL(&statMux);
+}
+
+static int sd_serve(sd_req_t *req) {
+  switch (req->type) {
+  case sd_req_line:
+    sd_csv_append(req->u.line);
+    return 0;
+  case sd_req_enqueue:
+    return sdq_card_enqueue(&req->u.msg) ? 0 : -1;
+  case sd_req_dequeue:
+    return sdq_card_dequeue(req->u.out) ? 0 : -1;
+  case sd_req_peek:
+    return sdq_card_peek(req->u.out) ? 0 : -1;
+  case sd_req_count:
+    return sdq_card_count();
+  case sd_req_call:
+    return req->u.call.fn(req->u.call.arg);
+  case sd_req_log:
+    sdlog_commit(0);
+    return 0;
+  default:
+    return -1;
+  }
+}
+
+static void sd_loop(void *pvParameters) {
+  sd_req_t req;
+  bool dirty = false;
+  uint32_t dirtySince = 0;
+
+  for (;;) {
+    // wake up at least every SDLOG_FLUSH_MS for due TX log records
+    TickType_t wait = pdMS_TO_TICKS(SDLOG_FLUSH_MS);
+    if (dirty) {
+      uint32_t age = millis() - dirtySince;
+      if (age >= SD_FLUSH_MS)
+        wait = 0;
+      else if (SD_FLUSH_MS - age < SDLOG_FLUSH_MS)
+        wait = pdMS_TO_TICKS(SD_FLUSH_MS - age);
+    }
+    if (xQueueReceive(sdQueue, &req, wait) != pdTRUE) {
+      if (sd_overflow_drain() && !dirty) {
+        dirty = true;
+        dirtySince = millis();
+      }
+      if (dirty && (millis() - dirtySince >= SD_FLUSH_MS)) {
+        sd_csv_flush();
+        dirty = false;
+      }
+      sdlog_commit(SDLOG_FLUSH_MS);
+      continue;
+    }
+
+    if (req.type == sd_req_lend) {
+      // borrower gets a flushed card, we wait until it is returned
+      crash_note(ct_sd_begin, req.type, 0);
+      sd_csv_flush();
+      sdlog_commit(0);
+      dirty = false;
+      sd_account(req.type, micros() - req.posted);
+      req.done(0, req.ctx);
+      xSemaphoreTake(lendReturned, portMAX_DELAY);
+      crash_note(ct_sd_end, req.type, 0);
+      // the borrower may have appended csv lines inline
+      dirty = true;
+      dirtySince = millis();
+      continue;
+    }
+
+    if ((req.type == sd_req_line) && !dirty) {
+      dirty = true;
+      dirtySince = millis();
+    }
+    crash_note(ct_sd_begin, req.type, 0);
+    int res = sd_serve(&req);
+    crash_note(ct_sd_end, req.type, res);
+    sd_account(req.type, micros() - req.posted);
+    if (req.done)
+      req.done(res, req.ctx);
+    // parked lines are newer than all queued ones
+    if (!uxQueueMessagesWaiting(sdQueue) && sd_overflow_drain() && !dirty) {
+      dirty = true;
+      dirtySince = millis();
+    }
+    // a busy service never times out, due log records go out here then
+    sdlog_commit(SDLOG_FLUSH_MS);
+  }
+}
+
+bool sd_post(sd_req_t *req, TickType_t wait) {
+  if (sdQueue == NULL)
+    return false;
+  req->posted = micros();
+  if (xQueueSendToBack(sdQueue, req, wait) == pdTRUE)
+    return true;
+  portENTER_CRITICAL(&statMux);
+  stats[req->type].dropped++;
+  portEXIT_CRITICAL(&statMux);
+  return false;
+}
+
+typedef struct {
+  SemaphoreHandle_t done;
+  int result;
+} sd_sync_t;
+
+static void sd_sync_done(int result, void *ctx) {
+  sd_sync_t *s = (sd_sync_t *)ctx;
+  s->result = result;
+  xSemaphoreGive(s->done);
+}
+
+// posts request and waits for its completion, served inline on own task and
+// on the borrower's, which would wait for itself otherwise
+static int sd_sync(sd_req_t *req) {
+  if (onServiceTask() || onBorrower())
+    return sd_serve(req);
+
+  StaticSemaphore_t buf;
+  sd_sync_t s = {xSemaphoreCreateBinaryStatic(&buf), -1};
+  req->done = sd_sync_done;
+  req->ctx = &s;
+  if (sd_post(req, portMAX_DELAY))
+    xSemaphoreTake(s.done, portMAX_DELAY);
+  vSemaphoreDelete(s.done);
+  return s.result;
+}
+
+// async, waits at most SD_POST_WAIT_MS for room in the request queue, not at
+// all while the card is lent. Lines that find no room are parked in the
+// overflow buffer, and so are later ones until it is drained, to keep their
+// order. Parked lines complete at once
+bool sd_post_line(const char *line, sd_done_t done, void *ctx) {
+  if (onServiceTask() || onBorrower()) {
+    sd_csv_append(line);
+    return true;
+  }
+  if (!sd_overflow_pending()) {
+    sd_req_t req;
+    req.type = sd_req_line;
+    req.done = done;
+    req.ctx = ctx;
+    strlcpy(req.u.line, line, sizeof(req.u.line));
+    if (sd_post(&req, borrower ? 0 : pdMS_TO_TICKS(SD_POST_WAIT_MS)))
+      return true;
+  }
+  if (!sd_overflow_put(line))
+    return false;
+  if (done)
+    done(0, ctx);
+  return true;
+}
+
+// persistent queue requests, returns 0 or count on success, < 0 on failure
+int sd_request(sd_req_type_t type, MessageBuffer_t *msg) {
+  sd_req_t req;
+  req.type = type;
+  if (type == sd_req_enqueue)
+    memcpy(&req.u.msg, msg, sizeof(req.u.msg));
+  else
+    req.u.out = msg;
+  return sd_sync(&req);
+}
+
+int sd_call(sd_fn_t fn, void *arg) {
+  sd_req_t req;
+  req.type = sd_req_call;
+  req.u.call.fn = fn;
+  req.u.call.arg = arg;
+  return sd_sync(&req);
+}
+
+// caller may use mySD directly until sd_return(), calls may nest. Returns
+// false if the card could not be lent, the caller must not touch it then and
+// must not call sd_return(). Keep borrows to one file chunk, other tasks wait
+// for the card meanwhile
+bool sd_borrow(void) {
+  if (onServiceTask())
+    return true;
+  if (onBorrower()) {
+    borrowDepth++;
+    return true;
+  }
+  sd_req_t req;
+  req.type = sd_req_lend;
+  if (sd_sync(&req) != 0) {
+    ESP_LOGE(TAG, "SD card could not be lent");
+    return false;
+  }
+  borrower = xTaskGetCurrentTaskHandle();
+  borrowDepth = 1;
+  return true;
+}
+
+void sd_return(void) {
+  if ((borrower != xTaskGetCurrentTaskHandle()) || --borrowDepth)
+    return;
+  borrower = NULL;
+  xSemaphoreGive(lendReturned);
+}
+
+esp_err_t sd_service_init(void) {
+  if (sdTask)
+    return ESP_OK;
+  sdQueue = mem_queue_create(MEM_QUEUE_SDREQ);
+  lendReturned = xSemaphoreCreateBinaryStatic(&lendReturnedBuf);
+  overflow = (char *)mem_buffer_get(MEM_BUF_SDLINES);
+  if (sdQueue == NULL) {
+    ESP_LOGE(TAG, "Could not create SD request queue");
+    return ESP_FAIL;
+  }
+  if (mem_task_create(MEM_TASK_SDSERVICE, sd_loop, NULL, 2, &sdTask, 1) !=
+      pdPASS)
+    return ESP_FAIL;
+  ESP_LOGI(TAG, "SD service started, %u request slots", SD_REQ_QUEUE_SIZE);
+  return ESP_OK;
+}
+
+void sd_print_stats(void) {
+  char hist[SD_HIST_BUCKETS * 7 + 1];
+
+  ESP_LOGD(TAG, "latency [ms]    <1 <2 <4 <8 <16 <32 <64 <128 <256 <512 "
+                "<1024 >=1024");
+  for (int t = 0; t < SD_REQ_TYPES; t++) {
+    sd_stat_t s;
+    portENTER_CRITICAL(&statMux);
+    s = stats[t];
+    portEXIT_CRITICAL(&statMux);
+    if (!s.count && !s.dropped)
+      continue;
+    int n = 0;
+    for (int b = 0; b < SD_HIST_BUCKETS; b++)
+      n += snprintf(hist + n, sizeof(hist) - n, " %u", s.hist[b]);
+    ESP_LOGD(TAG, "%-7s %6u reqs, max %u us, dropped %u:%s", reqName[t],
+             s.count, s.max_us, s.dropped, hist);
+  }
+  if (ovLost)
+    ESP_LOGD(TAG, "csv lines lost with overflow buffer full: %u", ovLost);
+}
+
+#endif // HAS_SDCARD
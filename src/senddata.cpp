@@ -7,17 +7,16 @@
 
 static const char TAG[] = "senddata";
 
-Ticker sendcycler;
+int sendcycleJob = -1;
 bool sent = false;
 // Canal de último envío de contadores: 0=ninguno, 1=LoRa, 2=NB-IoT, 3=SD
 uint8_t lastSendChannel = 0;
 
-void sendcycle() {
-  xTaskNotifyFromISR(irqHandlerTask, SENDCYCLE_IRQ, eSetBits, NULL);
-}
+void sendcycle() { xTaskNotify(irqHandlerTask, SENDCYCLE_IRQ, eSetBits); }
 
 // put data to send in RTos Queues used for transmit over channels Lora and SPI
 void SendPayload(uint8_t port, sendprio_t prio) {
+  LAT_SCOPE(lat_send_payload);
 
   MessageBuffer_t SendBuffer;
   SendBuffer.MessageSize = payload.getSize();
@@ -239,7 +238,12 @@ void sendData() {
         }
       }
 
-      if (cfg.countermode != 1) {
+      if (cfg.countermode == COUNTER_SLIDING) {
+        // counts slide on, only the hash lists of this cycle start over
+        macs_list_wifi.clear();
+        macs_list_ble.clear();
+        macs_list_bt.clear();
+      } else if (cfg.countermode != 1) {
         reset_counters();
         get_salt();
         ESP_LOGI(TAG, "Counter cleared");
@@ -299,216 +303,226 @@ void sendData() {
     mask <<= 1;
   } // while
 
+#if (CRASH_TRACE)
+  crash_send(); // trace of a crashed previous run, if any
+#endif
+
+#if (HAS_NBIOT)
+  nb_sendcycle();
+#endif
+} // sendData()
+
 // === ADEMUX: Health check LoRa (cada HEALTHCHECK_INTERVAL_MINUTES) ===
-  {
-    static unsigned long lastHealthCheck = 0;
-    if ((millis() - lastHealthCheck) >= (HEALTHCHECK_INTERVAL_MINUTES * 60 * 1000)) {
-      lastHealthCheck = millis();
-
-      uint32_t uptime = (uint32_t)(millis() / 1000);
-      uint8_t cputemp = (uint8_t)round(temperatureRead());
-      uint16_t free_heap_div16 = (uint16_t)(ESP.getFreeHeap() / 16);
-      uint16_t min_heap_div16 = (uint16_t)(ESP.getMinFreeHeap() / 16);
-      uint8_t reset_reason = (uint8_t)esp_reset_reason();
-
-      uint8_t flags1 = 0;
-      flags1 |= (wifi_radio_ok ? 1 : 0) << 7;
-      flags1 |= (ble_module_ok ? 1 : 0) << 6;
-      flags1 |= (bt_module_ok ? 1 : 0) << 5;
+void healthcheck() { xTaskNotify(irqHandlerTask, HEALTHCHECK_IRQ, eSetBits); }
+
+void sendHealthCheck() {
+  uint32_t uptime = (uint32_t)(millis() / 1000);
+  uint8_t cputemp = (uint8_t)round(temperatureRead());
+  uint16_t free_heap_div16 = (uint16_t)(ESP.getFreeHeap() / 16);
+  uint16_t min_heap_div16 = (uint16_t)(ESP.getMinFreeHeap() / 16);
+  uint8_t reset_reason = (uint8_t)esp_reset_reason();
+
+  uint8_t flags1 = 0;
+  flags1 |= (wifi_radio_ok ? 1 : 0) << 7;
+  flags1 |= (ble_module_ok ? 1 : 0) << 6;
+  flags1 |= (bt_module_ok ? 1 : 0) << 5;
 #if (HAS_LORA)
-      flags1 |= (LMIC.devaddr ? 1 : 0) << 4;
+  flags1 |= (LMIC.devaddr ? 1 : 0) << 4;
 #endif
 #if (HAS_NBIOT)
-      flags1 |= (nb_module_ok ? 1 : 0) << 3;
+  flags1 |= (nb_module_ok ? 1 : 0) << 3;
 #endif
 #ifdef HAS_SDCARD
-      flags1 |= (isSDCardAvailable() ? 1 : 0) << 2;
+  flags1 |= (isSDCardAvailable() ? 1 : 0) << 2;
+#endif
+#if (HAS_NBIOT)
+  flags1 |= (nb_warm_start ? 1 : 0) << 1;
 #endif
 
-      uint8_t flags2 = 0;
+  uint8_t flags2 = 0;
 #if (HAS_LORA)
-      flags2 = healthcheck_failures;
+  flags2 = healthcheck_failures;
 #endif
 
-      uint8_t lora_rssi = 0;
-      int8_t lora_snr = 0;
+  uint8_t lora_rssi = 0;
+  int8_t lora_snr = 0;
 #if (HAS_LORA)
-      lora_rssi = (uint8_t)(LMIC.rssi < 0 ? -LMIC.rssi : LMIC.rssi);
-      lora_snr = (int8_t)LMIC.snr;
+  lora_rssi = (uint8_t)(LMIC.rssi < 0 ? -LMIC.rssi : LMIC.rssi);
+  lora_snr = (int8_t)LMIC.snr;
 #endif
 
-      // === ADEMUX: encoding NUESTATS para payload HC ===
-      // nb_rsrp: (-rsrp_dBm) - 44, rango 0-112, 0xFF=N/A
-      uint8_t nb_rsrp_encoded = 0xFF;
+  // === ADEMUX: encoding NUESTATS para payload HC ===
+  // nb_rsrp: (-rsrp_dBm) - 44, rango 0-112, 0xFF=N/A
+  uint8_t nb_rsrp_encoded = 0xFF;
 #if (HAS_NBIOT)
-      if (nb_status_rsrp != 127) {
-        int rsrp_abs = -((int)nb_status_rsrp);  // ej: 78
-        if (rsrp_abs >= 44 && rsrp_abs <= 156) {
-          nb_rsrp_encoded = (uint8_t)(rsrp_abs - 44);  // ej: 34
-        }
-      }
+  if (nb_status_rsrp != 127) {
+    int rsrp_abs = -((int)nb_status_rsrp);  // ej: 78
+    if (rsrp_abs >= 44 && rsrp_abs <= 156) {
+      nb_rsrp_encoded = (uint8_t)(rsrp_abs - 44);  // ej: 34
+    }
+  }
 #endif
 
-      // nb_snr: snr_dB + 20, rango 0-50, 0xFF=N/A
-      uint8_t nb_snr_encoded = 0xFF;
+  // nb_snr: snr_dB + 20, rango 0-50, 0xFF=N/A
+  uint8_t nb_snr_encoded = 0xFF;
 #if (HAS_NBIOT)
-      if (nb_status_snr_radio != 127) {
-        int snr_shifted = (int)nb_status_snr_radio + 20;  // ej: 8+20=28
-        if (snr_shifted >= 0 && snr_shifted <= 50) {
-          nb_snr_encoded = (uint8_t)snr_shifted;
-        }
-      }
+  if (nb_status_snr_radio != 127) {
+    int snr_shifted = (int)nb_status_snr_radio + 20;  // ej: 8+20=28
+    if (snr_shifted >= 0 && snr_shifted <= 50) {
+      nb_snr_encoded = (uint8_t)snr_shifted;
+    }
+  }
 #endif
 
-      // nb_ecl: directo 0/1/2, 0xFF=N/A
-      uint8_t nb_ecl_val = 0xFF;
+  // nb_ecl: directo 0/1/2, 0xFF=N/A
+  uint8_t nb_ecl_val = 0xFF;
 #if (HAS_NBIOT)
-      nb_ecl_val = nb_status_ecl;
+  nb_ecl_val = nb_status_ecl;
 #endif
 
-      uint8_t nb_failures = 0;
+  uint8_t nb_failures = 0;
+  uint16_t nb_ttfp_val = 0xFFFF;
 #if (HAS_NBIOT)
-      nb_failures = nb_status_failures;
+  nb_failures = nb_status_failures;
+  nb_ttfp_val = nb_ttfp;
 #endif
 
-      uint8_t flags3 = 0;
+  uint8_t flags3 = 0;
 #if (HAS_NBIOT)
-      flags3 |= (nb_status_registered ? 1 : 0) << 7;
-      flags3 |= (nb_status_connected ? 1 : 0) << 6;
-#endif
-      uint8_t cpu_freq_code = 0;
-      int cpuMHz = getCpuFrequencyMhz();
-      if (cpuMHz <= 80) cpu_freq_code = 0;
-      else if (cpuMHz <= 160) cpu_freq_code = 1;
-      else cpu_freq_code = 2;
-      flags3 |= (cpu_freq_code & 0x03) << 4;
-      flags3 |= (lastSendChannel & 0x03) << 2;
-      flags3 |= (bt_module_ok ? 1 : 0) << 1;
-      flags3 |= (ble_module_ok ? 1 : 0) << 0;
-
-      payload.reset();
-      payload.addStatus(uptime, cputemp, free_heap_div16, min_heap_div16,
-                        reset_reason, flags1, flags2,
-                        lora_rssi, lora_snr,
-                        nb_rsrp_encoded, nb_failures, flags3,
-                        nb_snr_encoded, nb_ecl_val);
-
-      SendPayload(TELEMETRYPORT, prio_normal);
+  flags3 |= (nb_status_registered ? 1 : 0) << 7;
+  flags3 |= (nb_status_connected ? 1 : 0) << 6;
+#endif
+  uint8_t cpu_freq_code = 0;
+  int cpuMHz = getCpuFrequencyMhz();
+  if (cpuMHz <= 80) cpu_freq_code = 0;
+  else if (cpuMHz <= 160) cpu_freq_code = 1;
+  else cpu_freq_code = 2;
+  flags3 |= (cpu_freq_code & 0x03) << 4;
+  flags3 |= (lastSendChannel & 0x03) << 2;
+  flags3 |= (bt_module_ok ? 1 : 0) << 1;
+  flags3 |= (ble_module_ok ? 1 : 0) << 0;
+
+  payload.reset();
+  payload.addStatus(uptime, cputemp, free_heap_div16, min_heap_div16,
+                    reset_reason, flags1, flags2,
+                    lora_rssi, lora_snr,
+                    nb_rsrp_encoded, nb_failures, flags3,
+                    nb_snr_encoded, nb_ecl_val, nb_ttfp_val);
+#if (TASKSTATS) && (TASKSTATS_HEALTH)
+  taskstat_add(0, TASKSTAT_HEALTH_TOP); // busiest tasks, see taskstats.h
+#endif
+
+  SendPayload(TELEMETRYPORT, prio_normal);
 
 #if (HAS_NBIOT)
-      {
-        MessageBuffer_t nbMessage;
-        nbMessage.MessageSize = payload.getSize();
-        nbMessage.MessagePort = TELEMETRYPORT;
-        nbMessage.MessagePrio = prio_normal;
-        memcpy(nbMessage.Message, payload.getBuffer(), payload.getSize());
-        nb_send_direct(&nbMessage);
-      }
+  {
+    MessageBuffer_t nbMessage;
+    nbMessage.MessageSize = payload.getSize();
+    nbMessage.MessagePort = TELEMETRYPORT;
+    nbMessage.MessagePrio = prio_normal;
+    memcpy(nbMessage.Message, payload.getBuffer(), payload.getSize());
+    nb_send_direct(&nbMessage);
+  }
 #endif
 
-      ESP_LOGI(TAG, "Health check [Up:%u T:%u Heap:%u/%u Rst:%u F1:0x%02X F2:0x%02X RSSI:%u SNR:%d RSRP:%d SNRr:%d ECL:%d NbF:%u F3:0x%02X]",
-               uptime, cputemp, free_heap_div16 * 16, min_heap_div16 * 16,
-               reset_reason, flags1, flags2, lora_rssi, lora_snr,
-               nb_status_rsrp, nb_status_snr_radio, nb_status_ecl,
-               nb_failures, flags3);
-    }
-  }
+  ESP_LOGI(TAG, "Health check [Up:%u T:%u Heap:%u/%u Rst:%u F1:0x%02X F2:0x%02X RSSI:%u SNR:%d RSRP:%d SNRr:%d ECL:%d NbF:%u F3:0x%02X]",
+           uptime, cputemp, free_heap_div16 * 16, min_heap_div16 * 16,
+           reset_reason, flags1, flags2, lora_rssi, lora_snr,
+           nb_status_rsrp, nb_status_snr_radio, nb_status_ecl,
+           nb_failures, flags3);
+}
 
 // === ADEMUX: Health check NB-IoT independiente (cada NB_HEALTHCHECK_INTERVAL_MINUTES) ===
 #if (HAS_NBIOT)
-  {
-    static unsigned long lastNbHealthCheck = 0;
-    if ((millis() - lastNbHealthCheck) >= (NB_HEALTHCHECK_INTERVAL_MINUTES * 60 * 1000)) {
-      lastNbHealthCheck = millis();
-
-      uint32_t uptime = (uint32_t)(millis() / 1000);
-      uint8_t cputemp = (uint8_t)round(temperatureRead());
-      uint16_t free_heap_div16 = (uint16_t)(ESP.getFreeHeap() / 16);
-      uint16_t min_heap_div16 = (uint16_t)(ESP.getMinFreeHeap() / 16);
-      uint8_t reset_reason = (uint8_t)esp_reset_reason();
-
-      uint8_t flags1 = 0;
-      flags1 |= (wifi_radio_ok ? 1 : 0) << 7;
-      flags1 |= (ble_module_ok ? 1 : 0) << 6;
-      flags1 |= (bt_module_ok ? 1 : 0) << 5;
+void nbhealthcheck() { xTaskNotify(irqHandlerTask, NB_HEALTHCHECK_IRQ, eSetBits); }
+
+void sendNbHealthCheck() {
+  uint32_t uptime = (uint32_t)(millis() / 1000);
+  uint8_t cputemp = (uint8_t)round(temperatureRead());
+  uint16_t free_heap_div16 = (uint16_t)(ESP.getFreeHeap() / 16);
+  uint16_t min_heap_div16 = (uint16_t)(ESP.getMinFreeHeap() / 16);
+  uint8_t reset_reason = (uint8_t)esp_reset_reason();
+
+  uint8_t flags1 = 0;
+  flags1 |= (wifi_radio_ok ? 1 : 0) << 7;
+  flags1 |= (ble_module_ok ? 1 : 0) << 6;
+  flags1 |= (bt_module_ok ? 1 : 0) << 5;
 #if (HAS_LORA)
-      flags1 |= (LMIC.devaddr ? 1 : 0) << 4;
+  flags1 |= (LMIC.devaddr ? 1 : 0) << 4;
 #endif
-      flags1 |= (nb_module_ok ? 1 : 0) << 3;
+  flags1 |= (nb_module_ok ? 1 : 0) << 3;
 #ifdef HAS_SDCARD
-      flags1 |= (isSDCardAvailable() ? 1 : 0) << 2;
+  flags1 |= (isSDCardAvailable() ? 1 : 0) << 2;
 #endif
+  flags1 |= (nb_warm_start ? 1 : 0) << 1;
 
-      uint8_t flags2 = 0;
+  uint8_t flags2 = 0;
 #if (HAS_LORA)
-      flags2 = healthcheck_failures;
+  flags2 = healthcheck_failures;
 #endif
 
-      uint8_t lora_rssi = 0;
-      int8_t lora_snr = 0;
+  uint8_t lora_rssi = 0;
+  int8_t lora_snr = 0;
 #if (HAS_LORA)
-      lora_rssi = (uint8_t)(LMIC.rssi < 0 ? -LMIC.rssi : LMIC.rssi);
-      lora_snr = (int8_t)LMIC.snr;
+  lora_rssi = (uint8_t)(LMIC.rssi < 0 ? -LMIC.rssi : LMIC.rssi);
+  lora_snr = (int8_t)LMIC.snr;
 #endif
 
-      // === ADEMUX: encoding NUESTATS (mismo cálculo que HC LoRa) ===
-      uint8_t nb_rsrp_encoded = 0xFF;
-      if (nb_status_rsrp != 127) {
-        int rsrp_abs = -((int)nb_status_rsrp);
-        if (rsrp_abs >= 44 && rsrp_abs <= 156) {
-          nb_rsrp_encoded = (uint8_t)(rsrp_abs - 44);
-        }
-      }
-
-      uint8_t nb_snr_encoded = 0xFF;
-      if (nb_status_snr_radio != 127) {
-        int snr_shifted = (int)nb_status_snr_radio + 20;
-        if (snr_shifted >= 0 && snr_shifted <= 50) {
-          nb_snr_encoded = (uint8_t)snr_shifted;
-        }
-      }
-
-      uint8_t nb_ecl_val = nb_status_ecl;
-      uint8_t nb_failures = nb_status_failures;
-
-      uint8_t flags3 = 0;
-      flags3 |= (nb_status_registered ? 1 : 0) << 7;
-      flags3 |= (nb_status_connected ? 1 : 0) << 6;
-      uint8_t cpu_freq_code = 0;
-      int cpuMHz = getCpuFrequencyMhz();
-      if (cpuMHz <= 80) cpu_freq_code = 0;
-      else if (cpuMHz <= 160) cpu_freq_code = 1;
-      else cpu_freq_code = 2;
-      flags3 |= (cpu_freq_code & 0x03) << 4;
-      flags3 |= (lastSendChannel & 0x03) << 2;
-      flags3 |= (bt_module_ok ? 1 : 0) << 1;
-      flags3 |= (ble_module_ok ? 1 : 0) << 0;
-
-      payload.reset();
-      payload.addStatus(uptime, cputemp, free_heap_div16, min_heap_div16,
-                        reset_reason, flags1, flags2,
-                        lora_rssi, lora_snr,
-                        nb_rsrp_encoded, nb_failures, flags3,
-                        nb_snr_encoded, nb_ecl_val);
-
-      MessageBuffer_t nbMessage;
-      nbMessage.MessageSize = payload.getSize();
-      nbMessage.MessagePort = TELEMETRYPORT;
-      nbMessage.MessagePrio = prio_normal;
-      memcpy(nbMessage.Message, payload.getBuffer(), payload.getSize());
-      nb_send_direct(&nbMessage);
-
-      ESP_LOGI(TAG, "NB health check [Up:%u T:%u Heap:%u/%u Rst:%u F1:0x%02X F2:0x%02X RSSI:%u SNR:%d RSRP:%d SNRr:%d ECL:%d NbF:%u F3:0x%02X]",
-               uptime, cputemp, free_heap_div16 * 16, min_heap_div16 * 16,
-               reset_reason, flags1, flags2, lora_rssi, lora_snr,
-               nb_status_rsrp, nb_status_snr_radio, nb_status_ecl,
-               nb_failures, flags3);
+  // === ADEMUX: encoding NUESTATS (mismo cálculo que HC LoRa) ===
+  uint8_t nb_rsrp_encoded = 0xFF;
+  if (nb_status_rsrp != 127) {
+    int rsrp_abs = -((int)nb_status_rsrp);
+    if (rsrp_abs >= 44 && rsrp_abs <= 156) {
+      nb_rsrp_encoded = (uint8_t)(rsrp_abs - 44);
     }
   }
-#endif
 
-} // sendData()
+  uint8_t nb_snr_encoded = 0xFF;
+  if (nb_status_snr_radio != 127) {
+    int snr_shifted = (int)nb_status_snr_radio + 20;
+    if (snr_shifted >= 0 && snr_shifted <= 50) {
+      nb_snr_encoded = (uint8_t)snr_shifted;
+    }
+  }
 
+  uint8_t nb_ecl_val = nb_status_ecl;
+  uint8_t nb_failures = nb_status_failures;
+  uint16_t nb_ttfp_val = nb_ttfp;
+
+  uint8_t flags3 = 0;
+  flags3 |= (nb_status_registered ? 1 : 0) << 7;
+  flags3 |= (nb_status_connected ? 1 : 0) << 6;
+  uint8_t cpu_freq_code = 0;
+  int cpuMHz = getCpuFrequencyMhz();
+  if (cpuMHz <= 80) cpu_freq_code = 0;
+  else if (cpuMHz <= 160) cpu_freq_code = 1;
+  else cpu_freq_code = 2;
+  flags3 |= (cpu_freq_code & 0x03) << 4;
+  flags3 |= (lastSendChannel & 0x03) << 2;
+  flags3 |= (bt_module_ok ? 1 : 0) << 1;
+  flags3 |= (ble_module_ok ? 1 : 0) << 0;
+
+  payload.reset();
+  payload.addStatus(uptime, cputemp, free_heap_div16, min_heap_div16,
+                    reset_reason, flags1, flags2,
+                    lora_rssi, lora_snr,
+                    nb_rsrp_encoded, nb_failures, flags3,
+                    nb_snr_encoded, nb_ecl_val, nb_ttfp_val);
+
+  MessageBuffer_t nbMessage;
+  nbMessage.MessageSize = payload.getSize();
+  nbMessage.MessagePort = TELEMETRYPORT;
+  nbMessage.MessagePrio = prio_normal;
+  memcpy(nbMessage.Message, payload.getBuffer(), payload.getSize());
+  nb_send_direct(&nbMessage);
+
+  ESP_LOGI(TAG, "NB health check [Up:%u T:%u Heap:%u/%u Rst:%u F1:0x%02X F2:0x%02X RSSI:%u SNR:%d RSRP:%d SNRr:%d ECL:%d NbF:%u F3:0x%02X]",
+           uptime, cputemp, free_heap_div16 * 16, min_heap_div16 * 16,
+           reset_reason, flags1, flags2, lora_rssi, lora_snr,
+           nb_status_rsrp, nb_status_snr_radio, nb_status_ecl,
+           nb_failures, flags3);
+}
+#endif
 
 void checkQueue() {
 #if (HAS_LORA && HAS_NBIOT)
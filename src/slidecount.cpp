@@ -0,0 +1,113 @@
+/* slidecount runs countermode 4. Every hashed MAC of mac_add() is noted in a
+slidewin table carved from the memory budget on first use, so memory stays
+fixed however long the device counts. A scheduler job sweeps a share of the
+table every second and publishes the window counts to macs_wifi, macs_ble
+and macs_bt, which are not reset after a send cycle in this mode. The table
+holds 7/8 of SLIDING_CAPACITY hashes; devices beyond that are not counted,
+which remote command 0x8C shows as the slidewin buffer used up to its size. */
+
+// Basic Config
+#include "globals.h"
+#include "slidecount.h"
+
+// Local logging tag
+static const char TAG[] = "slide";
+
+static slide_t win;
+static bool winReady = false; // table carved and set up
+static portMUX_TYPE slideMux = portMUX_INITIALIZER_UNLOCKED;
+
+static struct {
+  uint32_t added, expired, full, sweepUs;
+} slideStats;
+
+static inline uint32_t slide_minute(void) {
+  return esp_timer_get_time() / 60000000ULL;
+}
+
+static inline uint8_t slide_window(void) {
+  return cfg.slidewindow ? cfg.slidewindow : SLIDING_WINDOW;
+}
+
+// inside slideMux
+static void slide_publish(uint8_t window) {
+  macs_wifi = slide_count(&win, MAC_SNIFF_WIFI, window);
+  macs_ble = slide_count(&win, MAC_SNIFF_BLE, window);
+  macs_bt = slide_count(&win, MAC_SNIFF_BT, window);
+}
+
+// any task, hash as mac_add() made it
+void slide_mac(uint8_t type, uint32_t hash) {
+  if (!winReady || (type >= SLIDE_TYPES))
+    return;
+  uint8_t window = slide_window();
+  portENTER_CRITICAL(&slideMux);
+  if (slide_add(&win, type, hash, slide_minute(), window) > 0)
+    slideStats.added++;
+  slide_publish(window);
+  portEXIT_CRITICAL(&slideMux);
+}
+
+void slide_reset(void) {
+  if (!winReady)
+    return;
+  portENTER_CRITICAL(&slideMux);
+  slide_clear(&win, slide_minute());
+  portEXIT_CRITICAL(&slideMux);
+}
+
+// scheduler job, one pass over the table every 16 s
+static void slide_job(void) {
+  if (cfg.countermode != COUNTER_SLIDING)
+    return;
+
+  if (!winReady) {
+    void *mem = mem_buffer_get(MEM_BUF_SLIDEWIN);
+    if (!mem)
+      return;
+    slide_create(&win, mem, SLIDING_CAPACITY, slide_minute());
+    winReady = true;
+    ESP_LOGI(TAG, "Sliding window of %u minutes, %u hashes max.",
+             slide_window(), win.limit);
+  }
+
+  uint8_t window = slide_window();
+  uint32_t minute = slide_minute();
+  int64_t t0 = esp_timer_get_time();
+  for (uint32_t n = 0; n < SLIDING_CAPACITY / 16; n += SLIDE_SWEEP_CHUNK) {
+    portENTER_CRITICAL(&slideMux);
+    slideStats.expired += slide_sweep(&win, minute, window, SLIDE_SWEEP_CHUNK);
+    portEXIT_CRITICAL(&slideMux);
+  }
+  portENTER_CRITICAL(&slideMux);
+  slide_publish(window);
+  uint32_t full = win.full, peak = win.peak;
+  portEXIT_CRITICAL(&slideMux);
+  slideStats.sweepUs = esp_timer_get_time() - t0;
+
+  // live hashes, at most 7/8 of the buffer; all of it once hashes were refused
+  if (full && !slideStats.full)
+    ESP_LOGW(TAG, "Sliding window table full at %u hashes, counts are low",
+             win.limit);
+  slideStats.full = full;
+  mem_buffer_used(MEM_BUF_SLIDEWIN, full ? mem_buffer_size(MEM_BUF_SLIDEWIN)
+                                         : SLIDE_BYTES(peak));
+}
+
+esp_err_t slide_init(void) {
+  static_assert((SLIDING_CAPACITY & (SLIDING_CAPACITY - 1)) == 0,
+                "SLIDING_CAPACITY must be a power of 2");
+  if (sched_add("slidewin", slide_job, SLIDE_TICK_MS, 0, 1) < 0)
+    return ESP_FAIL;
+  return ESP_OK;
+}
+
+void slide_print_stats(void) {
+  if (!winReady)
+    return;
+  ESP_LOGD(TAG,
+           "%u of %u slots used, %u added, %u expired, %u refused, last sweep "
+           "%u us",
+           win.live, win.mask + 1, slideStats.added, slideStats.expired,
+           slideStats.full, slideStats.sweepUs);
+}
@@ -0,0 +1,138 @@
+/* slidewin counts hashed MACs seen in the last minutes without dropping all
+of them at once. Every hash has one slot in a linear probing table with the
+minute it was last seen. A histogram of live slots per minute gives the
+count of any window up to SLIDE_HIST minutes directly; slots that fell out
+of the window are freed later by a sweep hand that looks at a bounded number
+of slots per call, with backward shift deletion, so no tombstones pile up.
+Until then a stale slot is just reused when its hash is seen again. */
+
+#include <string.h>
+
+#include "slidewin.h"
+
+#define SLIDE_STAMP_MASK ((1 << SLIDE_STAMP_BITS) - 1)
+#define SLIDE_ADD_SWEEP 64 // slots swept by an add into a full table
+
+static inline uint32_t slide_home(const slide_t *w, uint32_t key) {
+  // METIS digests are not uniform in their low bits, mix them
+  key ^= key >> 16;
+  key *= 0x85EBCA6B;
+  key ^= key >> 13;
+  return key & w->mask;
+}
+
+static inline uint32_t slide_age(const slide_t *w, uint16_t tag) {
+  return (w->now - tag) & SLIDE_STAMP_MASK;
+}
+
+// moves the clock, empties histogram bins of the minutes reused
+static void slide_tick(slide_t *w, uint32_t minute) {
+  if ((int32_t)(minute - w->now) <= 0)
+    return;
+  uint32_t n = minute - w->now;
+  if (n > SLIDE_HIST)
+    n = SLIDE_HIST;
+  for (uint32_t m = minute - n + 1; m != minute + 1; m++)
+    for (int t = 0; t < SLIDE_TYPES; t++)
+      w->hist[t][m % SLIDE_HIST] = 0;
+  w->now = minute;
+}
+
+// slot i leaves the histogram, if it is still counted there
+static inline void slide_uncount(slide_t *w, uint32_t i) {
+  uint16_t tag = w->tag[i];
+  if (slide_age(w, tag) < SLIDE_HIST)
+    w->hist[tag >> SLIDE_STAMP_BITS][(tag & SLIDE_STAMP_MASK) % SLIDE_HIST]--;
+}
+
+void slide_create(slide_t *w, void *mem, uint32_t capacity, uint32_t minute) {
+  memset(w, 0, sizeof(*w));
+  w->key = (uint32_t *)mem;
+  w->tag = (uint16_t *)(w->key + capacity);
+  w->mask = capacity - 1;
+  w->limit = capacity - capacity / 8;
+  slide_clear(w, minute);
+}
+
+void slide_clear(slide_t *w, uint32_t minute) {
+  memset(w->key, 0, (w->mask + 1) * sizeof(uint32_t));
+  memset(w->hist, 0, sizeof(w->hist));
+  w->live = 0;
+  w->hand = 0;
+  w->now = minute;
+}
+
+int slide_add(slide_t *w, uint8_t type, uint32_t hash, uint32_t minute,
+              uint8_t window) {
+  if (hash == SLIDE_EMPTY)
+    hash = 1;
+  slide_tick(w, minute);
+  uint16_t tag = (type << SLIDE_STAMP_BITS) | (w->now & SLIDE_STAMP_MASK);
+
+  uint32_t i = slide_home(w, hash);
+  for (; w->key[i] != SLIDE_EMPTY; i = (i + 1) & w->mask) {
+    if ((w->key[i] != hash) || ((w->tag[i] >> SLIDE_STAMP_BITS) != type))
+      continue;
+    int fresh = slide_age(w, w->tag[i]) >= window;
+    slide_uncount(w, i);
+    w->tag[i] = tag;
+    w->hist[type][w->now % SLIDE_HIST]++;
+    return fresh;
+  }
+
+  if (w->live >= w->limit) {
+    // stale slots may not have met the hand yet, one freed slot is enough
+    if (!slide_sweep(w, minute, window, SLIDE_ADD_SWEEP)) {
+      w->full++;
+      return -1;
+    }
+    return slide_add(w, type, hash, minute, window); // slots have moved
+  }
+  w->key[i] = hash;
+  w->tag[i] = tag;
+  if (++w->live > w->peak)
+    w->peak = w->live;
+  w->hist[type][w->now % SLIDE_HIST]++;
+  return 1;
+}
+
+uint32_t slide_sweep(slide_t *w, uint32_t minute, uint8_t window, uint32_t n) {
+  uint32_t freed = 0;
+  slide_tick(w, minute);
+
+  while (n--) {
+    uint32_t i = w->hand;
+    if ((w->key[i] == SLIDE_EMPTY) || (slide_age(w, w->tag[i]) < window)) {
+      w->hand = (i + 1) & w->mask;
+      continue;
+    }
+
+    // backward shift: pull later slots of the cluster into the hole, unless
+    // their home lies cyclically in (hole, slot]. The hand stays on i, a
+    // slot moved there is looked at next
+    slide_uncount(w, i);
+    uint32_t hole = i;
+    for (uint32_t j = (i + 1) & w->mask; w->key[j] != SLIDE_EMPTY;
+         j = (j + 1) & w->mask) {
+      uint32_t home = slide_home(w, w->key[j]);
+      if (((j - home) & w->mask) >= ((j - hole) & w->mask)) {
+        w->key[hole] = w->key[j];
+        w->tag[hole] = w->tag[j];
+        hole = j;
+      }
+    }
+    w->key[hole] = SLIDE_EMPTY;
+    w->live--;
+    freed++;
+  }
+  return freed;
+}
+
+uint32_t slide_count(const slide_t *w, uint8_t type, uint8_t window) {
+  uint32_t sum = 0;
+  if (window >= SLIDE_HIST)
+    window = SLIDE_HIST - 1;
+  for (uint32_t age = 0; age < window; age++)
+    sum += w->hist[type][(w->now - age) % SLIDE_HIST];
+  return sum;
+}
@@ -0,0 +1,91 @@
+/* spiframe packs messages into the frames of the SPI slave interface and
+checks frames received from the master, see include/spiframe.h. */
+
+#include <string.h>
+#include <rom/crc.h>
+
+#include "spiframe.h"
+
+static void put16(uint8_t *p, uint16_t v) {
+  p[0] = v & 0xFF;
+  p[1] = v >> 8;
+}
+
+static uint16_t get16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+void spi_frame_begin(spi_frame_t *f, uint8_t *buf, uint16_t size) {
+  f->buf = buf;
+  f->size = size;
+  f->len = 0;
+  f->n = 0;
+}
+
+bool spi_frame_add(spi_frame_t *f, uint8_t port, const uint8_t *data,
+                   uint8_t size) {
+  uint16_t at = SPI_FRAME_HEAD + f->len;
+  if ((f->n == 0xFF) ||
+      (at + SPI_RECORD_HEAD + size + SPI_FRAME_CRC > f->size))
+    return false;
+  f->buf[at] = port;
+  f->buf[at + 1] = size;
+  memcpy(f->buf + at + SPI_RECORD_HEAD, data, size);
+  f->len += SPI_RECORD_HEAD + size;
+  f->n++;
+  return true;
+}
+
+uint16_t spi_frame_end(spi_frame_t *f, uint16_t seq, uint8_t pending) {
+  uint8_t *b = f->buf;
+  uint16_t end = SPI_FRAME_HEAD + f->len;
+
+  b[0] = SPI_FRAME_MAGIC;
+  b[1] = SPI_FRAME_VERSION;
+  put16(b + 2, seq);
+  b[4] = f->n;
+  b[5] = pending;
+  put16(b + 6, f->len);
+  uint32_t crc = crc32_le(0, b, end);
+  for (int i = 0; i < SPI_FRAME_CRC; i++)
+    b[end + i] = crc >> (8 * i);
+  end += SPI_FRAME_CRC;
+
+  // only the padding is cleared, not the whole buffer
+  while ((end % 4) && (end < f->size))
+    b[end++] = 0;
+  return end;
+}
+
+int spi_frame_check(const uint8_t *buf, uint16_t size) {
+  if ((size < SPI_FRAME_HEAD + SPI_FRAME_CRC) || (buf[0] != SPI_FRAME_MAGIC) ||
+      (buf[1] != SPI_FRAME_VERSION))
+    return -1;
+  uint16_t end = SPI_FRAME_HEAD + get16(buf + 6);
+  if (end + SPI_FRAME_CRC > size)
+    return -1;
+  uint32_t crc = 0;
+  for (int i = 0; i < SPI_FRAME_CRC; i++)
+    crc |= (uint32_t)buf[end + i] << (8 * i);
+  if (crc != crc32_le(0, buf, end))
+    return -1;
+
+  // records must fill len exactly
+  uint16_t pos = SPI_FRAME_HEAD;
+  int n = 0;
+  while (pos + SPI_RECORD_HEAD <= end) {
+    pos += SPI_RECORD_HEAD + buf[pos + 1];
+    n++;
+  }
+  return ((pos == end) && (n == buf[4])) ? n : -1;
+}
+
+bool spi_frame_next(const uint8_t *buf, uint16_t *pos, uint8_t *port,
+                    const uint8_t **data, uint8_t *size) {
+  uint16_t end = SPI_FRAME_HEAD + get16(buf + 6);
+  if (*pos + SPI_RECORD_HEAD > end)
+    return false;
+  *port = buf[*pos];
+  *size = buf[*pos + 1];
+  *data = buf + *pos + SPI_RECORD_HEAD;
+  *pos += SPI_RECORD_HEAD + *size;
+  return *pos <= end;
+}
@@ -28,84 +28,120 @@ licenses. Refer to LICENSE.txt file in repository for more details.
 
 #include <driver/spi_slave.h>
 #include <sys/param.h>
-#include <rom/crc.h>
 
 static const char TAG[] = __FILE__;
 
-#define HEADER_SIZE 4
 // SPI transaction size needs to be at least 8 bytes and dividable by 4, see
 // https://docs.espressif.com/projects/esp-idf/en/latest/api-reference/peripherals/spi_slave.html
-#define BUFFER_SIZE                                                            \
-  (MAX(8, HEADER_SIZE + PAYLOAD_BUFFER_SIZE) +                                 \
-   (PAYLOAD_BUFFER_SIZE % 4 == 0                                               \
-        ? 0                                                                    \
-        : 4 - MAX(8, HEADER_SIZE + PAYLOAD_BUFFER_SIZE) % 4))
-DMA_ATTR uint8_t txbuf[BUFFER_SIZE];
-DMA_ATTR uint8_t rxbuf[BUFFER_SIZE];
+#if (SPI_FRAME_SIZE % 4) ||                                                    \
+    (SPI_FRAME_SIZE < SPI_FRAME_HEAD + SPI_RECORD_HEAD + PAYLOAD_BUFFER_SIZE +  \
+                          SPI_FRAME_CRC)
+#error "SPI_FRAME_SIZE must be a multiple of 4 and hold the largest message"
+#endif
+
+#define SPI_SLOTS 2
+
+DMA_ATTR uint8_t txbuf[SPI_SLOTS][SPI_FRAME_SIZE];
+DMA_ATTR uint8_t rxbuf[SPI_SLOTS][SPI_FRAME_SIZE];
+static spi_slave_transaction_t trans[SPI_SLOTS];
+
+// message taken from the queue which did not fit into the last frame
+static MessageBuffer_t carry;
+static bool carried = false;
+static uint16_t seq = 0;
+static uint32_t frames = 0, messages = 0, commands = 0, rxerrors = 0;
 
 QueueHandle_t SPISendQueue;
 
 TaskHandle_t spiTask;
 
-void spi_slave_task(void *param) {
-  while (1) {
-    MessageBuffer_t msg;
-    size_t transaction_size;
+// packs queued messages into the tx buffer of slot s and queues the
+// transaction, waits up to wait ticks for the first message
+static bool spi_fill(int s, TickType_t wait) {
+  spi_frame_t f;
+  UBaseType_t pending;
 
-    // clear rx + tx buffers
-    memset(txbuf, 0, sizeof(txbuf));
-    memset(rxbuf, 0, sizeof(rxbuf));
+  if (!carried) {
+    if (xQueueReceive(SPISendQueue, &carry, wait) != pdTRUE)
+      return false;
+    carried = true;
+  }
 
-    // fetch next or wait for payload to send from queue
-    if (xQueueReceive(SPISendQueue, &msg, portMAX_DELAY) != pdTRUE) {
-      ESP_LOGE(TAG, "Premature return from xQueueReceive() with no data!");
-      continue;
+  spi_frame_begin(&f, txbuf[s], SPI_FRAME_SIZE);
+  while (carried && spi_frame_add(&f, carry.MessagePort, carry.Message,
+                                  carry.MessageSize))
+    carried = (xQueueReceive(SPISendQueue, &carry, 0) == pdTRUE);
+
+  pending = uxQueueMessagesWaiting(SPISendQueue) + (carried ? 1 : 0);
+  uint16_t len = spi_frame_end(&f, seq++, MIN(pending, 255));
+  frames++;
+  messages += f.n;
+
+  // the master may clock a full frame, e.g. to send a command frame, so the
+  // transaction is sized for the buffer and ended by the master
+  memset(&trans[s], 0, sizeof(trans[s]));
+  trans[s].length = SPI_FRAME_SIZE * 8;
+  trans[s].tx_buffer = txbuf[s];
+  trans[s].rx_buffer = rxbuf[s];
+  rxbuf[s][0] = 0; // no stale frame if the master sends nothing
+
+  ESP_LOGD(TAG, "Prepared SPI frame %u with %u message(s), %u byte(s)",
+           seq - 1, f.n, len);
+  ESP_LOG_BUFFER_HEXDUMP(TAG, txbuf[s], len, ESP_LOG_VERBOSE);
+  ESP_ERROR_CHECK_WITHOUT_ABORT(
+      spi_slave_queue_trans(HSPI_HOST, &trans[s], portMAX_DELAY));
+  return true;
+}
+
+// runs the command interpreter for each RCMDPORT record sent by the master
+static void spi_receive(const uint8_t *buf, size_t trans_len) {
+  uint16_t pos = SPI_FRAME_HEAD;
+  uint8_t port, size;
+  const uint8_t *data;
+
+  if (buf[0] != SPI_FRAME_MAGIC)
+    return; // master did not send a frame
+  if (spi_frame_check(buf, trans_len / 8) < 0) {
+    rxerrors++;
+    ESP_LOGW(TAG, "Discarded corrupt frame from SPI master");
+    return;
+  }
+  while (spi_frame_next(buf, &pos, &port, &data, &size))
+    if (port == RCMDPORT) {
+      commands++;
+      rcommand(data, size);
     }
+}
 
-    // fill tx buffer with data to send from queue
-    uint8_t *messageType = txbuf + 2;
-    *messageType = msg.MessagePort;
-    uint8_t *messageSize = txbuf + 3;
-    *messageSize = msg.MessageSize;
-    memcpy(txbuf + HEADER_SIZE, &msg.Message, msg.MessageSize);
-    // calculate crc16 checksum over txbuf and insert checksum at pos 0+1 of
-    // txbuf
-    uint16_t *crc = (uint16_t *)txbuf;
-    *crc = crc16_be(0, messageType, msg.MessageSize + HEADER_SIZE - 2);
-
-    // set length for spi slave driver
-    transaction_size = HEADER_SIZE + msg.MessageSize;
-    // SPI transaction size needs to be at least 8 bytes and dividable by 4, see
-    // https://docs.espressif.com/projects/esp-idf/en/latest/api-reference/peripherals/spi_slave.html
-    if (transaction_size % 4 != 0) {
-      transaction_size += (4 - transaction_size % 4);
+void spi_slave_task(void *param) {
+  spi_slave_transaction_t *done;
+  int next = 0, inflight = 0;
+
+  while (1) {
+    // keep both slots queued, block for data only if the master has nothing
+    // to clock out
+    while ((inflight < SPI_SLOTS) &&
+           spi_fill(next, inflight ? 0 : portMAX_DELAY)) {
+      next = (next + 1) % SPI_SLOTS;
+      inflight++;
     }
 
-    // prepare spi transaction
-    spi_slave_transaction_t spi_transaction = {0};
-    spi_transaction.length = transaction_size * 8;
-    spi_transaction.tx_buffer = txbuf;
-    spi_transaction.rx_buffer = rxbuf;
-
-    // wait until spi master clocks out the data, and read results in rx buffer
-    ESP_LOGI(TAG, "Prepared SPI transaction for %zu byte(s)", transaction_size);
-    ESP_LOG_BUFFER_HEXDUMP(TAG, txbuf, transaction_size, ESP_LOG_DEBUG);
-    ESP_ERROR_CHECK_WITHOUT_ABORT(
-        spi_slave_transmit(HSPI_HOST, &spi_transaction, portMAX_DELAY));
-    ESP_LOG_BUFFER_HEXDUMP(TAG, rxbuf, transaction_size, ESP_LOG_DEBUG);
-    ESP_LOGI(TAG, "Transaction finished with size %zu bits",
-             spi_transaction.trans_len);
-
-    // check if command was received, then call interpreter with command payload
-    if ((spi_transaction.trans_len) && ((rxbuf[2]) == RCMDPORT)) {
-      rcommand(rxbuf + HEADER_SIZE, spi_transaction.trans_len - HEADER_SIZE);
-    };
+    // with a free slot, come back to pack newly queued messages into it
+    if (spi_slave_get_trans_result(
+            HSPI_HOST, &done,
+            inflight == SPI_SLOTS ? portMAX_DELAY
+                                  : pdMS_TO_TICKS(SPI_POLL_MS)) != ESP_OK)
+      continue;
+    inflight--;
+
+    ESP_LOGD(TAG, "Transaction finished with size %zu bits", done->trans_len);
+    spi_receive((const uint8_t *)done->rx_buffer, done->trans_len);
   }
 }
 
 esp_err_t spi_init() {
   assert(SEND_QUEUE_SIZE);
-  SPISendQueue = xQueueCreate(SEND_QUEUE_SIZE, sizeof(MessageBuffer_t));
+  SPISendQueue = mem_queue_create(MEM_QUEUE_SPISEND);
   if (SPISendQueue == 0) {
     ESP_LOGE(TAG, "Could not create SPI send queue. Aborting.");
     return ESP_FAIL;
@@ -123,7 +159,7 @@ esp_err_t spi_init() {
 
   spi_slave_interface_config_t spi_slv_cfg = {.spics_io_num = SPI_CS,
                                               .flags = 0,
-                                              .queue_size = 1,
+                                              .queue_size = SPI_SLOTS,
                                               .mode = 0,
                                               .post_setup_cb = NULL,
                                               .post_trans_cb = NULL};
@@ -139,7 +175,8 @@ esp_err_t spi_init() {
 
   if (ret == ESP_OK) {
     ESP_LOGI(TAG, "Starting SPIloop...");
-    xTaskCreate(spi_slave_task, "spiloop", 4096, (void *)NULL, 2, &spiTask);
+    mem_task_create(MEM_TASK_SPILOOP, spi_slave_task, (void *)NULL, 2, &spiTask,
+                    tskNO_AFFINITY);
   } else {
     ESP_LOGE(TAG, "SPI interface initialization failed");
   }
@@ -172,4 +209,9 @@ void spi_enqueuedata(MessageBuffer_t *message) {
 
 void spi_queuereset(void) { xQueueReset(SPISendQueue); }
 
+void spi_print_stats(void) {
+  ESP_LOGD(TAG, "SPI: %u frames, %u messages, %u commands, %u rx errors",
+           frames, messages, commands, rxerrors);
+}
+
 #endif // HAS_SPI
\ No newline at end of file
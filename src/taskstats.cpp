@@ -0,0 +1,171 @@
+/* taskstats finds out which task eats the cpu, in the field, without a
+serial console. The framework's FreeRTOS is built without run time stats,
+so a tick hook on both cores samples the running task instead: at 1000 Hz
+that resolves about 0.1% of a core over a minute. Every TASKSTAT_PERIOD_MS
+a scheduler job turns the tick counts into per mille shares and core loads,
+which remote command 0x8E and the health check report together with the
+stack headroom of tasks started from the memory budget. */
+
+// Basic Config
+#include "globals.h"
+#include "taskstats.h"
+#include <esp_freertos_hooks.h>
+
+#if (TASKSTATS)
+
+// Local logging tag
+static const char TAG[] = "taskstat";
+
+typedef struct {
+  TaskHandle_t handle;
+  char name[TASKSTAT_NAME];
+  uint32_t ticks; // running in current period, both cores
+  uint16_t share; // last period, per mille of one core
+} taskstat_t;
+
+// entry TASKSTAT_MAX collects tasks beyond the table
+static taskstat_t stats[TASKSTAT_MAX + 1];
+static uint8_t statCount = 0;
+static uint32_t coreTicks[2], coreIdle[2]; // current period
+static TaskHandle_t idleTask[2];
+
+// last period, what the reports show
+static uint8_t coreLoad[2];
+static uint16_t periodSec = 0;
+static uint8_t order[TASKSTAT_MAX + 1]; // busiest first
+static uint8_t orderCount = 0;
+
+static portMUX_TYPE statMux = portMUX_INITIALIZER_UNLOCKED;
+
+// tick interrupt, both cores. FreeRTOS is linked to IRAM, so this runs
+// while the flash cache is off
+static void IRAM_ATTR taskstat_tick(void) {
+  int core = xPortGetCoreID();
+  TaskHandle_t h = xTaskGetCurrentTaskHandleForCPU(core);
+
+  portENTER_CRITICAL_ISR(&statMux);
+  coreTicks[core]++;
+  if (h == idleTask[core]) {
+    coreIdle[core]++;
+  } else {
+    int i = 0;
+    while ((i < statCount) && (stats[i].handle != h))
+      i++;
+    if ((i == statCount) && (statCount < TASKSTAT_MAX)) {
+      const char *name = pcTaskGetTaskName(h);
+      stats[i].handle = h;
+      for (int c = 0; c < TASKSTAT_NAME; c++)
+        stats[i].name[c] = (name && (c == 0 || stats[i].name[c - 1]))
+                               ? name[c]
+                               : 0;
+      statCount++;
+    } else if (i == statCount) {
+      i = TASKSTAT_MAX;
+    }
+    stats[i].ticks++;
+  }
+  portEXIT_CRITICAL_ISR(&statMux);
+}
+
+// scheduler job, closes the period
+static void taskstat_period(void) {
+  static uint32_t t0 = 0;
+  uint32_t t = millis();
+
+  portENTER_CRITICAL(&statMux);
+  uint32_t base = max(coreTicks[0], coreTicks[1]);
+  if (base == 0)
+    base = 1;
+  for (int i = 0; i <= TASKSTAT_MAX; i++) {
+    stats[i].share = (uint64_t)stats[i].ticks * 1000 / base;
+    stats[i].ticks = 0;
+  }
+  for (int c = 0; c < 2; c++) {
+    coreLoad[c] = coreTicks[c]
+                      ? 100 - (uint64_t)coreIdle[c] * 100 / coreTicks[c]
+                      : 0;
+    coreTicks[c] = coreIdle[c] = 0;
+  }
+  uint8_t n = statCount;
+  portEXIT_CRITICAL(&statMux);
+
+  // insertion sort by share, "other" only if it ran
+  uint8_t sorted[TASKSTAT_MAX + 1], k = 0;
+  for (uint8_t i = 0; i <= TASKSTAT_MAX; i++) {
+    if ((i >= n) && ((i < TASKSTAT_MAX) || !stats[i].share))
+      continue;
+    uint8_t j = k++;
+    for (; j && (stats[sorted[j - 1]].share < stats[i].share); j--)
+      sorted[j] = sorted[j - 1];
+    sorted[j] = i;
+  }
+
+  portENTER_CRITICAL(&statMux);
+  memcpy(order, sorted, k);
+  orderCount = k;
+  periodSec = t0 ? (t - t0 + 500) / 1000 : TASKSTAT_PERIOD_MS / 1000;
+  portEXIT_CRITICAL(&statMux);
+  t0 = t;
+}
+
+esp_err_t taskstat_init(void) {
+  strncpy(stats[TASKSTAT_MAX].name, "other", TASKSTAT_NAME);
+  for (int c = 0; c < 2; c++) {
+    idleTask[c] = xTaskGetIdleTaskHandleForCPU(c);
+    if (esp_register_freertos_tick_hook_for_cpu(taskstat_tick, c) != ESP_OK)
+      return ESP_FAIL;
+  }
+  if (sched_add("taskstat", taskstat_period, TASKSTAT_PERIOD_MS, 0, 1) < 0)
+    return ESP_FAIL;
+  return ESP_OK;
+}
+
+uint8_t taskstat_count(void) { return orderCount; }
+
+// stack bytes never touched, 0xFFFF if the task is not in the budget
+static uint16_t taskstat_stack(TaskHandle_t h) {
+  int id = mem_task_find(h);
+  if (id < 0)
+    return 0xFFFF;
+  int32_t peak = mem_budget_peak((mem_id_t)id);
+  uint32_t size = mem_budget_size((mem_id_t)id);
+  return (peak < 0) ? 0xFFFF : (uint16_t)min(size - peak, (uint32_t)0xFFFE);
+}
+
+uint8_t taskstat_add(uint8_t first, uint8_t n) {
+  if (first >= orderCount)
+    n = 0;
+  else if (first + n > orderCount)
+    n = orderCount - first;
+
+  payload.addByte(periodSec >> 8);
+  payload.addByte(periodSec & 0xFF);
+  payload.addByte(coreLoad[0]);
+  payload.addByte(coreLoad[1]);
+  payload.addByte(n);
+  for (uint8_t i = first; i < first + n; i++) {
+    const taskstat_t *s = &stats[order[i]];
+    uint16_t stack = (order[i] < TASKSTAT_MAX) ? taskstat_stack(s->handle)
+                                               : 0xFFFF;
+    for (int c = 0; c < TASKSTAT_NAME; c++)
+      payload.addByte(s->name[c]);
+    payload.addByte(s->share >> 8);
+    payload.addByte(s->share & 0xFF);
+    payload.addByte(stack >> 8);
+    payload.addByte(stack & 0xFF);
+  }
+  return n;
+}
+
+void taskstat_print(void) {
+  ESP_LOGD(TAG, "Core load %u%% / %u%% over %u s", coreLoad[0], coreLoad[1],
+           periodSec);
+  for (uint8_t i = 0; i < orderCount; i++) {
+    const taskstat_t *s = &stats[order[i]];
+    if (!s->share)
+      break;
+    ESP_LOGD(TAG, "%-6.6s %3u.%u%%", s->name, s->share / 10, s->share % 10);
+  }
+}
+
+#endif // TASKSTATS
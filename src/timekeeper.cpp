@@ -19,7 +19,7 @@ const char timeSetSymbols[] = {'G', 'R', 'L', '?'};
 HardwareSerial IF482(2); // use UART #2 (#1 may be in use for serial GPS)
 #endif
 
-Ticker timesyncer;
+int timesyncJob = -1;
 
 void timeSync() { xTaskNotify(irqHandlerTask, TIMESYNC_IRQ, eSetBits); }
 
@@ -102,11 +102,11 @@ void IRAM_ATTR setMyTime(uint32_t t_sec, uint16_t t_msec,
     setTime(time_to_set); // set the time on top of second
 
     timeSource = mytimesource; // set global variable
-    timesyncer.attach(TIME_SYNC_INTERVAL * 60, timeSync);
+    sched_set_period(timesyncJob, TIME_SYNC_INTERVAL * 60 * 1000);
     ESP_LOGI(TAG, "[%0.3f] Timesync finished, time was set | source: %c",
              millis() / 1000.0, timeSetSymbols[timeSource]);
   } else {
-    timesyncer.attach(TIME_SYNC_INTERVAL_RETRY * 60, timeSync);
+    sched_set_period(timesyncJob, TIME_SYNC_INTERVAL_RETRY * 60 * 1000);
     ESP_LOGI(TAG, "[%0.3f] Timesync failed, invalid time fetched | source: %c",
              millis() / 1000.0, timeSetSymbols[timeSource]);
   }
@@ -166,7 +166,9 @@ void timepulse_start(void) {
 
   // start cyclic time sync
   timeSync(); // init systime by RTC or GPS or LORA
-  timesyncer.attach(TIME_SYNC_INTERVAL * 60, timeSync);
+  if (timesyncJob < 0)
+    timesyncJob = sched_add("timesync", timeSync, TIME_SYNC_INTERVAL * 60 * 1000,
+                            TIME_SYNC_INTERVAL * 1000, 1);
 }
 
 // interrupt service routine triggered by either pps or esp32 hardware timer
@@ -235,13 +237,12 @@ void clock_init(void) {
 
   userUTCTime = now();
 
-  xTaskCreatePinnedToCore(clock_loop,           // task function
-                          "clockloop",          // name of task
-                          2048,                 // stack size of task
-                          (void *)&userUTCTime, // start time as task parameter
-                          4,                    // priority of the task
-                          &ClockTask,           // task handle
-                          1);                   // CPU core
+  mem_task_create(MEM_TASK_CLOCK,       // budget entry
+                  clock_loop,           // task function
+                  (void *)&userUTCTime, // start time as task parameter
+                  4,                    // priority of the task
+                  &ClockTask,           // task handle
+                  1);                   // CPU core
 
   assert(ClockTask); // has clock task started?
 } // clock_init
@@ -231,13 +231,12 @@ int recv_timesync_ans(const uint8_t buf[], const uint8_t buf_len) {
 
 // create task for timeserver handshake processing, called from main.cpp
 void timesync_init() {
-  xTaskCreatePinnedToCore(process_timesync_req, // task function
-                          "timesync_req",       // name of task
-                          2048,                 // stack size of task
-                          (void *)1,            // task parameter
-                          3,                    // priority of the task
-                          &timeSyncReqTask,     // task handle
-                          1);                   // CPU core
+  mem_task_create(MEM_TASK_TIMESYNC,    // budget entry
+                  process_timesync_req, // task function
+                  (void *)1,            // task parameter
+                  3,                    // priority of the task
+                  &timeSyncReqTask,     // task handle
+                  1);                   // CPU core
 }
 
 #endif
@@ -41,21 +41,27 @@ bool generateChecksumFile(int fileNumber)
   CRC32 crcFile;
   crcFile.reset();
 
-  char buff[2048];
-  size_t res = updateFile.readBytes(buff, sizeof(buff));
+  char *buff = (char *)io_lease(IO_HTTP_BODY_SIZE, "update_part");
+  if (!buff) {
+    updateFile.close();
+    return false;
+  }
+  size_t res = updateFile.readBytes(buff, IO_HTTP_BODY_SIZE);
   size_t fileSize = updateFile.size();
   updateFile.close();
 
   if (res <= 0) {
     ESP_LOGE(TAG, "Failed to read file (empty): %s", fileName.c_str());
+    io_release(buff);
     return false;
   }
 
   ESP_LOGV(TAG, "File size: %d", fileSize);
   // Here we add each byte to the checksum, caclulating the checksum as we go.
-  for (size_t i = 0; i < fileSize; i++) {
+  for (size_t i = 0; i < res; i++) {
     crcFile.update(buff[i]);
   }
+  io_release(buff);
 
   // Once we have added all of the data, generate the final CRC32 checksum.
   uint32_t checksum = crcFile.finalize();
@@ -135,12 +141,17 @@ bool checkUpdateFile(int fileNumber, uint32_t crc) {
   return true;
 }
 
+// borrows the card per part, other sd requests are served in between
 bool unifyUpdates(int parts) {
   char finalFilename[20];
   sprintf(finalFilename, "%s/final.gz", UPDATE_FOLDER);
 
   FileMySD finalFile;
-  if (!createFile(finalFilename, finalFile)) {
+  if (!sd_borrow())
+    return false;
+  bool created = createFile(finalFilename, finalFile);
+  sd_return();
+  if (!created) {
     ESP_LOGE(TAG, "Failed to create final file");
     return false;
   }
@@ -152,8 +163,12 @@ bool unifyUpdates(int parts) {
     char filename[20];
     sprintf(filename, "%s/%d.bin", UPDATE_FOLDER, i);
 
+    if (!sd_borrow())
+      return false;
     if (!openFile(filename, file)) {
       ESP_LOGE(TAG, "Failed to open file number: %d", i);
+      finalFile.close();
+      sd_return();
       return false;
     }
     ESP_LOGD(TAG, "Reading file number: %d", i);
@@ -162,8 +177,12 @@ bool unifyUpdates(int parts) {
     file.close();
 
     finalFile.write(buff, filesize);
+    sd_return();
   }
+  if (!sd_borrow())
+    return false;
   finalFile.close();
+  sd_return();
   return true;
 }
 
@@ -173,12 +192,16 @@ bool downloadChecksumFile(int i, uint32_t *crcBuffer, int bufferSize,
   sprintf(filename, "/%d.chk", i);
   ESP_LOGD(TAG, "Downloading %s", filename);
 
-  char buff[2048];
+  char *buff = (char *)io_lease(IO_HTTP_BODY_SIZE, "update_chk");
   int responseSize = 0;
+  bool ok = false;
+  if (!buff)
+    return false;
 
   if (getData(UPDATES_SERVER_IP, UPDATES_SERVER_PORT, filename, buff,
-              sizeof(buff), &responseSize) >= 0) {
+              IO_HTTP_BODY_SIZE, &responseSize) >= 0) {
     if (responseSize > 0) {
+      ok = true;
       for (int i = 0; i < checksumsPerFile; i++) {
         if (i * 4 >= responseSize) {
           break;
@@ -186,15 +209,16 @@ bool downloadChecksumFile(int i, uint32_t *crcBuffer, int bufferSize,
         uint32_t crc = *((uint32_t *)&buff[i * sizeof(uint32_t)]);
         if (i >= bufferSize) {
           ESP_LOGE(TAG, "Buffer overflow");
-          return false;
+          ok = false;
+          break;
         }
         crcBuffer[i] = crc;
         //ESP_LOGD(TAG, "CRC: %08x", crc);
       }
-      return true;
     }
   }
-  return false;
+  io_release(buff);
+  return ok;
 }
 
 bool downloadFile(int i, uint32_t crc) {
@@ -202,18 +226,33 @@ bool downloadFile(int i, uint32_t crc) {
   sprintf(filename, "/%d.bin", i);
   ESP_LOGI(TAG, "Downloading %s", filename);
 
-  char buff[2048];
+  char *buff = (char *)io_lease(IO_HTTP_BODY_SIZE, "update_part");
   int responseSize = 0;
+  if (!buff)
+    return false;
   if (getData(UPDATES_SERVER_IP, UPDATES_SERVER_PORT, filename, buff,
-              sizeof(buff), &responseSize) >= 0) {
+              IO_HTTP_BODY_SIZE, &responseSize) >= 0) {
     if (responseSize > 0) {
-      if (!savePartUpdateFile(i, buff, responseSize)) {
+      bool saved = sd_borrow();
+      if (saved) {
+        saved = savePartUpdateFile(i, buff, responseSize);
+        sd_return();
+      }
+      if (!saved) {
         ESP_LOGE(TAG, "Failed to save file number: %d", i);
+        io_release(buff);
         return false;
       }
     }
   }
-  if (!checkUpdateFile(i, crc)) {
+  // checkUpdateFile leases its own block
+  io_release(buff);
+  bool valid = sd_borrow();
+  if (valid) {
+    valid = checkUpdateFile(i, crc);
+    sd_return();
+  }
+  if (!valid) {
     ESP_LOGE(TAG, "Checksum fail for file: %d", i);
     return false;
   }
@@ -221,116 +260,116 @@ bool downloadFile(int i, uint32_t crc) {
   return true;
 }
 
-bool removeUpdateFiles(std::string index)
+bool removeUpdateFiles(const char *index)
 {
-  std::size_t found = index.find("\r\n");
-  if (found != std::string::npos) {
-    std::string version = index.substr(0, found);
-
-    const char *partsStr = index.substr(found + 2).c_str();
-    char *end;
-    long parts = strtol(partsStr, &end, 10);
-
-    if (end == partsStr || errno == ERANGE) {
-      ESP_LOGE(TAG, "Invalid number of parts: %s", partsStr);
+  upd_index_t idx;
+  int res = upd_index_parse(index, &idx);
+  if (res == UPD_INDEX_VERSION)
+    return true;
+  if (res == UPD_INDEX_PARTS) {
+    ESP_LOGE(TAG, "Invalid number of parts in update index");
+    return false;
+  }
+  long parts = idx.parts;
+  ESP_LOGD(TAG, "Number of parts to remove: %d", parts);
+  for (int i = 1; i <= parts; i++) {
+    ESP_LOGD(TAG, "Removing part: %d/%d", i, parts);
+    char filename[20];
+    sprintf(filename, "%s/%d.bin", UPDATE_FOLDER, i);
+    ESP_LOGV(TAG, "Removing file: %s", filename);
+    if (!deleteFile(filename)) {
+      ESP_LOGE(TAG, "Failed to remove file: %s", filename);
       return false;
     }
-    ESP_LOGD(TAG, "Number of parts to remove: %d", parts);
-    for (int i = 1; i <= parts; i++) {
-      ESP_LOGD(TAG, "Removing part: %d/%d", i, parts);
-      char filename[20];
-      sprintf(filename, "%s/%d.bin", UPDATE_FOLDER, i);
-      ESP_LOGV(TAG, "Removing file: %s", filename);
-      if (!deleteFile(filename)) {
-        ESP_LOGE(TAG, "Failed to remove file: %s", filename);
-        return false;
-      }
-      char checksumFilename[20];
-      sprintf(checksumFilename, "%s/%d.sum", UPDATE_FOLDER, i);
-      ESP_LOGV(TAG, "Removing file: %s", checksumFilename);
-      if (!deleteFile(checksumFilename)) {
-        ESP_LOGE(TAG, "Failed to remove file: %s", checksumFilename);
-        return false;
-      }
+    char checksumFilename[20];
+    sprintf(checksumFilename, "%s/%d.sum", UPDATE_FOLDER, i);
+    ESP_LOGV(TAG, "Removing file: %s", checksumFilename);
+    if (!deleteFile(checksumFilename)) {
+      ESP_LOGE(TAG, "Failed to remove file: %s", checksumFilename);
+      return false;
     }
   }
   return true;
 }
 
-bool downloadUpdates(std::string index) {
+// checksums are fetched one .chk file at a time, right before the parts they
+// cover, so the number of parts is not bounded by a buffer
+bool downloadUpdates(const char *index) {
   unsigned long startTime = millis();
-  std::size_t found = index.find("\r\n");
-  if (found != std::string::npos) {
-    std::string version = index.substr(0, found);
-    ESP_LOGI(TAG, "Latest Version: %s", version.c_str());
-
-    const char *partsStr = index.substr(found + 2).c_str();
-    char *end;
-    long parts = strtol(partsStr, &end, 10);
+  upd_index_t idx;
+  int res = upd_index_parse(index, &idx);
+  if (res == UPD_INDEX_VERSION)
+    return false;
+  ESP_LOGI(TAG, "Latest Version: %s", idx.version);
+  if (res == UPD_INDEX_PARTS) {
+    ESP_LOGE(TAG, "Invalid number of parts in update index");
+    return false;
+  }
+  if (res == UPD_INDEX_PERFILE) {
+    ESP_LOGE(TAG, "Invalid number of checksums per part in update index");
+    return false;
+  }
+  long parts = idx.parts;
+  long checksumsPerFile = idx.perFile;
+  // a .chk file is one http body
+  if (checksumsPerFile > (long)(IO_HTTP_BODY_SIZE / sizeof(uint32_t))) {
+    ESP_LOGE(TAG, "Update index has %d checksums per file, at most %u fit",
+             checksumsPerFile, IO_HTTP_BODY_SIZE / sizeof(uint32_t));
+    return false;
+  }
 
-    if (end == partsStr || errno == ERANGE) {
-      ESP_LOGE(TAG, "Invalid number of parts: %s", partsStr);
-      return false;
-    }
+  ESP_LOGD(TAG, "Number of parts: %d", parts);
+  ESP_LOGD(TAG, "Number of checksums per file: %d", checksumsPerFile);
 
-    char *checksumsPerFileStr = new char[strlen(end) + 1];
-    strcpy(checksumsPerFileStr, end);
-    long checksumsPerFile = strtol(checksumsPerFileStr, &end, 10);
+  uint32_t *crcBuffer = (uint32_t *)io_lease(
+      checksumsPerFile * sizeof(uint32_t), "update_crc_part");
+  if (!crcBuffer)
+    return false;
 
-    if (end == checksumsPerFileStr || errno == ERANGE) {
-      ESP_LOGE(TAG, "Invalid number of checksums per part: %s",
-               checksumsPerFileStr);
+  for (int first = 1; first <= parts; first += checksumsPerFile) {
+    if (!downloadChecksumFile(first, crcBuffer, checksumsPerFile,
+                              checksumsPerFile)) {
+      ESP_LOGE(TAG, "Failed to download checksums of part %d", first);
+      io_release(crcBuffer);
       return false;
     }
-
-    ESP_LOGD(TAG, "Number of parts: %d", parts);
-    ESP_LOGD(TAG, "Number of checksums per file: %d", checksumsPerFile);
-
-    uint32_t *crcBuffer = new uint32_t[parts];
-    for (int i = 1; i <= parts; i += checksumsPerFile) {
-      uint32_t *tempBuffer = new uint32_t[checksumsPerFile];
-      downloadChecksumFile(i, tempBuffer, checksumsPerFile, checksumsPerFile);
-      for (int j = 0; j < checksumsPerFile; j++) {
-        if (i - 1 + j >= parts) {
-          break;
-        }
-        crcBuffer[i - 1 + j] = tempBuffer[j];
-      }
-      delete tempBuffer;
-    }
-
-    int retries = 0;
-    for (int i = 1; i <= parts; i++) {
-        ESP_LOGI(TAG, "Downloading part: %d/%d", i, parts);
-      retries = 0;
+    for (int i = first; (i <= parts) && (i < first + checksumsPerFile); i++) {
+      uint32_t crc = crcBuffer[i - first];
+      ESP_LOGI(TAG, "Downloading part: %d/%d", i, parts);
+      int retries = 0;
       while (retries < MAX_DOWNLOAD_RETRIES) {
-        if (checkUpdateFile(i, crcBuffer[i - 1])) {
-            ESP_LOGI(TAG, "File %d already downloaded, skipping", i);
-            break;
+        // card is borrowed per file step, not across the http download
+        bool present = sd_borrow();
+        if (present) {
+          present = checkUpdateFile(i, crc);
+          sd_return();
         }
-        if (!downloadFile(i, crcBuffer[i - 1])) {
+        if (present) {
+          ESP_LOGI(TAG, "File %d already downloaded, skipping", i);
+          break;
+        }
+        if (!downloadFile(i, crc)) {
           ESP_LOGE(TAG, "Failed to download file number: %d", i);
           retries += 1;
-        }
-        else {
+        } else {
           break;
         }
         ESP_LOGW(TAG, "Retrying download file number: %d", i);
       }
       if (retries == MAX_DOWNLOAD_RETRIES) {
         ESP_LOGE(TAG, "Failed to download file number: %d", i);
-        delete crcBuffer;
+        io_release(crcBuffer);
         return false;
       }
       if (startTime + MAX_DOWNLOAD_TIME < millis()) {
         ESP_LOGI(TAG, "Download time exceeded, continuing normal operation and retrying");
-        delete crcBuffer;
+        io_release(crcBuffer);
         return false;
       }
     }
-    delete crcBuffer;
-    return unifyUpdates(parts);
   }
+  io_release(crcBuffer);
+  return unifyUpdates(parts);
 }
 
 /*bool performUpdate(Stream &updateSource, size_t updateSize) {
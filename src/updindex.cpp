@@ -0,0 +1,45 @@
+/* updindex parses the index of the update server in place, see
+include/updindex.h. Used by the update check of nbiot.cpp, the download in
+updates.cpp and the http request of BC95.cpp. */
+
+#include "updindex.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool upd_index_version(const char *index, char *version, size_t size) {
+  const char *eol = strstr(index, "\r\n");
+  if (!eol || (eol == index) || ((size_t)(eol - index) >= size))
+    return false;
+  memcpy(version, index, eol - index);
+  version[eol - index] = 0;
+  return true;
+}
+
+int upd_index_parse(const char *index, upd_index_t *idx) {
+  idx->parts = idx->perFile = 0;
+  if (!upd_index_version(index, idx->version, sizeof(idx->version)))
+    return UPD_INDEX_VERSION;
+
+  const char *p = strstr(index, "\r\n") + 2;
+  char *end;
+  errno = 0;
+  idx->parts = strtol(p, &end, 10);
+  if ((end == p) || (errno == ERANGE) || (idx->parts <= 0))
+    return UPD_INDEX_PARTS;
+
+  p = end;
+  idx->perFile = strtol(p, &end, 10);
+  if ((end == p) || (errno == ERANGE) || (idx->perFile <= 0))
+    return UPD_INDEX_PERFILE;
+  return 0;
+}
+
+void upd_version_param(const char *version, char *out, size_t size) {
+  size_t i = 0;
+  for (; version[i] && (i + 1 < size); i++)
+    out[i] = (version[i] == '.') ? '_' : version[i];
+  if (size)
+    out[i] = 0;
+}